@@ -766,18 +766,20 @@ DWORD WINAPI GetBestRoute(DWORD dwDestAddr, DWORD dwSourceAddr, PMIB_IPFORWARDRO
 
   AllocateAndGetIpForwardTableFromStack(&table, FALSE, GetProcessHeap(), 0);
   if (table) {
-    DWORD ndx, matchedBits, matchedNdx = 0;
+    DWORD ndx, mask, matchedMask = 0, matchedNdx = 0;
+    BOOL matched = FALSE;
 
-    for (ndx = 0, matchedBits = 0; ndx < table->dwNumEntries; ndx++) {
+    for (ndx = 0; ndx < table->dwNumEntries; ndx++) {
       if ((dwDestAddr & table->table[ndx].dwForwardMask) ==
        (table->table[ndx].dwForwardDest & table->table[ndx].dwForwardMask)) {
-        DWORD numShifts, mask;
-
-        for (numShifts = 0, mask = table->table[ndx].dwForwardMask;
-         mask && !(mask & 1); mask >>= 1, numShifts++)
-          ;
-        if (numShifts > matchedBits) {
-          matchedBits = numShifts;
+        /* Masks are contiguous, so in host order the longest prefix is the largest.
+         * Among routes to the same prefix, the lowest metric wins. */
+        mask = ntohl(table->table[ndx].dwForwardMask);
+        if (!matched || mask > matchedMask ||
+         (mask == matchedMask &&
+          table->table[ndx].dwForwardMetric1 < table->table[matchedNdx].dwForwardMetric1)) {
+          matched = TRUE;
+          matchedMask = mask;
           matchedNdx = ndx;
         }
       }
@@ -19,9 +19,163 @@
 DEBUG_CHANNEL(kernel32file);
 #endif
 
+/* Vista flag, our headers hide it from pre-Vista targets */
+#if (_WIN32_WINNT < 0x0600)
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+/* Number of buffers cycling between the source reads and the destination writes */
+#define COPY_BUFFER_COUNT           3
+
+/* Chunk size bounds, the chunk size itself is scaled to the file size */
+#define COPY_MIN_CHUNK_SIZE         0x10000
+#define COPY_MAX_CHUNK_SIZE         0x100000
+
+/* Smaller files keep going through the cache even with COPY_FILE_NO_BUFFERING */
+#define COPY_NO_BUFFERING_THRESHOLD (8 * 1024 * 1024)
+
+/* Minimum delay between two chunk progress callbacks, in milliseconds */
+#define COPY_PROGRESS_INTERVAL      100
+
+typedef struct _COPY_BUFFER
+{
+    PUCHAR Buffer;
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+    LARGE_INTEGER Offset;
+    ULONG Length;
+    BOOLEAN Busy;
+    BOOLEAN Writing;    /* The operation in flight is a write, not a read */
+} COPY_BUFFER, *PCOPY_BUFFER;
+
 /* FUNCTIONS ****************************************************************/
 
+static ULONG
+CopyChunkSize(
+    LARGE_INTEGER FileSize
+)
+{
+    ULONGLONG ChunkSize;
+
+    /* Aim for a few chunks per file, so small files don't allocate much */
+    ChunkSize = FileSize.QuadPart / (COPY_BUFFER_COUNT * 2);
+    if (ChunkSize < COPY_MIN_CHUNK_SIZE) return COPY_MIN_CHUNK_SIZE;
+    if (ChunkSize > COPY_MAX_CHUNK_SIZE) return COPY_MAX_CHUNK_SIZE;
+    return ROUND_UP(ChunkSize, COPY_MIN_CHUNK_SIZE);
+}
+
+static VOID
+CopyStartRead(
+    PCOPY_BUFFER Buffer,
+    HANDLE FileHandle,
+    ULONGLONG Offset,
+    ULONG Length
+)
+{
+    Buffer->Offset.QuadPart = Offset;
+    Buffer->Busy = TRUE;
+    Buffer->Writing = FALSE;
+    Buffer->Status = NtReadFile(FileHandle,
+                                Buffer->Event,
+                                NULL,
+                                NULL,
+                                &Buffer->IoStatusBlock,
+                                Buffer->Buffer,
+                                Length,
+                                &Buffer->Offset,
+                                NULL);
+}
+
+static VOID
+CopyStartWrite(
+    PCOPY_BUFFER Buffer,
+    HANDLE FileHandle,
+    ULONG Length
+)
+{
+    Buffer->Busy = TRUE;
+    Buffer->Writing = TRUE;
+    Buffer->Status = NtWriteFile(FileHandle,
+                                 Buffer->Event,
+                                 NULL,
+                                 NULL,
+                                 &Buffer->IoStatusBlock,
+                                 Buffer->Buffer,
+                                 Length,
+                                 &Buffer->Offset,
+                                 NULL);
+}
 
+static NTSTATUS
+CopyWaitBuffer(
+    PCOPY_BUFFER Buffer
+)
+{
+    if (!Buffer->Busy)
+        return Buffer->Status;
+
+    if (Buffer->Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Buffer->Event, FALSE, NULL);
+        Buffer->Status = Buffer->IoStatusBlock.Status;
+    }
+
+    Buffer->Busy = FALSE;
+    return Buffer->Status;
+}
+
+static NTSTATUS
+CopyReportProgress(
+    LPPROGRESS_ROUTINE *lpProgressRoutine,
+    LPVOID lpData,
+    LARGE_INTEGER SourceFileSize,
+    LARGE_INTEGER BytesCopied,
+    DWORD CallbackReason,
+    HANDLE FileHandleSource,
+    HANDLE FileHandleDest,
+    BOOL *KeepDest
+)
+{
+    DWORD ProgressResult;
+
+    if (NULL == *lpProgressRoutine)
+        return STATUS_SUCCESS;
+
+    ProgressResult = (**lpProgressRoutine)(SourceFileSize,
+                                           BytesCopied,
+                                           SourceFileSize,
+                                           BytesCopied,
+                                           0,
+                                           CallbackReason,
+                                           FileHandleSource,
+                                           FileHandleDest,
+                                           lpData);
+    switch (ProgressResult)
+    {
+    case PROGRESS_CANCEL:
+        TRACE("Progress callback requested cancel\n");
+        return STATUS_REQUEST_ABORTED;
+    case PROGRESS_STOP:
+        TRACE("Progress callback requested stop\n");
+        *KeepDest = TRUE;
+        return STATUS_REQUEST_ABORTED;
+    case PROGRESS_QUIET:
+        *lpProgressRoutine = NULL;
+        break;
+    case PROGRESS_CONTINUE:
+    default:
+        break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Copies the data with COPY_BUFFER_COUNT buffers in flight: while one buffer
+ * is being written out, the next ones are already being read, so the source
+ * and the destination disks work at the same time.
+ */
 static NTSTATUS
 CopyLoop (
     HANDLE			FileHandleSource,
@@ -30,128 +184,209 @@ CopyLoop (
     LPPROGRESS_ROUTINE	lpProgressRoutine,
     LPVOID			lpData,
     BOOL			*pbCancel,
-    BOOL                 *KeepDest
+    BOOL                 *KeepDest,
+    ULONG                SectorSize
 )
 {
     NTSTATUS errCode;
     IO_STATUS_BLOCK IoStatusBlock;
+    COPY_BUFFER Buffers[COPY_BUFFER_COUNT];
+    PCOPY_BUFFER Current, Previous;
+    FILE_END_OF_FILE_INFORMATION EndOfFile;
     UCHAR *lpBuffer = NULL;
-    SIZE_T RegionSize = 0x10000;
+    SIZE_T RegionSize;
+    ULONG ChunkSize, i;
+    ULONGLONG Chunk, ChunkCount;
     LARGE_INTEGER BytesCopied;
-    DWORD CallbackReason;
-    DWORD ProgressResult;
-    BOOL EndOfFileFound;
+    DWORD LastReport;
 
     *KeepDest = FALSE;
+    RtlZeroMemory(Buffers, sizeof(Buffers));
+
+    ChunkSize = CopyChunkSize(SourceFileSize);
+    ChunkCount = (SourceFileSize.QuadPart + ChunkSize - 1) / ChunkSize;
+    RegionSize = (SIZE_T)ChunkSize * COPY_BUFFER_COUNT;
     errCode = NtAllocateVirtualMemory(NtCurrentProcess(),
                                       (PVOID *)&lpBuffer,
                                       0,
                                       &RegionSize,
                                       MEM_RESERVE | MEM_COMMIT,
                                       PAGE_READWRITE);
+    if (!NT_SUCCESS(errCode))
+    {
+        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        return errCode;
+    }
 
+    for (i = 0; i < COPY_BUFFER_COUNT && NT_SUCCESS(errCode); i++)
+    {
+        Buffers[i].Buffer = lpBuffer + i * ChunkSize;
+        errCode = NtCreateEvent(&Buffers[i].Event,
+                                EVENT_ALL_ACCESS,
+                                NULL,
+                                NotificationEvent,
+                                FALSE);
+    }
+
+    BytesCopied.QuadPart = 0;
     if (NT_SUCCESS(errCode))
     {
-        BytesCopied.QuadPart = 0;
-        EndOfFileFound = FALSE;
-        CallbackReason = CALLBACK_STREAM_SWITCH;
-        while (! EndOfFileFound &&
-                NT_SUCCESS(errCode) &&
-                (NULL == pbCancel || ! *pbCancel))
+        errCode = CopyReportProgress(&lpProgressRoutine,
+                                     lpData,
+                                     SourceFileSize,
+                                     BytesCopied,
+                                     CALLBACK_STREAM_SWITCH,
+                                     FileHandleSource,
+                                     FileHandleDest,
+                                     KeepDest);
+    }
+    LastReport = GetTickCount();
+
+    /* Fill the pipeline */
+    for (i = 0; i < COPY_BUFFER_COUNT && i < ChunkCount && NT_SUCCESS(errCode); i++)
+    {
+        CopyStartRead(&Buffers[i], FileHandleSource, (ULONGLONG)i * ChunkSize, ChunkSize);
+    }
+
+    for (Chunk = 0; Chunk < ChunkCount && NT_SUCCESS(errCode); Chunk++)
+    {
+        Current = &Buffers[Chunk % COPY_BUFFER_COUNT];
+
+        if (Chunk > 0)
         {
-            if (NULL != lpProgressRoutine)
+            /* Retire the previous write and reuse its buffer for a read further ahead */
+            Previous = &Buffers[(Chunk - 1) % COPY_BUFFER_COUNT];
+            errCode = CopyWaitBuffer(Previous);
+            if (!NT_SUCCESS(errCode))
             {
-                ProgressResult = (*lpProgressRoutine)(SourceFileSize,
-                                                      BytesCopied,
-                                                      SourceFileSize,
-                                                      BytesCopied,
-                                                      0,
-                                                      CallbackReason,
-                                                      FileHandleSource,
-                                                      FileHandleDest,
-                                                      lpData);
-                switch (ProgressResult)
-                {
-                case PROGRESS_CANCEL:
-                    TRACE("Progress callback requested cancel\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    break;
-                case PROGRESS_STOP:
-                    TRACE("Progress callback requested stop\n");
-                    errCode = STATUS_REQUEST_ABORTED;
-                    *KeepDest = TRUE;
-                    break;
-                case PROGRESS_QUIET:
-                    lpProgressRoutine = NULL;
-                    break;
-                case PROGRESS_CONTINUE:
-                default:
-                    break;
-                }
-                CallbackReason = CALLBACK_CHUNK_FINISHED;
+                WARN("Error 0x%08x writing to dest\n", errCode);
+                break;
             }
-            if (NT_SUCCESS(errCode))
+            BytesCopied.QuadPart += Previous->Length;
+
+            if (NULL != pbCancel && *pbCancel)
             {
-                errCode = NtReadFile(FileHandleSource,
-                                     NULL,
-                                     NULL,
-                                     NULL,
-                                     (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                     lpBuffer,
-                                     RegionSize,
-                                     NULL,
-                                     NULL);
-                if (NT_SUCCESS(errCode) && (NULL == pbCancel || ! *pbCancel))
-                {
-                    errCode = NtWriteFile(FileHandleDest,
-                                          NULL,
-                                          NULL,
-                                          NULL,
-                                          (PIO_STATUS_BLOCK)&IoStatusBlock,
-                                          lpBuffer,
-                                          IoStatusBlock.Information,
-                                          NULL,
-                                          NULL);
-                    if (NT_SUCCESS(errCode))
-                    {
-                        BytesCopied.QuadPart += IoStatusBlock.Information;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading writing to dest\n", errCode);
-                    }
-                }
-                else if (!NT_SUCCESS(errCode))
-                {
-                    if (STATUS_END_OF_FILE == errCode)
-                    {
-                        EndOfFileFound = TRUE;
-                        errCode = STATUS_SUCCESS;
-                    }
-                    else
-                    {
-                        WARN("Error 0x%08x reading from source\n", errCode);
-                    }
-                }
+                TRACE("User requested cancel\n");
+                errCode = STATUS_REQUEST_ABORTED;
+                break;
+            }
+
+            if (GetTickCount() - LastReport >= COPY_PROGRESS_INTERVAL)
+            {
+                errCode = CopyReportProgress(&lpProgressRoutine,
+                                             lpData,
+                                             SourceFileSize,
+                                             BytesCopied,
+                                             CALLBACK_CHUNK_FINISHED,
+                                             FileHandleSource,
+                                             FileHandleDest,
+                                             KeepDest);
+                if (!NT_SUCCESS(errCode)) break;
+                LastReport = GetTickCount();
+            }
+
+            if (Chunk - 1 + COPY_BUFFER_COUNT < ChunkCount)
+            {
+                CopyStartRead(Previous,
+                              FileHandleSource,
+                              (Chunk - 1 + COPY_BUFFER_COUNT) * ChunkSize,
+                              ChunkSize);
             }
         }
 
-        if (! EndOfFileFound && (NULL != pbCancel && *pbCancel))
+        errCode = CopyWaitBuffer(Current);
+        if (STATUS_END_OF_FILE == errCode)
         {
-            TRACE("User requested cancel\n");
-            errCode = STATUS_REQUEST_ABORTED;
+            /* The source shrank while we were copying it */
+            errCode = STATUS_SUCCESS;
+            break;
         }
+        else if (!NT_SUCCESS(errCode))
+        {
+            WARN("Error 0x%08x reading from source\n", errCode);
+            break;
+        }
+
+        Current->Length = (ULONG)Current->IoStatusBlock.Information;
+        if (Current->Length == 0)
+            break;
 
-        NtFreeVirtualMemory(NtCurrentProcess(),
-                            (PVOID *)&lpBuffer,
-                            &RegionSize,
-                            MEM_RELEASE);
+        /* Non-cached writes must cover whole sectors, the tail is trimmed at the end */
+        CopyStartWrite(Current,
+                       FileHandleDest,
+                       SectorSize ? ROUND_UP(Current->Length, SectorSize) : Current->Length);
+
+        /* A short read means there is nothing left to copy */
+        if (Current->Length < ChunkSize)
+            ChunkCount = Chunk + 1;
     }
-    else
+
+    /*
+     * Retire the last write. After an early exit the buffer before the
+     * current one may already be reading ahead, so only count real writes.
+     */
+    for (i = 0; i < COPY_BUFFER_COUNT && NT_SUCCESS(errCode); i++)
     {
-        TRACE("Error 0x%08x allocating buffer of %lu bytes\n", errCode, RegionSize);
+        Previous = &Buffers[i];
+        if (!Previous->Busy || !Previous->Writing)
+            continue;
+
+        errCode = CopyWaitBuffer(Previous);
+        if (NT_SUCCESS(errCode))
+        {
+            BytesCopied.QuadPart += Previous->Length;
+        }
+        else
+        {
+            WARN("Error 0x%08x writing to dest\n", errCode);
+        }
+    }
+
+    /* Nothing may still be using the buffers when we free them */
+    for (i = 0; i < COPY_BUFFER_COUNT; i++)
+    {
+        CopyWaitBuffer(&Buffers[i]);
+    }
+
+    if (NT_SUCCESS(errCode) && SectorSize)
+    {
+        /* Drop the sector padding of the last write */
+        EndOfFile.EndOfFile.QuadPart = BytesCopied.QuadPart;
+        errCode = NtSetInformationFile(FileHandleDest,
+                                       &IoStatusBlock,
+                                       &EndOfFile,
+                                       sizeof(EndOfFile),
+                                       FileEndOfFileInformation);
+        if (!NT_SUCCESS(errCode))
+        {
+            WARN("Error 0x%08x truncating dest\n", errCode);
+        }
+    }
+
+    if (NT_SUCCESS(errCode) && ChunkCount > 0)
+    {
+        /* Always report the final state, whatever the rate limit says */
+        errCode = CopyReportProgress(&lpProgressRoutine,
+                                     lpData,
+                                     SourceFileSize,
+                                     BytesCopied,
+                                     CALLBACK_CHUNK_FINISHED,
+                                     FileHandleSource,
+                                     FileHandleDest,
+                                     KeepDest);
+    }
+
+    for (i = 0; i < COPY_BUFFER_COUNT; i++)
+    {
+        if (Buffers[i].Event) NtClose(Buffers[i].Event);
     }
 
+    RegionSize = 0;
+    NtFreeVirtualMemory(NtCurrentProcess(),
+                        (PVOID *)&lpBuffer,
+                        &RegionSize,
+                        MEM_RELEASE);
+
     return errCode;
 }
 
@@ -207,8 +442,11 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
     IO_STATUS_BLOCK IoStatusBlock;
     FILE_STANDARD_INFORMATION FileStandard;
     FILE_BASIC_INFORMATION FileBasic;
+    FILE_FS_SIZE_INFORMATION FileFsSize;
     BOOL RC = FALSE;
     BOOL KeepDestOnError = FALSE;
+    BOOL NoBuffering;
+    ULONG SectorSize = 0;
     DWORD SystemError;
 
     FileHandleSource = CreateFileW(lpExistingFileName,
@@ -216,7 +454,7 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
                                    FILE_SHARE_READ | FILE_SHARE_WRITE,
                                    NULL,
                                    OPEN_EXISTING,
-                                   FILE_ATTRIBUTE_NORMAL|FILE_FLAG_NO_BUFFERING,
+                                   FILE_ATTRIBUTE_NORMAL|FILE_FLAG_NO_BUFFERING|FILE_FLAG_OVERLAPPED,
                                    NULL);
     if (INVALID_HANDLE_VALUE != FileHandleSource)
     {
@@ -243,22 +481,48 @@ BasepCopyFileExW(IN LPCWSTR lpExistingFileName,
             }
             else
             {
+                /* Only large files are worth bypassing the cache for */
+                NoBuffering = (dwCopyFlags & COPY_FILE_NO_BUFFERING) &&
+                              (FileStandard.EndOfFile.QuadPart >= COPY_NO_BUFFERING_THRESHOLD);
+
                 FileHandleDest = CreateFileW(lpNewFileName,
                                              GENERIC_WRITE,
                                              FILE_SHARE_WRITE,
                                              NULL,
-                                             dwCopyFlags ? CREATE_NEW : CREATE_ALWAYS,
-                                             FileBasic.FileAttributes,
+                                             (dwCopyFlags & COPY_FILE_FAIL_IF_EXISTS) ? CREATE_NEW : CREATE_ALWAYS,
+                                             FileBasic.FileAttributes | FILE_FLAG_OVERLAPPED |
+                                             (NoBuffering ? FILE_FLAG_NO_BUFFERING : 0),
                                              NULL);
                 if (INVALID_HANDLE_VALUE != FileHandleDest)
                 {
+                    if (NoBuffering)
+                    {
+                        /* Non-cached writes have to be sector-sized */
+                        errCode = NtQueryVolumeInformationFile(FileHandleDest,
+                                                               &IoStatusBlock,
+                                                               &FileFsSize,
+                                                               sizeof(FILE_FS_SIZE_INFORMATION),
+                                                               FileFsSizeInformation);
+                        if (NT_SUCCESS(errCode) &&
+                            FileFsSize.BytesPerSector <= COPY_MIN_CHUNK_SIZE)
+                        {
+                            SectorSize = FileFsSize.BytesPerSector;
+                        }
+                        else
+                        {
+                            /* Fall back to the largest sector we can pad to */
+                            SectorSize = COPY_MIN_CHUNK_SIZE;
+                        }
+                    }
+
                     errCode = CopyLoop(FileHandleSource,
                                        FileHandleDest,
                                        FileStandard.EndOfFile,
                                        lpProgressRoutine,
                                        lpData,
                                        pbCancel,
-                                       &KeepDestOnError);
+                                       &KeepDestOnError,
+                                       SectorSize);
                     if (!NT_SUCCESS(errCode))
                     {
                         BaseSetLastNTError(errCode);
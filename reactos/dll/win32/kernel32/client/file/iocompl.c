@@ -22,22 +22,46 @@
 #define FILE_SKIP_SET_EVENT_ON_HANDLE        0x2
 #endif
 
+/* Same goes for the native information class that carries them */
+#define FileIoCompletionNotificationInformation ((FILE_INFORMATION_CLASS)41)
+
+typedef struct _FILE_IO_COMPLETION_NOTIFICATION_INFORMATION
+{
+    ULONG Flags;
+} FILE_IO_COMPLETION_NOTIFICATION_INFORMATION;
+
 /*
- * @unimplemented
+ * @implemented
  */
 BOOL
 WINAPI
 SetFileCompletionNotificationModes(IN HANDLE FileHandle,
                                    IN UCHAR Flags)
 {
+    NTSTATUS Status;
+    FILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInformation;
+    IO_STATUS_BLOCK IoStatusBlock;
+
     if (Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE))
     {
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
-    UNIMPLEMENTED;
-    return FALSE;
+    /* Let the I/O manager store the modes on the file object */
+    NotificationInformation.Flags = Flags;
+    Status = NtSetInformationFile(FileHandle,
+                                  &IoStatusBlock,
+                                  &NotificationInformation,
+                                  sizeof(NotificationInformation),
+                                  FileIoCompletionNotificationInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        BaseSetLastNTError(Status);
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 /*
@@ -0,0 +1,87 @@
+
+#include "k32_vista.h"
+
+#include <ndk/iofuncs.h>
+
+ULONG
+NTAPI
+RtlNtStatusToDosError(IN NTSTATUS Status);
+
+/* The native entries are converted in place, so both layouts must match in size */
+C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpCompletionKey) == FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, KeyContext));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpOverlapped) == FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, ApcContext));
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr = NULL;
+    PFILE_IO_COMPLETION_INFORMATION Information;
+    IO_STATUS_BLOCK IoStatus;
+    ULONG Removed = 0, i;
+
+    if (!ulCount)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Convert the timeout */
+    if (dwMilliseconds != INFINITE)
+    {
+        Time.QuadPart = (ULONGLONG)dwMilliseconds * -10000;
+        TimePtr = &Time;
+    }
+
+    /* Let the kernel fill the caller's array with native entries */
+    Information = (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries;
+    Status = NtRemoveIoCompletionEx(CompletionPort,
+                                    Information,
+                                    ulCount,
+                                    &Removed,
+                                    TimePtr,
+                                    fAlertable ? TRUE : FALSE);
+    if (!(NT_SUCCESS(Status)) || (Status == STATUS_TIMEOUT) ||
+        (Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+    {
+        *ulNumEntriesRemoved = 0;
+
+        /* Timeouts and APCs map to the usual wait results */
+        if (Status == STATUS_TIMEOUT)
+        {
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if ((Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+        {
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            SetLastError(RtlNtStatusToDosError(Status));
+        }
+
+        return FALSE;
+    }
+
+    /* Key and overlapped already line up, only the status block moves */
+    for (i = 0; i < Removed; i++)
+    {
+        IoStatus = Information[i].IoStatusBlock;
+        lpCompletionPortEntries[i].Internal = (ULONG_PTR)IoStatus.Status;
+        lpCompletionPortEntries[i].dwNumberOfBytesTransferred = (DWORD)IoStatus.Information;
+    }
+
+    *ulNumEntriesRemoved = Removed;
+    return TRUE;
+}
@@ -2,6 +2,7 @@
 @ stdcall InitOnceExecuteOnce(ptr ptr ptr ptr)
 @ stdcall GetFileInformationByHandleEx(long long ptr long)
 @ stdcall -ret64 GetTickCount64()
+@ stdcall GetQueuedCompletionStatusEx(ptr ptr long ptr long long)
 
 @ stdcall InitializeSRWLock(ptr)
 @ stdcall AcquireSRWLockExclusive(ptr)
@@ -14,3 +15,31 @@
 @ stdcall SleepConditionVariableSRW(ptr ptr long long)
 @ stdcall WakeAllConditionVariable(ptr)
 @ stdcall WakeConditionVariable(ptr)
+
+@ stdcall CreateThreadpool(ptr)
+@ stdcall CloseThreadpool(ptr)
+@ stdcall SetThreadpoolThreadMaximum(ptr long)
+@ stdcall SetThreadpoolThreadMinimum(ptr long)
+@ stdcall CreateThreadpoolCleanupGroup()
+@ stdcall CloseThreadpoolCleanupGroup(ptr)
+@ stdcall CloseThreadpoolCleanupGroupMembers(ptr long ptr)
+@ stdcall CreateThreadpoolWork(ptr ptr ptr)
+@ stdcall SubmitThreadpoolWork(ptr)
+@ stdcall CloseThreadpoolWork(ptr)
+@ stdcall WaitForThreadpoolWorkCallbacks(ptr long)
+@ stdcall TrySubmitThreadpoolCallback(ptr ptr ptr)
+@ stdcall CreateThreadpoolTimer(ptr ptr ptr)
+@ stdcall SetThreadpoolTimer(ptr ptr long long)
+@ stdcall IsThreadpoolTimerSet(ptr)
+@ stdcall CloseThreadpoolTimer(ptr)
+@ stdcall WaitForThreadpoolTimerCallbacks(ptr long)
+@ stdcall CreateThreadpoolWait(ptr ptr ptr)
+@ stdcall SetThreadpoolWait(ptr ptr ptr)
+@ stdcall CloseThreadpoolWait(ptr)
+@ stdcall WaitForThreadpoolWaitCallbacks(ptr long)
+@ stdcall CallbackMayRunLong(ptr)
+@ stdcall DisassociateCurrentThreadFromCallback(ptr)
+@ stdcall SetEventWhenCallbackReturns(ptr ptr)
+@ stdcall ReleaseSemaphoreWhenCallbackReturns(ptr ptr long)
+@ stdcall ReleaseMutexWhenCallbackReturns(ptr ptr)
+@ stdcall LeaveCriticalSectionWhenCallbackReturns(ptr ptr)
@@ -0,0 +1,426 @@
+
+#include "k32_vista.h"
+
+#define NDEBUG
+#include <debug.h>
+
+NTSTATUS NTAPI TpAllocPool(OUT PTP_POOL *Pool, IN PVOID Reserved);
+VOID NTAPI TpReleasePool(IN OUT PTP_POOL Pool);
+VOID NTAPI TpSetPoolMaxThreads(IN OUT PTP_POOL Pool, IN LONG MaxThreads);
+NTSTATUS NTAPI TpSetPoolMinThreads(IN OUT PTP_POOL Pool, IN LONG MinThreads);
+NTSTATUS NTAPI TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroup);
+VOID NTAPI TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup);
+VOID NTAPI TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup, IN BOOLEAN CancelPendingCallbacks, IN OUT PVOID CleanupParameter OPTIONAL);
+NTSTATUS NTAPI TpAllocWork(OUT PTP_WORK *Work, IN PTP_WORK_CALLBACK Callback, IN OUT PVOID Context OPTIONAL, IN PTP_CALLBACK_ENVIRON Environment OPTIONAL);
+VOID NTAPI TpPostWork(IN OUT PTP_WORK Work);
+VOID NTAPI TpReleaseWork(IN OUT PTP_WORK Work);
+VOID NTAPI TpWaitForWork(IN OUT PTP_WORK Work, IN BOOLEAN CancelPendingCallbacks);
+NTSTATUS NTAPI TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback, IN OUT PVOID Context OPTIONAL, IN PTP_CALLBACK_ENVIRON Environment OPTIONAL);
+NTSTATUS NTAPI TpAllocTimer(OUT PTP_TIMER *Timer, IN PTP_TIMER_CALLBACK Callback, IN OUT PVOID Context OPTIONAL, IN PTP_CALLBACK_ENVIRON Environment OPTIONAL);
+VOID NTAPI TpSetTimer(IN OUT PTP_TIMER Timer, IN PLARGE_INTEGER DueTime OPTIONAL, IN LONG Period, IN LONG WindowLength);
+BOOL NTAPI TpIsTimerSet(IN PTP_TIMER Timer);
+VOID NTAPI TpReleaseTimer(IN OUT PTP_TIMER Timer);
+VOID NTAPI TpWaitForTimer(IN OUT PTP_TIMER Timer, IN BOOLEAN CancelPendingCallbacks);
+NTSTATUS NTAPI TpAllocWait(OUT PTP_WAIT *Wait, IN PTP_WAIT_CALLBACK Callback, IN OUT PVOID Context OPTIONAL, IN PTP_CALLBACK_ENVIRON Environment OPTIONAL);
+VOID NTAPI TpSetWait(IN OUT PTP_WAIT Wait, IN HANDLE Handle OPTIONAL, IN PLARGE_INTEGER Timeout OPTIONAL);
+VOID NTAPI TpReleaseWait(IN OUT PTP_WAIT Wait);
+VOID NTAPI TpWaitForWait(IN OUT PTP_WAIT Wait, IN BOOLEAN CancelPendingCallbacks);
+NTSTATUS NTAPI TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance);
+VOID NTAPI TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance);
+VOID NTAPI TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance, IN HANDLE Event);
+VOID NTAPI TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance, IN HANDLE Semaphore, IN ULONG ReleaseCount);
+VOID NTAPI TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance, IN HANDLE Mutex);
+VOID NTAPI TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance, IN OUT PRTL_CRITICAL_SECTION CriticalSection);
+
+ULONG
+NTAPI
+RtlNtStatusToDosError(IN NTSTATUS Status);
+
+static
+PLARGE_INTEGER
+FileTimeToLargeInteger(IN PFILETIME FileTime OPTIONAL,
+                       OUT PLARGE_INTEGER LargeInteger)
+{
+    if (!FileTime)
+        return NULL;
+
+    LargeInteger->u.LowPart = FileTime->dwLowDateTime;
+    LargeInteger->u.HighPart = (LONG)FileTime->dwHighDateTime;
+    return LargeInteger;
+}
+
+/*
+ * @implemented
+ */
+PTP_POOL
+WINAPI
+CreateThreadpool(IN PVOID reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Status = TpAllocPool(&Pool, reserved);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    return Pool;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpool(IN OUT PTP_POOL ptpp)
+{
+    TpReleasePool(ptpp);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(IN OUT PTP_POOL ptpp,
+                           IN DWORD cthrdMost)
+{
+    TpSetPoolMaxThreads(ptpp, (LONG)min(cthrdMost, MAXLONG));
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(IN OUT PTP_POOL ptpp,
+                           IN DWORD cthrdMic)
+{
+    NTSTATUS Status;
+
+    Status = TpSetPoolMinThreads(ptpp, (LONG)min(cthrdMic, MAXLONG));
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    Status = TpAllocCleanupGroup(&CleanupGroup);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    return CleanupGroup;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(IN OUT PTP_CLEANUP_GROUP ptpcg)
+{
+    TpReleaseCleanupGroup(ptpcg);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP ptpcg,
+                                   IN BOOL fCancelPendingCallbacks,
+                                   IN OUT PVOID pvCleanupContext OPTIONAL)
+{
+    TpReleaseCleanupGroupMembers(ptpcg, fCancelPendingCallbacks ? TRUE : FALSE, pvCleanupContext);
+}
+
+/*
+ * @implemented
+ */
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(IN PTP_WORK_CALLBACK pfnwk,
+                     IN OUT PVOID pv OPTIONAL,
+                     IN PTP_CALLBACK_ENVIRON pcbe OPTIONAL)
+{
+    PTP_WORK Work;
+    NTSTATUS Status;
+
+    Status = TpAllocWork(&Work, pfnwk, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    return Work;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SubmitThreadpoolWork(IN OUT PTP_WORK pwk)
+{
+    TpPostWork(pwk);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWork(IN OUT PTP_WORK pwk)
+{
+    TpReleaseWork(pwk);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(IN OUT PTP_WORK pwk,
+                               IN BOOL fCancelPendingCallbacks)
+{
+    TpWaitForWork(pwk, fCancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(IN PTP_SIMPLE_CALLBACK pfns,
+                            IN OUT PVOID pv OPTIONAL,
+                            IN PTP_CALLBACK_ENVIRON pcbe OPTIONAL)
+{
+    NTSTATUS Status;
+
+    Status = TpSimpleTryPost(pfns, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(IN PTP_TIMER_CALLBACK pfnti,
+                      IN OUT PVOID pv OPTIONAL,
+                      IN PTP_CALLBACK_ENVIRON pcbe OPTIONAL)
+{
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = TpAllocTimer(&Timer, pfnti, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    return Timer;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolTimer(IN OUT PTP_TIMER pti,
+                   IN PFILETIME pftDueTime OPTIONAL,
+                   IN DWORD msPeriod,
+                   IN DWORD msWindowLength OPTIONAL)
+{
+    LARGE_INTEGER DueTime;
+
+    TpSetTimer(pti, FileTimeToLargeInteger(pftDueTime, &DueTime), msPeriod, msWindowLength);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+IsThreadpoolTimerSet(IN OUT PTP_TIMER pti)
+{
+    return TpIsTimerSet(pti);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolTimer(IN OUT PTP_TIMER pti)
+{
+    TpReleaseTimer(pti);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(IN OUT PTP_TIMER pti,
+                                IN BOOL fCancelPendingCallbacks)
+{
+    TpWaitForTimer(pti, fCancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(IN PTP_WAIT_CALLBACK pfnwa,
+                     IN OUT PVOID pv OPTIONAL,
+                     IN PTP_CALLBACK_ENVIRON pcbe OPTIONAL)
+{
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+
+    Status = TpAllocWait(&Wait, pfnwa, pv, pcbe);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    return Wait;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolWait(IN OUT PTP_WAIT pwa,
+                  IN HANDLE h OPTIONAL,
+                  IN PFILETIME pftTimeout OPTIONAL)
+{
+    LARGE_INTEGER Timeout;
+
+    TpSetWait(pwa, h, FileTimeToLargeInteger(pftTimeout, &Timeout));
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWait(IN OUT PTP_WAIT pwa)
+{
+    TpReleaseWait(pwa);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(IN OUT PTP_WAIT pwa,
+                               IN BOOL fCancelPendingCallbacks)
+{
+    TpWaitForWait(pwa, fCancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+CallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE pci)
+{
+    NTSTATUS Status;
+
+    Status = TpCallbackMayRunLong(pci);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(IN OUT PTP_CALLBACK_INSTANCE pci)
+{
+    TpDisassociateCallback(pci);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetEventWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE pci,
+                            IN HANDLE evt)
+{
+    TpCallbackSetEventOnCompletion(pci, evt);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE pci,
+                                    IN HANDLE sem,
+                                    IN DWORD crel)
+{
+    TpCallbackReleaseSemaphoreOnCompletion(pci, sem, crel);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE pci,
+                                IN HANDLE mut)
+{
+    TpCallbackReleaseMutexOnCompletion(pci, mut);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(IN OUT PTP_CALLBACK_INSTANCE pci,
+                                        IN OUT PCRITICAL_SECTION pcs)
+{
+    TpCallbackLeaveCriticalSectionOnCompletion(pci, pcs);
+}
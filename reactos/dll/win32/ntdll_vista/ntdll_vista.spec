@@ -8,3 +8,30 @@
 @ stdcall RtlReleaseSRWLockShared(ptr)
 @ stdcall RtlAcquireSRWLockExclusive(ptr)
 @ stdcall RtlReleaseSRWLockExclusive(ptr)
+@ stdcall TpAllocPool(ptr ptr)
+@ stdcall TpReleasePool(ptr)
+@ stdcall TpSetPoolMaxThreads(ptr long)
+@ stdcall TpSetPoolMinThreads(ptr long)
+@ stdcall TpAllocCleanupGroup(ptr)
+@ stdcall TpReleaseCleanupGroup(ptr)
+@ stdcall TpReleaseCleanupGroupMembers(ptr long ptr)
+@ stdcall TpAllocWork(ptr ptr ptr ptr)
+@ stdcall TpPostWork(ptr)
+@ stdcall TpReleaseWork(ptr)
+@ stdcall TpWaitForWork(ptr long)
+@ stdcall TpSimpleTryPost(ptr ptr ptr)
+@ stdcall TpAllocTimer(ptr ptr ptr ptr)
+@ stdcall TpSetTimer(ptr ptr long long)
+@ stdcall TpIsTimerSet(ptr)
+@ stdcall TpReleaseTimer(ptr)
+@ stdcall TpWaitForTimer(ptr long)
+@ stdcall TpAllocWait(ptr ptr ptr ptr)
+@ stdcall TpSetWait(ptr ptr ptr)
+@ stdcall TpReleaseWait(ptr)
+@ stdcall TpWaitForWait(ptr long)
+@ stdcall TpCallbackMayRunLong(ptr)
+@ stdcall TpDisassociateCallback(ptr)
+@ stdcall TpCallbackSetEventOnCompletion(ptr ptr)
+@ stdcall TpCallbackReleaseSemaphoreOnCompletion(ptr ptr long)
+@ stdcall TpCallbackReleaseMutexOnCompletion(ptr ptr)
+@ stdcall TpCallbackLeaveCriticalSectionOnCompletion(ptr ptr)
@@ -0,0 +1,1863 @@
+/*
+ * COPYRIGHT:         See COPYING in the top level directory
+ * PROJECT:           ReactOS system libraries
+ * PURPOSE:           Vista-style Thread Pool (Tp*) Routines
+ *
+ * NOTES:             Every worker owns a bounded deque. Work posted from a
+ *                    worker goes to its own deque and is popped LIFO, work
+ *                    posted from elsewhere is spread round-robin over the
+ *                    workers, and idle workers steal FIFO from the others.
+ *                    Idle workers sleep on the pool completion port, which
+ *                    is also how posters wake them up. Timers and waits are
+ *                    handled by process-wide threads which only queue the
+ *                    callbacks into the pool of their object. The timer
+ *                    thread also adds workers to pools whose queue has not
+ *                    moved for a while, so blocking callbacks can't starve
+ *                    the rest of the work. Pending timers sit in a min-heap
+ *                    on their due time, and wait threads whose bucket stays
+ *                    empty for a while free it and exit.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+RtlInitializeConditionVariable(OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableCS(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                            IN OUT PRTL_CRITICAL_SECTION CriticalSection,
+                            IN PLARGE_INTEGER TimeOut OPTIONAL);
+
+/* INTERNAL TYPES ***********************************************************/
+
+/* Upper bound of the worker threads of one pool */
+#define TPP_MAX_WORKERS             64
+
+/* Entries of a worker deque, must be a power of two */
+#define TPP_DEQUE_SIZE              256
+#define TPP_DEQUE_MASK              (TPP_DEQUE_SIZE - 1)
+
+/* Workers idle for that long exit, as long as the pool keeps its minimum */
+#define TPP_WORKER_IDLE_TIMEOUT     (-20LL * 1000 * 1000 * 10)
+
+/* How long queued work may sit without progress before the pool grows, in 100ns */
+#define TPP_GATE_INTERVAL           (500LL * 10000)
+
+#define TPP_WAITS_PER_BUCKET        (MAXIMUM_WAIT_OBJECTS - 1)
+
+/* Wait threads with an empty bucket for that long free it and exit */
+#define TPP_WAIT_IDLE_TIMEOUT       (-20LL * 1000 * 1000 * 10)
+
+/* Initial entries of the timer heap, it doubles when full */
+#define TPP_TIMER_HEAP_SIZE         32
+
+#define TPP_INFINITE                MAXLONGLONG
+
+typedef enum _TPP_OBJECT_TYPE
+{
+    TppWorkObject,
+    TppSimpleObject,
+    TppTimerObject,
+    TppWaitObject
+} TPP_OBJECT_TYPE;
+
+typedef struct _TPP_POOL *PTPP_POOL;
+typedef struct _TPP_CLEANUP_GROUP *PTPP_CLEANUP_GROUP;
+typedef struct _TPP_WAIT_BUCKET *PTPP_WAIT_BUCKET;
+
+typedef struct _TPP_OBJECT
+{
+    TPP_OBJECT_TYPE Type;
+    LONG RefCount;
+    PTPP_POOL Pool;
+    PTPP_CLEANUP_GROUP Group;
+    LIST_ENTRY GroupLink;
+    PVOID Callback;
+    PVOID Context;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CancelCallback;
+    BOOLEAN LongFunction;
+    LONG Released;
+
+    /* Callbacks sitting in a deque, running, and queued ones to skip */
+    LONG Queued;
+    LONG Running;
+    LONG Cancelled;
+
+    union
+    {
+        struct
+        {
+            ULONG HeapIndex;
+            BOOLEAN Set;
+            BOOLEAN Pending;
+            LONGLONG DueTime;
+            ULONG Period;
+            ULONG Window;
+        } Timer;
+        struct
+        {
+            HANDLE Handle;
+            LONGLONG Timeout;
+            PTPP_WAIT_BUCKET Bucket;
+            ULONG Slot;
+            TP_WAIT_RESULT Result;
+        } Wait;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+typedef struct _TPP_WORKER
+{
+    PTPP_POOL Pool;
+    HANDLE ThreadId;
+    BOOLEAN Active;
+
+    /* Head is where thieves take from, Tail is where the owner works */
+    LONG Lock;
+    ULONG Head;
+    ULONG Tail;
+    PTPP_OBJECT Deque[TPP_DEQUE_SIZE];
+} TPP_WORKER, *PTPP_WORKER;
+
+typedef struct _TPP_OVERFLOW_ENTRY
+{
+    LIST_ENTRY Link;
+    PTPP_OBJECT Object;
+} TPP_OVERFLOW_ENTRY, *PTPP_OVERFLOW_ENTRY;
+
+typedef struct _TPP_POOL
+{
+    LIST_ENTRY PoolLink;
+    LONG RefCount;
+    BOOLEAN Shutdown;
+    HANDLE CompletionPort;
+
+    /* Protects the thread management and the callback waiters */
+    RTL_CRITICAL_SECTION Lock;
+    RTL_CONDITION_VARIABLE CallbacksDone;
+    LONG Waiters;
+
+    LONG ThreadCount;
+    LONG IdleCount;
+    LONG LongCount;
+    LONG MinThreads;
+    LONG MaxThreads;
+    LONG NextWorker;
+
+    /* Queued callbacks and dequeues so far, for the starvation check */
+    LONG Pending;
+    LONG Dequeues;
+    LONG LastDequeues;
+
+    /* Posts which found no room in the deques */
+    LONG OverflowLock;
+    LIST_ENTRY OverflowList;
+
+    TPP_WORKER Workers[TPP_MAX_WORKERS];
+} TPP_POOL;
+
+typedef struct _TPP_CLEANUP_GROUP
+{
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY Members;
+} TPP_CLEANUP_GROUP;
+
+typedef struct _TPP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN MayRunLong;
+    BOOLEAN Disassociated;
+    HANDLE Event;
+    HANDLE Semaphore;
+    ULONG SemaphoreCount;
+    HANDLE Mutex;
+    PRTL_CRITICAL_SECTION CriticalSection;
+} TPP_CALLBACK_INSTANCE, *PTPP_CALLBACK_INSTANCE;
+
+typedef struct _TPP_WAIT_BUCKET
+{
+    LIST_ENTRY Link;
+    HANDLE UpdateEvent;
+    ULONG Count;
+    PTPP_OBJECT Waits[TPP_WAITS_PER_BUCKET];
+    ULONG Generation[TPP_WAITS_PER_BUCKET];
+} TPP_WAIT_BUCKET;
+
+/* GLOBALS ******************************************************************/
+
+static PTPP_POOL TppDefaultPool;
+
+static RTL_CRITICAL_SECTION TppTimerLock;
+static PTPP_OBJECT *TppTimerHeap;
+static ULONG TppTimerCount;
+static ULONG TppTimerHeapSize;
+static LIST_ENTRY TppPoolList;
+static HANDLE TppTimerEvent;
+static BOOLEAN TppTimerThreadStarted;
+static LONG TppGateArmed;
+
+static RTL_CRITICAL_SECTION TppWaitLock;
+static LIST_ENTRY TppWaitBuckets;
+
+/* INTERNAL FUNCTIONS *******************************************************/
+
+FORCEINLINE
+VOID
+TppAcquireSpinLock(IN OUT PLONG Lock)
+{
+    while (InterlockedExchange(Lock, 1))
+    {
+        while (*(volatile LONG *)Lock)
+            YieldProcessor();
+    }
+}
+
+FORCEINLINE
+BOOLEAN
+TppTryAcquireSpinLock(IN OUT PLONG Lock)
+{
+    return (InterlockedExchange(Lock, 1) == 0);
+}
+
+FORCEINLINE
+VOID
+TppReleaseSpinLock(IN OUT PLONG Lock)
+{
+    InterlockedExchange(Lock, 0);
+}
+
+static
+NTSTATUS
+TppStartThread(IN PTHREAD_START_ROUTINE Function,
+               IN PVOID Parameter,
+               OUT PCLIENT_ID ClientId OPTIONAL)
+{
+    NTSTATUS Status;
+    HANDLE ThreadHandle;
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 Function,
+                                 Parameter,
+                                 &ThreadHandle,
+                                 ClientId);
+    if (NT_SUCCESS(Status))
+        NtClose(ThreadHandle);
+
+    return Status;
+}
+
+static
+LONGLONG
+TppAbsoluteTime(IN PLARGE_INTEGER Time OPTIONAL)
+{
+    LARGE_INTEGER Now;
+
+    if (!Time)
+        return TPP_INFINITE;
+
+    if (Time->QuadPart > 0)
+        return Time->QuadPart;
+
+    NtQuerySystemTime(&Now);
+    return Now.QuadPart - Time->QuadPart;
+}
+
+static
+VOID
+TppFreePool(IN PTPP_POOL Pool)
+{
+    PTPP_OVERFLOW_ENTRY Entry;
+
+    while (!IsListEmpty(&Pool->OverflowList))
+    {
+        Entry = CONTAINING_RECORD(RemoveHeadList(&Pool->OverflowList), TPP_OVERFLOW_ENTRY, Link);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Entry);
+    }
+
+    RtlEnterCriticalSection(&TppTimerLock);
+    RemoveEntryList(&Pool->PoolLink);
+    RtlLeaveCriticalSection(&TppTimerLock);
+
+    NtClose(Pool->CompletionPort);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+VOID
+TppDereferencePool(IN PTPP_POOL Pool)
+{
+    BOOLEAN Free;
+    LONG i;
+
+    if (InterlockedDecrement(&Pool->RefCount) != 0)
+        return;
+
+    /* Nothing can queue work anymore, let the workers go */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+    Free = (Pool->ThreadCount == 0);
+    for (i = 0; i < Pool->ThreadCount; i++)
+    {
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Free)
+        TppFreePool(Pool);
+}
+
+static
+NTSTATUS
+TppAllocPool(OUT PTPP_POOL *PoolPtr)
+{
+    PTPP_POOL Pool;
+    NTSTATUS Status;
+    ULONG i;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TPP_POOL));
+    if (!Pool)
+        return STATUS_NO_MEMORY;
+
+    Status = NtCreateIoCompletion(&Pool->CompletionPort, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    RtlInitializeCriticalSection(&Pool->Lock);
+    RtlInitializeConditionVariable(&Pool->CallbacksDone);
+    InitializeListHead(&Pool->OverflowList);
+    Pool->RefCount = 1;
+    Pool->MaxThreads = TPP_MAX_WORKERS;
+
+    for (i = 0; i < TPP_MAX_WORKERS; i++)
+        Pool->Workers[i].Pool = Pool;
+
+    RtlEnterCriticalSection(&TppTimerLock);
+    InsertTailList(&TppPoolList, &Pool->PoolLink);
+    RtlLeaveCriticalSection(&TppTimerLock);
+
+    *PoolPtr = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+PTPP_POOL
+TppGetPool(IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    PTPP_POOL Pool;
+
+    if (Environment && Environment->Pool)
+        return (PTPP_POOL)Environment->Pool;
+
+    if (!TppDefaultPool)
+    {
+        if (!NT_SUCCESS(TppAllocPool(&Pool)))
+            return NULL;
+
+        /* Someone else may have been faster */
+        if (InterlockedCompareExchangePointer((PVOID *)&TppDefaultPool, Pool, NULL) != NULL)
+            TppDereferencePool(Pool);
+    }
+
+    return TppDefaultPool;
+}
+
+static
+VOID
+TppFreeObject(IN PTPP_OBJECT Object)
+{
+    TPP_CALLBACK_INSTANCE Instance;
+    PTPP_CLEANUP_GROUP Group;
+
+    if (Object->FinalizationCallback)
+    {
+        RtlZeroMemory(&Instance, sizeof(Instance));
+        Instance.Object = Object;
+        Instance.Disassociated = TRUE;
+        Object->FinalizationCallback((PTP_CALLBACK_INSTANCE)&Instance, Object->Context);
+    }
+
+    Group = Object->Group;
+    if (Group)
+    {
+        RtlEnterCriticalSection(&Group->Lock);
+        if (Object->Group)
+            RemoveEntryList(&Object->GroupLink);
+        RtlLeaveCriticalSection(&Group->Lock);
+    }
+
+    TppDereferencePool(Object->Pool);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+}
+
+FORCEINLINE
+VOID
+TppReferenceObject(IN PTPP_OBJECT Object)
+{
+    InterlockedIncrement(&Object->RefCount);
+}
+
+FORCEINLINE
+VOID
+TppDereferenceObject(IN PTPP_OBJECT Object)
+{
+    if (InterlockedDecrement(&Object->RefCount) == 0)
+        TppFreeObject(Object);
+}
+
+static
+NTSTATUS
+TppAllocObject(OUT PTPP_OBJECT *ObjectPtr,
+               IN TPP_OBJECT_TYPE Type,
+               IN PVOID Callback,
+               IN PVOID Context,
+               IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    PTPP_POOL Pool;
+    PTPP_CLEANUP_GROUP Group;
+
+    Pool = TppGetPool(Environment);
+    if (!Pool)
+        return STATUS_NO_MEMORY;
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TPP_OBJECT));
+    if (!Object)
+        return STATUS_NO_MEMORY;
+
+    Object->Type = Type;
+    Object->RefCount = 1;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    InterlockedIncrement(&Pool->RefCount);
+
+    if (Environment)
+    {
+        Object->FinalizationCallback = Environment->FinalizationCallback;
+        Object->CancelCallback = Environment->CleanupGroupCancelCallback;
+        Object->LongFunction = Environment->u.s.LongFunction ? TRUE : FALSE;
+
+        Group = (PTPP_CLEANUP_GROUP)Environment->CleanupGroup;
+        if (Group)
+        {
+            RtlEnterCriticalSection(&Group->Lock);
+            Object->Group = Group;
+            InsertTailList(&Group->Members, &Object->GroupLink);
+            RtlLeaveCriticalSection(&Group->Lock);
+        }
+    }
+
+    *ObjectPtr = Object;
+    return STATUS_SUCCESS;
+}
+
+/* Must be called with the pool lock held */
+static
+BOOLEAN
+TppStartWorker(IN PTPP_POOL Pool);
+
+/* Must be called with the timer lock held */
+static
+BOOLEAN
+TppStartTimerThread(VOID);
+
+static
+PTPP_WORKER
+TppCurrentWorker(IN PTPP_POOL Pool)
+{
+    HANDLE ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+    ULONG i;
+
+    for (i = 0; i < TPP_MAX_WORKERS; i++)
+    {
+        if (Pool->Workers[i].ThreadId == ThreadId)
+            return &Pool->Workers[i];
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+TppPushWorker(IN PTPP_WORKER Worker,
+              IN PTPP_OBJECT Object)
+{
+    BOOLEAN Pushed = FALSE;
+
+    TppAcquireSpinLock(&Worker->Lock);
+    if (Worker->Active && (Worker->Tail - Worker->Head) < TPP_DEQUE_SIZE)
+    {
+        Worker->Deque[Worker->Tail & TPP_DEQUE_MASK] = Object;
+        Worker->Tail++;
+        Pushed = TRUE;
+    }
+    TppReleaseSpinLock(&Worker->Lock);
+
+    return Pushed;
+}
+
+static
+VOID
+TppWakeWorker(IN PTPP_POOL Pool)
+{
+    LONG Idle;
+
+    /* Hand the work to an idle worker if there is one */
+    for (;;)
+    {
+        Idle = *(volatile LONG *)&Pool->IdleCount;
+        if (Idle <= 0)
+            break;
+
+        if (InterlockedCompareExchange(&Pool->IdleCount, Idle - 1, Idle) == Idle)
+        {
+            NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+            return;
+        }
+    }
+
+    /* Otherwise grow, as long as callbacks that don't block keep CPUs busy */
+    if ((Pool->ThreadCount - Pool->LongCount) < (LONG)NtCurrentPeb()->NumberOfProcessors &&
+        Pool->ThreadCount < Pool->MaxThreads)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        if ((Pool->ThreadCount - Pool->LongCount) < (LONG)NtCurrentPeb()->NumberOfProcessors &&
+            Pool->ThreadCount < Pool->MaxThreads &&
+            TppStartWorker(Pool))
+        {
+            RtlLeaveCriticalSection(&Pool->Lock);
+            return;
+        }
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    /* All workers are busy, have the timer thread watch for starvation */
+    if (!*(volatile LONG *)&TppGateArmed && !InterlockedExchange(&TppGateArmed, TRUE))
+    {
+        RtlEnterCriticalSection(&TppTimerLock);
+        if (TppStartTimerThread())
+            NtSetEvent(TppTimerEvent, NULL);
+        RtlLeaveCriticalSection(&TppTimerLock);
+    }
+}
+
+static
+BOOLEAN
+TppEnqueue(IN PTPP_OBJECT Object)
+{
+    PTPP_POOL Pool = Object->Pool;
+    PTPP_WORKER Worker;
+    PTPP_OVERFLOW_ENTRY Entry;
+    ULONG i, Start;
+    BOOLEAN Pushed = FALSE;
+
+    /* Every queued callback holds a reference on its object */
+    TppReferenceObject(Object);
+    InterlockedIncrement(&Object->Queued);
+    InterlockedIncrement(&Pool->Pending);
+
+    Worker = TppCurrentWorker(Pool);
+    if (Worker)
+        Pushed = TppPushWorker(Worker, Object);
+
+    if (!Pushed)
+    {
+        Start = (ULONG)InterlockedIncrement(&Pool->NextWorker);
+        for (i = 0; i < TPP_MAX_WORKERS && !Pushed; i++)
+        {
+            Worker = &Pool->Workers[(Start + i) % TPP_MAX_WORKERS];
+            if (Worker->Active)
+                Pushed = TppPushWorker(Worker, Object);
+        }
+    }
+
+    if (!Pushed)
+    {
+        Entry = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(TPP_OVERFLOW_ENTRY));
+        if (!Entry)
+        {
+            DPRINT1("Dropping callback of object %p, out of memory\n", Object);
+            InterlockedDecrement(&Pool->Pending);
+            InterlockedDecrement(&Object->Queued);
+            TppDereferenceObject(Object);
+            return FALSE;
+        }
+
+        Entry->Object = Object;
+        TppAcquireSpinLock(&Pool->OverflowLock);
+        InsertTailList(&Pool->OverflowList, &Entry->Link);
+        TppReleaseSpinLock(&Pool->OverflowLock);
+    }
+
+    TppWakeWorker(Pool);
+    return TRUE;
+}
+
+static
+PTPP_OBJECT
+TppDequeue(IN PTPP_WORKER Worker)
+{
+    PTPP_POOL Pool = Worker->Pool;
+    PTPP_OBJECT Object = NULL;
+    PTPP_OVERFLOW_ENTRY Entry = NULL;
+    PTPP_WORKER Victim;
+    ULONG i, Start;
+
+    /* Own deque first, newest work is the most likely to be cache-hot */
+    TppAcquireSpinLock(&Worker->Lock);
+    if (Worker->Tail != Worker->Head)
+    {
+        Worker->Tail--;
+        Object = Worker->Deque[Worker->Tail & TPP_DEQUE_MASK];
+    }
+    TppReleaseSpinLock(&Worker->Lock);
+    if (Object)
+        return Object;
+
+    if (!IsListEmpty(&Pool->OverflowList))
+    {
+        TppAcquireSpinLock(&Pool->OverflowLock);
+        if (!IsListEmpty(&Pool->OverflowList))
+            Entry = CONTAINING_RECORD(RemoveHeadList(&Pool->OverflowList), TPP_OVERFLOW_ENTRY, Link);
+        TppReleaseSpinLock(&Pool->OverflowLock);
+
+        if (Entry)
+        {
+            Object = Entry->Object;
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Entry);
+            return Object;
+        }
+    }
+
+    /* Steal the oldest work of the others, skipping deques that are busy */
+    Start = (ULONG)(Worker - Pool->Workers) + 1;
+    for (i = 0; i < TPP_MAX_WORKERS - 1; i++)
+    {
+        Victim = &Pool->Workers[(Start + i) % TPP_MAX_WORKERS];
+        if (*(volatile ULONG *)&Victim->Tail == *(volatile ULONG *)&Victim->Head)
+            continue;
+
+        if (!TppTryAcquireSpinLock(&Victim->Lock))
+            continue;
+
+        if (Victim->Tail != Victim->Head)
+        {
+            Object = Victim->Deque[Victim->Head & TPP_DEQUE_MASK];
+            Victim->Head++;
+        }
+        TppReleaseSpinLock(&Victim->Lock);
+
+        if (Object)
+            return Object;
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+TppConsumeCancel(IN PTPP_OBJECT Object)
+{
+    LONG Cancelled;
+
+    for (;;)
+    {
+        Cancelled = *(volatile LONG *)&Object->Cancelled;
+        if (Cancelled <= 0)
+            return FALSE;
+
+        if (InterlockedCompareExchange(&Object->Cancelled, Cancelled - 1, Cancelled) == Cancelled)
+            return TRUE;
+    }
+}
+
+static
+VOID
+TppCallbackDone(IN PTPP_OBJECT Object)
+{
+    PTPP_POOL Pool = Object->Pool;
+
+    if (InterlockedDecrement(&Object->Running) == 0 &&
+        *(volatile LONG *)&Object->Queued == 0 &&
+        *(volatile LONG *)&Pool->Waiters != 0)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        RtlWakeAllConditionVariable(&Pool->CallbacksDone);
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+}
+
+static
+VOID
+TppRunCallback(IN PTPP_OBJECT Object)
+{
+    PTPP_POOL Pool = Object->Pool;
+    TPP_CALLBACK_INSTANCE Instance;
+    PTP_CALLBACK_INSTANCE CallbackInstance = (PTP_CALLBACK_INSTANCE)&Instance;
+
+    /* Count as running before leaving the queue, so waiters never see a gap */
+    InterlockedIncrement(&Object->Running);
+    InterlockedDecrement(&Object->Queued);
+    InterlockedDecrement(&Pool->Pending);
+    InterlockedIncrement(&Pool->Dequeues);
+
+    if (TppConsumeCancel(Object))
+    {
+        TppCallbackDone(Object);
+        TppDereferenceObject(Object);
+        return;
+    }
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    if (Object->LongFunction)
+    {
+        Instance.MayRunLong = TRUE;
+        InterlockedIncrement(&Pool->LongCount);
+    }
+
+    switch (Object->Type)
+    {
+        case TppWorkObject:
+            ((PTP_WORK_CALLBACK)Object->Callback)(CallbackInstance,
+                                                  Object->Context,
+                                                  (PTP_WORK)Object);
+            break;
+
+        case TppSimpleObject:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(CallbackInstance,
+                                                    Object->Context);
+            break;
+
+        case TppTimerObject:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(CallbackInstance,
+                                                   Object->Context,
+                                                   (PTP_TIMER)Object);
+            break;
+
+        case TppWaitObject:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(CallbackInstance,
+                                                  Object->Context,
+                                                  (PTP_WAIT)Object,
+                                                  Object->u.Wait.Result);
+            break;
+    }
+
+    /* Run the completion actions the callback asked for */
+    if (Instance.CriticalSection)
+        RtlLeaveCriticalSection(Instance.CriticalSection);
+    if (Instance.Mutex)
+        NtReleaseMutant(Instance.Mutex, NULL);
+    if (Instance.Semaphore)
+        NtReleaseSemaphore(Instance.Semaphore, Instance.SemaphoreCount, NULL);
+    if (Instance.Event)
+        NtSetEvent(Instance.Event, NULL);
+
+    if (Instance.MayRunLong)
+        InterlockedDecrement(&Pool->LongCount);
+
+    if (!Instance.Disassociated)
+        TppCallbackDone(Object);
+
+    TppDereferenceObject(Object);
+}
+
+static
+VOID
+TppWaitForCallbacks(IN PTPP_OBJECT Object,
+                    IN BOOLEAN CancelPendingCallbacks)
+{
+    PTPP_POOL Pool = Object->Pool;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* Queued callbacks are skipped by the workers as they come up */
+    if (CancelPendingCallbacks)
+        InterlockedExchange(&Object->Cancelled, *(volatile LONG *)&Object->Queued);
+
+    InterlockedIncrement(&Pool->Waiters);
+    while (*(volatile LONG *)&Object->Queued != 0 ||
+           *(volatile LONG *)&Object->Running != 0)
+    {
+        RtlSleepConditionVariableCS(&Pool->CallbacksDone, &Pool->Lock, NULL);
+    }
+    InterlockedDecrement(&Pool->Waiters);
+
+    /*
+     * A worker may have left the queue between reading Queued and setting
+     * Cancelled. Nothing is queued or running anymore, so drop what is left
+     * over before it swallows callbacks submitted later.
+     */
+    if (CancelPendingCallbacks)
+        InterlockedExchange(&Object->Cancelled, 0);
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static
+VOID
+TppRetireWorker(IN PTPP_WORKER Worker)
+{
+    PTPP_POOL Pool = Worker->Pool;
+    PTPP_OBJECT Object;
+    BOOLEAN Free;
+
+    /* Leftovers have to be picked up by someone else, thieves may still come by */
+    TppAcquireSpinLock(&Worker->Lock);
+    Worker->Active = FALSE;
+    TppReleaseSpinLock(&Worker->Lock);
+
+    for (;;)
+    {
+        Object = NULL;
+        TppAcquireSpinLock(&Worker->Lock);
+        if (Worker->Tail != Worker->Head)
+        {
+            Object = Worker->Deque[Worker->Head & TPP_DEQUE_MASK];
+            Worker->Head++;
+        }
+        TppReleaseSpinLock(&Worker->Lock);
+
+        if (!Object)
+            break;
+
+        /* Requeueing takes new references, drop the ones of the old entry */
+        TppEnqueue(Object);
+        InterlockedDecrement(&Object->Queued);
+        InterlockedDecrement(&Pool->Pending);
+        TppDereferenceObject(Object);
+    }
+
+    Worker->ThreadId = NULL;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->ThreadCount--;
+    Free = Pool->Shutdown && Pool->ThreadCount == 0;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Free)
+        TppFreePool(Pool);
+}
+
+static
+BOOLEAN
+TppTryLeaveIdle(IN PTPP_POOL Pool)
+{
+    LONG Idle;
+
+    for (;;)
+    {
+        Idle = *(volatile LONG *)&Pool->IdleCount;
+        if (Idle <= 0)
+        {
+            /* A poster already picked us and queued a wake-up packet */
+            return FALSE;
+        }
+
+        if (InterlockedCompareExchange(&Pool->IdleCount, Idle - 1, Idle) == Idle)
+            return TRUE;
+    }
+}
+
+static
+DWORD
+WINAPI
+TppWorkerThread(IN LPVOID Parameter)
+{
+    PTPP_WORKER Worker = Parameter;
+    PTPP_POOL Pool = Worker->Pool;
+    PTPP_OBJECT Object;
+    LARGE_INTEGER Timeout;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PVOID KeyContext, ApcContext;
+    NTSTATUS Status;
+    BOOLEAN Retire;
+
+    Worker->ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+
+    for (;;)
+    {
+        Object = TppDequeue(Worker);
+        if (Object)
+        {
+            TppRunCallback(Object);
+            continue;
+        }
+
+        /* Announce ourselves idle, then look again so no post gets lost */
+        InterlockedIncrement(&Pool->IdleCount);
+        Object = TppDequeue(Worker);
+        if (Object)
+        {
+            TppTryLeaveIdle(Pool);
+            TppRunCallback(Object);
+            continue;
+        }
+
+        if (Pool->Shutdown && TppTryLeaveIdle(Pool))
+            break;
+
+        Timeout.QuadPart = TPP_WORKER_IDLE_TIMEOUT;
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      &KeyContext,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      &Timeout);
+        if (Status != STATUS_TIMEOUT)
+        {
+            if (Pool->Shutdown && IsListEmpty(&Pool->OverflowList))
+                break;
+            continue;
+        }
+
+        /* Nothing to do for a while, give the thread back if we can spare it */
+        RtlEnterCriticalSection(&Pool->Lock);
+        Retire = (Pool->ThreadCount > Pool->MinThreads) && TppTryLeaveIdle(Pool);
+        RtlLeaveCriticalSection(&Pool->Lock);
+        if (Retire)
+            break;
+    }
+
+    TppRetireWorker(Worker);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+static
+BOOLEAN
+TppStartWorker(IN PTPP_POOL Pool)
+{
+    PTPP_WORKER Worker;
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = 0; i < TPP_MAX_WORKERS; i++)
+    {
+        Worker = &Pool->Workers[i];
+        if (Worker->Active || Worker->ThreadId)
+            continue;
+
+        Worker->Head = Worker->Tail = 0;
+        Worker->Active = TRUE;
+        Pool->ThreadCount++;
+
+        Status = TppStartThread(TppWorkerThread, Worker, NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to start a pool worker: 0x%lx\n", Status);
+            Worker->Active = FALSE;
+            Pool->ThreadCount--;
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* The pending timers form a min-heap on their due time */
+FORCEINLINE
+VOID
+TppSetTimerHeapEntry(IN ULONG Index,
+                     IN PTPP_OBJECT Timer)
+{
+    TppTimerHeap[Index] = Timer;
+    Timer->u.Timer.HeapIndex = Index;
+}
+
+/* Must be called with the timer lock held */
+static
+VOID
+TppSiftTimerUp(IN ULONG Index)
+{
+    PTPP_OBJECT Timer = TppTimerHeap[Index];
+    ULONG Parent;
+
+    while (Index > 0)
+    {
+        Parent = (Index - 1) / 2;
+        if (TppTimerHeap[Parent]->u.Timer.DueTime <= Timer->u.Timer.DueTime)
+            break;
+        TppSetTimerHeapEntry(Index, TppTimerHeap[Parent]);
+        Index = Parent;
+    }
+
+    TppSetTimerHeapEntry(Index, Timer);
+}
+
+/* Must be called with the timer lock held */
+static
+VOID
+TppSiftTimerDown(IN ULONG Index)
+{
+    PTPP_OBJECT Timer = TppTimerHeap[Index];
+    ULONG Child;
+
+    for (;;)
+    {
+        Child = Index * 2 + 1;
+        if (Child >= TppTimerCount)
+            break;
+        if (Child + 1 < TppTimerCount &&
+            TppTimerHeap[Child + 1]->u.Timer.DueTime < TppTimerHeap[Child]->u.Timer.DueTime)
+        {
+            Child++;
+        }
+        if (Timer->u.Timer.DueTime <= TppTimerHeap[Child]->u.Timer.DueTime)
+            break;
+        TppSetTimerHeapEntry(Index, TppTimerHeap[Child]);
+        Index = Child;
+    }
+
+    TppSetTimerHeapEntry(Index, Timer);
+}
+
+/* Must be called with the timer lock held */
+static
+BOOLEAN
+TppInsertTimer(IN PTPP_OBJECT Timer)
+{
+    PTPP_OBJECT *Heap;
+    ULONG Size;
+
+    if (TppTimerCount == TppTimerHeapSize)
+    {
+        Size = TppTimerHeapSize ? TppTimerHeapSize * 2 : TPP_TIMER_HEAP_SIZE;
+        if (TppTimerHeap)
+            Heap = RtlReAllocateHeap(RtlGetProcessHeap(), 0, TppTimerHeap, Size * sizeof(*Heap));
+        else
+            Heap = RtlAllocateHeap(RtlGetProcessHeap(), 0, Size * sizeof(*Heap));
+        if (!Heap)
+            return FALSE;
+
+        TppTimerHeap = Heap;
+        TppTimerHeapSize = Size;
+    }
+
+    TppSetTimerHeapEntry(TppTimerCount++, Timer);
+    TppSiftTimerUp(Timer->u.Timer.HeapIndex);
+    Timer->u.Timer.Pending = TRUE;
+    return TRUE;
+}
+
+/* Must be called with the timer lock held */
+static
+VOID
+TppRemoveTimer(IN PTPP_OBJECT Timer)
+{
+    ULONG Index = Timer->u.Timer.HeapIndex;
+    PTPP_OBJECT Last;
+
+    Timer->u.Timer.Pending = FALSE;
+    Last = TppTimerHeap[--TppTimerCount];
+    if (Last == Timer)
+        return;
+
+    TppSetTimerHeapEntry(Index, Last);
+    if (Index > 0 && TppTimerHeap[(Index - 1) / 2]->u.Timer.DueTime > Last->u.Timer.DueTime)
+        TppSiftTimerUp(Index);
+    else
+        TppSiftTimerDown(Index);
+}
+
+/* Must be called with the timer lock held */
+static
+VOID
+TppCheckStarvation(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTPP_POOL Pool;
+    BOOLEAN Busy = FALSE;
+    LONG Dequeues;
+
+    for (Entry = TppPoolList.Flink; Entry != &TppPoolList; Entry = Entry->Flink)
+    {
+        Pool = CONTAINING_RECORD(Entry, TPP_POOL, PoolLink);
+        if (*(volatile LONG *)&Pool->Pending <= 0)
+            continue;
+
+        Busy = TRUE;
+        Dequeues = *(volatile LONG *)&Pool->Dequeues;
+        if (Dequeues == Pool->LastDequeues && *(volatile LONG *)&Pool->IdleCount == 0)
+        {
+            /* Nothing came off the queue since last time, the workers are stuck */
+            RtlEnterCriticalSection(&Pool->Lock);
+            if (Pool->ThreadCount < Pool->MaxThreads && !Pool->Shutdown)
+                TppStartWorker(Pool);
+            RtlLeaveCriticalSection(&Pool->Lock);
+        }
+        Pool->LastDequeues = Dequeues;
+    }
+
+    if (!Busy)
+        InterlockedExchange(&TppGateArmed, FALSE);
+}
+
+static
+DWORD
+WINAPI
+TppTimerThread(IN LPVOID Parameter)
+{
+    PTPP_OBJECT Timer;
+    LARGE_INTEGER Now, Timeout;
+    LONGLONG NextGate = 0;
+    BOOLEAN Wait;
+
+    for (;;)
+    {
+        RtlEnterCriticalSection(&TppTimerLock);
+        NtQuerySystemTime(&Now);
+
+        if (TppGateArmed)
+        {
+            if (Now.QuadPart >= NextGate)
+            {
+                TppCheckStarvation();
+                NextGate = Now.QuadPart + TPP_GATE_INTERVAL;
+            }
+        }
+        else
+        {
+            NextGate = Now.QuadPart + TPP_GATE_INTERVAL;
+        }
+
+        while (TppTimerCount)
+        {
+            Timer = TppTimerHeap[0];
+
+            /* Timers within their window are coalesced with the one that is due */
+            if (Timer->u.Timer.DueTime - (LONGLONG)Timer->u.Timer.Window * 10000 > Now.QuadPart)
+                break;
+
+            if (Timer->u.Timer.Period)
+            {
+                /* Stays in the heap, only its position changes */
+                Timer->u.Timer.DueTime += (LONGLONG)Timer->u.Timer.Period * 10000;
+                if (Timer->u.Timer.DueTime <= Now.QuadPart)
+                    Timer->u.Timer.DueTime = Now.QuadPart + (LONGLONG)Timer->u.Timer.Period * 10000;
+                TppSiftTimerDown(0);
+            }
+            else
+            {
+                TppRemoveTimer(Timer);
+            }
+
+            TppEnqueue(Timer);
+        }
+
+        Wait = (TppTimerCount != 0);
+        if (Wait)
+        {
+            Timer = TppTimerHeap[0];
+            Timeout.QuadPart = Timer->u.Timer.DueTime - (LONGLONG)Timer->u.Timer.Window * 10000;
+        }
+        if (TppGateArmed && (!Wait || NextGate < Timeout.QuadPart))
+        {
+            Timeout.QuadPart = NextGate;
+            Wait = TRUE;
+        }
+        RtlLeaveCriticalSection(&TppTimerLock);
+
+        NtWaitForSingleObject(TppTimerEvent, FALSE, Wait ? &Timeout : NULL);
+    }
+
+    return 0;
+}
+
+static
+BOOLEAN
+TppStartTimerThread(VOID)
+{
+    NTSTATUS Status;
+
+    if (TppTimerThreadStarted)
+        return TRUE;
+
+    Status = NtCreateEvent(&TppTimerEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (NT_SUCCESS(Status))
+    {
+        Status = TppStartThread(TppTimerThread, NULL, NULL);
+        if (!NT_SUCCESS(Status))
+            NtClose(TppTimerEvent);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start the pool timer thread: 0x%lx\n", Status);
+        return FALSE;
+    }
+
+    TppTimerThreadStarted = TRUE;
+    return TRUE;
+}
+
+static
+VOID
+TppCancelTimer(IN PTPP_OBJECT Timer)
+{
+    RtlEnterCriticalSection(&TppTimerLock);
+    if (Timer->u.Timer.Pending)
+        TppRemoveTimer(Timer);
+    Timer->u.Timer.Set = FALSE;
+    RtlLeaveCriticalSection(&TppTimerLock);
+}
+
+/* Must be called with the wait lock held */
+static
+VOID
+TppRemoveWait(IN PTPP_OBJECT Wait)
+{
+    PTPP_WAIT_BUCKET Bucket = Wait->u.Wait.Bucket;
+
+    if (!Bucket)
+        return;
+
+    Bucket->Waits[Wait->u.Wait.Slot] = NULL;
+    Bucket->Generation[Wait->u.Wait.Slot]++;
+    Bucket->Count--;
+    Wait->u.Wait.Bucket = NULL;
+    NtSetEvent(Bucket->UpdateEvent, NULL);
+}
+
+/* Must be called with the wait lock held */
+static
+VOID
+TppCheckWaitTimeouts(IN PTPP_WAIT_BUCKET Bucket)
+{
+    LARGE_INTEGER Now;
+    PTPP_OBJECT Wait;
+    ULONG i;
+
+    NtQuerySystemTime(&Now);
+    for (i = 0; i < TPP_WAITS_PER_BUCKET; i++)
+    {
+        Wait = Bucket->Waits[i];
+        if (Wait && Wait->u.Wait.Timeout <= Now.QuadPart)
+        {
+            TppRemoveWait(Wait);
+            Wait->u.Wait.Result = WAIT_TIMEOUT;
+            TppEnqueue(Wait);
+        }
+    }
+}
+
+static
+BOOLEAN
+TppFailBadWaits(IN PTPP_WAIT_BUCKET Bucket,
+                IN PHANDLE Handles,
+                IN PULONG Slots,
+                IN PULONG Generations,
+                IN ULONG Count)
+{
+    OBJECT_BASIC_INFORMATION ObjectInfo;
+    PTPP_OBJECT Wait;
+    NTSTATUS Status;
+    BOOLEAN Failed = FALSE;
+    ULONG i;
+
+    /* Check the snapshotted handles without waiting on them, a wait could consume a signal */
+    for (i = 0; i < Count; i++)
+    {
+        Status = NtQueryObject(Handles[i],
+                               ObjectBasicInformation,
+                               &ObjectInfo,
+                               sizeof(ObjectInfo),
+                               NULL);
+        if (NT_SUCCESS(Status) && !(ObjectInfo.GrantedAccess & SYNCHRONIZE))
+            Status = STATUS_ACCESS_DENIED;
+        if (NT_SUCCESS(Status))
+            continue;
+
+        RtlEnterCriticalSection(&TppWaitLock);
+        if (Bucket->Generation[Slots[i]] == Generations[i])
+        {
+            DPRINT1("Failing wait on handle %p: 0x%lx\n", Handles[i], Status);
+            Wait = Bucket->Waits[Slots[i]];
+            TppRemoveWait(Wait);
+            Wait->u.Wait.Result = WAIT_FAILED;
+            TppEnqueue(Wait);
+        }
+        RtlLeaveCriticalSection(&TppWaitLock);
+        Failed = TRUE;
+    }
+
+    return Failed;
+}
+
+static
+DWORD
+WINAPI
+TppWaitThread(IN LPVOID Parameter)
+{
+    PTPP_WAIT_BUCKET Bucket = Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    ULONG Slots[TPP_WAITS_PER_BUCKET];
+    ULONG Generations[TPP_WAITS_PER_BUCKET];
+    LARGE_INTEGER Timeout;
+    PTPP_OBJECT Wait;
+    NTSTATUS Status;
+    ULONG Count, Index, i;
+
+    for (;;)
+    {
+        /* Snapshot the handles, slots can change as soon as we unlock */
+        RtlEnterCriticalSection(&TppWaitLock);
+        Handles[0] = Bucket->UpdateEvent;
+        Timeout.QuadPart = TPP_INFINITE;
+        Count = 0;
+        for (i = 0; i < TPP_WAITS_PER_BUCKET; i++)
+        {
+            Wait = Bucket->Waits[i];
+            if (!Wait)
+                continue;
+
+            Handles[Count + 1] = Wait->u.Wait.Handle;
+            Slots[Count] = i;
+            Generations[Count] = Bucket->Generation[i];
+            if (Wait->u.Wait.Timeout < Timeout.QuadPart)
+                Timeout.QuadPart = Wait->u.Wait.Timeout;
+            Count++;
+        }
+        RtlLeaveCriticalSection(&TppWaitLock);
+
+        /* An empty bucket only waits for new waits, and not forever */
+        if (!Count)
+            Timeout.QuadPart = TPP_WAIT_IDLE_TIMEOUT;
+
+        Status = NtWaitForMultipleObjects(Count + 1,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          (Timeout.QuadPart == TPP_INFINITE) ? NULL : &Timeout);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Most likely a handle closed behind our back, fail the waits on it */
+            DPRINT1("Pool wait failed: 0x%lx\n", Status);
+            if (!TppFailBadWaits(Bucket, &Handles[1], Slots, Generations, Count))
+            {
+                /* No culprit found, don't spin but retry after a while */
+                Timeout.QuadPart = -1000LL * 10000;
+                NtWaitForSingleObject(Bucket->UpdateEvent, FALSE, &Timeout);
+            }
+            continue;
+        }
+
+        RtlEnterCriticalSection(&TppWaitLock);
+        if (Status == STATUS_TIMEOUT && !Count && !Bucket->Count)
+        {
+            /* Nobody can find the bucket once it is off the list */
+            RemoveEntryList(&Bucket->Link);
+            RtlLeaveCriticalSection(&TppWaitLock);
+            break;
+        }
+
+        Index = Count;
+        if (Status >= STATUS_WAIT_1 && Status <= STATUS_WAIT_0 + Count)
+            Index = Status - STATUS_WAIT_1;
+        else if (Status >= STATUS_ABANDONED_WAIT_0 + 1 && Status <= STATUS_ABANDONED_WAIT_0 + Count)
+            Index = Status - (STATUS_ABANDONED_WAIT_0 + 1);
+
+        /* Only fire if the slot still holds the wait we snapshotted */
+        if (Index < Count && Bucket->Generation[Slots[Index]] == Generations[Index])
+        {
+            Wait = Bucket->Waits[Slots[Index]];
+            TppRemoveWait(Wait);
+            Wait->u.Wait.Result = WAIT_OBJECT_0;
+            TppEnqueue(Wait);
+        }
+
+        TppCheckWaitTimeouts(Bucket);
+        RtlLeaveCriticalSection(&TppWaitLock);
+    }
+
+    NtClose(Bucket->UpdateEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Must be called with the wait lock held */
+static
+PTPP_WAIT_BUCKET
+TppGetWaitBucket(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTPP_WAIT_BUCKET Bucket;
+    NTSTATUS Status;
+
+    for (Entry = TppWaitBuckets.Flink; Entry != &TppWaitBuckets; Entry = Entry->Flink)
+    {
+        Bucket = CONTAINING_RECORD(Entry, TPP_WAIT_BUCKET, Link);
+        if (Bucket->Count < TPP_WAITS_PER_BUCKET)
+            return Bucket;
+    }
+
+    Bucket = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TPP_WAIT_BUCKET));
+    if (!Bucket)
+        return NULL;
+
+    Status = NtCreateEvent(&Bucket->UpdateEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (NT_SUCCESS(Status))
+    {
+        Status = TppStartThread(TppWaitThread, Bucket, NULL);
+        if (!NT_SUCCESS(Status))
+            NtClose(Bucket->UpdateEvent);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create a wait bucket: 0x%lx\n", Status);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+        return NULL;
+    }
+
+    InsertTailList(&TppWaitBuckets, &Bucket->Link);
+    return Bucket;
+}
+
+static
+VOID
+TppCancelWait(IN PTPP_OBJECT Wait)
+{
+    RtlEnterCriticalSection(&TppWaitLock);
+    TppRemoveWait(Wait);
+    RtlLeaveCriticalSection(&TppWaitLock);
+}
+
+static
+VOID
+TppReleaseObject(IN PTPP_OBJECT Object)
+{
+    if (Object->Type == TppTimerObject)
+        TppCancelTimer(Object);
+    else if (Object->Type == TppWaitObject)
+        TppCancelWait(Object);
+
+    if (!InterlockedExchange(&Object->Released, TRUE))
+        TppDereferenceObject(Object);
+}
+
+VOID
+RtlpInitializeThreadPool(VOID)
+{
+    RtlInitializeCriticalSection(&TppTimerLock);
+    InitializeListHead(&TppPoolList);
+    RtlInitializeCriticalSection(&TppWaitLock);
+    InitializeListHead(&TppWaitBuckets);
+}
+
+/* FUNCTIONS ****************************************************************/
+
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *Pool,
+            IN PVOID Reserved)
+{
+    return TppAllocPool((PTPP_POOL *)Pool);
+}
+
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    TppDereferencePool((PTPP_POOL)Pool);
+}
+
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MaxThreads)
+{
+    PTPP_POOL Pool2 = (PTPP_POOL)Pool;
+
+    if (MaxThreads < 1)
+        MaxThreads = 1;
+    if (MaxThreads > TPP_MAX_WORKERS)
+        MaxThreads = TPP_MAX_WORKERS;
+
+    RtlEnterCriticalSection(&Pool2->Lock);
+    Pool2->MaxThreads = MaxThreads;
+    if (Pool2->MinThreads > MaxThreads)
+        Pool2->MinThreads = MaxThreads;
+    RtlLeaveCriticalSection(&Pool2->Lock);
+}
+
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MinThreads)
+{
+    PTPP_POOL Pool2 = (PTPP_POOL)Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (MinThreads < 0 || MinThreads > TPP_MAX_WORKERS)
+        return STATUS_INVALID_PARAMETER;
+
+    RtlEnterCriticalSection(&Pool2->Lock);
+    Pool2->MinThreads = MinThreads;
+    if (Pool2->MaxThreads < MinThreads)
+        Pool2->MaxThreads = MinThreads;
+
+    while (Pool2->ThreadCount < MinThreads)
+    {
+        if (!TppStartWorker(Pool2))
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+    }
+    RtlLeaveCriticalSection(&Pool2->Lock);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroup)
+{
+    PTPP_CLEANUP_GROUP Group;
+
+    Group = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(TPP_CLEANUP_GROUP));
+    if (!Group)
+        return STATUS_NO_MEMORY;
+
+    RtlInitializeCriticalSection(&Group->Lock);
+    InitializeListHead(&Group->Members);
+
+    *CleanupGroup = (PTP_CLEANUP_GROUP)Group;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    PTPP_CLEANUP_GROUP Group = (PTPP_CLEANUP_GROUP)CleanupGroup;
+
+    RtlDeleteCriticalSection(&Group->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Group);
+}
+
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN BOOLEAN CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    PTPP_CLEANUP_GROUP Group = (PTPP_CLEANUP_GROUP)CleanupGroup;
+    PTPP_OBJECT Object;
+    PLIST_ENTRY Entry;
+    LONG RefCount;
+
+    for (;;)
+    {
+        /* Pick a member that is not already on its way out */
+        Object = NULL;
+        RtlEnterCriticalSection(&Group->Lock);
+        for (Entry = Group->Members.Flink; Entry != &Group->Members; Entry = Entry->Flink)
+        {
+            Object = CONTAINING_RECORD(Entry, TPP_OBJECT, GroupLink);
+            RefCount = *(volatile LONG *)&Object->RefCount;
+            if (RefCount > 0 &&
+                InterlockedCompareExchange(&Object->RefCount, RefCount + 1, RefCount) == RefCount)
+            {
+                RemoveEntryList(&Object->GroupLink);
+                Object->Group = NULL;
+                break;
+            }
+            Object = NULL;
+        }
+        RtlLeaveCriticalSection(&Group->Lock);
+
+        if (!Object)
+            break;
+
+        if (Object->Type == TppTimerObject)
+            TppCancelTimer(Object);
+        else if (Object->Type == TppWaitObject)
+            TppCancelWait(Object);
+
+        TppWaitForCallbacks(Object, CancelPendingCallbacks);
+
+        if (CancelPendingCallbacks && Object->CancelCallback)
+            Object->CancelCallback(Object->Context, CleanupParameter);
+
+        TppReleaseObject(Object);
+        TppDereferenceObject(Object);
+    }
+}
+
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *Work,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)Work, TppWorkObject, Callback, Context, Environment);
+}
+
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    TppEnqueue((PTPP_OBJECT)Work);
+}
+
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    TppReleaseObject((PTPP_OBJECT)Work);
+}
+
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(&Object, TppSimpleObject, Callback, Context, Environment);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* The queued callback keeps the object alive, nobody else owns it */
+    Object->Released = TRUE;
+    if (!TppEnqueue(Object))
+        Status = STATUS_NO_MEMORY;
+    TppDereferenceObject(Object);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *Timer,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)Timer, TppTimerObject, Callback, Context, Environment);
+}
+
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN LONG Period,
+           IN LONG WindowLength)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+
+    RtlEnterCriticalSection(&TppTimerLock);
+
+    if (Object->u.Timer.Pending)
+        TppRemoveTimer(Object);
+
+    Object->u.Timer.Set = (DueTime != NULL) && TppStartTimerThread();
+    if (Object->u.Timer.Set)
+    {
+        Object->u.Timer.DueTime = TppAbsoluteTime(DueTime);
+        Object->u.Timer.Period = (ULONG)max(Period, 0);
+        Object->u.Timer.Window = (ULONG)max(WindowLength, 0);
+        if (!TppInsertTimer(Object))
+        {
+            DPRINT1("Failed to grow the timer heap\n");
+            Object->u.Timer.Set = FALSE;
+        }
+
+        /* The timer thread only needs to know if its next deadline moved */
+        else if (Object->u.Timer.HeapIndex == 0)
+            NtSetEvent(TppTimerEvent, NULL);
+    }
+
+    RtlLeaveCriticalSection(&TppTimerLock);
+}
+
+BOOL
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    TppReleaseObject((PTPP_OBJECT)Timer);
+}
+
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *Wait,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)Wait, TppWaitObject, Callback, Context, Environment);
+}
+
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    PTPP_WAIT_BUCKET Bucket;
+    ULONG Slot;
+
+    RtlEnterCriticalSection(&TppWaitLock);
+    TppRemoveWait(Object);
+
+    if (Handle)
+    {
+        Bucket = TppGetWaitBucket();
+        if (Bucket)
+        {
+            for (Slot = 0; Bucket->Waits[Slot]; Slot++);
+
+            Object->u.Wait.Handle = Handle;
+            Object->u.Wait.Timeout = TppAbsoluteTime(Timeout);
+            Object->u.Wait.Bucket = Bucket;
+            Object->u.Wait.Slot = Slot;
+            Bucket->Waits[Slot] = Object;
+            Bucket->Generation[Slot]++;
+            Bucket->Count++;
+            NtSetEvent(Bucket->UpdateEvent, NULL);
+        }
+    }
+
+    RtlLeaveCriticalSection(&TppWaitLock);
+}
+
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TppReleaseObject((PTPP_OBJECT)Wait);
+}
+
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_CALLBACK_INSTANCE Instance2 = (PTPP_CALLBACK_INSTANCE)Instance;
+    PTPP_POOL Pool = Instance2->Object->Pool;
+
+    if (!Instance2->MayRunLong)
+    {
+        Instance2->MayRunLong = TRUE;
+        InterlockedIncrement(&Pool->LongCount);
+    }
+
+    /* Make sure the rest of the queue does not wait on us */
+    if (*(volatile LONG *)&Pool->IdleCount == 0)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (Pool->ThreadCount >= Pool->MaxThreads || !TppStartWorker(Pool))
+        {
+            RtlLeaveCriticalSection(&Pool->Lock);
+            return STATUS_TOO_MANY_THREADS;
+        }
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_CALLBACK_INSTANCE Instance2 = (PTPP_CALLBACK_INSTANCE)Instance;
+
+    if (!Instance2->Disassociated)
+    {
+        Instance2->Disassociated = TRUE;
+        TppCallbackDone(Instance2->Object);
+    }
+}
+
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    ((PTPP_CALLBACK_INSTANCE)Instance)->Event = Event;
+}
+
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN ULONG ReleaseCount)
+{
+    ((PTPP_CALLBACK_INSTANCE)Instance)->Semaphore = Semaphore;
+    ((PTPP_CALLBACK_INSTANCE)Instance)->SemaphoreCount = ReleaseCount;
+}
+
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    ((PTPP_CALLBACK_INSTANCE)Instance)->Mutex = Mutex;
+}
+
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    ((PTPP_CALLBACK_INSTANCE)Instance)->CriticalSection = CriticalSection;
+}
@@ -176,6 +176,18 @@ FindFile(
             ExFreePool(PathNameBuffer);
             return Status;
         }
+
+        /* Large directories are looked up through their name index */
+        Status = vfatDirIndexFind(DeviceExt, Parent, FileToFindU, DirContext);
+        if (Status != STATUS_NOT_SUPPORTED)
+        {
+            if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+            {
+                Status = STATUS_NO_MORE_ENTRIES;
+            }
+            ExFreePool(PathNameBuffer);
+            return Status;
+        }
     }
 
     /* FsRtlIsNameInExpression need the searched string to be upcase,
@@ -0,0 +1,436 @@
+/*
+ * COPYRIGHT:        See COPYING in the top level directory
+ * PROJECT:          ReactOS kernel
+ * FILE:             drivers/filesystems/fastfat/dirindex.c
+ * PURPOSE:          In-memory name index of large directories
+ *
+ */
+
+/*
+ * Looking a name up in a FAT directory means reading every entry until the
+ * name shows up. For large directories, the first lookup builds a hash table
+ * of the long and short names of the entries instead, so following lookups
+ * only read the entries whose name hash matches. The table is kept up to date
+ * by VfatAddEntry() and VfatDelEntry(), and thrown away whenever it cannot be
+ * trusted or there is no memory for it: the callers then scan the directory
+ * as they always did.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "vfat.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS ******************************************************************/
+
+/* Directories smaller than this are scanned, it's cheap enough */
+#define DIR_INDEX_MIN_SIZE      (32 * 1024)
+
+#define DIR_INDEX_INITIAL_SIZE  1024
+
+/* Upper bound of the slots of all indexes, about 3MB of paged pool */
+#define DIR_INDEX_MAX_SLOTS     (256 * 1024)
+
+#define DIR_INDEX_EMPTY         0xffffffff
+#define DIR_INDEX_DELETED       0xfffffffe
+
+typedef struct _VFAT_DIR_INDEX_SLOT
+{
+    ULONG Hash;
+    /* Index of the short name entry, or one of the markers above */
+    ULONG DirIndex;
+    /* Index of the first long name entry */
+    ULONG StartIndex;
+} VFAT_DIR_INDEX_SLOT, *PVFAT_DIR_INDEX_SLOT;
+
+typedef struct _VFAT_DIR_INDEX
+{
+    /* Always a power of two */
+    ULONG Size;
+    /* Live and deleted slots */
+    ULONG Used;
+    VFAT_DIR_INDEX_SLOT Slots[ANYSIZE_ARRAY];
+} VFAT_DIR_INDEX, *PVFAT_DIR_INDEX;
+
+static LONG DirIndexSlots = 0;
+
+/* FUNCTIONS ****************************************************************/
+
+static
+ULONG
+vfatDirIndexHash(
+    PUNICODE_STRING NameU)
+{
+    ULONG Hash = 0;
+    USHORT i;
+
+    /* Case insensitive, as the name comparisons are */
+    for (i = 0; i < NameU->Length / sizeof(WCHAR); i++)
+    {
+        Hash = (Hash + RtlUpcaseUnicodeChar(NameU->Buffer[i])) * 31;
+    }
+
+    return Hash;
+}
+
+static
+PVFAT_DIR_INDEX
+vfatDirIndexAllocate(
+    ULONG Size)
+{
+    PVFAT_DIR_INDEX Index;
+    ULONG i;
+
+    if (InterlockedExchangeAdd(&DirIndexSlots, Size) + Size > DIR_INDEX_MAX_SLOTS)
+    {
+        InterlockedExchangeAdd(&DirIndexSlots, -(LONG)Size);
+        return NULL;
+    }
+
+    Index = ExAllocatePoolWithTag(PagedPool,
+                                  FIELD_OFFSET(VFAT_DIR_INDEX, Slots[Size]),
+                                  TAG_DIR_INDEX);
+    if (Index == NULL)
+    {
+        InterlockedExchangeAdd(&DirIndexSlots, -(LONG)Size);
+        return NULL;
+    }
+
+    Index->Size = Size;
+    Index->Used = 0;
+    for (i = 0; i < Size; i++)
+    {
+        Index->Slots[i].DirIndex = DIR_INDEX_EMPTY;
+    }
+
+    return Index;
+}
+
+static
+VOID
+vfatDirIndexFree(
+    PVFAT_DIR_INDEX Index)
+{
+    InterlockedExchangeAdd(&DirIndexSlots, -(LONG)Index->Size);
+    ExFreePoolWithTag(Index, TAG_DIR_INDEX);
+}
+
+VOID
+vfatDirIndexDiscard(
+    PVFATFCB pDirFcb)
+{
+    if (pDirFcb->NameIndex != NULL)
+    {
+        DPRINT("Discarding name index of %wZ\n", &pDirFcb->PathNameU);
+        vfatDirIndexFree(pDirFcb->NameIndex);
+        pDirFcb->NameIndex = NULL;
+    }
+}
+
+static
+VOID
+vfatDirIndexStore(
+    PVFAT_DIR_INDEX Index,
+    ULONG Hash,
+    ULONG DirIndex,
+    ULONG StartIndex)
+{
+    ULONG Mask = Index->Size - 1;
+    ULONG i;
+
+    for (i = Hash & Mask; ; i = (i + 1) & Mask)
+    {
+        if (Index->Slots[i].DirIndex == DIR_INDEX_DELETED)
+        {
+            break;
+        }
+        if (Index->Slots[i].DirIndex == DIR_INDEX_EMPTY)
+        {
+            Index->Used++;
+            break;
+        }
+    }
+
+    Index->Slots[i].Hash = Hash;
+    Index->Slots[i].DirIndex = DirIndex;
+    Index->Slots[i].StartIndex = StartIndex;
+}
+
+/*
+ * Adds a name to the index of pDirFcb, growing it when it gets half full.
+ * On failure, the index is discarded.
+ */
+static
+BOOLEAN
+vfatDirIndexAdd(
+    PVFATFCB pDirFcb,
+    PUNICODE_STRING NameU,
+    ULONG DirIndex,
+    ULONG StartIndex)
+{
+    PVFAT_DIR_INDEX Index = pDirFcb->NameIndex, NewIndex;
+    ULONG i;
+
+    if ((Index->Used + 1) * 2 > Index->Size)
+    {
+        NewIndex = vfatDirIndexAllocate(Index->Size * 2);
+        if (NewIndex == NULL)
+        {
+            vfatDirIndexDiscard(pDirFcb);
+            return FALSE;
+        }
+
+        /* Rehashing also drops the deleted slots */
+        for (i = 0; i < Index->Size; i++)
+        {
+            if (Index->Slots[i].DirIndex < DIR_INDEX_DELETED)
+            {
+                vfatDirIndexStore(NewIndex, Index->Slots[i].Hash,
+                                  Index->Slots[i].DirIndex, Index->Slots[i].StartIndex);
+            }
+        }
+
+        vfatDirIndexFree(Index);
+        pDirFcb->NameIndex = Index = NewIndex;
+    }
+
+    vfatDirIndexStore(Index, vfatDirIndexHash(NameU), DirIndex, StartIndex);
+    return TRUE;
+}
+
+static
+VOID
+vfatDirIndexDelete(
+    PVFAT_DIR_INDEX Index,
+    PUNICODE_STRING NameU,
+    ULONG DirIndex)
+{
+    ULONG Hash = vfatDirIndexHash(NameU);
+    ULONG Mask = Index->Size - 1;
+    ULONG i;
+
+    for (i = Hash & Mask; Index->Slots[i].DirIndex != DIR_INDEX_EMPTY; i = (i + 1) & Mask)
+    {
+        if (Index->Slots[i].DirIndex == DirIndex && Index->Slots[i].Hash == Hash)
+        {
+            Index->Slots[i].DirIndex = DIR_INDEX_DELETED;
+            return;
+        }
+    }
+}
+
+/*
+ * Indexes every entry of pDirFcb with a single pass over the directory
+ */
+static
+NTSTATUS
+vfatDirIndexBuild(
+    PDEVICE_EXTENSION pDeviceExt,
+    PVFATFCB pDirFcb)
+{
+    NTSTATUS Status;
+    PVOID Context = NULL;
+    PVOID Page = NULL;
+    BOOLEAN First = TRUE;
+    VFAT_DIRENTRY_CONTEXT DirContext;
+    WCHAR LongNameBuffer[260];
+    WCHAR ShortNameBuffer[13];
+
+    pDirFcb->NameIndex = vfatDirIndexAllocate(DIR_INDEX_INITIAL_SIZE);
+    if (pDirFcb->NameIndex == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    DirContext.DirIndex = 0;
+    DirContext.LongNameU.Buffer = LongNameBuffer;
+    DirContext.LongNameU.Length = 0;
+    DirContext.LongNameU.MaximumLength = sizeof(LongNameBuffer);
+    DirContext.ShortNameU.Buffer = ShortNameBuffer;
+    DirContext.ShortNameU.Length = 0;
+    DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
+
+    while (TRUE)
+    {
+        Status = VfatGetNextDirEntry(pDeviceExt, &Context, &Page, pDirFcb, &DirContext, First);
+        First = FALSE;
+        if (Status == STATUS_NO_MORE_ENTRIES)
+        {
+            break;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            vfatDirIndexDiscard(pDirFcb);
+            return Status;
+        }
+
+        /* Skip what the scans skip */
+        if (!ENTRY_VOLUME(FALSE, &DirContext.DirEntry) &&
+            DirContext.LongNameU.Length != 0 &&
+            DirContext.ShortNameU.Length != 0)
+        {
+            if (!vfatDirIndexAdd(pDirFcb, &DirContext.LongNameU, DirContext.DirIndex, DirContext.StartIndex) ||
+                !vfatDirIndexAdd(pDirFcb, &DirContext.ShortNameU, DirContext.DirIndex, DirContext.StartIndex))
+            {
+                if (Context)
+                {
+                    CcUnpinData(Context);
+                }
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+        }
+        DirContext.DirIndex++;
+    }
+
+    DPRINT("Built name index of %wZ, %u slots\n", &pDirFcb->PathNameU, pDirFcb->NameIndex->Used);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Looks a name up through the name index of a directory, building
+ *           the index first if needed. On input, DirContext->DirIndex is the
+ *           first entry to consider, and the name buffers of DirContext
+ *           must be set up. Returns STATUS_NOT_SUPPORTED when the directory
+ *           has no usable index and must be scanned instead.
+ */
+NTSTATUS
+vfatDirIndexFind(
+    PDEVICE_EXTENSION pDeviceExt,
+    PVFATFCB pDirFcb,
+    PUNICODE_STRING FileToFindU,
+    PVFAT_DIRENTRY_CONTEXT DirContext)
+{
+    PVFAT_DIR_INDEX Index;
+    ULONG Hash, Mask, i;
+    ULONG MinIndex = DirContext->DirIndex;
+    ULONG Best;
+    PVFAT_DIR_INDEX_SLOT BestSlot;
+    PVOID Context;
+    PVOID Page;
+    NTSTATUS Status;
+
+    /* FATX directories are small and have their own "." and ".." handling */
+    if (vfatVolumeIsFatX(pDeviceExt))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (pDirFcb->NameIndex == NULL)
+    {
+        if (pDirFcb->RFCB.FileSize.u.LowPart < DIR_INDEX_MIN_SIZE ||
+            !NT_SUCCESS(vfatDirIndexBuild(pDeviceExt, pDirFcb)))
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+
+    Index = pDirFcb->NameIndex;
+    Hash = vfatDirIndexHash(FileToFindU);
+    Mask = Index->Size - 1;
+
+    while (TRUE)
+    {
+        /* Take the candidate coming first in the directory */
+        Best = DIR_INDEX_DELETED;
+        BestSlot = NULL;
+        for (i = Hash & Mask; Index->Slots[i].DirIndex != DIR_INDEX_EMPTY; i = (i + 1) & Mask)
+        {
+            if (Index->Slots[i].Hash == Hash &&
+                Index->Slots[i].DirIndex >= MinIndex &&
+                Index->Slots[i].DirIndex < Best)
+            {
+                Best = Index->Slots[i].DirIndex;
+                BestSlot = &Index->Slots[i];
+            }
+        }
+
+        if (BestSlot == NULL)
+        {
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+
+        /* Read it back, the index only holds positions */
+        Context = NULL;
+        DirContext->DirIndex = BestSlot->StartIndex;
+        Status = VfatGetNextDirEntry(pDeviceExt, &Context, &Page, pDirFcb, DirContext, TRUE);
+        if (Context)
+        {
+            CcUnpinData(Context);
+        }
+
+        if (!NT_SUCCESS(Status) || DirContext->DirIndex != Best ||
+            (vfatDirIndexHash(&DirContext->LongNameU) != Hash &&
+             vfatDirIndexHash(&DirContext->ShortNameU) != Hash))
+        {
+            DPRINT1("Name index of %wZ out of date at %u\n", &pDirFcb->PathNameU, Best);
+            vfatDirIndexDiscard(pDirFcb);
+            DirContext->DirIndex = MinIndex;
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        if (RtlEqualUnicodeString(FileToFindU, &DirContext->LongNameU, TRUE) ||
+            RtlEqualUnicodeString(FileToFindU, &DirContext->ShortNameU, TRUE))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        /* Another name with the same hash, look further */
+        MinIndex = Best + 1;
+    }
+}
+
+/*
+ * FUNCTION: Records the names of a new entry of pDirFcb
+ */
+VOID
+vfatDirIndexInsert(
+    PVFATFCB pDirFcb,
+    PVFATFCB pFcb)
+{
+    if (pDirFcb->NameIndex == NULL)
+    {
+        return;
+    }
+
+    if (pFcb->LongNameU.Length == 0 || pFcb->ShortNameU.Length == 0)
+    {
+        /* Can't happen with names we wrote, but don't guess */
+        vfatDirIndexDiscard(pDirFcb);
+        return;
+    }
+
+    if (vfatDirIndexAdd(pDirFcb, &pFcb->LongNameU, pFcb->dirIndex, pFcb->startIndex))
+    {
+        vfatDirIndexAdd(pDirFcb, &pFcb->ShortNameU, pFcb->dirIndex, pFcb->startIndex);
+    }
+}
+
+/*
+ * FUNCTION: Forgets the names of an entry removed from its parent directory.
+ *           If the removal failed half way, the whole index is dropped.
+ */
+VOID
+vfatDirIndexRemove(
+    PVFATFCB pFcb,
+    BOOLEAN Deleted)
+{
+    PVFATFCB pDirFcb = pFcb->parentFcb;
+
+    if (pDirFcb == NULL || pDirFcb->NameIndex == NULL)
+    {
+        return;
+    }
+
+    if (!Deleted)
+    {
+        vfatDirIndexDiscard(pDirFcb);
+        return;
+    }
+
+    vfatDirIndexDelete(pDirFcb->NameIndex, &pFcb->LongNameU, pFcb->dirIndex);
+    vfatDirIndexDelete(pDirFcb->NameIndex, &pFcb->ShortNameU, pFcb->dirIndex);
+}
+
+/* EOF */
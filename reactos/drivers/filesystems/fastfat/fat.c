@@ -19,6 +19,9 @@
 #define  CACHEPAGESIZE(pDeviceExt) ((pDeviceExt)->FatInfo.BytesPerCluster > PAGE_SIZE ? \
 		   (pDeviceExt)->FatInfo.BytesPerCluster : PAGE_SIZE)
 
+/* Length of the free run a file is moved to when it cannot grow in place */
+#define FREE_CLUSTER_RUN 16
+
 /* FUNCTIONS ****************************************************************/
 
 /*
@@ -371,12 +374,14 @@ FAT32FindAndMarkAvailableCluster(
 }
 
 /*
- * FUNCTION: Counts free cluster in a FAT12 table
+ * FUNCTION: Counts free cluster in a FAT12 table, and marks them in Bitmap
+ *           if one is given
  */
 static
 NTSTATUS
 FAT12CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     ULONG Entry;
     PVOID BaseAddress;
@@ -413,7 +418,11 @@ FAT12CountAvailableClusters(
         }
 
         if (Entry == 0)
+        {
             ulCount++;
+            if (Bitmap)
+                RtlSetBit(Bitmap, i);
+        }
     }
 
     CcUnpinData(Context);
@@ -430,7 +439,8 @@ FAT12CountAvailableClusters(
 static
 NTSTATUS
 FAT16CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     PUSHORT Block;
     PUSHORT BlockEnd;
@@ -464,7 +474,11 @@ FAT16CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if (*Block == 0)
+            {
                 ulCount++;
+                if (Bitmap)
+                    RtlSetBit(Bitmap, i);
+            }
             Block++;
             i++;
         }
@@ -485,7 +499,8 @@ FAT16CountAvailableClusters(
 static
 NTSTATUS
 FAT32CountAvailableClusters(
-    PDEVICE_EXTENSION DeviceExt)
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
 {
     PULONG Block;
     PULONG BlockEnd;
@@ -520,7 +535,11 @@ FAT32CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if ((*Block & 0x0fffffff) == 0)
+            {
                 ulCount++;
+                if (Bitmap)
+                    RtlSetBit(Bitmap, i);
+            }
             Block++;
             i++;
         }
@@ -534,6 +553,84 @@ FAT32CountAvailableClusters(
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+ScanAvailableClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    PRTL_BITMAP Bitmap)
+{
+    if (DeviceExt->FatInfo.FatType == FAT12)
+        return FAT12CountAvailableClusters(DeviceExt, Bitmap);
+    else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
+        return FAT16CountAvailableClusters(DeviceExt, Bitmap);
+    else
+        return FAT32CountAvailableClusters(DeviceExt, Bitmap);
+}
+
+/*
+ * FUNCTION: Builds the in-memory free cluster bitmap with a single pass over
+ *           the FAT, which also refreshes the free cluster count.
+ *           The caller must hold the FAT resource exclusively.
+ */
+static
+NTSTATUS
+BuildFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    NTSTATUS Status;
+    PULONG Buffer;
+    ULONG Size;
+
+    if (DeviceExt->FreeClusterBitmap.Buffer)
+        return STATUS_SUCCESS;
+
+    /* Index the bitmap by cluster number, the two reserved entries stay clear */
+    Size = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(Size, 32) / 8, TAG_BITMAP);
+    if (Buffer == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlInitializeBitMap(&DeviceExt->FreeClusterBitmap, Buffer, Size);
+    RtlClearAllBits(&DeviceExt->FreeClusterBitmap);
+
+    Status = ScanAvailableClusters(DeviceExt, &DeviceExt->FreeClusterBitmap);
+    if (!NT_SUCCESS(Status))
+    {
+        DestroyFreeClusterBitmap(DeviceExt);
+        return Status;
+    }
+
+    DPRINT("Built free cluster bitmap, %u free clusters of %u\n",
+           DeviceExt->AvailableClusters, DeviceExt->FatInfo.NumberOfClusters);
+    return STATUS_SUCCESS;
+}
+
+VOID
+DestroyFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FreeClusterBitmap.Buffer)
+    {
+        ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
+        DeviceExt->FreeClusterBitmap.Buffer = NULL;
+    }
+}
+
+/*
+ * FUNCTION: Drops the free cluster bitmap and the free cluster count, so both
+ *           are read from the FAT again. Used when the FAT may have changed
+ *           behind our back, e.g. while the media was out of the drive.
+ *           The caller must hold the FAT resource exclusively.
+ */
+VOID
+InvalidateFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    DestroyFreeClusterBitmap(DeviceExt);
+    DeviceExt->AvailableClustersValid = FALSE;
+    DeviceExt->LastAvailableCluster = 2;
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
@@ -543,12 +640,11 @@ CountAvailableClusters(
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
-        if (DeviceExt->FatInfo.FatType == FAT12)
-            Status = FAT12CountAvailableClusters(DeviceExt);
-        else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
-            Status = FAT16CountAvailableClusters(DeviceExt);
-        else
-            Status = FAT32CountAvailableClusters(DeviceExt);
+        /* The scan is needed anyway, so build the bitmap along with it */
+        if (!DeviceExt->FreeClusterBitmap.Buffer)
+            Status = BuildFreeClusterBitmap(DeviceExt);
+        if (!DeviceExt->AvailableClustersValid)
+            Status = ScanAvailableClusters(DeviceExt, NULL);
     }
     Clusters->QuadPart = DeviceExt->AvailableClusters;
     ExReleaseResourceLite (&DeviceExt->FatResource);
@@ -556,6 +652,84 @@ CountAvailableClusters(
     return Status;
 }
 
+/*
+ * FUNCTION: Finds a free cluster, as close as possible after HintCluster,
+ *           and marks it as the end of a chain.
+ *           The caller must hold the FAT resource exclusively.
+ */
+static
+NTSTATUS
+FindAndMarkAvailableCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG HintCluster,
+    PULONG Cluster)
+{
+    NTSTATUS Status;
+    ULONG NewCluster, OldValue, Attempt;
+
+    if (!DeviceExt->FreeClusterBitmap.Buffer &&
+        !NT_SUCCESS(BuildFreeClusterBitmap(DeviceExt)))
+    {
+        /* No memory for the bitmap, scan the FAT itself */
+        return DeviceExt->FindAndMarkAvailableCluster(DeviceExt, Cluster);
+    }
+
+    if (HintCluster < 2 || HintCluster >= DeviceExt->FreeClusterBitmap.SizeOfBitMap)
+        HintCluster = DeviceExt->LastAvailableCluster;
+
+    /* Take the cluster right after the current end of the file when it is
+     * free. Otherwise, start the file over at the beginning of a free run,
+     * so the following extends can stay contiguous */
+    NewCluster = ~0U;
+    if (RtlCheckBit(&DeviceExt->FreeClusterBitmap, HintCluster))
+        NewCluster = HintCluster;
+
+    for (Attempt = 0; ; Attempt++)
+    {
+        if (NewCluster == ~0U)
+            NewCluster = RtlFindSetBits(&DeviceExt->FreeClusterBitmap, FREE_CLUSTER_RUN, HintCluster);
+        if (NewCluster == ~0U)
+            NewCluster = RtlFindSetBits(&DeviceExt->FreeClusterBitmap, 1, HintCluster);
+        if (NewCluster == ~0U)
+            return STATUS_DISK_FULL;
+
+        ASSERT(NewCluster >= 2);
+        Status = DeviceExt->WriteCluster(DeviceExt, NewCluster, 0xffffffff, &OldValue);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        if (OldValue == 0)
+            break;
+
+        /* The bitmap disagrees with the FAT: give the entry its value back
+         * and never hand that cluster out again */
+        DPRINT1("WARNING: Free cluster bitmap out of sync for 0x%x (0x%x)\n", NewCluster, OldValue);
+        Status = DeviceExt->WriteCluster(DeviceExt, NewCluster, OldValue, &OldValue);
+        if (!NT_SUCCESS(Status))
+            return Status;
+        RtlClearBit(&DeviceExt->FreeClusterBitmap, NewCluster);
+
+        if (Attempt > 0)
+        {
+            /* Don't trust the bitmap any longer, it will be rebuilt from
+             * the FAT on the next allocation */
+            InvalidateFreeClusterBitmap(DeviceExt);
+            return DeviceExt->FindAndMarkAvailableCluster(DeviceExt, Cluster);
+        }
+
+        HintCluster = NewCluster;
+        NewCluster = ~0U;
+    }
+
+    RtlClearBit(&DeviceExt->FreeClusterBitmap, NewCluster);
+    DeviceExt->LastAvailableCluster = *Cluster = NewCluster;
+    if (DeviceExt->AvailableClustersValid)
+        InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+
+    DPRINT("Found available cluster 0x%x\n", NewCluster);
+    return STATUS_SUCCESS;
+}
+
 
 /*
  * FUNCTION: Writes a cluster to the FAT12 physical and in-memory tables
@@ -706,6 +880,14 @@ WriteCluster(
 
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->WriteCluster(DeviceExt, ClusterToWrite, NewValue, &OldValue);
+    if (NT_SUCCESS(Status) && DeviceExt->FreeClusterBitmap.Buffer &&
+        ClusterToWrite >= 2 && ClusterToWrite < DeviceExt->FreeClusterBitmap.SizeOfBitMap)
+    {
+        if (NewValue == 0)
+            RtlSetBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+        else
+            RtlClearBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
+    }
     if (DeviceExt->AvailableClustersValid)
     {
         if (OldValue && NewValue == 0)
@@ -782,7 +964,7 @@ GetNextClusterExtend(
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, 0, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -801,7 +983,7 @@ GetNextClusterExtend(
         /* We are after last existing cluster, we must add one to file */
         /* Firstly, find the next available open allocation unit and
            mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, CurrentCluster + 1, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -146,7 +146,7 @@ vfatNewFCB(
     ExInitializeResourceLite(&rcFCB->PagingIoResource);
     ExInitializeResourceLite(&rcFCB->MainResource);
     FsRtlInitializeFileLock(&rcFCB->FileLock, NULL, NULL);
-    ExInitializeFastMutex(&rcFCB->LastMutex);
+    FsRtlInitializeLargeMcb(&rcFCB->ClusterMap, NonPagedPool);
     rcFCB->RFCB.PagingIoResource = &rcFCB->PagingIoResource;
     rcFCB->RFCB.Resource = &rcFCB->MainResource;
     rcFCB->RFCB.IsFastIoPossible = FastIoIsNotPossible;
@@ -265,6 +265,8 @@ vfatDestroyFCB(
     PVFATFCB pFCB)
 {
     FsRtlUninitializeFileLock(&pFCB->FileLock);
+    FsRtlUninitializeLargeMcb(&pFCB->ClusterMap);
+    vfatDirIndexDiscard(pFCB);
     if (!vfatFCBIsRoot(pFCB) &&
         !BooleanFlagOn(pFCB->Flags, FCB_IS_FAT) && !BooleanFlagOn(pFCB->Flags, FCB_IS_VOLUME))
     {
@@ -796,6 +798,19 @@ vfatDirFindFile(
     DirContext.ShortNameU.Length = 0;
     DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
 
+    status = vfatDirIndexFind(pDeviceExt, pDirectoryFCB, FileToFindU, &DirContext);
+    if (status != STATUS_NOT_SUPPORTED)
+    {
+        if (NT_SUCCESS(status))
+        {
+            status = vfatMakeFCBFromDirEntry(pDeviceExt,
+                pDirectoryFCB,
+                &DirContext,
+                pFoundFCB);
+        }
+        return status;
+    }
+
     while (TRUE)
     {
         status = VfatGetNextDirEntry(pDeviceExt,
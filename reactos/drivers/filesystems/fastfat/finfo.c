@@ -1213,7 +1213,7 @@ VfatSetAllocationSizeInformation(
 
     ULONG ClusterSize = DeviceExt->FatInfo.BytesPerCluster;
     ULONG NewSize = AllocationSize->u.LowPart;
-    ULONG NCluster;
+    ULONG NCluster, RunLength;
     BOOLEAN AllocSizeChanged = FALSE, IsFatX = vfatVolumeIsFatX(DeviceExt);
 
     DPRINT("VfatSetAllocationSizeInformation(File <%wZ>, AllocationSize %d %u)\n",
@@ -1241,7 +1241,6 @@ VfatSetAllocationSizeInformation(
         AllocSizeChanged = TRUE;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
             Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
             if (!NT_SUCCESS(Status))
             {
@@ -1291,25 +1290,14 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
+            /* Growing the chain keeps the known runs valid, the new
+               clusters are mapped when they are first accessed */
+            Status = VfatMapFileCluster(DeviceExt, Fcb, FirstCluster,
+                                        Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize - 1,
+                                        &Cluster, &RunLength);
+            if (NT_SUCCESS(Status) && Cluster == 0xffffffff)
             {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
+                Status = STATUS_FILE_CORRUPT_ERROR;
             }
 
             if (!NT_SUCCESS(Status))
@@ -1317,13 +1305,11 @@ VfatSetAllocationSizeInformation(
                 return Status;
             }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
-
             /* FIXME: Check status */
             /* Cluster points now to the last cluster within the chain */
             Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
+                                     ROUND_DOWN(NewSize - 1, ClusterSize) -
+                                     (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize),
                                      &NCluster, TRUE);
             if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
             {
@@ -1355,14 +1341,12 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &Cluster, FALSE);
+            Status = VfatMapFileCluster(DeviceExt, Fcb, FirstCluster,
+                                        (NewSize - 1) / ClusterSize,
+                                        &Cluster, &RunLength);
 
             NCluster = Cluster;
             Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
@@ -1398,6 +1382,9 @@ VfatSetAllocationSizeInformation(
             WriteCluster(DeviceExt, Cluster, 0);
             Cluster = NCluster;
         }
+
+        /* The runs past the new end of file are gone */
+        FsRtlResetLargeMcb(&Fcb->ClusterMap, FALSE);
     }
     else
     {
@@ -870,6 +870,11 @@ VfatVerify(
                 else
                 {
                     DPRINT1("Same volume\n");
+
+                    /* The FAT may have been changed elsewhere meanwhile */
+                    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+                    InvalidateFreeClusterBitmap(DeviceExt);
+                    ExReleaseResourceLite(&DeviceExt->FatResource);
                 }
             }
         }
@@ -1162,6 +1167,9 @@ VfatDismountVolume(
     /* Flush volume & files */
     VfatFlushVolume(DeviceExt, (PVFATFCB)FileObject->FsContext);
 
+    /* Whatever happens to the media now, don't allocate from a stale bitmap */
+    InvalidateFreeClusterBitmap(DeviceExt);
+
     /* Rebrowse the FCB in order to free them now */
     while (!IsListEmpty(&DeviceExt->FcbListHead))
     {
@@ -439,6 +439,8 @@ VfatCheckForDismount(
     {
         PVPB DelVpb;
 
+        DestroyFreeClusterBitmap(DeviceExt);
+
         /* If we have a local VPB, we'll have to delete it
          * but we won't dismount us - something went bad before
          */
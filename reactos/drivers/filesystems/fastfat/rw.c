@@ -15,9 +15,9 @@
 #include <debug.h>
 
 /*
- * Uncomment to enable strict verification of cluster/offset pair
- * caching. If this option is enabled you lose all the benefits of
- * the caching and the read/write operations will actually be
+ * Uncomment to enable strict verification of the cluster run map.
+ * If this option is enabled you lose all the benefits of the
+ * caching and the read/write operations will actually be
  * slower. It's meant only for debugging!!!
  * - Filip Navara, 26/07/2004
  */
@@ -106,6 +106,101 @@ OffsetToCluster(
    }
 }
 
+/*
+ * Return the disk cluster holding the given cluster of a file, along with
+ * the number of clusters that follow it contiguously on disk. The runs are
+ * kept in the FCB run map, which is filled on demand by following the FAT
+ * chain from the last known run. If the map can't take a run, the chain is
+ * walked uncached from there on. Cluster is 0xffffffff past the end of the
+ * chain.
+ */
+NTSTATUS
+VfatMapFileCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FirstCluster,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength)
+{
+    LONGLONG Lbn, Count, LastVbn, LastLbn;
+    ULONG RunVcn, RunStart, RunClusters, CurrentCluster;
+    BOOLEAN Caching = TRUE;
+    NTSTATUS Status;
+
+    ASSERT(FirstCluster > 1);
+
+    if (FsRtlLookupLargeMcbEntry(&Fcb->ClusterMap, FileCluster, &Lbn, &Count, NULL, NULL, NULL) &&
+        Lbn != -1)
+    {
+        *Cluster = (ULONG)Lbn;
+        *RunLength = (ULONG)Count;
+#ifdef DEBUG_VERIFY_OFFSET_CACHING
+        /* DEBUG VERIFICATION */
+        {
+            ULONG CorrectCluster;
+            OffsetToCluster(DeviceExt, FirstCluster,
+                            FileCluster * DeviceExt->FatInfo.BytesPerCluster,
+                            &CorrectCluster, FALSE);
+            if (CorrectCluster != *Cluster)
+                KeBugCheck(FAT_FILE_SYSTEM);
+        }
+#endif
+        return STATUS_SUCCESS;
+    }
+
+    /*
+     * Carry on with the chain after the last known run. A cluster before it
+     * sits in a hole of the map, the chain is then followed from its start.
+     */
+    if (FsRtlLookupLastLargeMcbEntry(&Fcb->ClusterMap, &LastVbn, &LastLbn) &&
+        FileCluster > (ULONG)LastVbn)
+    {
+        Status = GetNextCluster(DeviceExt, (ULONG)LastLbn, &CurrentCluster);
+        if (!NT_SUCCESS(Status))
+            return Status;
+        RunVcn = (ULONG)LastVbn + 1;
+    }
+    else
+    {
+        CurrentCluster = FirstCluster;
+        RunVcn = 0;
+    }
+
+    while (CurrentCluster != 0xffffffff)
+    {
+        RunStart = CurrentCluster;
+        RunClusters = 0;
+        do
+        {
+            RunClusters++;
+            Status = GetNextCluster(DeviceExt, CurrentCluster, &CurrentCluster);
+            if (!NT_SUCCESS(Status))
+                return Status;
+        }
+        while (CurrentCluster == RunStart + RunClusters);
+
+        /* Runs past a hole would be taken as the end of the map, so stop adding at the first failure */
+        if (Caching &&
+            !FsRtlAddLargeMcbEntry(&Fcb->ClusterMap, RunVcn, RunStart, RunClusters))
+        {
+            Caching = FALSE;
+        }
+
+        if (FileCluster < RunVcn + RunClusters)
+        {
+            *Cluster = RunStart + (FileCluster - RunVcn);
+            *RunLength = RunClusters - (FileCluster - RunVcn);
+            return STATUS_SUCCESS;
+        }
+        RunVcn += RunClusters;
+    }
+
+    *Cluster = 0xffffffff;
+    *RunLength = 0;
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Reads data from a file
  */
@@ -121,16 +216,14 @@ VfatReadFileData(
     ULONG FirstCluster;
     ULONG StartCluster;
     ULONG ClusterCount;
+    ULONG ClusterOffset;
     LARGE_INTEGER StartOffset;
     PDEVICE_EXTENSION DeviceExt;
-    BOOLEAN First = TRUE;
     PVFATFCB Fcb;
     NTSTATUS Status;
     ULONG BytesDone;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -208,87 +301,25 @@ VfatReadFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /* Find the cluster to start the read from */
-    if (LastCluster > 0 && ReadOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (ReadOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
     IrpContext->RefCount = 1;
+    Status = STATUS_SUCCESS;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    /* Issue one read per run of contiguous clusters */
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        Status = VfatMapFileCluster(DeviceExt, Fcb, FirstCluster,
+                                    ReadOffset.u.LowPart / BytesPerCluster,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (ReadOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += ReadOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
 
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        ClusterOffset = ReadOffset.u.LowPart % BytesPerCluster;
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector + ClusterOffset;
+        BytesDone = (ULONG)min((ULONGLONG)Length, (ULONGLONG)ClusterCount * BytesPerCluster - ClusterOffset);
+        DPRINT("start %08x, count %u, bytes %u\n", StartCluster, ClusterCount, BytesDone);
 
         /* Fire up the read command */
         Status = VfatReadDiskPartial (IrpContext, &StartOffset, BytesDone, *LengthRead, FALSE);
@@ -336,14 +367,12 @@ VfatWriteFileData(
     ULONG BytesDone;
     ULONG StartCluster;
     ULONG ClusterCount;
+    ULONG ClusterOffset;
     NTSTATUS Status = STATUS_SUCCESS;
-    BOOLEAN First = TRUE;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
     LARGE_INTEGER StartOffset;
     ULONG BufferOffset;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -421,89 +450,24 @@ VfatWriteFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /*
-     * Find the cluster to start the write from
-     */
-    if (LastCluster > 0 && WriteOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (WriteOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     IrpContext->RefCount = 1;
     BufferOffset = 0;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    /* Issue one write per run of contiguous clusters */
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        Status = VfatMapFileCluster(DeviceExt, Fcb, FirstCluster,
+                                    WriteOffset.u.LowPart / BytesPerCluster,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (WriteOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += WriteOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+
+        ClusterOffset = WriteOffset.u.LowPart % BytesPerCluster;
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector + ClusterOffset;
+        BytesDone = (ULONG)min((ULONGLONG)Length, (ULONGLONG)ClusterCount * BytesPerCluster - ClusterOffset);
+        DPRINT("start %08x, count %u, bytes %u\n", StartCluster, ClusterCount, BytesDone);
 
         // Fire up the write command
         Status = VfatWriteDiskPartial (IrpContext, &StartOffset, BytesDone, BufferOffset, FALSE);
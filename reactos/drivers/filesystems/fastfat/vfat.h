@@ -306,6 +306,9 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    /* One bit per FAT entry, set when the cluster is free. Built on first
+     * allocation and kept in sync by WriteCluster; Buffer is NULL until then */
+    RTL_BITMAP FreeClusterBitmap;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
 
@@ -334,6 +337,22 @@ typedef struct DEVICE_EXTENSION
     VFAT_DISPATCH Dispatch;
 } DEVICE_EXTENSION, VCB, *PVCB;
 
+/* dirindex.c, needed by the dispatch wrappers below */
+
+VOID
+vfatDirIndexInsert(
+    struct _VFATFCB* pDirFcb,
+    struct _VFATFCB* pFcb);
+
+VOID
+vfatDirIndexRemove(
+    struct _VFATFCB* pFcb,
+    BOOLEAN Deleted);
+
+VOID
+vfatDirIndexDiscard(
+    struct _VFATFCB* pDirFcb);
+
 FORCEINLINE
 BOOLEAN
 VfatIsDirectoryEmpty(PDEVICE_EXTENSION DeviceExt,
@@ -352,7 +371,19 @@ VfatAddEntry(PDEVICE_EXTENSION DeviceExt,
              UCHAR ReqAttr,
              struct _VFAT_MOVE_CONTEXT* MoveContext)
 {
-    return DeviceExt->Dispatch.AddEntry(DeviceExt, NameU, Fcb, ParentFcb, RequestedOptions, ReqAttr, MoveContext);
+    NTSTATUS Status;
+
+    Status = DeviceExt->Dispatch.AddEntry(DeviceExt, NameU, Fcb, ParentFcb, RequestedOptions, ReqAttr, MoveContext);
+    if (NT_SUCCESS(Status))
+    {
+        vfatDirIndexInsert(ParentFcb, *Fcb);
+    }
+    else
+    {
+        /* The directory may have been partially written */
+        vfatDirIndexDiscard(ParentFcb);
+    }
+    return Status;
 }
 
 FORCEINLINE
@@ -361,7 +392,11 @@ VfatDelEntry(PDEVICE_EXTENSION DeviceExt,
              struct _VFATFCB* Fcb,
              struct _VFAT_MOVE_CONTEXT* MoveContext)
 {
-    return DeviceExt->Dispatch.DelEntry(DeviceExt, Fcb, MoveContext);
+    NTSTATUS Status;
+
+    Status = DeviceExt->Dispatch.DelEntry(DeviceExt, Fcb, MoveContext);
+    vfatDirIndexRemove(Fcb, NT_SUCCESS(Status));
+    return Status;
 }
 
 FORCEINLINE
@@ -477,13 +512,14 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Optimization: map of the file clusters (VCN) to runs of disk clusters
+     * (LCN), filled on demand. Can't be in VFATCCB because it must be reset
+     * everytime the allocated clusters are truncated.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    LARGE_MCB ClusterMap;
+
+    /* For directories: index of the entry names, see dirindex.c */
+    struct _VFAT_DIR_INDEX *NameIndex;
 } VFATFCB, *PVFATFCB;
 
 #define CCB_DELETE_ON_CLOSE     0x0001
@@ -502,6 +538,8 @@ typedef struct _VFATCCB
 #define TAG_FCB  'BCFV'
 #define TAG_IRP  'PRIV'
 #define TAG_VFAT 'TAFV'
+#define TAG_BITMAP 'MBFV'
+#define TAG_DIR_INDEX 'IDFV'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -848,6 +886,23 @@ WriteCluster(
     ULONG ClusterToWrite,
     ULONG NewValue);
 
+VOID
+DestroyFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+InvalidateFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt);
+
+/* dirindex.c */
+
+NTSTATUS
+vfatDirIndexFind(
+    PDEVICE_EXTENSION pDeviceExt,
+    PVFATFCB pDirFcb,
+    PUNICODE_STRING FileToFindU,
+    PVFAT_DIRENTRY_CONTEXT DirContext);
+
 /* fcb.c */
 
 PVFATFCB
@@ -1041,6 +1096,15 @@ NextCluster(
     PULONG CurrentCluster,
     BOOLEAN Extend);
 
+NTSTATUS
+VfatMapFileCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FirstCluster,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength);
+
 /* shutdown.c */
 
 DRIVER_DISPATCH
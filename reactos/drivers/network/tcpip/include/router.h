@@ -18,8 +18,12 @@ typedef struct _FIB_ENTRY {
     IP_ADDRESS Netmask;           /* Netmask of network */
     PNEIGHBOR_CACHE_ENTRY Router; /* Pointer to NCE of router to use */
     UINT Metric;                  /* Cost of this route */
+    struct _FIB_ENTRY *HashNext;  /* Next entry in the prefix hash bucket */
+    UINT PrefixLength;            /* Netmask prefix length, FIB_NOT_INDEXED if not hashed */
 } FIB_ENTRY, *PFIB_ENTRY;
 
+#define FIB_NOT_INDEXED ((UINT)-1)
+
 PFIB_ENTRY RouterAddRoute(
     PIP_ADDRESS NetworkAddress,
     PIP_ADDRESS Netmask,
@@ -0,0 +1,581 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/fdo.c
+ * PURPOSE:         Adapter device object (FDO) functions
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS ****************************************************************/
+
+static
+PCM_RESOURCE_LIST
+PortCopyResourceList(
+    _In_opt_ PCM_RESOURCE_LIST ResourceList)
+{
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor;
+    PCM_RESOURCE_LIST Copy;
+    ULONG Size, i;
+
+    if (ResourceList == NULL)
+        return NULL;
+
+    /* Walk the list to find its size */
+    FullDescriptor = &ResourceList->List[0];
+    for (i = 0; i < ResourceList->Count; i++)
+    {
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)
+            &FullDescriptor->PartialResourceList.PartialDescriptors[FullDescriptor->PartialResourceList.Count];
+    }
+
+    Size = (ULONG)((ULONG_PTR)FullDescriptor - (ULONG_PTR)ResourceList);
+
+    Copy = ExAllocatePoolWithTag(NonPagedPool, Size, TAG_STORPORT);
+    if (Copy != NULL)
+        RtlCopyMemory(Copy, ResourceList, Size);
+
+    return Copy;
+}
+
+
+static
+VOID
+PortFdoStopAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    DPRINT("PortFdoStopAdapter(%p)\n", DeviceExtension);
+
+    /* Nothing may be in flight or queued in a DPC once the requests and the DMA adapter go */
+    PortDrainRequests(DeviceExtension);
+    MiniportStop(DeviceExtension);
+    PortFreeRequests(DeviceExtension);
+
+    if (DeviceExtension->DmaAdapter != NULL)
+    {
+        DeviceExtension->DmaAdapter->DmaOperations->PutDmaAdapter(DeviceExtension->DmaAdapter);
+        DeviceExtension->DmaAdapter = NULL;
+    }
+
+    if (DeviceExtension->AllocatedResources != NULL)
+    {
+        ExFreePoolWithTag(DeviceExtension->AllocatedResources, TAG_STORPORT);
+        DeviceExtension->AllocatedResources = NULL;
+    }
+
+    if (DeviceExtension->TranslatedResources != NULL)
+    {
+        ExFreePoolWithTag(DeviceExtension->TranslatedResources, TAG_STORPORT);
+        DeviceExtension->TranslatedResources = NULL;
+    }
+
+    DeviceExtension->Common.PnpState = dsStopped;
+}
+
+
+static
+NTSTATUS
+PortFdoStartDevice(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    NTSTATUS Status;
+
+    DPRINT("PortFdoStartDevice(%p %p)\n", DeviceExtension, Irp);
+
+    ASSERT(DeviceExtension->Common.PnpState == dsStopped);
+
+    DeviceExtension->Stopping = FALSE;
+
+    DeviceExtension->AllocatedResources =
+        PortCopyResourceList(Stack->Parameters.StartDevice.AllocatedResources);
+    DeviceExtension->TranslatedResources =
+        PortCopyResourceList(Stack->Parameters.StartDevice.AllocatedResourcesTranslated);
+
+    if ((Stack->Parameters.StartDevice.AllocatedResources != NULL && DeviceExtension->AllocatedResources == NULL) ||
+        (Stack->Parameters.StartDevice.AllocatedResourcesTranslated != NULL && DeviceExtension->TranslatedResources == NULL))
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto done;
+    }
+
+    Status = MiniportFindAdapter(DeviceExtension,
+                                 DeviceExtension->AllocatedResources,
+                                 DeviceExtension->TranslatedResources);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("MiniportFindAdapter() failed (Status 0x%08lx)\n", Status);
+        goto done;
+    }
+
+    /* A miniport that did not ask for an uncached extension still needs the adapter for its transfers */
+    if (MiniportGetDmaAdapter(DeviceExtension) == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto done;
+    }
+
+    Status = PortAllocateRequests(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("PortAllocateRequests() failed (Status 0x%08lx)\n", Status);
+        goto done;
+    }
+
+    Status = MiniportInitialize(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("MiniportInitialize() failed (Status 0x%08lx)\n", Status);
+        goto done;
+    }
+
+    DeviceExtension->Common.PnpState = dsStarted;
+
+    /* Requests that came in while the adapter was stopped are still queued */
+    PortStartAllLuns(DeviceExtension);
+
+done:
+    if (!NT_SUCCESS(Status))
+        PortFdoStopAdapter(DeviceExtension);
+
+    return Status;
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortInquiryCompletion(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PVOID Context)
+{
+    KeSetEvent((PKEVENT)Context, IO_NO_INCREMENT, FALSE);
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+
+static
+BOOLEAN
+PortSendInquiry(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ PINQUIRYDATA InquiryBuffer)
+{
+    SCSI_REQUEST_BLOCK Srb;
+    PIO_STACK_LOCATION Stack;
+    PCDB Cdb;
+    KEVENT Event;
+    PIRP Irp;
+    PMDL Mdl;
+    BOOLEAN Present;
+
+    DPRINT("PortSendInquiry(%p)\n", LunExtension);
+
+    Irp = IoAllocateIrp(LunExtension->Common.DeviceObject->StackSize, FALSE);
+    if (Irp == NULL)
+        return FALSE;
+
+    Mdl = IoAllocateMdl(InquiryBuffer, INQUIRYDATABUFFERSIZE, FALSE, FALSE, Irp);
+    if (Mdl == NULL)
+    {
+        IoFreeIrp(Irp);
+        return FALSE;
+    }
+
+    MmBuildMdlForNonPagedPool(Mdl);
+
+    RtlZeroMemory(InquiryBuffer, INQUIRYDATABUFFERSIZE);
+    RtlZeroMemory(&Srb, sizeof(Srb));
+
+    Srb.Length = sizeof(SCSI_REQUEST_BLOCK);
+    Srb.Function = SRB_FUNCTION_EXECUTE_SCSI;
+    Srb.PathId = LunExtension->PathId;
+    Srb.TargetId = LunExtension->TargetId;
+    Srb.Lun = LunExtension->Lun;
+    Srb.SrbFlags = SRB_FLAGS_DATA_IN | SRB_FLAGS_DISABLE_SYNCH_TRANSFER | SRB_FLAGS_DISABLE_AUTOSENSE;
+    Srb.TimeOutValue = 4;
+    Srb.DataBuffer = InquiryBuffer;
+    Srb.DataTransferLength = INQUIRYDATABUFFERSIZE;
+    Srb.OriginalRequest = Irp;
+    Srb.CdbLength = 6;
+
+    Cdb = (PCDB)Srb.Cdb;
+    Cdb->CDB6INQUIRY.OperationCode = SCSIOP_INQUIRY;
+    Cdb->CDB6INQUIRY.LogicalUnitNumber = LunExtension->Lun;
+    Cdb->CDB6INQUIRY.AllocationLength = INQUIRYDATABUFFERSIZE;
+
+    Stack = IoGetNextIrpStackLocation(Irp);
+    Stack->MajorFunction = IRP_MJ_SCSI;
+    Stack->Parameters.Scsi.Srb = &Srb;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    IoSetCompletionRoutine(Irp, PortInquiryCompletion, &Event, TRUE, TRUE, TRUE);
+
+    if (IoCallDriver(LunExtension->Common.DeviceObject, Irp) == STATUS_PENDING)
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+
+    Present = (SRB_STATUS(Srb.SrbStatus) == SRB_STATUS_SUCCESS ||
+               SRB_STATUS(Srb.SrbStatus) == SRB_STATUS_DATA_OVERRUN) &&
+              InquiryBuffer->DeviceTypeQualifier == DEVICE_CONNECTED;
+
+    IoFreeMdl(Mdl);
+    IoFreeIrp(Irp);
+
+    return Present;
+}
+
+
+static
+VOID
+PortFdoScanBus(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+    PINQUIRYDATA InquiryBuffer;
+    UCHAR PathId, TargetId, Lun;
+    BOOLEAN Present;
+    NTSTATUS Status;
+
+    DPRINT("PortFdoScanBus(%p)\n", DeviceExtension);
+
+    InquiryBuffer = ExAllocatePoolWithTag(NonPagedPool, INQUIRYDATABUFFERSIZE, TAG_STORPORT);
+    if (InquiryBuffer == NULL)
+        return;
+
+    for (PathId = 0; PathId < DeviceExtension->PortConfig.NumberOfBuses; PathId++)
+    {
+        for (TargetId = 0; TargetId < DeviceExtension->PortConfig.MaximumNumberOfTargets; TargetId++)
+        {
+            for (Lun = 0; Lun < DeviceExtension->PortConfig.MaximumNumberOfLogicalUnits; Lun++)
+            {
+                LunExtension = PortGetLun(DeviceExtension, PathId, TargetId, Lun);
+                if (LunExtension == NULL)
+                {
+                    Status = PortCreateLun(DeviceExtension, PathId, TargetId, Lun, &LunExtension);
+                    if (!NT_SUCCESS(Status))
+                        continue;
+                }
+
+                Present = PortSendInquiry(LunExtension, InquiryBuffer);
+                if (Present)
+                {
+                    RtlCopyMemory(&LunExtension->InquiryData, InquiryBuffer, sizeof(INQUIRYDATA));
+                    LunExtension->Present = TRUE;
+                }
+                else
+                {
+                    LunExtension->Present = FALSE;
+
+                    /* Units never reported to PnP can go right away */
+                    if (!LunExtension->Reported)
+                        PortDeleteLun(LunExtension);
+                }
+
+                /* No LUN 0, no other LUNs on this target */
+                if (!Present && Lun == 0)
+                    break;
+            }
+        }
+    }
+
+    ExFreePoolWithTag(InquiryBuffer, TAG_STORPORT);
+}
+
+
+static
+NTSTATUS
+PortFdoQueryBusRelations(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _Out_ PDEVICE_RELATIONS *pDeviceRelations)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+    PDEVICE_RELATIONS DeviceRelations;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PLIST_ENTRY ListEntry;
+    ULONG Count = 0;
+
+    DPRINT("PortFdoQueryBusRelations(%p)\n", DeviceExtension);
+
+    if (DeviceExtension->Common.PnpState == dsStarted)
+        PortFdoScanBus(DeviceExtension);
+
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->LunListLock, &LockHandle);
+
+    for (ListEntry = DeviceExtension->LunListHead.Flink;
+         ListEntry != &DeviceExtension->LunListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        LunExtension = CONTAINING_RECORD(ListEntry, PDO_DEVICE_EXTENSION, LunEntry);
+        if (LunExtension->Present)
+            Count++;
+    }
+
+    DeviceRelations = ExAllocatePoolWithTag(NonPagedPool,
+                                            FIELD_OFFSET(DEVICE_RELATIONS, Objects) +
+                                            max(Count, 1) * sizeof(PDEVICE_OBJECT),
+                                            TAG_STORPORT);
+    if (DeviceRelations == NULL)
+    {
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    DeviceRelations->Count = 0;
+    for (ListEntry = DeviceExtension->LunListHead.Flink;
+         ListEntry != &DeviceExtension->LunListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        LunExtension = CONTAINING_RECORD(ListEntry, PDO_DEVICE_EXTENSION, LunEntry);
+        if (!LunExtension->Present)
+            continue;
+
+        LunExtension->Reported = TRUE;
+        ObReferenceObject(LunExtension->Common.DeviceObject);
+        DeviceRelations->Objects[DeviceRelations->Count++] = LunExtension->Common.DeviceObject;
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    *pDeviceRelations = DeviceRelations;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+VOID
+PortFdoRemoveDevice(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+    PLIST_ENTRY ListEntry;
+    PDRIVER_OBJECT_EXTENSION DriverExtension;
+
+    DPRINT("PortFdoRemoveDevice(%p)\n", DeviceExtension);
+
+    /* Units can only go once the adapter has no request of theirs anymore */
+    if (DeviceExtension->Common.PnpState == dsStarted)
+        PortFdoStopAdapter(DeviceExtension);
+
+    /* The PnP manager already removed the units it knew about */
+    while (!IsListEmpty(&DeviceExtension->LunListHead))
+    {
+        ListEntry = DeviceExtension->LunListHead.Flink;
+        LunExtension = CONTAINING_RECORD(ListEntry, PDO_DEVICE_EXTENSION, LunEntry);
+        PortFlushLunQueue(LunExtension, SRB_STATUS_NO_DEVICE);
+        PortDeleteLun(LunExtension);
+    }
+
+    DeviceExtension->Common.PnpState = dsRemoved;
+
+    DriverExtension = IoGetDriverObjectExtension(DeviceExtension->Common.DeviceObject->DriverObject,
+                                                 (PVOID)DriverEntry);
+    if (DriverExtension != NULL)
+        DriverExtension->AdapterCount--;
+
+    if (DeviceExtension->Miniport != NULL)
+    {
+        ExFreePoolWithTag(DeviceExtension->Miniport, TAG_STORPORT);
+        DeviceExtension->Miniport = NULL;
+        DeviceExtension->MiniportExtension = NULL;
+    }
+}
+
+
+NTSTATUS
+PortFdoQueryAdapterProperty(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PSTORAGE_ADAPTER_DESCRIPTOR Descriptor;
+    ULONG BufferLength;
+
+    DPRINT("PortFdoQueryAdapterProperty(%p %p)\n", DeviceExtension, Irp);
+
+    PropertyQuery = (PSTORAGE_PROPERTY_QUERY)Irp->AssociatedIrp.SystemBuffer;
+    BufferLength = Stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (Stack->Parameters.DeviceIoControl.InputBufferLength < FIELD_OFFSET(STORAGE_PROPERTY_QUERY, AdditionalParameters))
+        return STATUS_INVALID_PARAMETER;
+
+    if (PropertyQuery->QueryType == PropertyExistsQuery)
+        return STATUS_SUCCESS;
+
+    if (PropertyQuery->QueryType != PropertyStandardQuery)
+        return STATUS_NOT_SUPPORTED;
+
+    if (BufferLength < sizeof(STORAGE_DESCRIPTOR_HEADER))
+        return STATUS_INFO_LENGTH_MISMATCH;
+
+    /* The descriptor overwrites the query in the system buffer */
+    Descriptor = (PSTORAGE_ADAPTER_DESCRIPTOR)Irp->AssociatedIrp.SystemBuffer;
+
+    if (BufferLength < sizeof(STORAGE_ADAPTER_DESCRIPTOR))
+    {
+        Descriptor->Version = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+        Descriptor->Size = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+        Irp->IoStatus.Information = sizeof(STORAGE_DESCRIPTOR_HEADER);
+        return STATUS_SUCCESS;
+    }
+
+    RtlZeroMemory(Descriptor, sizeof(STORAGE_ADAPTER_DESCRIPTOR));
+    Descriptor->Version = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+    Descriptor->Size = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+    Descriptor->MaximumTransferLength = DeviceExtension->PortConfig.MaximumTransferLength;
+    Descriptor->MaximumPhysicalPages = min(DeviceExtension->PortConfig.NumberOfPhysicalBreaks,
+                                           DeviceExtension->NumberOfMapRegisters);
+    Descriptor->AlignmentMask = DeviceExtension->PortConfig.AlignmentMask;
+    Descriptor->AdapterUsesPio = FALSE;
+    Descriptor->AdapterScansDown = DeviceExtension->PortConfig.AdapterScansDown;
+    Descriptor->CommandQueueing = TRUE;
+    Descriptor->AcceleratedTransfer = TRUE;
+    Descriptor->BusType = BusTypeScsi;
+    Descriptor->BusMajorVersion = 2;
+    Descriptor->BusMinorVersion = 0;
+
+    Irp->IoStatus.Information = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    NTSTATUS Status;
+
+    DPRINT("PortFdoDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension->Common.IsFDO);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+        case IOCTL_STORAGE_QUERY_PROPERTY:
+            PropertyQuery = (PSTORAGE_PROPERTY_QUERY)Irp->AssociatedIrp.SystemBuffer;
+            if (Stack->Parameters.DeviceIoControl.InputBufferLength >= sizeof(STORAGE_PROPERTY_ID) &&
+                PropertyQuery->PropertyId == StorageAdapterProperty)
+            {
+                Status = PortFdoQueryAdapterProperty(DeviceExtension, Irp);
+            }
+            else
+            {
+                Status = STATUS_NOT_SUPPORTED;
+            }
+            break;
+
+        default:
+            DPRINT1("Unsupported IOCTL 0x%lx\n", Stack->Parameters.DeviceIoControl.IoControlCode);
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+NTSTATUS
+NTAPI
+PortFdoPnp(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    ULONG_PTR Information = Irp->IoStatus.Information;
+    PDEVICE_OBJECT LowerDevice;
+    NTSTATUS Status;
+
+    DPRINT("PortFdoPnp(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension->Common.IsFDO);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->MinorFunction)
+    {
+        case IRP_MN_START_DEVICE: /* 0x00 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_START_DEVICE\n");
+            Status = ForwardIrpAndWait(DeviceExtension->LowerDevice, Irp);
+            if (NT_SUCCESS(Status))
+                Status = PortFdoStartDevice(DeviceExtension, Irp);
+            break;
+
+        case IRP_MN_QUERY_REMOVE_DEVICE: /* 0x01 */
+        case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
+        case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
+        case IRP_MN_CANCEL_STOP_DEVICE: /* 0x06 */
+            Irp->IoStatus.Status = STATUS_SUCCESS;
+            return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+
+        case IRP_MN_REMOVE_DEVICE: /* 0x02 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_REMOVE_DEVICE\n");
+            PortFdoRemoveDevice(DeviceExtension);
+
+            LowerDevice = DeviceExtension->LowerDevice;
+            Irp->IoStatus.Status = STATUS_SUCCESS;
+            Status = ForwardIrpAndForget(LowerDevice, Irp);
+
+            IoDetachDevice(LowerDevice);
+            IoDeleteDevice(DeviceObject);
+            return Status;
+
+        case IRP_MN_STOP_DEVICE: /* 0x04 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_STOP_DEVICE\n");
+            if (DeviceExtension->Common.PnpState == dsStarted)
+                PortFdoStopAdapter(DeviceExtension);
+
+            Irp->IoStatus.Status = STATUS_SUCCESS;
+            return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+
+        case IRP_MN_QUERY_DEVICE_RELATIONS: /* 0x07 */
+            if (Stack->Parameters.QueryDeviceRelations.Type != BusRelations)
+                return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_DEVICE_RELATIONS / BusRelations\n");
+            Status = PortFdoQueryBusRelations(DeviceExtension, (PDEVICE_RELATIONS *)&Information);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            Irp->IoStatus.Information = Information;
+            Irp->IoStatus.Status = Status;
+            return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+
+        case IRP_MN_QUERY_PNP_DEVICE_STATE: /* 0x14 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_PNP_DEVICE_STATE\n");
+            Irp->IoStatus.Information |= PNP_DEVICE_NOT_DISABLEABLE;
+            Irp->IoStatus.Status = STATUS_SUCCESS;
+            return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+
+        default:
+            DPRINT("IRP_MJ_PNP / Unknown minor function 0x%x\n", Stack->MinorFunction);
+            return ForwardIrpAndForget(DeviceExtension->LowerDevice, Irp);
+    }
+
+    Irp->IoStatus.Information = Information;
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+/* EOF */
@@ -0,0 +1,499 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/miniport.c
+ * PURPOSE:         Miniport interface
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS ****************************************************************/
+
+static
+VOID
+MiniportInitializePortConfig(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PCM_RESOURCE_LIST AllocatedResources)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig = &DeviceExtension->PortConfig;
+    PHW_INITIALIZATION_DATA HwInitData = &DeviceExtension->InitData->HwInitData;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR Descriptor;
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor;
+    ULONG i, j, RangeCount = 0;
+
+    DPRINT("MiniportInitializePortConfig(%p %p)\n", DeviceExtension, AllocatedResources);
+
+    RtlZeroMemory(PortConfig, sizeof(PORT_CONFIGURATION_INFORMATION));
+
+    PortConfig->Length = sizeof(PORT_CONFIGURATION_INFORMATION);
+    PortConfig->AdapterInterfaceType = HwInitData->AdapterInterfaceType;
+    PortConfig->InterruptMode = LevelSensitive;
+    PortConfig->MaximumTransferLength = SP_UNINITIALIZED_VALUE;
+    PortConfig->NumberOfPhysicalBreaks = SP_UNINITIALIZED_VALUE;
+    PortConfig->DmaChannel = SP_UNINITIALIZED_VALUE;
+    PortConfig->DmaPort = SP_UNINITIALIZED_VALUE;
+    PortConfig->NumberOfAccessRanges = HwInitData->NumberOfAccessRanges;
+    PortConfig->AccessRanges = (PVOID)&DeviceExtension->AccessRanges;
+    PortConfig->NumberOfBuses = 1;
+    PortConfig->InitiatorBusId[0] = (UCHAR)SP_UNINITIALIZED_VALUE;
+    PortConfig->ScatterGather = TRUE;
+    PortConfig->Master = TRUE;
+    PortConfig->Dma32BitAddresses = TRUE;
+    PortConfig->MapBuffers = HwInitData->MapBuffers;
+    PortConfig->NeedPhysicalAddresses = TRUE;
+    PortConfig->TaggedQueuing = TRUE;
+    PortConfig->AutoRequestSense = TRUE;
+    PortConfig->MultipleRequestPerLu = TRUE;
+    PortConfig->MaximumNumberOfTargets = SCSI_MAXIMUM_TARGETS_PER_BUS;
+    PortConfig->MaximumNumberOfLogicalUnits = SCSI_MAXIMUM_LOGICAL_UNITS;
+    PortConfig->DeviceExtensionSize = HwInitData->DeviceExtensionSize;
+    PortConfig->SpecificLuExtensionSize = HwInitData->SpecificLuExtensionSize;
+    PortConfig->SrbExtensionSize = HwInitData->SrbExtensionSize;
+    PortConfig->SynchronizationModel = StorSynchronizeHalfDuplex;
+
+    if (AllocatedResources == NULL)
+        return;
+
+    /* Hand the assigned resources to the miniport */
+    FullDescriptor = &AllocatedResources->List[0];
+    for (i = 0; i < AllocatedResources->Count; i++)
+    {
+        PortConfig->AdapterInterfaceType = FullDescriptor->InterfaceType;
+        PortConfig->SystemIoBusNumber = FullDescriptor->BusNumber;
+
+        for (j = 0; j < FullDescriptor->PartialResourceList.Count; j++)
+        {
+            Descriptor = &FullDescriptor->PartialResourceList.PartialDescriptors[j];
+
+            switch (Descriptor->Type)
+            {
+                case CmResourceTypePort:
+                case CmResourceTypeMemory:
+                    if (RangeCount >= RTL_NUMBER_OF(DeviceExtension->AccessRanges))
+                        break;
+
+                    DeviceExtension->AccessRanges[RangeCount].RangeStart = Descriptor->u.Port.Start;
+                    DeviceExtension->AccessRanges[RangeCount].RangeLength = Descriptor->u.Port.Length;
+                    DeviceExtension->AccessRanges[RangeCount].RangeInMemory =
+                        (Descriptor->Type == CmResourceTypeMemory);
+                    RangeCount++;
+                    break;
+
+                case CmResourceTypeInterrupt:
+                    PortConfig->BusInterruptLevel = Descriptor->u.Interrupt.Level;
+                    PortConfig->BusInterruptVector = Descriptor->u.Interrupt.Vector;
+                    PortConfig->InterruptMode =
+                        (Descriptor->Flags & CM_RESOURCE_INTERRUPT_LATCHED) ? Latched : LevelSensitive;
+                    break;
+
+                case CmResourceTypeDma:
+                    PortConfig->DmaChannel = Descriptor->u.Dma.Channel;
+                    PortConfig->DmaPort = Descriptor->u.Dma.Port;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)
+            &FullDescriptor->PartialResourceList.PartialDescriptors[FullDescriptor->PartialResourceList.Count];
+    }
+
+    PortConfig->NumberOfAccessRanges = max(PortConfig->NumberOfAccessRanges, RangeCount);
+}
+
+
+static
+VOID
+MiniportGetInterruptResource(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PCM_RESOURCE_LIST TranslatedResources = DeviceExtension->TranslatedResources;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR Descriptor;
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor;
+    ULONG i, j;
+
+    if (TranslatedResources == NULL)
+        return;
+
+    FullDescriptor = &TranslatedResources->List[0];
+    for (i = 0; i < TranslatedResources->Count; i++)
+    {
+        for (j = 0; j < FullDescriptor->PartialResourceList.Count; j++)
+        {
+            Descriptor = &FullDescriptor->PartialResourceList.PartialDescriptors[j];
+            if (Descriptor->Type != CmResourceTypeInterrupt)
+                continue;
+
+            DeviceExtension->InterruptVector = Descriptor->u.Interrupt.Vector;
+            DeviceExtension->InterruptIrql = (KIRQL)Descriptor->u.Interrupt.Level;
+            DeviceExtension->InterruptAffinity = Descriptor->u.Interrupt.Affinity;
+            DeviceExtension->InterruptMode =
+                (Descriptor->Flags & CM_RESOURCE_INTERRUPT_LATCHED) ? Latched : LevelSensitive;
+            DeviceExtension->InterruptShared =
+                (Descriptor->ShareDisposition == CmResourceShareShared);
+            return;
+        }
+
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)
+            &FullDescriptor->PartialResourceList.PartialDescriptors[FullDescriptor->PartialResourceList.Count];
+    }
+}
+
+
+static
+BOOLEAN
+NTAPI
+MiniportInterruptRoutine(
+    _In_ PKINTERRUPT Interrupt,
+    _In_ PVOID ServiceContext)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)ServiceContext;
+
+    DPRINT("MiniportInterruptRoutine(%p %p)\n", Interrupt, ServiceContext);
+
+    /* Completions are batched, the miniport only pushes them onto the list */
+    return DeviceExtension->InitData->HwInitData.HwInterrupt(DeviceExtension->MiniportExtension);
+}
+
+
+static
+BOOLEAN
+NTAPI
+MiniportHwInitializeRoutine(
+    _In_ PVOID Context)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)Context;
+
+    return DeviceExtension->InitData->HwInitData.HwInitialize(DeviceExtension->MiniportExtension);
+}
+
+
+static
+BOOLEAN
+NTAPI
+MiniportStopAdapterRoutine(
+    _In_ PVOID Context)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)Context;
+    PHW_ADAPTER_CONTROL HwAdapterControl = DeviceExtension->InitData->HwInitData.HwAdapterControl;
+    struct
+    {
+        SCSI_SUPPORTED_CONTROL_TYPE_LIST List;
+        BOOLEAN SupportedTypeList[ScsiAdapterControlMax];
+    } ControlTypes;
+
+    RtlZeroMemory(&ControlTypes, sizeof(ControlTypes));
+    ControlTypes.List.MaxControlType = ScsiAdapterControlMax;
+
+    if (HwAdapterControl(DeviceExtension->MiniportExtension,
+                         ScsiQuerySupportedControlTypes,
+                         &ControlTypes.List) != ScsiAdapterControlSuccess ||
+        !ControlTypes.List.SupportedTypeList[ScsiStopAdapter])
+    {
+        return FALSE;
+    }
+
+    return HwAdapterControl(DeviceExtension->MiniportExtension,
+                            ScsiStopAdapter,
+                            NULL) == ScsiAdapterControlSuccess;
+}
+
+
+PFDO_DEVICE_EXTENSION
+MiniportGetAdapter(
+    _In_ PVOID MiniportExtension)
+{
+    return CONTAINING_RECORD(MiniportExtension, MINIPORT_DEVICE_EXTENSION, HwDeviceExtension)->Adapter;
+}
+
+
+PDMA_ADAPTER
+MiniportGetDmaAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig = &DeviceExtension->PortConfig;
+    DEVICE_DESCRIPTION DeviceDescription;
+
+    if (DeviceExtension->DmaAdapter != NULL)
+        return DeviceExtension->DmaAdapter;
+
+    RtlZeroMemory(&DeviceDescription, sizeof(DeviceDescription));
+    DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION;
+    DeviceDescription.Master = PortConfig->Master;
+    DeviceDescription.ScatterGather = PortConfig->ScatterGather;
+    DeviceDescription.DemandMode = PortConfig->DemandMode;
+    DeviceDescription.Dma32BitAddresses = PortConfig->Dma32BitAddresses;
+    DeviceDescription.Dma64BitAddresses = (PortConfig->Dma64BitAddresses != 0);
+    DeviceDescription.InterfaceType = PortConfig->AdapterInterfaceType;
+    DeviceDescription.BusNumber = PortConfig->SystemIoBusNumber;
+    DeviceDescription.DmaChannel = PortConfig->DmaChannel;
+    DeviceDescription.DmaPort = PortConfig->DmaPort;
+    DeviceDescription.DmaWidth = PortConfig->DmaWidth;
+    DeviceDescription.DmaSpeed = PortConfig->DmaSpeed;
+    DeviceDescription.MaximumLength = PortConfig->MaximumTransferLength;
+    if (DeviceDescription.MaximumLength == SP_UNINITIALIZED_VALUE)
+        DeviceDescription.MaximumLength = 0x10000;
+
+    DeviceExtension->DmaAdapter = IoGetDmaAdapter(DeviceExtension->PhysicalDevice,
+                                                  &DeviceDescription,
+                                                  &DeviceExtension->NumberOfMapRegisters);
+    if (DeviceExtension->DmaAdapter == NULL)
+        DPRINT1("IoGetDmaAdapter() failed\n");
+
+    return DeviceExtension->DmaAdapter;
+}
+
+
+BOOLEAN
+MiniportTranslateResourceAddress(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PHYSICAL_ADDRESS IoAddress,
+    _In_ ULONG NumberOfBytes,
+    _In_ BOOLEAN InIoSpace,
+    _Out_ PPHYSICAL_ADDRESS TranslatedAddress)
+{
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR Descriptor, TranslatedDescriptor;
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor, TranslatedFullDescriptor;
+    UCHAR Type = InIoSpace ? CmResourceTypePort : CmResourceTypeMemory;
+    ULONG i, j;
+
+    if (DeviceExtension->AllocatedResources == NULL ||
+        DeviceExtension->TranslatedResources == NULL)
+        return FALSE;
+
+    /* Both lists describe the same resources in the same order */
+    FullDescriptor = &DeviceExtension->AllocatedResources->List[0];
+    TranslatedFullDescriptor = &DeviceExtension->TranslatedResources->List[0];
+    for (i = 0; i < DeviceExtension->AllocatedResources->Count; i++)
+    {
+        for (j = 0; j < FullDescriptor->PartialResourceList.Count; j++)
+        {
+            Descriptor = &FullDescriptor->PartialResourceList.PartialDescriptors[j];
+            TranslatedDescriptor = &TranslatedFullDescriptor->PartialResourceList.PartialDescriptors[j];
+
+            if (Descriptor->Type != Type)
+                continue;
+
+            if (IoAddress.QuadPart < Descriptor->u.Memory.Start.QuadPart ||
+                IoAddress.QuadPart + NumberOfBytes >
+                Descriptor->u.Memory.Start.QuadPart + Descriptor->u.Memory.Length)
+                continue;
+
+            TranslatedAddress->QuadPart = TranslatedDescriptor->u.Memory.Start.QuadPart +
+                                          (IoAddress.QuadPart - Descriptor->u.Memory.Start.QuadPart);
+            return TRUE;
+        }
+
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)
+            &FullDescriptor->PartialResourceList.PartialDescriptors[FullDescriptor->PartialResourceList.Count];
+        TranslatedFullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)
+            &TranslatedFullDescriptor->PartialResourceList.PartialDescriptors[TranslatedFullDescriptor->PartialResourceList.Count];
+    }
+
+    return FALSE;
+}
+
+
+NTSTATUS
+MiniportFindAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PCM_RESOURCE_LIST AllocatedResources,
+    _In_ PCM_RESOURCE_LIST TranslatedResources)
+{
+    BOOLEAN Reserved = FALSE;
+    ULONG Result;
+
+    DPRINT("MiniportFindAdapter(%p)\n", DeviceExtension);
+
+    MiniportInitializePortConfig(DeviceExtension, AllocatedResources);
+    MiniportGetInterruptResource(DeviceExtension);
+
+    Result = DeviceExtension->InitData->HwInitData.HwFindAdapter(DeviceExtension->MiniportExtension,
+                                                                 DeviceExtension->InitData->HwContext,
+                                                                 NULL,
+                                                                 NULL,
+                                                                 &DeviceExtension->PortConfig,
+                                                                 &Reserved);
+    DPRINT("HwFindAdapter() returned %lu\n", Result);
+
+    switch (Result)
+    {
+        case SP_RETURN_FOUND:
+            break;
+
+        case SP_RETURN_NOT_FOUND:
+            return STATUS_NOT_FOUND;
+
+        case SP_RETURN_BAD_CONFIG:
+            return STATUS_INVALID_PARAMETER;
+
+        default:
+            return STATUS_ADAPTER_HARDWARE_ERROR;
+    }
+
+    DeviceExtension->SynchronizationModel =
+        (STOR_SYNCHRONIZATION_MODEL)DeviceExtension->PortConfig.SynchronizationModel;
+    DeviceExtension->SrbExtensionSize = ROUND_UP(DeviceExtension->PortConfig.SrbExtensionSize, 8);
+
+    DPRINT("Synchronization model %s\n",
+           DeviceExtension->SynchronizationModel == StorSynchronizeFullDuplex ? "full duplex" : "half duplex");
+
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+MiniportInitialize(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    KIRQL OldIrql;
+    BOOLEAN Result;
+    NTSTATUS Status;
+
+    DPRINT("MiniportInitialize(%p)\n", DeviceExtension);
+
+    if (DeviceExtension->InterruptVector != 0)
+    {
+        Status = IoConnectInterrupt(&DeviceExtension->Interrupt,
+                                    MiniportInterruptRoutine,
+                                    DeviceExtension,
+                                    NULL,
+                                    DeviceExtension->InterruptVector,
+                                    DeviceExtension->InterruptIrql,
+                                    DeviceExtension->InterruptIrql,
+                                    DeviceExtension->InterruptMode,
+                                    DeviceExtension->InterruptShared,
+                                    DeviceExtension->InterruptAffinity,
+                                    FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("IoConnectInterrupt() failed (Status 0x%08lx)\n", Status);
+            DeviceExtension->Interrupt = NULL;
+            return Status;
+        }
+    }
+
+    if (DeviceExtension->Interrupt != NULL)
+    {
+        Result = KeSynchronizeExecution(DeviceExtension->Interrupt,
+                                        MiniportHwInitializeRoutine,
+                                        DeviceExtension);
+    }
+    else
+    {
+        KeAcquireSpinLock(&DeviceExtension->InterruptSpinLock, &OldIrql);
+        Result = MiniportHwInitializeRoutine(DeviceExtension);
+        KeReleaseSpinLock(&DeviceExtension->InterruptSpinLock, OldIrql);
+    }
+
+    if (!Result)
+    {
+        DPRINT1("HwInitialize() failed\n");
+        MiniportStop(DeviceExtension);
+        return STATUS_ADAPTER_HARDWARE_ERROR;
+    }
+
+    DeviceExtension->MiniportStarted = TRUE;
+
+    if (DeviceExtension->HwPassiveInitRoutine != NULL &&
+        !DeviceExtension->HwPassiveInitRoutine(DeviceExtension->MiniportExtension))
+    {
+        DPRINT1("HwPassiveInitRoutine() failed\n");
+        MiniportStop(DeviceExtension);
+        return STATUS_ADAPTER_HARDWARE_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+VOID
+MiniportStop(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PMAPPED_ADDRESS_ENTRY AddressEntry;
+    PLIST_ENTRY ListEntry;
+    KIRQL OldIrql;
+
+    DPRINT("MiniportStop(%p)\n", DeviceExtension);
+
+    /* Let the miniport quiesce the hardware while its interrupt is still connected */
+    if (DeviceExtension->MiniportStarted)
+    {
+        DeviceExtension->MiniportStarted = FALSE;
+
+        if (DeviceExtension->InitData->HwInitData.HwAdapterControl != NULL)
+        {
+            if (DeviceExtension->Interrupt != NULL)
+            {
+                KeSynchronizeExecution(DeviceExtension->Interrupt,
+                                       MiniportStopAdapterRoutine,
+                                       DeviceExtension);
+            }
+            else
+            {
+                KeAcquireSpinLock(&DeviceExtension->InterruptSpinLock, &OldIrql);
+                MiniportStopAdapterRoutine(DeviceExtension);
+                KeReleaseSpinLock(&DeviceExtension->InterruptSpinLock, OldIrql);
+            }
+        }
+    }
+
+    /* The timer must not be armed again, neither by the miniport nor by the completion DPC */
+    DeviceExtension->HwTimer = NULL;
+    KeCancelTimer(&DeviceExtension->MiniportTimer);
+
+    if (DeviceExtension->Interrupt != NULL)
+    {
+        IoDisconnectInterrupt(DeviceExtension->Interrupt);
+        DeviceExtension->Interrupt = NULL;
+    }
+
+    /* Whatever the miniport still had won't complete anymore */
+    PortCompleteOutstandingRequests(DeviceExtension,
+                                    SP_UNTAGGED,
+                                    SP_UNTAGGED,
+                                    SP_UNTAGGED,
+                                    SRB_STATUS_BUS_RESET);
+
+    /* Have the completion DPC run one last time, then make sure nothing is left queued or running */
+    KeFlushQueuedDpcs();
+    KeCancelTimer(&DeviceExtension->MiniportTimer);
+    KeRemoveQueueDpc(&DeviceExtension->MiniportTimerDpc);
+    KeRemoveQueueDpc(&DeviceExtension->CompletionDpc);
+    KeCancelTimer(&DeviceExtension->PauseTimer);
+    KeRemoveQueueDpc(&DeviceExtension->PauseTimerDpc);
+    KeFlushQueuedDpcs();
+
+    /* A restarted miniport starts with a running queue */
+    DeviceExtension->PauseCount = 0;
+    DeviceExtension->BusyCount = 0;
+
+    while (!IsListEmpty(&DeviceExtension->MappedAddressList))
+    {
+        ListEntry = RemoveHeadList(&DeviceExtension->MappedAddressList);
+        AddressEntry = CONTAINING_RECORD(ListEntry, MAPPED_ADDRESS_ENTRY, Entry);
+        MmUnmapIoSpace(AddressEntry->MappedAddress, AddressEntry->NumberOfBytes);
+        ExFreePoolWithTag(AddressEntry, TAG_STORPORT);
+    }
+
+    if (DeviceExtension->UncachedExtension != NULL)
+    {
+        DeviceExtension->DmaAdapter->DmaOperations->FreeCommonBuffer(DeviceExtension->DmaAdapter,
+                                                                     DeviceExtension->UncachedExtensionSize,
+                                                                     DeviceExtension->UncachedExtensionPhysical,
+                                                                     DeviceExtension->UncachedExtension,
+                                                                     FALSE);
+        DeviceExtension->UncachedExtension = NULL;
+        DeviceExtension->UncachedExtensionSize = 0;
+    }
+}
+
+/* EOF */
@@ -0,0 +1,107 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/misc.c
+ * PURPOSE:         Miscellaneous support functions
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS ****************************************************************/
+
+static
+NTSTATUS
+NTAPI
+ForwardIrpAndWaitCompletion(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PVOID Context)
+{
+    if (Irp->PendingReturned)
+        KeSetEvent((PKEVENT)Context, IO_NO_INCREMENT, FALSE);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+
+NTSTATUS
+ForwardIrpAndWait(
+    _In_ PDEVICE_OBJECT LowerDevice,
+    _In_ PIRP Irp)
+{
+    KEVENT Event;
+    NTSTATUS Status;
+
+    ASSERT(LowerDevice);
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    IoSetCompletionRoutine(Irp, ForwardIrpAndWaitCompletion, &Event, TRUE, TRUE, TRUE);
+
+    Status = IoCallDriver(LowerDevice, Irp);
+    if (Status == STATUS_PENDING)
+    {
+        Status = KeWaitForSingleObject(&Event, Suspended, KernelMode, FALSE, NULL);
+        if (NT_SUCCESS(Status))
+            Status = Irp->IoStatus.Status;
+    }
+
+    return Status;
+}
+
+
+NTSTATUS
+NTAPI
+ForwardIrpAndForget(
+    _In_ PDEVICE_OBJECT LowerDevice,
+    _In_ PIRP Irp)
+{
+    ASSERT(LowerDevice);
+
+    IoSkipCurrentIrpStackLocation(Irp);
+    return IoCallDriver(LowerDevice, Irp);
+}
+
+
+PPDO_DEVICE_EXTENSION
+PortGetLun(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+    PLIST_ENTRY ListEntry;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT("PortGetLun(%p %u %u %u)\n",
+           DeviceExtension, PathId, TargetId, Lun);
+
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->LunListLock, &LockHandle);
+
+    for (ListEntry = DeviceExtension->LunListHead.Flink;
+         ListEntry != &DeviceExtension->LunListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        LunExtension = CONTAINING_RECORD(ListEntry, PDO_DEVICE_EXTENSION, LunEntry);
+        if (LunExtension->PathId == PathId &&
+            LunExtension->TargetId == TargetId &&
+            LunExtension->Lun == Lun)
+        {
+            KeReleaseInStackQueuedSpinLock(&LockHandle);
+            return LunExtension;
+        }
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    return NULL;
+}
+
+/* EOF */
@@ -0,0 +1,685 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/pdo.c
+ * PURPOSE:         Logical unit device object (PDO) functions
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS ****************************************************************/
+
+static
+PCWSTR
+PortGetDeviceType(
+    _In_ PINQUIRYDATA InquiryData)
+{
+    switch (InquiryData->DeviceType)
+    {
+        case DIRECT_ACCESS_DEVICE:
+            return L"Disk";
+
+        case SEQUENTIAL_ACCESS_DEVICE:
+            return L"Sequential";
+
+        case PRINTER_DEVICE:
+            return L"Printer";
+
+        case PROCESSOR_DEVICE:
+            return L"Processor";
+
+        case WRITE_ONCE_READ_MULTIPLE_DEVICE:
+            return L"Worm";
+
+        case READ_ONLY_DIRECT_ACCESS_DEVICE:
+            return L"CdRom";
+
+        case SCANNER_DEVICE:
+            return L"Scanner";
+
+        case OPTICAL_DEVICE:
+            return L"Optical";
+
+        case MEDIUM_CHANGER:
+            return L"Changer";
+
+        case COMMUNICATION_DEVICE:
+            return L"Net";
+
+        case ARRAY_CONTROLLER_DEVICE:
+            return L"Array";
+
+        default:
+            return L"Other";
+    }
+}
+
+
+static
+PCWSTR
+PortGetGenericType(
+    _In_ PINQUIRYDATA InquiryData)
+{
+    switch (InquiryData->DeviceType)
+    {
+        case DIRECT_ACCESS_DEVICE:
+            return L"GenDisk";
+
+        case SEQUENTIAL_ACCESS_DEVICE:
+            return L"GenSequential";
+
+        case WRITE_ONCE_READ_MULTIPLE_DEVICE:
+            return L"GenWorm";
+
+        case READ_ONLY_DIRECT_ACCESS_DEVICE:
+            return L"GenCdRom";
+
+        case OPTICAL_DEVICE:
+            return L"GenOptical";
+
+        case MEDIUM_CHANGER:
+            return L"GenChanger";
+
+        default:
+            return L"ScsiOther";
+    }
+}
+
+
+/* Copies an inquiry string, trailing blanks dropped and anything unprintable made an underscore */
+static
+VOID
+PortCopyField(
+    _Out_writes_(Length + 1) PWCHAR Destination,
+    _In_reads_(Length) PUCHAR Source,
+    _In_ ULONG Length)
+{
+    ULONG i;
+
+    while (Length > 0 && Source[Length - 1] == ' ')
+        Length--;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Source[i] <= ' ' || Source[i] >= 0x7F || Source[i] == ',')
+            Destination[i] = L'_';
+        else
+            Destination[i] = (WCHAR)Source[i];
+    }
+
+    Destination[Length] = UNICODE_NULL;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryId(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PINQUIRYDATA InquiryData = &DeviceExtension->InquiryData;
+    WCHAR VendorId[9], ProductId[17], Revision[5];
+    WCHAR Buffer[256];
+    PCWSTR DeviceType;
+    ULONG Index = 0;
+    PWCHAR Id;
+
+    PortCopyField(VendorId, InquiryData->VendorId, sizeof(InquiryData->VendorId));
+    PortCopyField(ProductId, InquiryData->ProductId, sizeof(InquiryData->ProductId));
+    PortCopyField(Revision, InquiryData->ProductRevisionLevel, sizeof(InquiryData->ProductRevisionLevel));
+    DeviceType = PortGetDeviceType(InquiryData);
+
+    switch (Stack->Parameters.QueryId.IdType)
+    {
+        case BusQueryDeviceID:
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_ID / BusQueryDeviceID\n");
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s&Ven_%s&Prod_%s&Rev_%s",
+                              DeviceType, VendorId, ProductId, Revision) + 1;
+            break;
+
+        case BusQueryHardwareIDs:
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_ID / BusQueryHardwareIDs\n");
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s&Ven_%s&Prod_%s&Rev_%s",
+                              DeviceType, VendorId, ProductId, Revision) + 1;
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s&Ven_%s&Prod_%s",
+                              DeviceType, VendorId, ProductId) + 1;
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s&Ven_%s",
+                              DeviceType, VendorId) + 1;
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s", DeviceType) + 1;
+            Index += swprintf(&Buffer[Index], L"%s", PortGetGenericType(InquiryData)) + 1;
+            break;
+
+        case BusQueryCompatibleIDs:
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_ID / BusQueryCompatibleIDs\n");
+            Index += swprintf(&Buffer[Index], L"SCSI\\%s", DeviceType) + 1;
+            Index += swprintf(&Buffer[Index], L"SCSI\\RAW") + 1;
+            break;
+
+        case BusQueryInstanceID:
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_ID / BusQueryInstanceID\n");
+            Index += swprintf(&Buffer[Index], L"%x%x%x",
+                              DeviceExtension->PathId,
+                              DeviceExtension->TargetId,
+                              DeviceExtension->Lun) + 1;
+            break;
+
+        default:
+            return Irp->IoStatus.Status;
+    }
+
+    /* Device and instance IDs are plain strings, the extra terminator does no harm */
+    Buffer[Index++] = UNICODE_NULL;
+
+    Id = ExAllocatePoolWithTag(PagedPool, Index * sizeof(WCHAR), TAG_STORPORT);
+    if (Id == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlCopyMemory(Id, Buffer, Index * sizeof(WCHAR));
+    Irp->IoStatus.Information = (ULONG_PTR)Id;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryDeviceText(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PINQUIRYDATA InquiryData = &DeviceExtension->InquiryData;
+    WCHAR VendorId[9], ProductId[17];
+    WCHAR Buffer[40];
+    ULONG Length;
+    PWCHAR Text;
+
+    if (Stack->Parameters.QueryDeviceText.DeviceTextType != DeviceTextDescription)
+        return Irp->IoStatus.Status;
+
+    PortCopyField(VendorId, InquiryData->VendorId, sizeof(InquiryData->VendorId));
+    PortCopyField(ProductId, InquiryData->ProductId, sizeof(InquiryData->ProductId));
+
+    Length = swprintf(Buffer, L"%s %s", VendorId, ProductId) + 1;
+
+    Text = ExAllocatePoolWithTag(PagedPool, Length * sizeof(WCHAR), TAG_STORPORT);
+    if (Text == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlCopyMemory(Text, Buffer, Length * sizeof(WCHAR));
+    Irp->IoStatus.Information = (ULONG_PTR)Text;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryCapabilities(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PDEVICE_CAPABILITIES Capabilities = Stack->Parameters.DeviceCapabilities.Capabilities;
+
+    if (Capabilities->Version != 1)
+        return STATUS_UNSUCCESSFUL;
+
+    Capabilities->UniqueID = FALSE;
+    Capabilities->Removable = DeviceExtension->InquiryData.RemovableMedia ? TRUE : FALSE;
+    Capabilities->SilentInstall = TRUE;
+    Capabilities->RawDeviceOK = TRUE;
+    Capabilities->Address = (DeviceExtension->TargetId << 8) | DeviceExtension->Lun;
+    Capabilities->UINumber = DeviceExtension->TargetId;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryTargetDeviceRelation(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PDEVICE_RELATIONS DeviceRelations;
+
+    DeviceRelations = ExAllocatePoolWithTag(PagedPool, sizeof(DEVICE_RELATIONS), TAG_STORPORT);
+    if (DeviceRelations == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    ObReferenceObject(DeviceExtension->Common.DeviceObject);
+    DeviceRelations->Count = 1;
+    DeviceRelations->Objects[0] = DeviceExtension->Common.DeviceObject;
+
+    Irp->IoStatus.Information = (ULONG_PTR)DeviceRelations;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryDeviceProperty(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PINQUIRYDATA InquiryData = &DeviceExtension->InquiryData;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PSTORAGE_DEVICE_DESCRIPTOR Descriptor;
+    ULONG BufferLength, Length;
+    PUCHAR Field;
+
+    PropertyQuery = (PSTORAGE_PROPERTY_QUERY)Irp->AssociatedIrp.SystemBuffer;
+    BufferLength = Stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (PropertyQuery->QueryType == PropertyExistsQuery)
+        return STATUS_SUCCESS;
+
+    if (PropertyQuery->QueryType != PropertyStandardQuery)
+        return STATUS_NOT_SUPPORTED;
+
+    /* Vendor, product and revision are appended as NUL-terminated strings */
+    Length = FIELD_OFFSET(STORAGE_DEVICE_DESCRIPTOR, RawDeviceProperties) +
+             INQUIRYDATABUFFERSIZE +
+             sizeof(InquiryData->VendorId) + 1 +
+             sizeof(InquiryData->ProductId) + 1 +
+             sizeof(InquiryData->ProductRevisionLevel) + 1;
+
+    if (BufferLength < sizeof(STORAGE_DESCRIPTOR_HEADER))
+        return STATUS_INFO_LENGTH_MISMATCH;
+
+    Descriptor = (PSTORAGE_DEVICE_DESCRIPTOR)Irp->AssociatedIrp.SystemBuffer;
+
+    if (BufferLength < Length)
+    {
+        Descriptor->Version = sizeof(STORAGE_DEVICE_DESCRIPTOR);
+        Descriptor->Size = Length;
+        Irp->IoStatus.Information = sizeof(STORAGE_DESCRIPTOR_HEADER);
+        return STATUS_SUCCESS;
+    }
+
+    RtlZeroMemory(Descriptor, Length);
+    Descriptor->Version = sizeof(STORAGE_DEVICE_DESCRIPTOR);
+    Descriptor->Size = Length;
+    Descriptor->DeviceType = InquiryData->DeviceType;
+    Descriptor->DeviceTypeModifier = InquiryData->DeviceTypeModifier;
+    Descriptor->RemovableMedia = InquiryData->RemovableMedia ? TRUE : FALSE;
+    Descriptor->CommandQueueing = InquiryData->CommandQueue ? TRUE : FALSE;
+    Descriptor->BusType = BusTypeScsi;
+    Descriptor->RawPropertiesLength = INQUIRYDATABUFFERSIZE;
+    RtlCopyMemory(Descriptor->RawDeviceProperties, InquiryData, INQUIRYDATABUFFERSIZE);
+
+    Field = &Descriptor->RawDeviceProperties[INQUIRYDATABUFFERSIZE];
+
+    Descriptor->VendorIdOffset = (ULONG)(Field - (PUCHAR)Descriptor);
+    RtlCopyMemory(Field, InquiryData->VendorId, sizeof(InquiryData->VendorId));
+    Field += sizeof(InquiryData->VendorId) + 1;
+
+    Descriptor->ProductIdOffset = (ULONG)(Field - (PUCHAR)Descriptor);
+    RtlCopyMemory(Field, InquiryData->ProductId, sizeof(InquiryData->ProductId));
+    Field += sizeof(InquiryData->ProductId) + 1;
+
+    Descriptor->ProductRevisionOffset = (ULONG)(Field - (PUCHAR)Descriptor);
+    RtlCopyMemory(Field, InquiryData->ProductRevisionLevel, sizeof(InquiryData->ProductRevisionLevel));
+
+    Irp->IoStatus.Information = Length;
+
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+PortCreateLun(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _Out_ PPDO_DEVICE_EXTENSION *LunExtension)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PDEVICE_OBJECT Pdo;
+    ULONG ExtensionSize;
+    NTSTATUS Status;
+
+    DPRINT("PortCreateLun(%p %u %u %u)\n", DeviceExtension, PathId, TargetId, Lun);
+
+    /* The miniport logical unit extension follows ours */
+    ExtensionSize = ROUND_UP(sizeof(PDO_DEVICE_EXTENSION), MEMORY_ALLOCATION_ALIGNMENT) +
+                    DeviceExtension->PortConfig.SpecificLuExtensionSize;
+
+    Status = IoCreateDevice(DeviceExtension->Common.DeviceObject->DriverObject,
+                            ExtensionSize,
+                            NULL,
+                            FILE_DEVICE_MASS_STORAGE,
+                            FILE_AUTOGENERATED_DEVICE_NAME | FILE_DEVICE_SECURE_OPEN,
+                            FALSE,
+                            &Pdo);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("IoCreateDevice() failed (Status 0x%08lx)\n", Status);
+        return Status;
+    }
+
+    PdoExtension = (PPDO_DEVICE_EXTENSION)Pdo->DeviceExtension;
+    RtlZeroMemory(PdoExtension, ExtensionSize);
+
+    PdoExtension->Common.IsFDO = FALSE;
+    PdoExtension->Common.DeviceObject = Pdo;
+    PdoExtension->Common.PnpState = dsStopped;
+    PdoExtension->Adapter = DeviceExtension;
+    PdoExtension->PathId = PathId;
+    PdoExtension->TargetId = TargetId;
+    PdoExtension->Lun = Lun;
+    PdoExtension->QueueDepth = STORPORT_DEFAULT_QUEUE_DEPTH;
+    KeInitializeSpinLock(&PdoExtension->QueueLock);
+    InitializeListHead(&PdoExtension->RequestQueue);
+    KeInitializeTimer(&PdoExtension->PauseTimer);
+    KeInitializeDpc(&PdoExtension->PauseTimerDpc, PortLunPauseTimerDpc, PdoExtension);
+
+    if (DeviceExtension->PortConfig.SpecificLuExtensionSize != 0)
+    {
+        PdoExtension->MiniportLunExtension =
+            (PUCHAR)PdoExtension + ROUND_UP(sizeof(PDO_DEVICE_EXTENSION), MEMORY_ALLOCATION_ALIGNMENT);
+    }
+
+    Pdo->AlignmentRequirement = DeviceExtension->PortConfig.AlignmentMask;
+    Pdo->Flags |= DO_DIRECT_IO | DO_BUS_ENUMERATED_DEVICE | DO_POWER_PAGABLE;
+    Pdo->Flags &= ~DO_DEVICE_INITIALIZING;
+
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->LunListLock, &LockHandle);
+    InsertTailList(&DeviceExtension->LunListHead, &PdoExtension->LunEntry);
+    DeviceExtension->LunCount++;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    *LunExtension = PdoExtension;
+
+    return STATUS_SUCCESS;
+}
+
+
+VOID
+PortDeleteLun(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = LunExtension->Adapter;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT("PortDeleteLun(%p)\n", LunExtension);
+
+    ASSERT(IsListEmpty(&LunExtension->RequestQueue));
+    ASSERT(LunExtension->OutstandingCount == 0);
+
+    /* A pending pause must not fire on a deleted unit */
+    KeCancelTimer(&LunExtension->PauseTimer);
+    KeRemoveQueueDpc(&LunExtension->PauseTimerDpc);
+    KeFlushQueuedDpcs();
+
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->LunListLock, &LockHandle);
+    RemoveEntryList(&LunExtension->LunEntry);
+    DeviceExtension->LunCount--;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    LunExtension->Common.PnpState = dsRemoved;
+    IoDeleteDevice(LunExtension->Common.DeviceObject);
+}
+
+
+NTSTATUS
+NTAPI
+PortPdoPnp(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    NTSTATUS Status;
+
+    DPRINT("PortPdoPnp(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(!DeviceExtension->Common.IsFDO);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->MinorFunction)
+    {
+        case IRP_MN_START_DEVICE: /* 0x00 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_START_DEVICE\n");
+            DeviceExtension->Common.PnpState = dsStarted;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_REMOVE_DEVICE: /* 0x01 */
+        case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
+        case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
+        case IRP_MN_CANCEL_STOP_DEVICE: /* 0x06 */
+        case IRP_MN_SURPRISE_REMOVAL: /* 0x17 */
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_REMOVE_DEVICE: /* 0x02 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_REMOVE_DEVICE\n");
+            PortFlushLunQueue(DeviceExtension, SRB_STATUS_NO_DEVICE);
+
+            /* A unit still on the bus stays until its adapter goes */
+            if (!DeviceExtension->Present)
+            {
+                Irp->IoStatus.Status = STATUS_SUCCESS;
+                IoCompleteRequest(Irp, IO_NO_INCREMENT);
+                PortDeleteLun(DeviceExtension);
+                return STATUS_SUCCESS;
+            }
+
+            DeviceExtension->Common.PnpState = dsStopped;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_STOP_DEVICE: /* 0x04 */
+            DeviceExtension->Common.PnpState = dsStopped;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_DEVICE_RELATIONS: /* 0x07 */
+            if (Stack->Parameters.QueryDeviceRelations.Type == TargetDeviceRelation)
+                Status = PortPdoQueryTargetDeviceRelation(DeviceExtension, Irp);
+            else
+                Status = Irp->IoStatus.Status;
+            break;
+
+        case IRP_MN_QUERY_CAPABILITIES: /* 0x09 */
+            Status = PortPdoQueryCapabilities(DeviceExtension, Irp);
+            break;
+
+        case IRP_MN_QUERY_DEVICE_TEXT: /* 0x0c */
+            Status = PortPdoQueryDeviceText(DeviceExtension, Irp);
+            break;
+
+        case IRP_MN_QUERY_ID: /* 0x13 */
+            Status = PortPdoQueryId(DeviceExtension, Irp);
+            break;
+
+        case IRP_MN_QUERY_RESOURCES: /* 0x0a */
+        case IRP_MN_QUERY_RESOURCE_REQUIREMENTS: /* 0x0b */
+            /* The unit has no resources of its own */
+        default:
+            DPRINT("IRP_MJ_PNP / Unknown minor function 0x%x\n", Stack->MinorFunction);
+            Status = Irp->IoStatus.Status;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+NTSTATUS
+PortPdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PSTORAGE_PROPERTY_QUERY PropertyQuery;
+    PSCSI_ADDRESS ScsiAddress;
+    PIO_STACK_LOCATION Stack;
+    NTSTATUS Status;
+
+    DPRINT("PortPdoDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(!DeviceExtension->Common.IsFDO);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    switch (Stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+        case IOCTL_STORAGE_QUERY_PROPERTY:
+            PropertyQuery = (PSTORAGE_PROPERTY_QUERY)Irp->AssociatedIrp.SystemBuffer;
+            if (Stack->Parameters.DeviceIoControl.InputBufferLength < FIELD_OFFSET(STORAGE_PROPERTY_QUERY, AdditionalParameters))
+            {
+                Status = STATUS_INVALID_PARAMETER;
+            }
+            else if (PropertyQuery->PropertyId == StorageAdapterProperty)
+            {
+                Status = PortFdoQueryAdapterProperty(DeviceExtension->Adapter, Irp);
+            }
+            else if (PropertyQuery->PropertyId == StorageDeviceProperty)
+            {
+                Status = PortPdoQueryDeviceProperty(DeviceExtension, Irp);
+            }
+            else
+            {
+                Status = STATUS_NOT_SUPPORTED;
+            }
+            break;
+
+        case IOCTL_SCSI_GET_ADDRESS:
+            if (Stack->Parameters.DeviceIoControl.OutputBufferLength < sizeof(SCSI_ADDRESS))
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            ScsiAddress = (PSCSI_ADDRESS)Irp->AssociatedIrp.SystemBuffer;
+            ScsiAddress->Length = sizeof(SCSI_ADDRESS);
+            ScsiAddress->PortNumber = (UCHAR)DeviceExtension->Adapter->AdapterNumber;
+            ScsiAddress->PathId = DeviceExtension->PathId;
+            ScsiAddress->TargetId = DeviceExtension->TargetId;
+            ScsiAddress->Lun = DeviceExtension->Lun;
+
+            Irp->IoStatus.Information = sizeof(SCSI_ADDRESS);
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            DPRINT1("Unsupported IOCTL 0x%lx\n", Stack->Parameters.DeviceIoControl.IoControlCode);
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+NTSTATUS
+PortPdoScsi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PSCSI_REQUEST_BLOCK Srb;
+    NTSTATUS Status;
+
+    DPRINT("PortPdoScsi(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(!DeviceExtension->Common.IsFDO);
+
+    Srb = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+    /* The class driver addresses the unit through its device object */
+    Srb->PathId = DeviceExtension->PathId;
+    Srb->TargetId = DeviceExtension->TargetId;
+    Srb->Lun = DeviceExtension->Lun;
+
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_EXECUTE_SCSI:
+        case SRB_FUNCTION_IO_CONTROL:
+        case SRB_FUNCTION_SHUTDOWN:
+        case SRB_FUNCTION_FLUSH:
+        case SRB_FUNCTION_ABORT_COMMAND:
+        case SRB_FUNCTION_RESET_DEVICE:
+            if (DeviceExtension->Adapter->Common.PnpState != dsStarted)
+            {
+                Srb->SrbStatus = SRB_STATUS_NO_HBA;
+                Status = STATUS_DEVICE_NOT_READY;
+                break;
+            }
+
+            IoMarkIrpPending(Irp);
+            PortQueueRequest(DeviceExtension, Irp);
+            return STATUS_PENDING;
+
+        case SRB_FUNCTION_CLAIM_DEVICE:
+            if (DeviceExtension->Claimed)
+            {
+                Srb->SrbStatus = SRB_STATUS_BUSY;
+                Status = STATUS_DEVICE_BUSY;
+                break;
+            }
+
+            DeviceExtension->Claimed = TRUE;
+            Srb->DataBuffer = DeviceObject;
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_RELEASE_DEVICE:
+            DeviceExtension->Claimed = FALSE;
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_FLUSH_QUEUE:
+            PortFlushLunQueue(DeviceExtension, SRB_STATUS_REQUEST_FLUSHED);
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_RELEASE_QUEUE:
+        case SRB_FUNCTION_LOCK_QUEUE:
+        case SRB_FUNCTION_UNLOCK_QUEUE:
+            /* The queue is never frozen */
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            DPRINT1("Unsupported SRB function 0x%x\n", Srb->Function);
+            Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+/* EOF */
@@ -0,0 +1,403 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/precomp.h
+ * PURPOSE:         Storport driver internal definitions
+ */
+
+#ifndef _STORPORT_PCH_
+#define _STORPORT_PCH_
+
+#include <ntddk.h>
+#include <stdio.h>
+
+/* storport.h has to come first so that srb.h picks up the Storport extensions */
+#define _STORPORT_
+#include <storport.h>
+#include <scsi.h>
+#include <ntddscsi.h>
+#include <ntddstor.h>
+#include <ntdddisk.h>
+
+#define TAG_STORPORT 'PROS'
+
+#ifndef ROUND_UP
+#define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
+#endif
+
+/* Requests the adapter can have in flight, the SRB extensions are preallocated for them */
+#define STORPORT_MAX_REQUESTS           128
+
+/* How long stopping an adapter waits for the requests the miniport has, in seconds */
+#define STORPORT_STOP_TIMEOUT           10
+
+/* Queue depth of a logical unit until the miniport sets one */
+#define STORPORT_DEFAULT_QUEUE_DEPTH    20
+#define STORPORT_MAX_QUEUE_DEPTH        254
+
+/* Notifications the completion DPC has to act on */
+#define PORT_NOTIFY_TIMER               0x00000001
+#define PORT_NOTIFY_BUS_CHANGE          0x00000002
+
+typedef enum _DEVICE_STATE
+{
+    dsStopped,
+    dsStarted,
+    dsRemoved
+} DEVICE_STATE;
+
+typedef struct _DRIVER_INIT_DATA
+{
+    LIST_ENTRY Entry;
+    PVOID HwContext;
+    HW_INITIALIZATION_DATA HwInitData;
+} DRIVER_INIT_DATA, *PDRIVER_INIT_DATA;
+
+typedef struct _DRIVER_OBJECT_EXTENSION
+{
+    PDRIVER_OBJECT DriverObject;
+    LIST_ENTRY InitDataListHead;
+    ULONG AdapterCount;
+} DRIVER_OBJECT_EXTENSION, *PDRIVER_OBJECT_EXTENSION;
+
+typedef struct _COMMON_DEVICE_EXTENSION
+{
+    BOOLEAN IsFDO;
+    PDEVICE_OBJECT DeviceObject;
+    DEVICE_STATE PnpState;
+} COMMON_DEVICE_EXTENSION, *PCOMMON_DEVICE_EXTENSION;
+
+/*
+ * One per Srb handed to the miniport. The SRB extension of each request lives
+ * in a single common buffer so the miniport can DMA from it, and the request
+ * is found again from the IRP through DriverContext[0].
+ *
+ * Owner is nonzero while the miniport owns the request and differs for every
+ * use of it. Whoever completes the request first swaps it to zero, which is
+ * what lets StorPortCompleteRequest run at any IRQL without a lock.
+ */
+typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) _STORPORT_REQUEST
+{
+    SLIST_ENTRY Entry;          /* Free list or completion list */
+    PIRP Irp;
+    PSCSI_REQUEST_BLOCK Srb;
+    struct _PDO_DEVICE_EXTENSION *Lun;
+    PVOID SrbExtension;
+    PVOID OriginalDataBuffer;
+    PSCATTER_GATHER_LIST SgList;
+    LONG Owner;
+    UCHAR PathId;
+    UCHAR TargetId;
+    UCHAR LunId;
+} STORPORT_REQUEST, *PSTORPORT_REQUEST;
+
+typedef struct _FDO_DEVICE_EXTENSION
+{
+    COMMON_DEVICE_EXTENSION Common;
+
+    PDEVICE_OBJECT LowerDevice;
+    PDEVICE_OBJECT PhysicalDevice;
+    PDRIVER_INIT_DATA InitData;
+    ULONG AdapterNumber;
+
+    /* Configuration handed to HwFindAdapter */
+    PORT_CONFIGURATION_INFORMATION PortConfig;
+    ACCESS_RANGE AccessRanges[16];
+    LIST_ENTRY MappedAddressList;
+    ULONG BusNumber;
+    ULONG SlotNumber;
+    PCM_RESOURCE_LIST AllocatedResources;
+    PCM_RESOURCE_LIST TranslatedResources;
+
+    /* Interrupt */
+    PKINTERRUPT Interrupt;
+    KSPIN_LOCK InterruptSpinLock;   /* Stands in for the interrupt lock of polled adapters */
+    ULONG InterruptVector;
+    KIRQL InterruptIrql;
+    KINTERRUPT_MODE InterruptMode;
+    KAFFINITY InterruptAffinity;
+    BOOLEAN InterruptShared;
+
+    /* DMA */
+    PDMA_ADAPTER DmaAdapter;
+    ULONG NumberOfMapRegisters;
+    PVOID UncachedExtension;
+    PHYSICAL_ADDRESS UncachedExtensionPhysical;
+    ULONG UncachedExtensionSize;
+
+    /* Requests and their SRB extensions */
+    PSTORPORT_REQUEST Requests;
+    ULONG RequestCount;
+    PVOID SrbExtensionBuffer;
+    PHYSICAL_ADDRESS SrbExtensionPhysical;
+    ULONG SrbExtensionSize;
+    BOOLEAN SrbExtensionCommon;
+    SLIST_HEADER FreeRequests;
+    LONG RequestStarved;
+    LONG NextOwner;
+
+    /* Completion: the miniport pushes, the DPC completes the whole batch */
+    SLIST_HEADER CompletedRequests;
+    KDPC CompletionDpc;
+    LONG PendingNotifications;
+
+    /* Synchronization with HwStartIo */
+    STOR_SYNCHRONIZATION_MODEL SynchronizationModel;
+    KSPIN_LOCK StartIoLock;
+
+    /* StorPortPause and StorPortBusy, every armed pause timer holds one pause count */
+    LONG PauseCount;
+    KTIMER PauseTimer;
+    KDPC PauseTimerDpc;
+    LONG BusyCount;             /* Completions to wait for before starting requests again */
+
+    /* Stop: no request starts once Stopping is set, none is sent once the miniport is stopped */
+    BOOLEAN Stopping;
+    BOOLEAN MiniportStarted;
+
+    /* Miniport timer */
+    KTIMER MiniportTimer;
+    KDPC MiniportTimerDpc;
+    PHW_TIMER HwTimer;
+    ULONG TimerValue;
+
+    PHW_PASSIVE_INITIALIZE_ROUTINE HwPassiveInitRoutine;
+
+    /* Logical units */
+    KSPIN_LOCK LunListLock;
+    LIST_ENTRY LunListHead;
+    ULONG LunCount;
+
+    struct _MINIPORT_DEVICE_EXTENSION *Miniport;
+    PVOID MiniportExtension;            /* Miniport->HwDeviceExtension */
+} FDO_DEVICE_EXTENSION, *PFDO_DEVICE_EXTENSION;
+
+/* The miniport device extension, preceded by a link back to its adapter */
+typedef struct _MINIPORT_DEVICE_EXTENSION
+{
+    PFDO_DEVICE_EXTENSION Adapter;
+    LONGLONG HwDeviceExtension[ANYSIZE_ARRAY];
+} MINIPORT_DEVICE_EXTENSION, *PMINIPORT_DEVICE_EXTENSION;
+
+typedef struct _PDO_DEVICE_EXTENSION
+{
+    COMMON_DEVICE_EXTENSION Common;
+
+    LIST_ENTRY LunEntry;
+    PFDO_DEVICE_EXTENSION Adapter;
+
+    UCHAR PathId;
+    UCHAR TargetId;
+    UCHAR Lun;
+    BOOLEAN Present;
+    BOOLEAN Reported;       /* Handed to PnP in the bus relations */
+    BOOLEAN Claimed;
+
+    INQUIRYDATA InquiryData;
+
+    /* Request queue of this unit */
+    KSPIN_LOCK QueueLock;
+    LIST_ENTRY RequestQueue;
+    ULONG OutstandingCount;
+    ULONG QueueDepth;
+
+    /* StorPortPauseDevice and StorPortDeviceBusy, same as for the adapter */
+    LONG PauseCount;
+    KTIMER PauseTimer;
+    KDPC PauseTimerDpc;
+    LONG BusyCount;
+
+    PVOID MiniportLunExtension;
+} PDO_DEVICE_EXTENSION, *PPDO_DEVICE_EXTENSION;
+
+typedef struct _MAPPED_ADDRESS_ENTRY
+{
+    LIST_ENTRY Entry;
+    PVOID MappedAddress;
+    ULONG NumberOfBytes;
+    PHYSICAL_ADDRESS IoAddress;
+    BOOLEAN InIoSpace;
+} MAPPED_ADDRESS_ENTRY, *PMAPPED_ADDRESS_ENTRY;
+
+
+/* fdo.c */
+
+NTSTATUS
+NTAPI
+PortFdoPnp(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortFdoQueryAdapterProperty(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+/* miniport.c */
+
+NTSTATUS
+MiniportFindAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PCM_RESOURCE_LIST AllocatedResources,
+    _In_ PCM_RESOURCE_LIST TranslatedResources);
+
+NTSTATUS
+MiniportInitialize(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+VOID
+MiniportStop(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+PFDO_DEVICE_EXTENSION
+MiniportGetAdapter(
+    _In_ PVOID MiniportExtension);
+
+PDMA_ADAPTER
+MiniportGetDmaAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+BOOLEAN
+MiniportTranslateResourceAddress(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PHYSICAL_ADDRESS IoAddress,
+    _In_ ULONG NumberOfBytes,
+    _In_ BOOLEAN InIoSpace,
+    _Out_ PPHYSICAL_ADDRESS TranslatedAddress);
+
+/* misc.c */
+
+NTSTATUS
+ForwardIrpAndWait(
+    _In_ PDEVICE_OBJECT LowerDevice,
+    _In_ PIRP Irp);
+
+NTSTATUS
+NTAPI
+ForwardIrpAndForget(
+    _In_ PDEVICE_OBJECT LowerDevice,
+    _In_ PIRP Irp);
+
+PPDO_DEVICE_EXTENSION
+PortGetLun(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun);
+
+/* pdo.c */
+
+NTSTATUS
+NTAPI
+PortPdoPnp(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortPdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortPdoScsi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+PortCreateLun(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _Out_ PPDO_DEVICE_EXTENSION *LunExtension);
+
+VOID
+PortDeleteLun(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension);
+
+/* queue.c */
+
+NTSTATUS
+PortAllocateRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+VOID
+PortFreeRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+BOOLEAN
+PortDrainRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+VOID
+PortQueueRequest(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ PIRP Irp);
+
+VOID
+PortStartNextRequests(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension);
+
+VOID
+PortStartAllLuns(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension);
+
+VOID
+PortFlushLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ UCHAR SrbStatus);
+
+VOID
+PortNotifyRequestComplete(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+VOID
+PortCompleteOutstandingRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ UCHAR SrbStatus);
+
+VOID
+PortPause(
+    _In_ PKTIMER Timer,
+    _In_ PKDPC Dpc,
+    _Inout_ PLONG PauseCount,
+    _In_ ULONG TimeOut);
+
+BOOLEAN
+PortResume(
+    _In_ PKTIMER Timer,
+    _In_ PKDPC Dpc,
+    _Inout_ PLONG PauseCount);
+
+KDEFERRED_ROUTINE PortCompletionDpc;
+KDEFERRED_ROUTINE PortMiniportTimerDpc;
+KDEFERRED_ROUTINE PortPauseTimerDpc;
+KDEFERRED_ROUTINE PortLunPauseTimerDpc;
+
+PSTOR_SCATTER_GATHER_LIST
+PortGetScatterGatherList(
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+BOOLEAN
+PortGetRequestPhysicalAddress(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PVOID VirtualAddress,
+    _Out_ PPHYSICAL_ADDRESS PhysicalAddress,
+    _Out_ PULONG Length);
+
+/* storport.c */
+
+extern ULONG PortNumber;
+
+DRIVER_INITIALIZE DriverEntry;
+
+#endif /* _STORPORT_PCH_ */
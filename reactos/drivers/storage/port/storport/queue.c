@@ -0,0 +1,981 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/queue.c
+ * PURPOSE:         Logical unit queues, request start and batched completion
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* The miniport gets the HAL list as is */
+C_ASSERT(FIELD_OFFSET(STOR_SCATTER_GATHER_LIST, List) == FIELD_OFFSET(SCATTER_GATHER_LIST, Elements));
+C_ASSERT(sizeof(STOR_SCATTER_GATHER_ELEMENT) == sizeof(SCATTER_GATHER_ELEMENT));
+
+/* FUNCTIONS ****************************************************************/
+
+static
+NTSTATUS
+PortSrbStatusToNtStatus(
+    _In_ UCHAR SrbStatus)
+{
+    switch (SRB_STATUS(SrbStatus))
+    {
+        case SRB_STATUS_SUCCESS:
+            return STATUS_SUCCESS;
+
+        case SRB_STATUS_TIMEOUT:
+        case SRB_STATUS_COMMAND_TIMEOUT:
+            return STATUS_IO_TIMEOUT;
+
+        case SRB_STATUS_BAD_SRB_BLOCK_LENGTH:
+        case SRB_STATUS_BAD_FUNCTION:
+        case SRB_STATUS_INVALID_REQUEST:
+            return STATUS_INVALID_DEVICE_REQUEST;
+
+        case SRB_STATUS_NO_DEVICE:
+        case SRB_STATUS_INVALID_LUN:
+        case SRB_STATUS_INVALID_TARGET_ID:
+        case SRB_STATUS_NO_HBA:
+            return STATUS_DEVICE_DOES_NOT_EXIST;
+
+        case SRB_STATUS_DATA_OVERRUN:
+            return STATUS_BUFFER_OVERFLOW;
+
+        case SRB_STATUS_SELECTION_TIMEOUT:
+            return STATUS_DEVICE_NOT_CONNECTED;
+
+        case SRB_STATUS_BUSY:
+            return STATUS_DEVICE_BUSY;
+
+        default:
+            return STATUS_IO_DEVICE_ERROR;
+    }
+}
+
+
+static
+PSTORPORT_REQUEST
+PortGetRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PIRP Irp = (PIRP)Srb->OriginalRequest;
+
+    return (PSTORPORT_REQUEST)Irp->Tail.Overlay.DriverContext[0];
+}
+
+
+static
+BOOLEAN
+PortIsReadWrite(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    switch (Srb->Cdb[0])
+    {
+        case SCSIOP_READ6:
+        case SCSIOP_WRITE6:
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+        case SCSIOP_READ12:
+        case SCSIOP_WRITE12:
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+
+static
+BOOLEAN
+NTAPI
+PortStartIoSynchronized(
+    _In_ PVOID SynchronizeContext)
+{
+    PSTORPORT_REQUEST Request = (PSTORPORT_REQUEST)SynchronizeContext;
+    PFDO_DEVICE_EXTENSION DeviceExtension = Request->Lun->Adapter;
+
+    return DeviceExtension->InitData->HwInitData.HwStartIo(DeviceExtension->MiniportExtension,
+                                                           Request->Srb);
+}
+
+
+static
+BOOLEAN
+NTAPI
+PortTimerSynchronized(
+    _In_ PVOID SynchronizeContext)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)SynchronizeContext;
+    PHW_TIMER HwTimer = DeviceExtension->HwTimer;
+
+    if (HwTimer != NULL)
+        HwTimer(DeviceExtension->MiniportExtension);
+
+    return TRUE;
+}
+
+
+/*
+ * Runs a miniport routine the way HwStartIo has to be called. A full duplex
+ * miniport only gets the StartIo lock, its interrupt keeps running on other
+ * processors. A half duplex one is serialized with its interrupt as well.
+ */
+static
+BOOLEAN
+PortSynchronizeStartIo(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PKSYNCHRONIZE_ROUTINE Routine,
+    _In_ PVOID Context)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+    BOOLEAN Result;
+
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->StartIoLock, &LockHandle);
+
+    if (DeviceExtension->SynchronizationModel == StorSynchronizeFullDuplex)
+    {
+        Result = Routine(Context);
+    }
+    else if (DeviceExtension->Interrupt != NULL)
+    {
+        Result = KeSynchronizeExecution(DeviceExtension->Interrupt, Routine, Context);
+    }
+    else
+    {
+        KeAcquireSpinLockAtDpcLevel(&DeviceExtension->InterruptSpinLock);
+        Result = Routine(Context);
+        KeReleaseSpinLockFromDpcLevel(&DeviceExtension->InterruptSpinLock);
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    return Result;
+}
+
+
+/* From now on the miniport owns the request and StorPortCompleteRequest may complete it */
+static
+VOID
+PortHandOverRequest(
+    _In_ PSTORPORT_REQUEST Request)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = Request->Lun->Adapter;
+    LONG Owner;
+
+    Request->PathId = Request->Srb->PathId;
+    Request->TargetId = Request->Srb->TargetId;
+    Request->LunId = Request->Srb->Lun;
+
+    do
+    {
+        Owner = InterlockedIncrement(&DeviceExtension->NextOwner);
+    } while (Owner == 0);
+
+    InterlockedExchange(&Request->Owner, Owner);
+}
+
+
+static
+VOID
+PortSendRequest(
+    _In_ PSTORPORT_REQUEST Request)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = Request->Lun->Adapter;
+    PHW_BUILDIO HwBuildIo = DeviceExtension->InitData->HwInitData.HwBuildIo;
+
+    DPRINT("PortSendRequest(%p)\n", Request);
+
+    PortHandOverRequest(Request);
+
+    /* The scatter/gather list may only have come after the adapter was stopped */
+    if (!DeviceExtension->MiniportStarted)
+    {
+        Request->Srb->SrbStatus = SRB_STATUS_NO_HBA;
+        PortNotifyRequestComplete(DeviceExtension, Request->Srb);
+        return;
+    }
+
+    /* HwBuildIo runs without any lock, FALSE means the miniport already completed the request */
+    if (HwBuildIo != NULL &&
+        !HwBuildIo(DeviceExtension->MiniportExtension, Request->Srb))
+    {
+        return;
+    }
+
+    PortSynchronizeStartIo(DeviceExtension, PortStartIoSynchronized, Request);
+}
+
+
+static
+VOID
+NTAPI
+PortScatterGatherListReady(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PSCATTER_GATHER_LIST ScatterGather,
+    _In_ PVOID Context)
+{
+    PSTORPORT_REQUEST Request = (PSTORPORT_REQUEST)Context;
+
+    DPRINT("PortScatterGatherListReady(%p %p %p %p)\n",
+           DeviceObject, Irp, ScatterGather, Context);
+
+    Request->SgList = ScatterGather;
+    PortSendRequest(Request);
+}
+
+
+static
+VOID
+PortStartRequest(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ PSTORPORT_REQUEST Request,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = LunExtension->Adapter;
+    PSCSI_REQUEST_BLOCK Srb;
+    PVOID SystemAddress;
+    BOOLEAN MapBuffer;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    Srb = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+    DPRINT("PortStartRequest(%p %p %p)\n", LunExtension, Request, Srb);
+
+    Request->Irp = Irp;
+    Request->Srb = Srb;
+    Request->Lun = LunExtension;
+    Request->OriginalDataBuffer = Srb->DataBuffer;
+    Request->SgList = NULL;
+    Irp->Tail.Overlay.DriverContext[0] = Request;
+
+    Srb->OriginalRequest = Irp;
+    Srb->SrbStatus = SRB_STATUS_PENDING;
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    Srb->QueueTag = (UCHAR)(Request - DeviceExtension->Requests) + 1;
+    Srb->SrbFlags |= SRB_FLAGS_IS_ACTIVE;
+
+    if (DeviceExtension->SrbExtensionSize != 0)
+    {
+        RtlZeroMemory(Request->SrbExtension, DeviceExtension->SrbExtensionSize);
+        Srb->SrbExtension = Request->SrbExtension;
+    }
+
+    if (Irp->MdlAddress == NULL ||
+        !(Srb->SrbFlags & (SRB_FLAGS_DATA_IN | SRB_FLAGS_DATA_OUT)))
+    {
+        PortSendRequest(Request);
+        return;
+    }
+
+    /* Give the miniport a system address for the buffers it wants to touch */
+    switch (DeviceExtension->PortConfig.MapBuffers)
+    {
+        case STOR_MAP_ALL_BUFFERS:
+            MapBuffer = TRUE;
+            break;
+
+        case STOR_MAP_NON_READ_WRITE_BUFFERS:
+            MapBuffer = !PortIsReadWrite(Srb);
+            break;
+
+        default:
+            MapBuffer = FALSE;
+            break;
+    }
+
+    if (MapBuffer)
+    {
+        SystemAddress = MmGetSystemAddressForMdlSafe(Irp->MdlAddress, HighPagePriority);
+        if (SystemAddress == NULL)
+        {
+            Srb->SrbStatus = SRB_STATUS_INTERNAL_ERROR;
+            PortHandOverRequest(Request);
+            PortNotifyRequestComplete(DeviceExtension, Srb);
+            return;
+        }
+
+        Srb->DataBuffer = (PUCHAR)SystemAddress +
+                          ((PUCHAR)Srb->DataBuffer - (PUCHAR)MmGetMdlVirtualAddress(Irp->MdlAddress));
+    }
+
+    if (DeviceExtension->DmaAdapter == NULL)
+    {
+        PortSendRequest(Request);
+        return;
+    }
+
+    /* The list is built at DISPATCH_LEVEL, the callback starts the request */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Status = DeviceExtension->DmaAdapter->DmaOperations->GetScatterGatherList(DeviceExtension->DmaAdapter,
+                                                                              DeviceExtension->Common.DeviceObject,
+                                                                              Irp->MdlAddress,
+                                                                              Request->OriginalDataBuffer,
+                                                                              Srb->DataTransferLength,
+                                                                              PortScatterGatherListReady,
+                                                                              Request,
+                                                                              (Srb->SrbFlags & SRB_FLAGS_DATA_OUT) != 0);
+    KeLowerIrql(OldIrql);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("GetScatterGatherList() failed (Status 0x%08lx)\n", Status);
+        Srb->SrbStatus = SRB_STATUS_INTERNAL_ERROR;
+        PortHandOverRequest(Request);
+        PortNotifyRequestComplete(DeviceExtension, Srb);
+    }
+}
+
+
+NTSTATUS
+PortAllocateRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PDMA_ADAPTER DmaAdapter = DeviceExtension->DmaAdapter;
+    ULONG i, RequestCount = STORPORT_MAX_REQUESTS;
+
+    DPRINT("PortAllocateRequests(%p)\n", DeviceExtension);
+
+    /* The SRB extensions go in one common buffer, with fewer requests if memory is short */
+    if (DeviceExtension->SrbExtensionSize != 0)
+    {
+        if (DmaAdapter != NULL)
+        {
+            while (RequestCount >= 16)
+            {
+                DeviceExtension->SrbExtensionBuffer =
+                    DmaAdapter->DmaOperations->AllocateCommonBuffer(DmaAdapter,
+                                                                    DeviceExtension->SrbExtensionSize * RequestCount,
+                                                                    &DeviceExtension->SrbExtensionPhysical,
+                                                                    TRUE);
+                if (DeviceExtension->SrbExtensionBuffer != NULL)
+                {
+                    DeviceExtension->SrbExtensionCommon = TRUE;
+                    break;
+                }
+
+                RequestCount /= 2;
+            }
+        }
+
+        if (DeviceExtension->SrbExtensionBuffer == NULL)
+        {
+            RequestCount = STORPORT_MAX_REQUESTS;
+            DeviceExtension->SrbExtensionBuffer = ExAllocatePoolWithTag(NonPagedPool,
+                                                                        DeviceExtension->SrbExtensionSize * RequestCount,
+                                                                        TAG_STORPORT);
+            if (DeviceExtension->SrbExtensionBuffer == NULL)
+                return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    DeviceExtension->Requests = ExAllocatePoolWithTag(NonPagedPool,
+                                                      RequestCount * sizeof(STORPORT_REQUEST),
+                                                      TAG_STORPORT);
+    if (DeviceExtension->Requests == NULL)
+    {
+        PortFreeRequests(DeviceExtension);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(DeviceExtension->Requests, RequestCount * sizeof(STORPORT_REQUEST));
+    DeviceExtension->RequestCount = RequestCount;
+
+    for (i = RequestCount; i > 0; i--)
+    {
+        if (DeviceExtension->SrbExtensionBuffer != NULL)
+        {
+            DeviceExtension->Requests[i - 1].SrbExtension =
+                (PUCHAR)DeviceExtension->SrbExtensionBuffer + (i - 1) * DeviceExtension->SrbExtensionSize;
+        }
+
+        InterlockedPushEntrySList(&DeviceExtension->FreeRequests, &DeviceExtension->Requests[i - 1].Entry);
+    }
+
+    DPRINT("%lu requests, SRB extension size %lu\n", RequestCount, DeviceExtension->SrbExtensionSize);
+
+    return STATUS_SUCCESS;
+}
+
+
+VOID
+PortFreeRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PDMA_ADAPTER DmaAdapter = DeviceExtension->DmaAdapter;
+
+    DPRINT("PortFreeRequests(%p)\n", DeviceExtension);
+
+    InterlockedFlushSList(&DeviceExtension->FreeRequests);
+
+    if (DeviceExtension->SrbExtensionBuffer != NULL)
+    {
+        if (DeviceExtension->SrbExtensionCommon)
+        {
+            DmaAdapter->DmaOperations->FreeCommonBuffer(DmaAdapter,
+                                                        DeviceExtension->SrbExtensionSize * DeviceExtension->RequestCount,
+                                                        DeviceExtension->SrbExtensionPhysical,
+                                                        DeviceExtension->SrbExtensionBuffer,
+                                                        TRUE);
+        }
+        else
+        {
+            ExFreePoolWithTag(DeviceExtension->SrbExtensionBuffer, TAG_STORPORT);
+        }
+
+        DeviceExtension->SrbExtensionBuffer = NULL;
+        DeviceExtension->SrbExtensionCommon = FALSE;
+    }
+
+    if (DeviceExtension->Requests != NULL)
+    {
+        ExFreePoolWithTag(DeviceExtension->Requests, TAG_STORPORT);
+        DeviceExtension->Requests = NULL;
+    }
+
+    DeviceExtension->RequestCount = 0;
+}
+
+
+/*
+ * Stops starting requests and gives the ones in flight some time to
+ * complete. The queued ones stay on their units. Returns FALSE if the
+ * miniport still has requests when the time is up.
+ */
+BOOLEAN
+PortDrainRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    LARGE_INTEGER Interval;
+    ULONG Waited;
+
+    DPRINT("PortDrainRequests(%p)\n", DeviceExtension);
+
+    DeviceExtension->Stopping = TRUE;
+    KeMemoryBarrier();
+
+    /* A request is back on the free list once the completion DPC is done with it */
+    Interval.QuadPart = -10LL * 1000 * 10;
+    for (Waited = 0; Waited < STORPORT_STOP_TIMEOUT * 1000; Waited += 10)
+    {
+        if (ExQueryDepthSList(&DeviceExtension->FreeRequests) == DeviceExtension->RequestCount)
+            return TRUE;
+
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    }
+
+    DPRINT1("%lu requests still outstanding\n",
+            DeviceExtension->RequestCount - ExQueryDepthSList(&DeviceExtension->FreeRequests));
+
+    return FALSE;
+}
+
+
+BOOLEAN
+PortGetRequestPhysicalAddress(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PVOID VirtualAddress,
+    _Out_ PPHYSICAL_ADDRESS PhysicalAddress,
+    _Out_ PULONG Length)
+{
+    ULONG_PTR Offset;
+
+    if (!DeviceExtension->SrbExtensionCommon)
+        return FALSE;
+
+    Offset = (ULONG_PTR)VirtualAddress - (ULONG_PTR)DeviceExtension->SrbExtensionBuffer;
+    if (Offset >= DeviceExtension->SrbExtensionSize * DeviceExtension->RequestCount)
+        return FALSE;
+
+    PhysicalAddress->QuadPart = DeviceExtension->SrbExtensionPhysical.QuadPart + Offset;
+    *Length = DeviceExtension->SrbExtensionSize - (ULONG)(Offset % DeviceExtension->SrbExtensionSize);
+
+    return TRUE;
+}
+
+
+PSTOR_SCATTER_GATHER_LIST
+PortGetScatterGatherList(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    if (Srb->OriginalRequest == NULL)
+        return NULL;
+
+    return (PSTOR_SCATTER_GATHER_LIST)PortGetRequest(Srb)->SgList;
+}
+
+
+VOID
+PortQueueRequest(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ PIRP Irp)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT("PortQueueRequest(%p %p)\n", LunExtension, Irp);
+
+    KeAcquireInStackQueuedSpinLock(&LunExtension->QueueLock, &LockHandle);
+    InsertTailList(&LunExtension->RequestQueue, &Irp->Tail.Overlay.ListEntry);
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    PortStartNextRequests(LunExtension);
+}
+
+
+/*
+ * Starts queued requests of a logical unit until its queue depth is
+ * reached or the adapter runs out of requests. Each unit has its own lock,
+ * so units on the same adapter never wait for each other here.
+ */
+VOID
+PortStartNextRequests(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = LunExtension->Adapter;
+    PSTORPORT_REQUEST Request;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PLIST_ENTRY ListEntry;
+    PIRP Irp;
+
+    for (;;)
+    {
+        if (DeviceExtension->Stopping ||
+            DeviceExtension->PauseCount != 0 ||
+            LunExtension->PauseCount != 0 ||
+            DeviceExtension->BusyCount > 0 ||
+            LunExtension->BusyCount > 0)
+        {
+            return;
+        }
+
+        KeAcquireInStackQueuedSpinLock(&LunExtension->QueueLock, &LockHandle);
+
+        if (IsListEmpty(&LunExtension->RequestQueue) ||
+            LunExtension->OutstandingCount >= LunExtension->QueueDepth)
+        {
+            KeReleaseInStackQueuedSpinLock(&LockHandle);
+            return;
+        }
+
+        Request = (PSTORPORT_REQUEST)InterlockedPopEntrySList(&DeviceExtension->FreeRequests);
+        if (Request == NULL)
+        {
+            /* Have the completion DPC restart us, then check again in case it already ran */
+            InterlockedExchange(&DeviceExtension->RequestStarved, TRUE);
+            Request = (PSTORPORT_REQUEST)InterlockedPopEntrySList(&DeviceExtension->FreeRequests);
+            if (Request == NULL)
+            {
+                KeReleaseInStackQueuedSpinLock(&LockHandle);
+                return;
+            }
+        }
+
+        ListEntry = RemoveHeadList(&LunExtension->RequestQueue);
+        InterlockedIncrement((PLONG)&LunExtension->OutstandingCount);
+
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+        Irp = CONTAINING_RECORD(ListEntry, IRP, Tail.Overlay.ListEntry);
+        PortStartRequest(LunExtension, Request, Irp);
+    }
+}
+
+
+VOID
+PortStartAllLuns(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PLIST_ENTRY ListEntry;
+    ULONG Index, i;
+
+    /*
+     * The list lock cannot be held while requests are started, the miniport
+     * looks its units up from HwStartIo. Units are only removed once idle.
+     */
+    for (Index = 0; ; Index++)
+    {
+        LunExtension = NULL;
+
+        KeAcquireInStackQueuedSpinLock(&DeviceExtension->LunListLock, &LockHandle);
+        for (ListEntry = DeviceExtension->LunListHead.Flink, i = 0;
+             ListEntry != &DeviceExtension->LunListHead;
+             ListEntry = ListEntry->Flink, i++)
+        {
+            if (i == Index)
+            {
+                LunExtension = CONTAINING_RECORD(ListEntry, PDO_DEVICE_EXTENSION, LunEntry);
+                break;
+            }
+        }
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+        if (LunExtension == NULL)
+            break;
+
+        PortStartNextRequests(LunExtension);
+    }
+}
+
+
+VOID
+PortFlushLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION LunExtension,
+    _In_ UCHAR SrbStatus)
+{
+    PSCSI_REQUEST_BLOCK Srb;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    LIST_ENTRY FlushList;
+    PLIST_ENTRY ListEntry;
+    PIRP Irp;
+
+    DPRINT("PortFlushLunQueue(%p %x)\n", LunExtension, SrbStatus);
+
+    InitializeListHead(&FlushList);
+
+    KeAcquireInStackQueuedSpinLock(&LunExtension->QueueLock, &LockHandle);
+    while (!IsListEmpty(&LunExtension->RequestQueue))
+    {
+        ListEntry = RemoveHeadList(&LunExtension->RequestQueue);
+        InsertTailList(&FlushList, ListEntry);
+    }
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    while (!IsListEmpty(&FlushList))
+    {
+        ListEntry = RemoveHeadList(&FlushList);
+        Irp = CONTAINING_RECORD(ListEntry, IRP, Tail.Overlay.ListEntry);
+
+        Srb = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+        Srb->SrbStatus = SrbStatus;
+        Srb->DataTransferLength = 0;
+
+        Irp->IoStatus.Status = PortSrbStatusToNtStatus(SrbStatus);
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
+}
+
+
+/*
+ * Pauses a queue for TimeOut seconds. Pausing again while the timer is armed
+ * only pushes the deadline out, the count is taken once per armed timer and
+ * dropped by whoever disarms it: PortResume or the timer DPC.
+ */
+VOID
+PortPause(
+    _In_ PKTIMER Timer,
+    _In_ PKDPC Dpc,
+    _Inout_ PLONG PauseCount,
+    _In_ ULONG TimeOut)
+{
+    LARGE_INTEGER DueTime;
+
+    /* Count first, the timer may expire right away */
+    InterlockedIncrement(PauseCount);
+
+    DueTime.QuadPart = -(LONGLONG)TimeOut * 1000 * 1000 * 10;
+    if (KeSetTimer(Timer, DueTime, Dpc))
+        InterlockedDecrement(PauseCount);
+}
+
+
+/* Ends a pause early, returns TRUE if the queue has to be restarted */
+BOOLEAN
+PortResume(
+    _In_ PKTIMER Timer,
+    _In_ PKDPC Dpc,
+    _Inout_ PLONG PauseCount)
+{
+    /* Not armed and not queued anymore: the timer DPC runs or ran and resumes itself */
+    if (!KeCancelTimer(Timer) && !KeRemoveQueueDpc(Dpc))
+        return FALSE;
+
+    return (InterlockedDecrement(PauseCount) == 0);
+}
+
+
+/* Counts a completion against a busy hold, returns TRUE if it ended the hold */
+static
+BOOLEAN
+PortCountBusyCompletion(
+    _Inout_ PLONG BusyCount)
+{
+    LONG Count;
+
+    for (;;)
+    {
+        Count = *(volatile LONG *)BusyCount;
+        if (Count <= 0)
+            return FALSE;
+
+        if (InterlockedCompareExchange(BusyCount, Count - 1, Count) == Count)
+            return (Count == 1);
+    }
+}
+
+
+/* Takes the request away from the miniport, FALSE if someone else completed it first */
+static
+BOOLEAN
+PortClaimRequest(
+    _In_ PSTORPORT_REQUEST Request,
+    _In_ LONG Owner)
+{
+    if (Owner == 0 ||
+        InterlockedCompareExchange(&Request->Owner, 0, Owner) != Owner)
+    {
+        return FALSE;
+    }
+
+    Request->Srb->SrbFlags &= ~SRB_FLAGS_IS_ACTIVE;
+    return TRUE;
+}
+
+
+/*
+ * Called by the miniport, usually from its ISR. The request is only pushed
+ * on the completion list: the DPC completes everything that piled up since
+ * it last ran, so a burst of completions costs a single DPC.
+ */
+VOID
+PortNotifyRequestComplete(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PSTORPORT_REQUEST Request;
+
+    DPRINT("PortNotifyRequestComplete(%p %p)\n", DeviceExtension, Srb);
+
+    Request = PortGetRequest(Srb);
+    ASSERT(Request->Srb == Srb);
+
+    /* StorPortCompleteRequest may race with the miniport, only the first completion counts */
+    if (!PortClaimRequest(Request, *(volatile LONG *)&Request->Owner))
+        return;
+
+    InterlockedPushEntrySList(&DeviceExtension->CompletedRequests, &Request->Entry);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+}
+
+
+/*
+ * Completes the requests the miniport owns on an address, SP_UNTAGGED is a
+ * wildcard. This never dereferences a request it has not claimed: the
+ * address is checked on copies kept in the request, and the claim fails if
+ * the request was completed and reused in the meantime. So it is safe at any
+ * IRQL, against the miniport and against the completion DPC.
+ */
+VOID
+PortCompleteOutstandingRequests(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ UCHAR SrbStatus)
+{
+    PSTORPORT_REQUEST Request;
+    BOOLEAN Completed = FALSE;
+    LONG Owner;
+    ULONG i;
+
+    DPRINT("PortCompleteOutstandingRequests(%p %u %u %u %x)\n",
+           DeviceExtension, PathId, TargetId, Lun, SrbStatus);
+
+    for (i = 0; i < DeviceExtension->RequestCount; i++)
+    {
+        Request = &DeviceExtension->Requests[i];
+
+        Owner = *(volatile LONG *)&Request->Owner;
+        if (Owner == 0)
+            continue;
+
+        if ((PathId != SP_UNTAGGED && Request->PathId != PathId) ||
+            (TargetId != SP_UNTAGGED && Request->TargetId != TargetId) ||
+            (Lun != SP_UNTAGGED && Request->LunId != Lun))
+            continue;
+
+        if (!PortClaimRequest(Request, Owner))
+            continue;
+
+        Request->Srb->SrbStatus = SrbStatus;
+        InterlockedPushEntrySList(&DeviceExtension->CompletedRequests, &Request->Entry);
+        Completed = TRUE;
+    }
+
+    if (Completed)
+        KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+}
+
+
+VOID
+NTAPI
+PortCompletionDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)DeferredContext;
+    PPDO_DEVICE_EXTENSION LunExtension, RestartLun = NULL;
+    PSLIST_ENTRY Entry, Next, Completed = NULL;
+    PSTORPORT_REQUEST Request;
+    PSCSI_REQUEST_BLOCK Srb;
+    BOOLEAN RestartAll = FALSE;
+    LARGE_INTEGER DueTime;
+    LONG Notifications;
+    PIRP Irp;
+
+    DPRINT("PortCompletionDpc(%p %p)\n", Dpc, DeferredContext);
+
+    /* Take the whole batch and put it back in completion order */
+    Entry = InterlockedFlushSList(&DeviceExtension->CompletedRequests);
+    while (Entry != NULL)
+    {
+        Next = Entry->Next;
+        Entry->Next = Completed;
+        Completed = Entry;
+        Entry = Next;
+    }
+
+    /* Nothing completed: we were queued to resume the queues */
+    if (Completed == NULL)
+        RestartAll = TRUE;
+
+    for (Entry = Completed; Entry != NULL; Entry = Next)
+    {
+        Next = Entry->Next;
+        Request = CONTAINING_RECORD(Entry, STORPORT_REQUEST, Entry);
+        Irp = Request->Irp;
+        Srb = Request->Srb;
+        LunExtension = Request->Lun;
+
+        if (Request->SgList != NULL)
+        {
+            DeviceExtension->DmaAdapter->DmaOperations->PutScatterGatherList(DeviceExtension->DmaAdapter,
+                                                                             Request->SgList,
+                                                                             (Srb->SrbFlags & SRB_FLAGS_DATA_OUT) != 0);
+        }
+
+        Srb->DataBuffer = Request->OriginalDataBuffer;
+        Srb->SrbExtension = NULL;
+
+        Irp->IoStatus.Status = PortSrbStatusToNtStatus(Srb->SrbStatus);
+        if (SRB_STATUS(Srb->SrbStatus) == SRB_STATUS_SUCCESS ||
+            SRB_STATUS(Srb->SrbStatus) == SRB_STATUS_DATA_OVERRUN)
+        {
+            Irp->IoStatus.Information = Srb->DataTransferLength;
+        }
+        else
+        {
+            Irp->IoStatus.Information = 0;
+        }
+
+        Request->Irp = NULL;
+        Request->Srb = NULL;
+        Request->SgList = NULL;
+        InterlockedPushEntrySList(&DeviceExtension->FreeRequests, &Request->Entry);
+
+        InterlockedDecrement((PLONG)&LunExtension->OutstandingCount);
+
+        /* The units of a busy adapter may all be waiting for this one */
+        if (PortCountBusyCompletion(&DeviceExtension->BusyCount))
+            RestartAll = TRUE;
+        PortCountBusyCompletion(&LunExtension->BusyCount);
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        if (RestartLun == NULL)
+            RestartLun = LunExtension;
+        else if (RestartLun != LunExtension)
+            RestartAll = TRUE;
+    }
+
+    /* Someone found no free request, every unit may be waiting */
+    if (InterlockedExchange(&DeviceExtension->RequestStarved, FALSE))
+        RestartAll = TRUE;
+
+    if (RestartAll)
+        PortStartAllLuns(DeviceExtension);
+    else if (RestartLun != NULL)
+        PortStartNextRequests(RestartLun);
+
+    Notifications = InterlockedExchange(&DeviceExtension->PendingNotifications, 0);
+
+    if (Notifications & PORT_NOTIFY_TIMER)
+    {
+        if (DeviceExtension->TimerValue == 0 || DeviceExtension->HwTimer == NULL)
+        {
+            KeCancelTimer(&DeviceExtension->MiniportTimer);
+        }
+        else
+        {
+            DueTime.QuadPart = -(LONGLONG)DeviceExtension->TimerValue * 10;
+            KeSetTimer(&DeviceExtension->MiniportTimer, DueTime, &DeviceExtension->MiniportTimerDpc);
+        }
+    }
+
+    if (Notifications & PORT_NOTIFY_BUS_CHANGE)
+        IoInvalidateDeviceRelations(DeviceExtension->PhysicalDevice, BusRelations);
+}
+
+
+VOID
+NTAPI
+PortMiniportTimerDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)DeferredContext;
+
+    DPRINT("PortMiniportTimerDpc(%p %p)\n", Dpc, DeferredContext);
+
+    PortSynchronizeStartIo(DeviceExtension, PortTimerSynchronized, DeviceExtension);
+}
+
+
+VOID
+NTAPI
+PortPauseTimerDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)DeferredContext;
+
+    DPRINT("PortPauseTimerDpc(%p %p)\n", Dpc, DeferredContext);
+
+    if (InterlockedDecrement(&DeviceExtension->PauseCount) == 0)
+        PortStartAllLuns(DeviceExtension);
+}
+
+
+VOID
+NTAPI
+PortLunPauseTimerDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PPDO_DEVICE_EXTENSION LunExtension = (PPDO_DEVICE_EXTENSION)DeferredContext;
+
+    DPRINT("PortLunPauseTimerDpc(%p %p)\n", Dpc, DeferredContext);
+
+    if (InterlockedDecrement(&LunExtension->PauseCount) == 0)
+        PortStartNextRequests(LunExtension);
+}
+
+/* EOF */
@@ -0,0 +1,1550 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS Storport Driver
+ * FILE:            drivers/storage/port/storport/storport.c
+ * PURPOSE:         Storport driver entry points and exported functions
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS ******************************************************************/
+
+ULONG PortNumber = 0;
+
+/* FUNCTIONS ****************************************************************/
+
+static
+PDRIVER_INIT_DATA
+PortGetDriverInitData(
+    _In_ PDRIVER_OBJECT_EXTENSION DriverExtension,
+    _In_ INTERFACE_TYPE InterfaceType)
+{
+    PDRIVER_INIT_DATA InitData;
+    PLIST_ENTRY ListEntry;
+
+    DPRINT("PortGetDriverInitData(%p %d)\n", DriverExtension, InterfaceType);
+
+    for (ListEntry = DriverExtension->InitDataListHead.Flink;
+         ListEntry != &DriverExtension->InitDataListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        InitData = CONTAINING_RECORD(ListEntry, DRIVER_INIT_DATA, Entry);
+        if (InitData->HwInitData.AdapterInterfaceType == InterfaceType)
+            return InitData;
+    }
+
+    /* Fall back to whatever the miniport registered first */
+    if (!IsListEmpty(&DriverExtension->InitDataListHead))
+        return CONTAINING_RECORD(DriverExtension->InitDataListHead.Blink, DRIVER_INIT_DATA, Entry);
+
+    return NULL;
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortAddDevice(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PDEVICE_OBJECT PhysicalDeviceObject)
+{
+    PDRIVER_OBJECT_EXTENSION DriverExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension = NULL;
+    PDRIVER_INIT_DATA InitData;
+    INTERFACE_TYPE InterfaceType = PNPBus;
+    WCHAR NameBuffer[80];
+    UNICODE_STRING DeviceName;
+    PDEVICE_OBJECT Fdo = NULL;
+    ULONG Length, AdapterNumber;
+    NTSTATUS Status;
+
+    DPRINT("PortAddDevice(%p %p)\n", DriverObject, PhysicalDeviceObject);
+
+    DriverExtension = IoGetDriverObjectExtension(DriverObject, (PVOID)DriverEntry);
+    if (DriverExtension == NULL)
+        return STATUS_UNSUCCESSFUL;
+
+    IoGetDeviceProperty(PhysicalDeviceObject,
+                        DevicePropertyLegacyBusType,
+                        sizeof(InterfaceType),
+                        &InterfaceType,
+                        &Length);
+
+    InitData = PortGetDriverInitData(DriverExtension, InterfaceType);
+    if (InitData == NULL)
+        return STATUS_NO_SUCH_DEVICE;
+
+    AdapterNumber = InterlockedIncrement((PLONG)&PortNumber) - 1;
+    swprintf(NameBuffer, L"\\Device\\RaidPort%lu", AdapterNumber);
+    RtlInitUnicodeString(&DeviceName, NameBuffer);
+
+    Status = IoCreateDevice(DriverObject,
+                            sizeof(FDO_DEVICE_EXTENSION),
+                            &DeviceName,
+                            FILE_DEVICE_CONTROLLER,
+                            FILE_DEVICE_SECURE_OPEN,
+                            FALSE,
+                            &Fdo);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("IoCreateDevice() failed (Status 0x%08lx)\n", Status);
+        return Status;
+    }
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)Fdo->DeviceExtension;
+    RtlZeroMemory(DeviceExtension, sizeof(FDO_DEVICE_EXTENSION));
+
+    DeviceExtension->Common.IsFDO = TRUE;
+    DeviceExtension->Common.DeviceObject = Fdo;
+    DeviceExtension->Common.PnpState = dsStopped;
+    DeviceExtension->PhysicalDevice = PhysicalDeviceObject;
+    DeviceExtension->InitData = InitData;
+    DeviceExtension->AdapterNumber = AdapterNumber;
+
+    InitializeListHead(&DeviceExtension->MappedAddressList);
+    InitializeListHead(&DeviceExtension->LunListHead);
+    KeInitializeSpinLock(&DeviceExtension->LunListLock);
+    KeInitializeSpinLock(&DeviceExtension->StartIoLock);
+    KeInitializeSpinLock(&DeviceExtension->InterruptSpinLock);
+    InitializeSListHead(&DeviceExtension->FreeRequests);
+    InitializeSListHead(&DeviceExtension->CompletedRequests);
+    KeInitializeDpc(&DeviceExtension->CompletionDpc, PortCompletionDpc, DeviceExtension);
+    KeInitializeTimer(&DeviceExtension->MiniportTimer);
+    KeInitializeDpc(&DeviceExtension->MiniportTimerDpc, PortMiniportTimerDpc, DeviceExtension);
+    KeInitializeTimer(&DeviceExtension->PauseTimer);
+    KeInitializeDpc(&DeviceExtension->PauseTimerDpc, PortPauseTimerDpc, DeviceExtension);
+
+    /* Allocate the miniport device extension */
+    DeviceExtension->Miniport = ExAllocatePoolWithTag(NonPagedPool,
+                                                      FIELD_OFFSET(MINIPORT_DEVICE_EXTENSION, HwDeviceExtension) +
+                                                      InitData->HwInitData.DeviceExtensionSize,
+                                                      TAG_STORPORT);
+    if (DeviceExtension->Miniport == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto done;
+    }
+
+    RtlZeroMemory(DeviceExtension->Miniport,
+                  FIELD_OFFSET(MINIPORT_DEVICE_EXTENSION, HwDeviceExtension) +
+                  InitData->HwInitData.DeviceExtensionSize);
+    DeviceExtension->Miniport->Adapter = DeviceExtension;
+    DeviceExtension->MiniportExtension = &DeviceExtension->Miniport->HwDeviceExtension;
+
+    Status = IoAttachDeviceToDeviceStackSafe(Fdo,
+                                             PhysicalDeviceObject,
+                                             &DeviceExtension->LowerDevice);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("IoAttachDeviceToDeviceStackSafe() failed (Status 0x%08lx)\n", Status);
+        goto done;
+    }
+
+    DriverExtension->AdapterCount++;
+
+    Fdo->Flags |= DO_DIRECT_IO | DO_POWER_PAGABLE;
+    Fdo->Flags &= ~DO_DEVICE_INITIALIZING;
+
+done:
+    if (!NT_SUCCESS(Status))
+    {
+        if (DeviceExtension->Miniport != NULL)
+            ExFreePoolWithTag(DeviceExtension->Miniport, TAG_STORPORT);
+
+        IoDeleteDevice(Fdo);
+    }
+
+    return Status;
+}
+
+
+static
+VOID
+NTAPI
+PortUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    PDRIVER_OBJECT_EXTENSION DriverExtension;
+    PDRIVER_INIT_DATA InitData;
+    PLIST_ENTRY ListEntry;
+
+    DPRINT1("PortUnload(%p)\n", DriverObject);
+
+    DriverExtension = IoGetDriverObjectExtension(DriverObject, (PVOID)DriverEntry);
+    if (DriverExtension == NULL)
+        return;
+
+    while (!IsListEmpty(&DriverExtension->InitDataListHead))
+    {
+        ListEntry = RemoveHeadList(&DriverExtension->InitDataListHead);
+        InitData = CONTAINING_RECORD(ListEntry, DRIVER_INIT_DATA, Entry);
+        ExFreePoolWithTag(InitData, TAG_STORPORT);
+    }
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchCreateClose(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    DPRINT("PortDispatchCreateClose(%p %p)\n", DeviceObject, Irp);
+
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = FILE_OPENED;
+
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PCOMMON_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("PortDispatchDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PCOMMON_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    if (DeviceExtension->IsFDO)
+        return PortFdoDeviceControl(DeviceObject, Irp);
+
+    return PortPdoDeviceControl(DeviceObject, Irp);
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchScsi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PCOMMON_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("PortDispatchScsi(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PCOMMON_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    if (!DeviceExtension->IsFDO)
+        return PortPdoScsi(DeviceObject, Irp);
+
+    /* Requests go to the logical units, not to the adapter */
+    Irp->IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return STATUS_INVALID_DEVICE_REQUEST;
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchSystemControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PCOMMON_DEVICE_EXTENSION DeviceExtension;
+    NTSTATUS Status;
+
+    DPRINT("PortDispatchSystemControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PCOMMON_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    if (DeviceExtension->IsFDO)
+        return ForwardIrpAndForget(((PFDO_DEVICE_EXTENSION)DeviceExtension)->LowerDevice, Irp);
+
+    Status = Irp->IoStatus.Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchPnp(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PCOMMON_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("PortDispatchPnp(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PCOMMON_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    if (DeviceExtension->IsFDO)
+        return PortFdoPnp(DeviceObject, Irp);
+
+    return PortPdoPnp(DeviceObject, Irp);
+}
+
+
+static
+NTSTATUS
+NTAPI
+PortDispatchPower(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PCOMMON_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    NTSTATUS Status;
+
+    DPRINT("PortDispatchPower(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PCOMMON_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+
+    PoStartNextPowerIrp(Irp);
+
+    if (DeviceExtension->IsFDO)
+    {
+        IoSkipCurrentIrpStackLocation(Irp);
+        return PoCallDriver(((PFDO_DEVICE_EXTENSION)DeviceExtension)->LowerDevice, Irp);
+    }
+
+    /* FIXME: Power management of the logical units */
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    if (Stack->MinorFunction == IRP_MN_SET_POWER ||
+        Stack->MinorFunction == IRP_MN_QUERY_POWER)
+    {
+        Irp->IoStatus.Status = STATUS_SUCCESS;
+    }
+
+    Status = Irp->IoStatus.Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+/* PUBLIC FUNCTIONS *********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+DriverEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PUNICODE_STRING RegistryPath)
+{
+    DPRINT("DriverEntry(%p %wZ)\n", DriverObject, RegistryPath);
+    return STATUS_SUCCESS;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG
+NTAPI
+StorPortInitialize(
+    _In_ PVOID Argument1,
+    _In_ PVOID Argument2,
+    _In_ struct _HW_INITIALIZATION_DATA *HwInitializationData,
+    _In_opt_ PVOID HwContext)
+{
+    PDRIVER_OBJECT DriverObject = (PDRIVER_OBJECT)Argument1;
+    PUNICODE_STRING RegistryPath = (PUNICODE_STRING)Argument2;
+    PDRIVER_OBJECT_EXTENSION DriverExtension;
+    PDRIVER_INIT_DATA InitData;
+    ULONG Size;
+    NTSTATUS Status;
+
+    DPRINT("StorPortInitialize(%p %wZ %p %p)\n",
+           DriverObject, RegistryPath, HwInitializationData, HwContext);
+
+    /* Storport miniports are PnP only and must provide these */
+    if (HwInitializationData->HwInitializationDataSize < FIELD_OFFSET(HW_INITIALIZATION_DATA, HwBuildIo) ||
+        HwInitializationData->HwFindAdapter == NULL ||
+        HwInitializationData->HwInitialize == NULL ||
+        HwInitializationData->HwStartIo == NULL ||
+        HwInitializationData->HwInterrupt == NULL ||
+        HwInitializationData->HwResetBus == NULL)
+    {
+        return STATUS_REVISION_MISMATCH;
+    }
+
+    DriverExtension = IoGetDriverObjectExtension(DriverObject, (PVOID)DriverEntry);
+    if (DriverExtension == NULL)
+    {
+        Status = IoAllocateDriverObjectExtension(DriverObject,
+                                                 (PVOID)DriverEntry,
+                                                 sizeof(DRIVER_OBJECT_EXTENSION),
+                                                 (PVOID *)&DriverExtension);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("IoAllocateDriverObjectExtension() failed (Status 0x%08lx)\n", Status);
+            return Status;
+        }
+
+        RtlZeroMemory(DriverExtension, sizeof(DRIVER_OBJECT_EXTENSION));
+        DriverExtension->DriverObject = DriverObject;
+        InitializeListHead(&DriverExtension->InitDataListHead);
+
+        DriverObject->DriverExtension->AddDevice = PortAddDevice;
+        if (DriverObject->DriverUnload == NULL)
+            DriverObject->DriverUnload = PortUnload;
+
+        DriverObject->MajorFunction[IRP_MJ_CREATE] = PortDispatchCreateClose;
+        DriverObject->MajorFunction[IRP_MJ_CLOSE] = PortDispatchCreateClose;
+        DriverObject->MajorFunction[IRP_MJ_DEVICE_CONTROL] = PortDispatchDeviceControl;
+        DriverObject->MajorFunction[IRP_MJ_SCSI] = PortDispatchScsi;
+        DriverObject->MajorFunction[IRP_MJ_POWER] = PortDispatchPower;
+        DriverObject->MajorFunction[IRP_MJ_SYSTEM_CONTROL] = PortDispatchSystemControl;
+        DriverObject->MajorFunction[IRP_MJ_PNP] = PortDispatchPnp;
+    }
+
+    InitData = ExAllocatePoolWithTag(NonPagedPool, sizeof(DRIVER_INIT_DATA), TAG_STORPORT);
+    if (InitData == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(InitData, sizeof(DRIVER_INIT_DATA));
+
+    /* Older miniports pass a shorter structure */
+    Size = min(HwInitializationData->HwInitializationDataSize, sizeof(HW_INITIALIZATION_DATA));
+    RtlCopyMemory(&InitData->HwInitData, HwInitializationData, Size);
+    InitData->HwInitData.HwInitializationDataSize = sizeof(HW_INITIALIZATION_DATA);
+    InitData->HwContext = HwContext;
+
+    InsertHeadList(&DriverExtension->InitDataListHead, &InitData->Entry);
+
+    return STATUS_SUCCESS;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+__cdecl
+StorPortNotification(
+    _In_ SCSI_NOTIFICATION_TYPE NotificationType,
+    _In_ PVOID HwDeviceExtension,
+    ...)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PSTOR_LOCK_HANDLE LockHandle;
+    PSTOR_DPC Dpc;
+    PLONG Result;
+    va_list ap;
+
+    DPRINT("StorPortNotification(%x %p)\n", NotificationType, HwDeviceExtension);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    va_start(ap, HwDeviceExtension);
+
+    switch ((ULONG)NotificationType)
+    {
+        case RequestComplete:
+            PortNotifyRequestComplete(DeviceExtension, va_arg(ap, PSCSI_REQUEST_BLOCK));
+            break;
+
+        case NextRequest:
+        case NextLuRequest:
+            /* Storport does the queueing, nothing to do */
+            break;
+
+        case ResetDetected:
+            DPRINT1("Notify: ResetDetected\n");
+            break;
+
+        case RequestTimerCall:
+            DeviceExtension->HwTimer = va_arg(ap, PHW_TIMER);
+            DeviceExtension->TimerValue = va_arg(ap, ULONG);
+
+            /* The timer is set from the completion DPC, the miniport may call this from its ISR */
+            InterlockedOr(&DeviceExtension->PendingNotifications, PORT_NOTIFY_TIMER);
+            KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+            break;
+
+        case BusChangeDetected:
+            /* Rescanning needs PASSIVE_LEVEL, the completion DPC asks PnP for it */
+            InterlockedOr(&DeviceExtension->PendingNotifications, PORT_NOTIFY_BUS_CHANGE);
+            KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+            break;
+
+        case EnablePassiveInitialization:
+            DeviceExtension->HwPassiveInitRoutine = va_arg(ap, PHW_PASSIVE_INITIALIZE_ROUTINE);
+            Result = va_arg(ap, PLONG);
+            *Result = TRUE;
+            break;
+
+        case InitializeDpc:
+            Dpc = va_arg(ap, PSTOR_DPC);
+            KeInitializeDpc(&Dpc->Dpc,
+                            (PKDEFERRED_ROUTINE)va_arg(ap, PHW_DPC_ROUTINE),
+                            HwDeviceExtension);
+            KeInitializeSpinLock(&Dpc->Lock);
+            break;
+
+        case IssueDpc:
+        {
+            PVOID SystemArgument1, SystemArgument2;
+
+            Dpc = va_arg(ap, PSTOR_DPC);
+            SystemArgument1 = va_arg(ap, PVOID);
+            SystemArgument2 = va_arg(ap, PVOID);
+            Result = va_arg(ap, PLONG);
+            *Result = KeInsertQueueDpc(&Dpc->Dpc, SystemArgument1, SystemArgument2);
+            break;
+        }
+
+        case AcquireSpinLock:
+        {
+            STOR_SPINLOCK SpinLock;
+            PVOID LockContext;
+
+            SpinLock = (STOR_SPINLOCK)va_arg(ap, int);
+            LockContext = va_arg(ap, PVOID);
+            LockHandle = va_arg(ap, PSTOR_LOCK_HANDLE);
+
+            LockHandle->Lock = SpinLock;
+            switch (SpinLock)
+            {
+                case DpcLock:
+                    KeAcquireInStackQueuedSpinLock(&((PSTOR_DPC)LockContext)->Lock,
+                                                   &LockHandle->Context.LockHandle);
+                    break;
+
+                case StartIoLock:
+                    KeAcquireInStackQueuedSpinLock(&DeviceExtension->StartIoLock,
+                                                   &LockHandle->Context.LockHandle);
+                    break;
+
+                case InterruptLock:
+                    if (DeviceExtension->Interrupt != NULL)
+                        LockHandle->Context.OldIrql = KeAcquireInterruptSpinLock(DeviceExtension->Interrupt);
+                    else
+                        KeAcquireSpinLock(&DeviceExtension->InterruptSpinLock, &LockHandle->Context.OldIrql);
+                    break;
+
+                default:
+                    DPRINT1("Unknown spin lock %d\n", SpinLock);
+                    ASSERT(FALSE);
+                    break;
+            }
+            break;
+        }
+
+        case ReleaseSpinLock:
+            LockHandle = va_arg(ap, PSTOR_LOCK_HANDLE);
+            switch (LockHandle->Lock)
+            {
+                case DpcLock:
+                case StartIoLock:
+                    KeReleaseInStackQueuedSpinLock(&LockHandle->Context.LockHandle);
+                    break;
+
+                case InterruptLock:
+                    if (DeviceExtension->Interrupt != NULL)
+                        KeReleaseInterruptSpinLock(DeviceExtension->Interrupt, LockHandle->Context.OldIrql);
+                    else
+                        KeReleaseSpinLock(&DeviceExtension->InterruptSpinLock, LockHandle->Context.OldIrql);
+                    break;
+
+                default:
+                    ASSERT(FALSE);
+                    break;
+            }
+            break;
+
+        default:
+            DPRINT1("Unsupported notification %lx\n", (ULONG)NotificationType);
+            break;
+    }
+
+    va_end(ap);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortSetDeviceQueueDepth(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ ULONG Depth)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortSetDeviceQueueDepth(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, Depth);
+
+    if (Depth == 0 || Depth > STORPORT_MAX_QUEUE_DEPTH)
+        return FALSE;
+
+    LunExtension = PortGetLun(MiniportGetAdapter(HwDeviceExtension), PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return FALSE;
+
+    /* Requests above the new depth are held back as the outstanding ones complete */
+    LunExtension->QueueDepth = Depth;
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+PSTOR_SCATTER_GATHER_LIST
+NTAPI
+StorPortGetScatterGatherList(
+    _In_ PVOID DeviceExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    DPRINT("StorPortGetScatterGatherList(%p %p)\n", DeviceExtension, Srb);
+
+    return PortGetScatterGatherList(Srb);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+PVOID
+NTAPI
+StorPortGetLogicalUnit(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortGetLogicalUnit(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    LunExtension = PortGetLun(MiniportGetAdapter(HwDeviceExtension), PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return NULL;
+
+    return LunExtension->MiniportLunExtension;
+}
+
+
+/*
+ * @unimplemented
+ */
+STORPORTAPI
+PSCSI_REQUEST_BLOCK
+NTAPI
+StorPortGetSrb(
+    _In_ PVOID DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ LONG QueueTag)
+{
+    /* Not supported by Storport */
+    DPRINT1("StorPortGetSrb()\n");
+    return NULL;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortCompleteRequest(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ UCHAR SrbStatus)
+{
+    DPRINT("StorPortCompleteRequest(%p %u %u %u %x)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, SrbStatus);
+
+    PortCompleteOutstandingRequests(MiniportGetAdapter(HwDeviceExtension),
+                                    PathId,
+                                    TargetId,
+                                    Lun,
+                                    SrbStatus);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortPause(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG TimeOut)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortPause(%p %lu)\n", HwDeviceExtension, TimeOut);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+    PortPause(&DeviceExtension->PauseTimer,
+              &DeviceExtension->PauseTimerDpc,
+              &DeviceExtension->PauseCount,
+              TimeOut);
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortResume(
+    _In_ PVOID HwDeviceExtension)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortResume(%p)\n", HwDeviceExtension);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+    if (PortResume(&DeviceExtension->PauseTimer,
+                   &DeviceExtension->PauseTimerDpc,
+                   &DeviceExtension->PauseCount))
+    {
+        KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortPauseDevice(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ ULONG TimeOut)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortPauseDevice(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, TimeOut);
+
+    LunExtension = PortGetLun(MiniportGetAdapter(HwDeviceExtension), PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return FALSE;
+
+    PortPause(&LunExtension->PauseTimer,
+              &LunExtension->PauseTimerDpc,
+              &LunExtension->PauseCount,
+              TimeOut);
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortResumeDevice(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortResumeDevice(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+    LunExtension = PortGetLun(DeviceExtension, PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return FALSE;
+
+    if (PortResume(&LunExtension->PauseTimer,
+                   &LunExtension->PauseTimerDpc,
+                   &LunExtension->PauseCount))
+    {
+        KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortBusy(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG RequestsToComplete)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    ULONG Outstanding;
+
+    DPRINT("StorPortBusy(%p %lu)\n", HwDeviceExtension, RequestsToComplete);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    /* Hold every unit until that many of the requests the miniport has are completed */
+    Outstanding = DeviceExtension->RequestCount - ExQueryDepthSList(&DeviceExtension->FreeRequests);
+    InterlockedExchange(&DeviceExtension->BusyCount, (LONG)min(RequestsToComplete, Outstanding));
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortReady(
+    _In_ PVOID HwDeviceExtension)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortReady(%p)\n", HwDeviceExtension);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+    InterlockedExchange(&DeviceExtension->BusyCount, 0);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortDeviceBusy(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ ULONG RequestsToComplete)
+{
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortDeviceBusy(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, RequestsToComplete);
+
+    LunExtension = PortGetLun(MiniportGetAdapter(HwDeviceExtension), PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return FALSE;
+
+    /* Hold the unit until that many of its requests are completed */
+    InterlockedExchange(&LunExtension->BusyCount,
+                        (LONG)min(RequestsToComplete, LunExtension->OutstandingCount));
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortDeviceReady(
+    _In_ PVOID HwDeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION LunExtension;
+
+    DPRINT("StorPortDeviceReady(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+    LunExtension = PortGetLun(DeviceExtension, PathId, TargetId, Lun);
+    if (LunExtension == NULL)
+        return FALSE;
+
+    InterlockedExchange(&LunExtension->BusyCount, 0);
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
+}
+
+
+typedef struct _SYNCHRONIZE_ACCESS_CONTEXT
+{
+    PSTOR_SYNCHRONIZED_ACCESS SynchronizedAccessRoutine;
+    PVOID HwDeviceExtension;
+    PVOID Context;
+} SYNCHRONIZE_ACCESS_CONTEXT, *PSYNCHRONIZE_ACCESS_CONTEXT;
+
+static
+BOOLEAN
+NTAPI
+PortSynchronizeAccessRoutine(
+    _In_ PVOID SynchronizeContext)
+{
+    PSYNCHRONIZE_ACCESS_CONTEXT Context = SynchronizeContext;
+
+    return Context->SynchronizedAccessRoutine(Context->HwDeviceExtension, Context->Context);
+}
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortSynchronizeAccess(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PSTOR_SYNCHRONIZED_ACCESS SynchronizedAccessRoutine,
+    _In_opt_ PVOID Context)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    SYNCHRONIZE_ACCESS_CONTEXT SyncContext;
+    KIRQL OldIrql;
+
+    DPRINT("StorPortSynchronizeAccess(%p %p %p)\n",
+           HwDeviceExtension, SynchronizedAccessRoutine, Context);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    SyncContext.SynchronizedAccessRoutine = SynchronizedAccessRoutine;
+    SyncContext.HwDeviceExtension = HwDeviceExtension;
+    SyncContext.Context = Context;
+
+    if (DeviceExtension->Interrupt != NULL)
+    {
+        KeSynchronizeExecution(DeviceExtension->Interrupt,
+                               PortSynchronizeAccessRoutine,
+                               &SyncContext);
+    }
+    else
+    {
+        KeAcquireSpinLock(&DeviceExtension->InterruptSpinLock, &OldIrql);
+        PortSynchronizeAccessRoutine(&SyncContext);
+        KeReleaseSpinLock(&DeviceExtension->InterruptSpinLock, OldIrql);
+    }
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG
+NTAPI
+StorPortGetBusData(
+    _In_ PVOID DeviceExtension,
+    _In_ ULONG BusDataType,
+    _In_ ULONG SystemIoBusNumber,
+    _In_ ULONG SlotNumber,
+    _Out_ _When_(Length != 0, _Out_writes_bytes_(Length)) PVOID Buffer,
+    _In_ ULONG Length)
+{
+    DPRINT("StorPortGetBusData(%p %lu %lu %lu %p %lu)\n",
+           DeviceExtension, BusDataType, SystemIoBusNumber, SlotNumber, Buffer, Length);
+
+    /* A zero length asks for the whole configuration space, Storport does not allocate it */
+    if (Length == 0)
+        return 0;
+
+    return HalGetBusData(BusDataType,
+                         SystemIoBusNumber,
+                         SlotNumber,
+                         Buffer,
+                         Length);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG
+NTAPI
+StorPortSetBusDataByOffset(
+    _In_ PVOID DeviceExtension,
+    _In_ ULONG BusDataType,
+    _In_ ULONG SystemIoBusNumber,
+    _In_ ULONG SlotNumber,
+    _In_reads_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Offset,
+    _In_ ULONG Length)
+{
+    DPRINT("StorPortSetBusDataByOffset(%p %lu %lu %lu %p %lu %lu)\n",
+           DeviceExtension, BusDataType, SystemIoBusNumber, SlotNumber, Buffer, Offset, Length);
+
+    return HalSetBusDataByOffset(BusDataType,
+                                 SystemIoBusNumber,
+                                 SlotNumber,
+                                 Buffer,
+                                 Offset,
+                                 Length);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+PVOID
+NTAPI
+StorPortGetDeviceBase(
+    _In_ PVOID HwDeviceExtension,
+    _In_ INTERFACE_TYPE BusType,
+    _In_ ULONG SystemIoBusNumber,
+    _In_ SCSI_PHYSICAL_ADDRESS IoAddress,
+    _In_ ULONG NumberOfBytes,
+    _In_ BOOLEAN InIoSpace)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PHYSICAL_ADDRESS TranslatedAddress;
+    PMAPPED_ADDRESS_ENTRY AddressEntry;
+    PVOID MappedAddress;
+
+    DPRINT("StorPortGetDeviceBase(%p %d %lu 0x%I64x %lu %u)\n",
+           HwDeviceExtension, BusType, SystemIoBusNumber, IoAddress.QuadPart, NumberOfBytes, InIoSpace);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    if (!MiniportTranslateResourceAddress(DeviceExtension,
+                                          IoAddress,
+                                          NumberOfBytes,
+                                          InIoSpace,
+                                          &TranslatedAddress))
+    {
+        DPRINT1("Address 0x%I64x is not one of the adapter resources\n", IoAddress.QuadPart);
+        return NULL;
+    }
+
+    /* I/O ports are accessed through their translated address directly */
+    if (InIoSpace)
+        return (PVOID)(ULONG_PTR)TranslatedAddress.QuadPart;
+
+    MappedAddress = MmMapIoSpace(TranslatedAddress, NumberOfBytes, MmNonCached);
+    if (MappedAddress == NULL)
+        return NULL;
+
+    AddressEntry = ExAllocatePoolWithTag(NonPagedPool, sizeof(MAPPED_ADDRESS_ENTRY), TAG_STORPORT);
+    if (AddressEntry == NULL)
+    {
+        MmUnmapIoSpace(MappedAddress, NumberOfBytes);
+        return NULL;
+    }
+
+    AddressEntry->MappedAddress = MappedAddress;
+    AddressEntry->NumberOfBytes = NumberOfBytes;
+    AddressEntry->IoAddress = IoAddress;
+    AddressEntry->InIoSpace = InIoSpace;
+    InsertTailList(&DeviceExtension->MappedAddressList, &AddressEntry->Entry);
+
+    return MappedAddress;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortFreeDeviceBase(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PVOID MappedAddress)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PMAPPED_ADDRESS_ENTRY AddressEntry;
+    PLIST_ENTRY ListEntry;
+
+    DPRINT("StorPortFreeDeviceBase(%p %p)\n", HwDeviceExtension, MappedAddress);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    for (ListEntry = DeviceExtension->MappedAddressList.Flink;
+         ListEntry != &DeviceExtension->MappedAddressList;
+         ListEntry = ListEntry->Flink)
+    {
+        AddressEntry = CONTAINING_RECORD(ListEntry, MAPPED_ADDRESS_ENTRY, Entry);
+        if (AddressEntry->MappedAddress == MappedAddress)
+        {
+            RemoveEntryList(&AddressEntry->Entry);
+            MmUnmapIoSpace(AddressEntry->MappedAddress, AddressEntry->NumberOfBytes);
+            ExFreePoolWithTag(AddressEntry, TAG_STORPORT);
+            return;
+        }
+    }
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+PVOID
+NTAPI
+StorPortGetUncachedExtension(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PPORT_CONFIGURATION_INFORMATION ConfigInfo,
+    _In_ ULONG NumberOfBytes)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PDMA_ADAPTER DmaAdapter;
+
+    DPRINT("StorPortGetUncachedExtension(%p %p %lu)\n",
+           HwDeviceExtension, ConfigInfo, NumberOfBytes);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    /* Only one uncached extension per adapter */
+    if (DeviceExtension->UncachedExtension != NULL)
+    {
+        if (NumberOfBytes > DeviceExtension->UncachedExtensionSize)
+            return NULL;
+
+        return DeviceExtension->UncachedExtension;
+    }
+
+    DmaAdapter = MiniportGetDmaAdapter(DeviceExtension);
+    if (DmaAdapter == NULL)
+        return NULL;
+
+    DeviceExtension->UncachedExtension =
+        DmaAdapter->DmaOperations->AllocateCommonBuffer(DmaAdapter,
+                                                        NumberOfBytes,
+                                                        &DeviceExtension->UncachedExtensionPhysical,
+                                                        FALSE);
+    if (DeviceExtension->UncachedExtension == NULL)
+        return NULL;
+
+    DeviceExtension->UncachedExtensionSize = NumberOfBytes;
+    RtlZeroMemory(DeviceExtension->UncachedExtension, NumberOfBytes);
+
+    return DeviceExtension->UncachedExtension;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+STOR_PHYSICAL_ADDRESS
+NTAPI
+StorPortGetPhysicalAddress(
+    _In_ PVOID HwDeviceExtension,
+    _In_opt_ PSCSI_REQUEST_BLOCK Srb,
+    _In_ PVOID VirtualAddress,
+    _Out_ ULONG *Length)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    STOR_PHYSICAL_ADDRESS PhysicalAddress;
+    ULONG_PTR Offset;
+
+    DPRINT("StorPortGetPhysicalAddress(%p %p %p %p)\n",
+           HwDeviceExtension, Srb, VirtualAddress, Length);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    /* Uncached extension */
+    Offset = (ULONG_PTR)VirtualAddress - (ULONG_PTR)DeviceExtension->UncachedExtension;
+    if (DeviceExtension->UncachedExtension != NULL &&
+        Offset < DeviceExtension->UncachedExtensionSize)
+    {
+        PhysicalAddress.QuadPart = DeviceExtension->UncachedExtensionPhysical.QuadPart + Offset;
+        *Length = DeviceExtension->UncachedExtensionSize - (ULONG)Offset;
+        return PhysicalAddress;
+    }
+
+    /* SRB extensions */
+    if (PortGetRequestPhysicalAddress(DeviceExtension, VirtualAddress, &PhysicalAddress, Length))
+        return PhysicalAddress;
+
+    /* Anything else is resident memory, only the rest of its page is known to be contiguous */
+    PhysicalAddress = MmGetPhysicalAddress(VirtualAddress);
+    *Length = PAGE_SIZE - BYTE_OFFSET(VirtualAddress);
+
+    return PhysicalAddress;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+PVOID
+NTAPI
+StorPortGetVirtualAddress(
+    _In_ PVOID HwDeviceExtension,
+    _In_ STOR_PHYSICAL_ADDRESS PhysicalAddress)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    ULONG64 Offset;
+
+    DPRINT("StorPortGetVirtualAddress(%p 0x%I64x)\n",
+           HwDeviceExtension, PhysicalAddress.QuadPart);
+
+    DeviceExtension = MiniportGetAdapter(HwDeviceExtension);
+
+    Offset = PhysicalAddress.QuadPart - DeviceExtension->UncachedExtensionPhysical.QuadPart;
+    if (DeviceExtension->UncachedExtension != NULL &&
+        Offset < DeviceExtension->UncachedExtensionSize)
+    {
+        return (PUCHAR)DeviceExtension->UncachedExtension + (ULONG_PTR)Offset;
+    }
+
+    Offset = PhysicalAddress.QuadPart - DeviceExtension->SrbExtensionPhysical.QuadPart;
+    if (DeviceExtension->SrbExtensionCommon &&
+        Offset < (ULONG64)DeviceExtension->SrbExtensionSize * DeviceExtension->RequestCount)
+    {
+        return (PUCHAR)DeviceExtension->SrbExtensionBuffer + (ULONG_PTR)Offset;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortValidateRange(
+    _In_ PVOID HwDeviceExtension,
+    _In_ INTERFACE_TYPE BusType,
+    _In_ ULONG SystemIoBusNumber,
+    _In_ STOR_PHYSICAL_ADDRESS IoAddress,
+    _In_ ULONG NumberOfBytes,
+    _In_ BOOLEAN InIoSpace)
+{
+    DPRINT("StorPortValidateRange(%p %d %lu 0x%I64x %lu %u)\n",
+           HwDeviceExtension, BusType, SystemIoBusNumber, IoAddress.QuadPart, NumberOfBytes, InIoSpace);
+
+    return TRUE;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortLogError(
+    _In_ PVOID HwDeviceExtension,
+    _In_opt_ PSCSI_REQUEST_BLOCK Srb,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _In_ ULONG ErrorCode,
+    _In_ ULONG UniqueId)
+{
+    DPRINT1("StorPortLogError() called\n");
+    DPRINT1("PathId: 0x%02x  TargetId: 0x%02x  Lun: 0x%02x  ErrorCode: 0x%08lx  UniqueId: 0x%08lx\n",
+            PathId, TargetId, Lun, ErrorCode, UniqueId);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+__cdecl
+StorPortDebugPrint(
+    _In_ ULONG DebugPrintLevel,
+    _In_ PCCHAR DebugMessage,
+    ...)
+{
+    va_list ap;
+
+    va_start(ap, DebugMessage);
+    vDbgPrintExWithPrefix("STORMINI: ", 0x58, DebugPrintLevel, DebugMessage, ap);
+    va_end(ap);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortMoveMemory(
+    _Out_writes_bytes_(Length) PVOID Destination,
+    _In_reads_bytes_(Length) PVOID Source,
+    _In_ ULONG Length)
+{
+    RtlMoveMemory(Destination, Source, Length);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortCopyMemory(
+    _Out_writes_bytes_(Length) PVOID Destination,
+    _In_reads_bytes_(Length) PVOID Source,
+    _In_ ULONG Length)
+{
+    RtlCopyMemory(Destination, Source, Length);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortStallExecution(
+    _In_ ULONG Delay)
+{
+    KeStallExecutionProcessor(Delay);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+STOR_PHYSICAL_ADDRESS
+NTAPI
+StorPortConvertUlong64ToPhysicalAddress(
+    _In_ ULONG64 UlongAddress)
+{
+    STOR_PHYSICAL_ADDRESS Address;
+
+    Address.QuadPart = UlongAddress;
+    return Address;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG64
+NTAPI
+StorPortConvertPhysicalAddressToUlong64(
+    _In_ STOR_PHYSICAL_ADDRESS Address)
+{
+    return Address.QuadPart;
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+UCHAR
+NTAPI
+StorPortReadPortUchar(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUCHAR Port)
+{
+    return READ_PORT_UCHAR(Port);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG
+NTAPI
+StorPortReadPortUlong(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PULONG Port)
+{
+    return READ_PORT_ULONG(Port);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+USHORT
+NTAPI
+StorPortReadPortUshort(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUSHORT Port)
+{
+    return READ_PORT_USHORT(Port);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+UCHAR
+NTAPI
+StorPortReadRegisterUchar(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUCHAR Register)
+{
+    return READ_REGISTER_UCHAR(Register);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+ULONG
+NTAPI
+StorPortReadRegisterUlong(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PULONG Register)
+{
+    return READ_REGISTER_ULONG(Register);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+USHORT
+NTAPI
+StorPortReadRegisterUshort(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUSHORT Register)
+{
+    return READ_REGISTER_USHORT(Register);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWritePortUchar(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUCHAR Port,
+    _In_ UCHAR Value)
+{
+    WRITE_PORT_UCHAR(Port, Value);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWritePortUlong(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PULONG Port,
+    _In_ ULONG Value)
+{
+    WRITE_PORT_ULONG(Port, Value);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWritePortUshort(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUSHORT Port,
+    _In_ USHORT Value)
+{
+    WRITE_PORT_USHORT(Port, Value);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWriteRegisterUchar(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUCHAR Register,
+    _In_ UCHAR Value)
+{
+    WRITE_REGISTER_UCHAR(Register, Value);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWriteRegisterUlong(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PULONG Register,
+    _In_ ULONG Value)
+{
+    WRITE_REGISTER_ULONG(Register, Value);
+}
+
+
+/*
+ * @implemented
+ */
+STORPORTAPI
+VOID
+NTAPI
+StorPortWriteRegisterUshort(
+    _In_ PVOID HwDeviceExtension,
+    _In_ PUSHORT Register,
+    _In_ USHORT Value)
+{
+    WRITE_REGISTER_USHORT(Register, Value);
+}
+
+/* EOF */
@@ -415,6 +415,7 @@ AhciStartPort (
  * @param SystemArgument2
  */
 VOID
+NTAPI
 AhciCommandCompletionDpcRoutine (
     __in PSTOR_DPC Dpc,
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension,
@@ -472,6 +473,7 @@ AhciCommandCompletionDpcRoutine (
  * return TRUE if intialization was successful
  */
 BOOLEAN
+NTAPI
 AhciHwPassiveInitialize (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension
     )
@@ -487,7 +489,7 @@ AhciHwPassiveInitialize (
         {
             PortExtension = &AdapterExtension->PortExtension[index];
             PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
-            StorPortInitializeDpc(AdapterExtension, &PortExtension->CommandCompletion, AhciCommandCompletionDpcRoutine);
+            StorPortInitializeDpc(AdapterExtension, &PortExtension->CommandCompletion, (PHW_DPC_ROUTINE)AhciCommandCompletionDpcRoutine);
         }
     }
 
@@ -506,6 +508,7 @@ AhciHwPassiveInitialize (
  * return TRUE if intialization was successful
  */
 BOOLEAN
+NTAPI
 AhciHwInitialize (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension
     )
@@ -529,7 +532,7 @@ AhciHwInitialize (
         AhciDebugPrint("\tMultiple MSI based message not supported\n");
     }
 
-    StorPortEnablePassiveInitialization(AdapterExtension, AhciHwPassiveInitialize);
+    StorPortEnablePassiveInitialization(AdapterExtension, (PHW_PASSIVE_INITIALIZE_ROUTINE)AhciHwPassiveInitialize);
 
     return TRUE;
 }// -- AhciHwInitialize();
@@ -678,11 +681,18 @@ AhciInterruptHandler (
     ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
     sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
 
+    // Native queued commands are completed by a Set Device Bits FIS (PxIS.SDBS), which makes
+    // the HBA clear their bits in PxSACT; several of them may complete with a single interrupt.
     outstanding = ci | sact; // NOTE: Including both non-NCQ and NCQ based commands
     if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
     {
         AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
         PortExtension->CommandIssuedSlots &= outstanding;
+        PortExtension->QueuedCommandSlots &= (outstanding | PortExtension->QueueSlots);
+
+        // slots were freed, hand them the pending Srbs
+        AhciFillCommandSlots(PortExtension);
+        AhciActivatePort(PortExtension);
     }
 
     return;
@@ -701,6 +711,7 @@ AhciInterruptHandler (
  * return FALSE Indicates the interrupt was not ours.
  */
 BOOLEAN
+NTAPI
 AhciHwInterrupt (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension
     )
@@ -765,6 +776,7 @@ AhciHwInterrupt (
  * return FALSE if the request must be submitted later
  */
 BOOLEAN
+NTAPI
 AhciHwStartIo (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension,
     __in PSCSI_REQUEST_BLOCK Srb
@@ -903,6 +915,7 @@ AhciHwStartIo (
  * return TRUE if bus was successfully reset
  */
 BOOLEAN
+NTAPI
 AhciHwResetBus (
     __in PVOID AdapterExtension,
     __in ULONG PathId
@@ -915,7 +928,7 @@ AhciHwResetBus (
 
     adapterExtension = AdapterExtension;
 
-    if (IsPortValid(AdapterExtension, PathId))
+    if (IsPortValid(adapterExtension, PathId))
     {
         // Acquire Lock
         StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
@@ -962,6 +975,7 @@ AhciHwResetBus (
  * @remarks Called by Storport.
  */
 ULONG
+NTAPI
 AhciHwFindAdapter (
     __in PVOID AdapterExtension,
     __in PVOID HwContext,
@@ -1133,6 +1147,7 @@ AhciHwFindAdapter (
  * NT_STATUS in case of driver loaded successfully.
  */
 ULONG
+NTAPI
 DriverEntry (
     __in PVOID DriverObject,
     __in PVOID RegistryPath
@@ -1146,11 +1161,11 @@ DriverEntry (
     hwInitializationData.HwInitializationDataSize = sizeof(HW_INITIALIZATION_DATA);
 
     // identity required miniport entry point routines
-    hwInitializationData.HwStartIo = AhciHwStartIo;
+    hwInitializationData.HwStartIo = (PHW_STARTIO)AhciHwStartIo;
     hwInitializationData.HwResetBus = AhciHwResetBus;
-    hwInitializationData.HwInterrupt = AhciHwInterrupt;
-    hwInitializationData.HwInitialize = AhciHwInitialize;
-    hwInitializationData.HwFindAdapter = AhciHwFindAdapter;
+    hwInitializationData.HwInterrupt = (PHW_INTERRUPT)AhciHwInterrupt;
+    hwInitializationData.HwInitialize = (PHW_INITIALIZE)AhciHwInitialize;
+    hwInitializationData.HwFindAdapter = (PHW_FIND_ADAPTER)AhciHwFindAdapter;
 
     // adapter specific information
     hwInitializationData.TaggedQueuing = TRUE;
@@ -1376,6 +1391,13 @@ AhciProcessSrb (
     NT_ASSERT(SlotIndex < AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
     SrbExtension->SlotIndex = SlotIndex;
 
+    if (IsQueuedCommand(SrbExtension))
+    {
+        // FPDMA QUEUED commands carry their tag in Count(7:3), we use the command slot as tag
+        NT_ASSERT(SlotIndex < PortExtension->DeviceParams.QueueDepth);
+        SrbExtension->SectorCountLow = (UCHAR)(SlotIndex << 3);
+    }
+
     // program the CFIS in the CommandTable
     CommandHeader = &PortExtension->CommandList[SlotIndex];
 
@@ -1441,6 +1463,11 @@ AhciProcessSrb (
     // mark this slot
     PortExtension->Slot[SlotIndex] = Srb;
     PortExtension->QueueSlots |= 1 << SlotIndex;
+
+    if (IsQueuedCommand(SrbExtension))
+    {
+        PortExtension->QueuedCommandSlots |= 1 << SlotIndex;
+    }
     return;
 }// -- AhciProcessSrb();
 
@@ -1459,7 +1486,7 @@ AhciActivatePort (
     )
 {
     AHCI_PORT_CMD cmd;
-    ULONG QueueSlots, slotToActivate, tmp;
+    ULONG QueueSlots, QueuedCommands, slotToActivate, tmp;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
 
     AhciDebugPrint("AhciActivatePort()\n");
@@ -1481,13 +1508,25 @@ AhciActivatePort (
         return;
     }
 
-    // get the lowest set bit
-    tmp = QueueSlots & (QueueSlots - 1);
+    // AhciFillCommandSlots never mixes native queued and non-queued commands
+    QueuedCommands = QueueSlots & PortExtension->QueuedCommandSlots;
+    NT_ASSERT((QueuedCommands == 0) || (QueuedCommands == QueueSlots));
 
-    if (tmp == 0)
-        slotToActivate = QueueSlots;
+    if (QueuedCommands != 0)
+    {
+        // native queued commands can all be issued at once
+        slotToActivate = QueuedCommands;
+    }
     else
-        slotToActivate = (QueueSlots & (~tmp));
+    {
+        // get the lowest set bit
+        tmp = QueueSlots & (QueueSlots - 1);
+
+        if (tmp == 0)
+            slotToActivate = QueueSlots;
+        else
+            slotToActivate = (QueueSlots & (~tmp));
+    }
 
     // mark that bit off in QueueSlots
     // so we can know we it is really needed to activate port or not
@@ -1496,6 +1535,13 @@ AhciActivatePort (
     // to validate in completeIssuedCommand
     PortExtension->CommandIssuedSlots |= slotToActivate;
 
+    // section 5.3.2.2
+    // for native queued commands, PxSACT must be set before the command is issued through PxCI
+    if (QueuedCommands != 0)
+    {
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SACT, slotToActivate);
+    }
+
     // tell the HBA to issue this Command Slot to the given port
     StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, slotToActivate);
 
@@ -1521,10 +1567,8 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PSCSI_REQUEST_BLOCK tmpSrb;
     STOR_LOCK_HANDLE lockhandle = {0};
     PAHCI_PORT_EXTENSION PortExtension;
-    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
 
     AhciDebugPrint("AhciProcessIO()\n");
     AhciDebugPrint("\tPathId: %d\n", PathId);
@@ -1546,45 +1590,94 @@ AhciProcessIO (
         return; // we should wait for device to get active
     }
 
+    AhciFillCommandSlots(PortExtension);
+
+    // program HBA port
+    AhciActivatePort(PortExtension);
+
+    // Release Lock
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+
+    return;
+}// -- AhciProcessIO();
+
+/**
+ * @name AhciFillCommandSlots
+ * @implemented
+ *
+ * Move pending Srbs from the port queue into free command slots.
+ * Caller must hold the InterruptLock.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciFillCommandSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PSCSI_REQUEST_BLOCK tmpSrb;
+    PAHCI_SRB_EXTENSION SrbExtension;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
+
+    AhciDebugPrint("AhciFillCommandSlots()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
     occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
     NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
     commandSlotMask = (1 << NCS) - 1; // available slots mask
 
     commandSlotMask = (commandSlotMask & ~occupiedSlots);
-    if(commandSlotMask != 0)
+
+    // iterate over all free HBA port slots
+    for (slotIndex = 0; (slotIndex < NCS) && (commandSlotMask != 0); slotIndex++)
     {
-        // iterate over HBA port slots
-        for (slotIndex = 0; slotIndex < NCS; slotIndex++)
+        if ((commandSlotMask & (1 << slotIndex)) == 0)
+        {
+            continue;
+        }
+
+        tmpSrb = PeekQueue(&PortExtension->SrbQueue);
+        if (tmpSrb == NULL)
+        {
+            break;
+        }
+
+        NT_ASSERT(tmpSrb->PathId == PortExtension->PortNumber);
+        SrbExtension = GetSrbExtension(tmpSrb);
+
+        // Serial ATA 13.6.4
+        // native queued and non-queued commands cannot be outstanding at the same time,
+        // keep the Srb pending until the other kind has drained
+        if (IsQueuedCommand(SrbExtension))
         {
-            // find first free slot
-            if ((commandSlotMask & (1 << slotIndex)) != 0)
+            if ((occupiedSlots & ~PortExtension->QueuedCommandSlots) != 0)
             {
-                tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
-                if (tmpSrb != NULL)
-                {
-                    NT_ASSERT(tmpSrb->PathId == PathId);
-                    AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
-                }
-                else
-                {
-                    break;
-                }
+                break;
             }
-            else
+
+            // the slot doubles as the NCQ tag, it must be below the device queue depth
+            if (slotIndex >= PortExtension->DeviceParams.QueueDepth)
             {
                 break;
             }
         }
-    }
+        else if ((occupiedSlots & PortExtension->QueuedCommandSlots) != 0)
+        {
+            break;
+        }
 
-    // program HBA port
-    AhciActivatePort(PortExtension);
+        RemoveQueue(&PortExtension->SrbQueue);
+        AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
 
-    // Release Lock
-    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+        occupiedSlots |= (1 << slotIndex);
+        commandSlotMask &= ~(1 << slotIndex);
+    }
 
     return;
-}// -- AhciProcessIO();
+}// -- AhciFillCommandSlots();
 
 /**
  * @name AtapiInquiryCompletion
@@ -1641,9 +1734,9 @@ InquiryCompletion (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PCDB cdb;
     BOOLEAN status;
     PINQUIRYDATA InquiryData;
+    ULONG NCS, SataCapabilities;
     PAHCI_SRB_EXTENSION SrbExtension;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
     PIDENTIFY_DEVICE_DATA IdentifyDeviceData;
@@ -1653,7 +1746,6 @@ InquiryCompletion (
     NT_ASSERT(Srb != NULL);
     NT_ASSERT(PortExtension != NULL);
 
-    cdb = (PCDB)&Srb->Cdb;
     InquiryData = Srb->DataBuffer;
     SrbExtension = GetSrbExtension(Srb);
     AdapterExtension = PortExtension->AdapterExtension;
@@ -1672,7 +1764,10 @@ InquiryCompletion (
     NT_ASSERT(Srb->SrbStatus == SRB_STATUS_SUCCESS);
 
     // Device specific data
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
     PortExtension->DeviceParams.MaxLba.QuadPart = 0;
+    PortExtension->DeviceParams.NcqEnabled = 0;
+    PortExtension->DeviceParams.QueueDepth = NCS;
 
     if (SrbExtension->CommandReg == IDE_COMMAND_IDENTIFY)
     {
@@ -1727,6 +1822,24 @@ InquiryCompletion (
         PortExtension->DeviceParams.RevisionID[sizeof(PortExtension->DeviceParams.RevisionID) - 1] = '\0';
         PortExtension->DeviceParams.SerialNumber[sizeof(PortExtension->DeviceParams.SerialNumber) - 1] = '\0';
 
+        /* Native command queuing, needs HBA (CAP.SNCQ) and device (word 76) support */
+        SataCapabilities = IdentifyDeviceData->ReservedWords76[0];
+        if (IsAdapterCAPSNCQ(AdapterExtension->CAP) &&
+            (SataCapabilities != 0xFFFF) &&
+            (SataCapabilities & IDENTIFY_SATA_CAPABILITIES_NCQ) &&
+            PortExtension->DeviceParams.Lba48BitMode)
+        {
+            PortExtension->DeviceParams.NcqEnabled = 1;
+
+            // word 75 holds the maximum queue depth - 1
+            if ((ULONG)IdentifyDeviceData->QueueDepth + 1 < NCS)
+            {
+                PortExtension->DeviceParams.QueueDepth = IdentifyDeviceData->QueueDepth + 1;
+            }
+
+            AhciDebugPrint("\tNCQ Queue Depth: %d\n", PortExtension->DeviceParams.QueueDepth);
+        }
+
         // TODO: Add other device params
         AhciDebugPrint("\tATA Device\n");
     }
@@ -1750,7 +1863,7 @@ InquiryCompletion (
     // prepare data to send
     InquiryData->Versions = 2;
     InquiryData->Wide32Bit = 1;
-    InquiryData->CommandQueue = 0; // NCQ not supported
+    InquiryData->CommandQueue = PortExtension->DeviceParams.NcqEnabled;
     InquiryData->ResponseDataFormat = 0x2;
     InquiryData->DeviceTypeModifier = 0;
     InquiryData->DeviceTypeQualifier = DEVICE_CONNECTED;
@@ -1772,7 +1885,7 @@ InquiryCompletion (
                                          Srb->PathId,
                                          Srb->TargetId,
                                          Srb->Lun,
-                                         AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
+                                         PortExtension->DeviceParams.QueueDepth);
 
     NT_ASSERT(status == TRUE);
     return;
@@ -1835,7 +1948,7 @@ AhciATAPICommand (
     {
         case SCSIOP_INQUIRY:
             SrbExtension->Flags |= ATA_FLAGS_DATA_IN;
-            SrbExtension->CompletionRoutine = AtapiInquiryCompletion;
+            SrbExtension->CompletionRoutine = (PAHCI_COMPLETION_ROUTINE)AtapiInquiryCompletion;
             break;
         case SCSIOP_READ:
             SrbExtension->Flags |= ATA_FLAGS_USE_DMA;
@@ -1978,8 +2091,10 @@ DeviceRequestReadWrite (
 
     NT_ASSERT(SectorCount > 0);
 
+    // the Srb extension is reused between requests, don't inherit stale flags
+    // such as ATA_FLAGS_QUEUED_COMMAND from the previous one
     SrbExtension->AtaFunction = ATA_FUNCTION_ATA_READ;
-    SrbExtension->Flags |= ATA_FLAGS_USE_DMA;
+    SrbExtension->Flags = ATA_FLAGS_USE_DMA;
     SrbExtension->CompletionRoutine = NULL;
 
     if (IsReading)
@@ -2026,6 +2141,19 @@ DeviceRequestReadWrite (
     SrbExtension->SectorCountLow = (SectorCount >> 0) & 0xFF;
     SrbExtension->SectorCountHigh = (SectorCount >> 8) & 0xFF;
 
+    if (PortExtension->DeviceParams.NcqEnabled)
+    {
+        // READ/WRITE FPDMA QUEUED take the sector count in the Features registers,
+        // the tag goes into Count and is assigned along with the command slot
+        SrbExtension->Flags |= ATA_FLAGS_QUEUED_COMMAND;
+        SrbExtension->CommandReg = IsReading ? IDE_COMMAND_READ_FPDMA_QUEUED : IDE_COMMAND_WRITE_FPDMA_QUEUED;
+        SrbExtension->Device = IDE_LBA_MODE;
+        SrbExtension->FeaturesLow = (SectorCount >> 0) & 0xFF;
+        SrbExtension->FeaturesHigh = (SectorCount >> 8) & 0xFF;
+        SrbExtension->SectorCountLow = 0;
+        SrbExtension->SectorCountHigh = 0;
+    }
+
     NT_ASSERT(SectorCount < 0x100);
 
     SrbExtension->pSgl = (PLOCAL_SCATTER_GATHER_LIST)StorPortGetScatterGatherList(AdapterExtension, Srb);
@@ -2236,8 +2364,8 @@ DeviceInquiryRequest (
         NT_ASSERT(SrbExtension != NULL);
 
         SrbExtension->AtaFunction = ATA_FUNCTION_ATA_IDENTIFY;
-        SrbExtension->Flags |= ATA_FLAGS_DATA_IN;
-        SrbExtension->CompletionRoutine = InquiryCompletion;
+        SrbExtension->Flags = ATA_FLAGS_DATA_IN;
+        SrbExtension->CompletionRoutine = (PAHCI_COMPLETION_ROUTINE)InquiryCompletion;
         SrbExtension->CommandReg = IDE_COMMAND_NOT_VALID;
 
         // TODO: Should use AhciZeroMemory
@@ -2499,6 +2627,33 @@ RemoveQueue (
     return Srb;
 }// -- RemoveQueue();
 
+/**
+ * @name PeekQueue
+ * @implemented
+ *
+ * Return the Srb at the front of Queue without removing it
+ *
+ * @param Queue
+ *
+ * @return
+ * return Srb
+ *
+ */
+__inline
+PVOID
+PeekQueue (
+    __in PAHCI_QUEUE Queue
+    )
+{
+    NT_ASSERT(Queue->Head < MAXIMUM_QUEUE_BUFFER_SIZE);
+    NT_ASSERT(Queue->Tail < MAXIMUM_QUEUE_BUFFER_SIZE);
+
+    if (Queue->Head == Queue->Tail)
+        return NULL;
+
+    return Queue->Buffer[Queue->Tail];
+}// -- PeekQueue();
+
 /**
  * @name GetSrbExtension
  * @implemented
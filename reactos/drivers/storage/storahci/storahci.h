@@ -8,6 +8,7 @@
 #include <ntddk.h>
 #include <ata.h>
 #include <storport.h>
+#include <scsi.h>
 
 #define DEBUG 1
 #pragma warning(disable:4214) // bit field types other than int
@@ -28,6 +29,7 @@
 
 // section 3.1.2
 #define AHCI_Global_HBA_CAP_S64A            (1 << 31)
+#define AHCI_Global_HBA_CAP_SNCQ            (1 << 30)
 
 // FIS Types : http://wiki.osdev.org/AHCI
 #define FIS_TYPE_REG_H2D        0x27 // Register FIS - host to device
@@ -66,17 +68,57 @@
 #define ATA_FLAGS_DATA_OUT                  (1 << 2)
 #define ATA_FLAGS_48BIT_COMMAND             (1 << 3)
 #define ATA_FLAGS_USE_DMA                   (1 << 4)
+#define ATA_FLAGS_QUEUED_COMMAND            (1 << 5) // native command queuing (FPDMA QUEUED)
+
+// ATA commands and device register bits missing from older ata.h headers
+#ifndef IDE_COMMAND_NOT_VALID
+#define IDE_COMMAND_NOT_VALID               0x00
+#endif
+#ifndef IDE_COMMAND_READ_DMA_EXT
+#define IDE_COMMAND_READ_DMA_EXT            0x25
+#endif
+#ifndef IDE_COMMAND_WRITE_DMA_EXT
+#define IDE_COMMAND_WRITE_DMA_EXT           0x35
+#endif
+#ifndef IDE_COMMAND_ATAPI_PACKET
+#define IDE_COMMAND_ATAPI_PACKET            0xA0
+#endif
+#ifndef IDE_COMMAND_ATAPI_IDENTIFY
+#define IDE_COMMAND_ATAPI_IDENTIFY          0xA1
+#endif
+#ifndef IDE_COMMAND_READ_DMA
+#define IDE_COMMAND_READ_DMA                0xC8
+#endif
+#ifndef IDE_COMMAND_WRITE_DMA
+#define IDE_COMMAND_WRITE_DMA               0xCA
+#endif
+#ifndef IDE_LBA_MODE
+#define IDE_LBA_MODE                        (1 << 6)
+#endif
+
+// Native command queuing commands (ATA8-ACS 7.20, 7.63)
+#ifndef IDE_COMMAND_READ_FPDMA_QUEUED
+#define IDE_COMMAND_READ_FPDMA_QUEUED       0x60
+#endif
+#ifndef IDE_COMMAND_WRITE_FPDMA_QUEUED
+#define IDE_COMMAND_WRITE_FPDMA_QUEUED      0x61
+#endif
+
+// IDENTIFY DEVICE word 76 (Serial ATA capabilities), bit 8: NCQ supported
+#define IDENTIFY_SATA_CAPABILITIES_NCQ      (1 << 8)
 
 #define IsAtaCommand(AtaFunction)           (AtaFunction & ATA_FUNCTION_ATA_COMMAND)
 #define IsAtapiCommand(AtaFunction)         (AtaFunction & ATA_FUNCTION_ATAPI_COMMAND)
 #define IsDataTransferNeeded(SrbExtension)  (SrbExtension->Flags & (ATA_FLAGS_DATA_IN | ATA_FLAGS_DATA_OUT))
 #define IsAdapterCAPS64(CAP)                (CAP & AHCI_Global_HBA_CAP_S64A)
+#define IsAdapterCAPSNCQ(CAP)               (CAP & AHCI_Global_HBA_CAP_SNCQ)
+#define IsQueuedCommand(SrbExtension)       (SrbExtension->Flags & ATA_FLAGS_QUEUED_COMMAND)
 
 // 3.1.1 NCS = CAP[12:08] -> Align
 #define AHCI_Global_Port_CAP_NCS(x)         (((x) & 0xF00) >> 8)
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
-#define AhciDebugPrint(format, ...) StorPortDebugPrint(0, format, __VA_ARGS__)
+#define AhciDebugPrint(format, ...) StorPortDebugPrint(0, format, ##__VA_ARGS__)
 
 typedef
 VOID
@@ -458,6 +500,7 @@ typedef struct _AHCI_PORT_EXTENSION
     ULONG PortNumber;
     ULONG QueueSlots;                                   // slots which we have already assigned task (Slot)
     ULONG CommandIssuedSlots;                           // slots which has been programmed
+    ULONG QueuedCommandSlots;                           // slots holding native queued commands (tracked in PxSACT)
     ULONG MaxPortQueueDepth;
 
     struct
@@ -467,6 +510,8 @@ typedef struct _AHCI_PORT_EXTENSION
         UCHAR AccessType;
         UCHAR DeviceType;
         UCHAR IsActive;
+        UCHAR NcqEnabled;                               // both HBA and device do native command queuing
+        ULONG QueueDepth;                               // commands the device accepts at once
         LARGE_INTEGER MaxLba;
         ULONG BytesPerLogicalSector;
         ULONG BytesPerPhysicalSector;
@@ -570,11 +615,21 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     );
 
+VOID
+AhciFillCommandSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    );
+
 BOOLEAN
 AhciAdapterReset (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension
     );
 
+VOID
+AhciActivatePort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    );
+
 __inline
 VOID
 AhciZeroMemory (
@@ -639,6 +694,12 @@ RemoveQueue (
     __inout PAHCI_QUEUE Queue
     );
 
+__inline
+PVOID
+PeekQueue (
+    __in PAHCI_QUEUE Queue
+    );
+
 __inline
 PAHCI_SRB_EXTENSION
 GetSrbExtension(
@@ -16,6 +16,25 @@
 BOOLEAN CcPfEnablePrefetcher;
 PFSN_PREFETCHER_GLOBALS CcPfGlobals;
 
+/* Read ahead window, in VACBs, for files detected as being read sequentially */
+#define CC_READ_AHEAD_VACBS     2
+
+typedef struct _CC_READ_AHEAD_WORK_ITEM
+{
+    LIST_ENTRY ListEntry;
+    PFILE_OBJECT FileObject;
+    LONGLONG FileOffset;
+    LONGLONG Length;
+} CC_READ_AHEAD_WORK_ITEM, *PCC_READ_AHEAD_WORK_ITEM;
+
+static LIST_ENTRY CcReadAheadQueue;
+static KSPIN_LOCK CcReadAheadQueueLock;
+static KEVENT CcReadAheadEvent;
+
+ULONG CcReadAheadIos;
+
+extern KGUARDED_MUTEX ViewLock;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -36,13 +55,155 @@ CcPfInitializePrefetcher(VOID)
     /* FIXME: Setup the rest of the prefetecher */
 }
 
+static
+VOID
+CcPerformReadAhead(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN LONGLONG Length)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+    LONGLONG CurrentOffset;
+    PROS_VACB Vacb;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
+    /* Make sure the file is still cached and keep its cache map alive */
+    KeAcquireGuardedMutex(&ViewLock);
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (FileObject->PrivateCacheMap == NULL || SharedCacheMap == NULL)
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+        return;
+    }
+    SharedCacheMap->OpenCount++;
+    KeReleaseGuardedMutex(&ViewLock);
+
+    if (SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, TRUE))
+    {
+        IoSetTopLevelIrp((PIRP)FSRTL_CACHE_TOP_LEVEL_IRP);
+
+        for (CurrentOffset = FileOffset;
+             CurrentOffset < FileOffset + Length;
+             CurrentOffset += VACB_MAPPING_GRANULARITY)
+        {
+            if (CurrentOffset >= SharedCacheMap->SectionSize.QuadPart)
+                break;
+
+            Status = CcRosRequestVacb(SharedCacheMap,
+                                      CurrentOffset,
+                                      &BaseAddress,
+                                      &Valid,
+                                      &Vacb);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            if (!Valid)
+            {
+                Status = CcReadVirtualAddress(Vacb);
+                CcReadAheadIos++;
+            }
+
+            CcRosReleaseVacb(SharedCacheMap, Vacb, NT_SUCCESS(Status), FALSE, FALSE);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Read ahead of %I64x failed, Status %x\n", CurrentOffset, Status);
+                break;
+            }
+        }
+
+        IoSetTopLevelIrp(NULL);
+        SharedCacheMap->Callbacks->ReleaseFromReadAhead(SharedCacheMap->LazyWriteContext);
+    }
+
+    CcRosDereferenceCache(FileObject);
+
+    /* Allow the next read ahead for this file object */
+    KeAcquireGuardedMutex(&ViewLock);
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    if (PrivateCacheMap != NULL)
+    {
+        KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+        PrivateCacheMap->ReadAheadActive = FALSE;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+    }
+    KeReleaseGuardedMutex(&ViewLock);
+}
+
+static
+VOID
+NTAPI
+CcReadAheadThread(
+    IN PVOID Context)
+{
+    PCC_READ_AHEAD_WORK_ITEM WorkItem;
+    PLIST_ENTRY ListEntry;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (;;)
+    {
+        KeWaitForSingleObject(&CcReadAheadEvent,
+                              Executive,
+                              KernelMode,
+                              FALSE,
+                              NULL);
+
+        while ((ListEntry = ExInterlockedRemoveHeadList(&CcReadAheadQueue,
+                                                        &CcReadAheadQueueLock)) != NULL)
+        {
+            WorkItem = CONTAINING_RECORD(ListEntry, CC_READ_AHEAD_WORK_ITEM, ListEntry);
+
+            CcPerformReadAhead(WorkItem->FileObject,
+                               WorkItem->FileOffset,
+                               WorkItem->Length);
+
+            ObDereferenceObject(WorkItem->FileObject);
+            ExFreePoolWithTag(WorkItem, TAG_CC);
+        }
+    }
+}
+
+static
+BOOLEAN
+INIT_FUNCTION
+CcInitReadAhead(VOID)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    InitializeListHead(&CcReadAheadQueue);
+    KeInitializeSpinLock(&CcReadAheadQueueLock);
+    KeInitializeEvent(&CcReadAheadEvent, SynchronizationEvent, FALSE);
+
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  NULL,
+                                  NULL,
+                                  NULL,
+                                  CcReadAheadThread,
+                                  NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create the read ahead thread, Status %x\n", Status);
+        return FALSE;
+    }
+
+    ZwClose(ThreadHandle);
+    return TRUE;
+}
+
 BOOLEAN
 NTAPI
 INIT_FUNCTION
 CcInitializeCacheManager(VOID)
 {
     CcInitView();
-    return TRUE;
+    CcInitDeferredWrites();
+    return CcInitReadAhead();
 }
 
 /*
@@ -78,7 +239,7 @@ CcRemapBcb (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -88,11 +249,97 @@ CcScheduleReadAhead (
 	IN	ULONG			Length
 	)
 {
-	UNIMPLEMENTED;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+    PCC_READ_AHEAD_WORK_ITEM WorkItem;
+    LONGLONG BeyondLastByte, Window, Start, End;
+    BOOLEAN Sequential, Queue = FALSE;
+    KIRQL OldIrql;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
+        FileObject, FileOffset->QuadPart, Length);
+
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    if (SharedCacheMap == NULL || PrivateCacheMap == NULL ||
+        SharedCacheMap->DisableReadAhead || Length == 0)
+    {
+        return;
+    }
+
+    BeyondLastByte = FileOffset->QuadPart + Length;
+
+    /* Read ahead at least a granule, more for large or sequential-only reads */
+    Window = max(CC_READ_AHEAD_VACBS * VACB_MAPPING_GRANULARITY,
+                 (LONGLONG)PrivateCacheMap->ReadAheadMask + 1);
+    Window = max(Window, (LONGLONG)Length);
+    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+        Window *= 2;
+
+    KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+
+    /* Sequential if both this read and the previous one continue in the granule
+       where the read before them ended */
+    Sequential = BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY) ||
+                 ((FileOffset->QuadPart & ~(LONGLONG)PrivateCacheMap->ReadAheadMask) ==
+                  (PrivateCacheMap->BeyondLastByte1.QuadPart & ~(LONGLONG)PrivateCacheMap->ReadAheadMask) &&
+                  (PrivateCacheMap->FileOffset1.QuadPart & ~(LONGLONG)PrivateCacheMap->ReadAheadMask) ==
+                  (PrivateCacheMap->BeyondLastByte2.QuadPart & ~(LONGLONG)PrivateCacheMap->ReadAheadMask));
+
+    PrivateCacheMap->FileOffset2 = PrivateCacheMap->FileOffset1;
+    PrivateCacheMap->BeyondLastByte2 = PrivateCacheMap->BeyondLastByte1;
+    PrivateCacheMap->FileOffset1.QuadPart = FileOffset->QuadPart;
+    PrivateCacheMap->BeyondLastByte1.QuadPart = BeyondLastByte;
+
+    if (!Sequential)
+    {
+        /* Random access, start over */
+        PrivateCacheMap->ReadAheadOffset.QuadPart = 0;
+    }
+    else if (!PrivateCacheMap->ReadAheadActive &&
+             PrivateCacheMap->ReadAheadOffset.QuadPart < BeyondLastByte + Window / 2)
+    {
+        /* Less than half a window is left ahead of the reader, refill it */
+        Start = max(PrivateCacheMap->ReadAheadOffset.QuadPart,
+                    ROUND_DOWN(BeyondLastByte, VACB_MAPPING_GRANULARITY));
+        End = min(ROUND_UP(BeyondLastByte + Window, VACB_MAPPING_GRANULARITY),
+                  ROUND_UP(SharedCacheMap->FileSize.QuadPart, VACB_MAPPING_GRANULARITY));
+        if (Start < End)
+        {
+            PrivateCacheMap->ReadAheadActive = TRUE;
+            PrivateCacheMap->ReadAheadOffset.QuadPart = End;
+            Queue = TRUE;
+        }
+    }
+
+    KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+
+    if (!Queue)
+        return;
+
+    WorkItem = ExAllocatePoolWithTag(NonPagedPool, sizeof(*WorkItem), TAG_CC);
+    if (WorkItem == NULL)
+    {
+        KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+        PrivateCacheMap->ReadAheadActive = FALSE;
+        PrivateCacheMap->ReadAheadOffset.QuadPart = 0;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    ObReferenceObject(FileObject);
+    WorkItem->FileObject = FileObject;
+    WorkItem->FileOffset = Start;
+    WorkItem->Length = End - Start;
+
+    ExInterlockedInsertTailList(&CcReadAheadQueue,
+                                &WorkItem->ListEntry,
+                                &CcReadAheadQueueLock);
+    KeSetEvent(&CcReadAheadEvent, IO_NO_INCREMENT, FALSE);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -102,10 +349,22 @@ CcSetAdditionalCacheAttributes (
 	IN	BOOLEAN		DisableWriteBehind
 	)
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p DisableReadAhead=%d DisableWriteBehind=%d\n",
         FileObject, DisableReadAhead, DisableWriteBehind);
 
-	UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap != NULL)
+    {
+        SharedCacheMap->DisableReadAhead = DisableReadAhead;
+    }
+
+    if (DisableWriteBehind)
+    {
+        /* FIXME: write behind is not implemented */
+        UNIMPLEMENTED;
+    }
 }
 
 /*
@@ -133,7 +392,7 @@ CcSetBcbOwnerPointer (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -142,14 +401,31 @@ CcSetDirtyPageThreshold (
 	IN	ULONG		DirtyPageThreshold
 	)
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PFSRTL_COMMON_FCB_HEADER Fcb;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p DirtyPageThreshold=%lu\n",
         FileObject, DirtyPageThreshold);
 
-	UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap != NULL)
+    {
+        SharedCacheMap->DirtyPageThreshold = DirtyPageThreshold;
+    }
+
+    /* Let the file system know that writes to this file are limited */
+    Fcb = FileObject->FsContext;
+    if (Fcb != NULL && DirtyPageThreshold != 0)
+    {
+        SetFlag(Fcb->Flags, FSRTL_FLAG_LIMIT_MODIFIED_PAGES);
+    }
+
+    /* A raised limit may let deferred writes through */
+    CcPostDeferredWrites();
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -158,8 +434,17 @@ CcSetReadAheadGranularity (
 	IN	ULONG		Granularity
 	)
 {
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p Granularity=%lu\n",
         FileObject, Granularity);
 
-	UNIMPLEMENTED;
+    /* The granularity must be a power of two, at least a page */
+    ASSERT(Granularity >= PAGE_SIZE && (Granularity & (Granularity - 1)) == 0);
+
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    if (PrivateCacheMap != NULL)
+    {
+        PrivateCacheMap->ReadAheadMask = Granularity - 1;
+    }
 }
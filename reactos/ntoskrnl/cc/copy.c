@@ -19,6 +19,15 @@ static PFN_NUMBER CcZeroPage = 0;
 
 #define MAX_ZERO_LENGTH    (256 * 1024)
 
+/* Most pages a single write is charged for against the dirty page limits */
+#define WRITE_CHARGE_PAGES      64
+
+/* How long a throttled writer waits before checking on the lazy writer itself */
+#define THROTTLE_RETRY_TIMEOUT  (-250 * 10000LL)
+
+/* How many times it checks before giving up and writing anyway, about 10 seconds */
+#define THROTTLE_MAX_RETRIES    40
+
 typedef enum _CC_COPY_OPERATION
 {
     CcOperationRead,
@@ -33,6 +42,19 @@ ULONG CcFastReadNotPossible;
 ULONG CcFastReadWait;
 ULONG CcFastReadNoWait;
 ULONG CcFastReadResourceMiss;
+ULONG CcCopyReadWait;
+ULONG CcCopyReadNoWait;
+ULONG CcCopyReadWaitMiss;
+ULONG CcCopyReadNoWaitMiss;
+ULONG CcDirtyPageThreshold;
+ULONG CcThrottledWrites;
+
+static LIST_ENTRY CcDeferredWrites;
+static KSPIN_LOCK CcDeferredWriteSpinLock;
+
+extern KGUARDED_MUTEX ViewLock;
+extern ULONG DirtyPageCount;
+extern KEVENT MpwThreadEvent;
 
 /* FUNCTIONS *****************************************************************/
 
@@ -60,6 +82,160 @@ CcInitCacheZeroPage (
     MiZeroPhysicalPage(CcZeroPage);
 }
 
+VOID
+NTAPI
+INIT_FUNCTION
+CcInitDeferredWrites (
+    VOID)
+{
+    InitializeListHead(&CcDeferredWrites);
+    KeInitializeSpinLock(&CcDeferredWriteSpinLock);
+
+    /* Start throttling writers once an eighth of the memory is dirty */
+    CcDirtyPageThreshold = max(MmNumberOfPhysicalPages / 8,
+                               4 * VACB_MAPPING_GRANULARITY / PAGE_SIZE);
+}
+
+/* Called with the ViewLock held */
+static
+BOOLEAN
+CcIsWriteWithinLimits (
+    IN PFILE_OBJECT FileObject,
+    IN ULONG BytesToWrite,
+    IN ULONG PagesCharged)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    ULONG Pages;
+
+    Pages = min(BYTES_TO_PAGES(BytesToWrite), WRITE_CHARGE_PAGES) + PagesCharged;
+
+    /* Always let a write through when nothing is dirty, the limit may be
+       lower than what a single view accounts for */
+    if (DirtyPageCount != 0 &&
+        DirtyPageCount + Pages > CcDirtyPageThreshold)
+    {
+        return FALSE;
+    }
+
+    SharedCacheMap = FileObject->SectionObjectPointer != NULL ?
+                     FileObject->SectionObjectPointer->SharedCacheMap : NULL;
+    if (SharedCacheMap != NULL &&
+        SharedCacheMap->DirtyPageThreshold != 0 &&
+        SharedCacheMap->DirtyPages != 0 &&
+        SharedCacheMap->DirtyPages + Pages > SharedCacheMap->DirtyPageThreshold)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Returns FALSE if CcPostDeferredWrites already took the write off the queue */
+static
+BOOLEAN
+CcCancelDeferredWrite (
+    IN PDEFERRED_WRITE DeferredWrite)
+{
+    PLIST_ENTRY ListEntry;
+    BOOLEAN Found = FALSE;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&CcDeferredWriteSpinLock, &OldIrql);
+    for (ListEntry = CcDeferredWrites.Flink;
+         ListEntry != &CcDeferredWrites;
+         ListEntry = ListEntry->Flink)
+    {
+        if (ListEntry == &DeferredWrite->DeferredWriteLinks)
+        {
+            RemoveEntryList(ListEntry);
+            Found = TRUE;
+            break;
+        }
+    }
+    KeReleaseSpinLock(&CcDeferredWriteSpinLock, OldIrql);
+
+    return Found;
+}
+
+static
+VOID
+CcQueueDeferredWrite (
+    IN PDEFERRED_WRITE DeferredWrite,
+    IN BOOLEAN Retrying)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&CcDeferredWriteSpinLock, &OldIrql);
+    /* Writes that already waited once keep their place in the queue */
+    if (Retrying)
+        InsertHeadList(&CcDeferredWrites, &DeferredWrite->DeferredWriteLinks);
+    else
+        InsertTailList(&CcDeferredWrites, &DeferredWrite->DeferredWriteLinks);
+    KeReleaseSpinLock(&CcDeferredWriteSpinLock, OldIrql);
+
+    /* Get the lazy writer going */
+    KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+}
+
+VOID
+NTAPI
+CcPostDeferredWrites (
+    VOID)
+/*
+ * FUNCTION: Releases the deferred writes which fit in the dirty page limits
+ */
+{
+    PDEFERRED_WRITE DeferredWrite;
+    PLIST_ENTRY ListEntry;
+    ULONG PagesCharged = 0;
+    KIRQL OldIrql;
+
+    if (IsListEmpty(&CcDeferredWrites))
+        return;
+
+    for (;;)
+    {
+        DeferredWrite = NULL;
+
+        KeAcquireGuardedMutex(&ViewLock);
+        KeAcquireSpinLock(&CcDeferredWriteSpinLock, &OldIrql);
+        for (ListEntry = CcDeferredWrites.Flink;
+             ListEntry != &CcDeferredWrites;
+             ListEntry = ListEntry->Flink)
+        {
+            DeferredWrite = CONTAINING_RECORD(ListEntry, DEFERRED_WRITE, DeferredWriteLinks);
+            if (CcIsWriteWithinLimits(DeferredWrite->FileObject,
+                                      DeferredWrite->BytesToWrite,
+                                      PagesCharged))
+            {
+                RemoveEntryList(&DeferredWrite->DeferredWriteLinks);
+                break;
+            }
+            DeferredWrite = NULL;
+        }
+        KeReleaseSpinLock(&CcDeferredWriteSpinLock, OldIrql);
+        KeReleaseGuardedMutex(&ViewLock);
+
+        if (DeferredWrite == NULL)
+            break;
+
+        /* The released writes haven't dirtied anything yet, account for them
+           so that they don't all go at once */
+        PagesCharged += min(BYTES_TO_PAGES(DeferredWrite->BytesToWrite), WRITE_CHARGE_PAGES);
+
+        if (DeferredWrite->Event != NULL)
+        {
+            KeSetEvent(DeferredWrite->Event, IO_NO_INCREMENT, FALSE);
+        }
+        else
+        {
+            DeferredWrite->PostRoutine(DeferredWrite->Context1, DeferredWrite->Context2);
+            ObDereferenceObject(DeferredWrite->FileObject);
+            ExFreePoolWithTag(DeferredWrite, TAG_CC);
+        }
+    }
+}
+
 NTSTATUS
 NTAPI
 CcReadVirtualAddress (
@@ -214,40 +390,42 @@ CcCopyData (
     ULONG BytesCopied;
     KIRQL OldIrql;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PLIST_ENTRY ListEntry;
+    LONGLONG ViewOffset;
     PROS_VACB Vacb;
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
+    BOOLEAN Miss = FALSE;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     CurrentOffset = FileOffset;
     BytesCopied = 0;
 
+    if (Operation == CcOperationRead)
+    {
+        if (Wait)
+            ++CcCopyReadWait;
+        else
+            ++CcCopyReadNoWait;
+    }
+
     if (!Wait)
     {
         /* test if the requested data is available */
         KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
-        /* FIXME: this loop doesn't take into account areas that don't have
-         * a VACB in the list yet */
-        ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
-        while (ListEntry != &SharedCacheMap->CacheMapVacbListHead)
+        for (ViewOffset = ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY);
+             ViewOffset < CurrentOffset + Length;
+             ViewOffset += VACB_MAPPING_GRANULARITY)
         {
-            Vacb = CONTAINING_RECORD(ListEntry,
-                                     ROS_VACB,
-                                     CacheMapVacbListEntry);
-            ListEntry = ListEntry->Flink;
-            if (!Vacb->Valid &&
-                DoRangesIntersect(Vacb->FileOffset.QuadPart,
-                                  VACB_MAPPING_GRANULARITY,
-                                  CurrentOffset, Length))
+            Vacb = CcRosGetIndexedVacb(SharedCacheMap, ViewOffset);
+            if (Vacb == NULL || !Vacb->Valid)
             {
                 KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
                 /* data not available */
+                if (Operation == CcOperationRead)
+                    ++CcCopyReadNoWaitMiss;
                 return FALSE;
             }
-            if (Vacb->FileOffset.QuadPart >= CurrentOffset + Length)
-                break;
         }
         KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
     }
@@ -266,6 +444,7 @@ CcCopyData (
             ExRaiseStatus(Status);
         if (!Valid)
         {
+            Miss = TRUE;
             Status = CcReadVirtualAddress(Vacb);
             if (!NT_SUCCESS(Status))
             {
@@ -306,6 +485,7 @@ CcCopyData (
             (Operation == CcOperationRead ||
              PartialLength < VACB_MAPPING_GRANULARITY))
         {
+            Miss = TRUE;
             Status = CcReadVirtualAddress(Vacb);
             if (!NT_SUCCESS(Status))
             {
@@ -327,13 +507,21 @@ CcCopyData (
         if (Operation != CcOperationZero)
             Buffer = (PVOID)((ULONG_PTR)Buffer + PartialLength);
     }
+    if (Miss && Operation == CcOperationRead)
+    {
+        if (Wait)
+            ++CcCopyReadWaitMiss;
+        else
+            ++CcCopyReadNoWaitMiss;
+    }
+
     IoStatus->Status = STATUS_SUCCESS;
     IoStatus->Information = BytesCopied;
     return TRUE;
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 BOOLEAN
 NTAPI
@@ -343,9 +531,74 @@ CcCanIWrite (
     IN BOOLEAN Wait,
     IN BOOLEAN Retrying)
 {
+    DEFERRED_WRITE DeferredWrite;
+    LARGE_INTEGER Timeout;
+    KEVENT Event;
+    BOOLEAN CanWrite;
+    NTSTATUS Status;
+    ULONG Retries;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p BytesToWrite=%lu Wait=%d Retrying=%d\n",
         FileObject, BytesToWrite, Wait, Retrying);
 
+    /* Write through doesn't leave dirty pages behind */
+    if (BooleanFlagOn(FileObject->Flags, FO_WRITE_THROUGH))
+    {
+        return TRUE;
+    }
+
+    /* Don't overtake writes which are already waiting */
+    KeAcquireGuardedMutex(&ViewLock);
+    CanWrite = (Retrying || IsListEmpty(&CcDeferredWrites)) &&
+               CcIsWriteWithinLimits(FileObject, BytesToWrite, 0);
+    KeReleaseGuardedMutex(&ViewLock);
+
+    if (CanWrite)
+    {
+        return TRUE;
+    }
+
+    /* A retried write was already counted the first time round */
+    if (!Retrying)
+        ++CcThrottledWrites;
+
+    if (!Wait)
+    {
+        KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+        return FALSE;
+    }
+
+    /* Queue ourselves and wait for the lazy writer to make room */
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    DeferredWrite.FileObject = FileObject;
+    DeferredWrite.BytesToWrite = BytesToWrite;
+    DeferredWrite.Event = &Event;
+    DeferredWrite.PostRoutine = NULL;
+    CcQueueDeferredWrite(&DeferredWrite, Retrying);
+
+    Timeout.QuadPart = THROTTLE_RETRY_TIMEOUT;
+    for (Retries = 0; ; Retries++)
+    {
+        Status = KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, &Timeout);
+        if (Status != STATUS_TIMEOUT)
+            break;
+
+        /* The lazy writer can't get below the limits, better write now than never */
+        if (Retries >= THROTTLE_MAX_RETRIES)
+        {
+            DPRINT1("Giving up throttling a write of %lu bytes to %p\n", BytesToWrite, FileObject);
+
+            /* If we were released meanwhile, the event is about to be set and must be waited for */
+            if (!CcCancelDeferredWrite(&DeferredWrite))
+                KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+            break;
+        }
+
+        /* The lazy writer may have made progress without noticing us */
+        CcPostDeferredWrites();
+        KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+    }
+
     return TRUE;
 }
 
@@ -370,13 +623,20 @@ CcCopyRead (
            FileObject, FileOffset->QuadPart, Length, Wait,
            Buffer, IoStatus);
 
-    return CcCopyData(FileObject,
-                      FileOffset->QuadPart,
-                      Buffer,
-                      Length,
-                      CcOperationRead,
-                      Wait,
-                      IoStatus);
+    if (!CcCopyData(FileObject,
+                    FileOffset->QuadPart,
+                    Buffer,
+                    Length,
+                    CcOperationRead,
+                    Wait,
+                    IoStatus))
+    {
+        return FALSE;
+    }
+
+    /* Keep the data ahead of a sequential reader in the cache */
+    CcScheduleReadAhead(FileObject, FileOffset, Length);
+    return TRUE;
 }
 
 /*
@@ -410,7 +670,7 @@ CcCopyWrite (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -422,10 +682,30 @@ CcDeferWrite (
     IN ULONG BytesToWrite,
     IN BOOLEAN Retrying)
 {
+    PDEFERRED_WRITE DeferredWrite;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p PostRoutine=%p Context1=%p Context2=%p BytesToWrite=%lu Retrying=%d\n",
         FileObject, PostRoutine, Context1, Context2, BytesToWrite, Retrying);
 
-    PostRoutine(Context1, Context2);
+    DeferredWrite = ExAllocatePoolWithTag(NonPagedPool, sizeof(*DeferredWrite), TAG_CC);
+    if (DeferredWrite == NULL)
+    {
+        /* Better write now than never */
+        PostRoutine(Context1, Context2);
+        return;
+    }
+
+    ObReferenceObject(FileObject);
+    DeferredWrite->FileObject = FileObject;
+    DeferredWrite->BytesToWrite = BytesToWrite;
+    DeferredWrite->Event = NULL;
+    DeferredWrite->PostRoutine = PostRoutine;
+    DeferredWrite->Context1 = Context1;
+    DeferredWrite->Context2 = Context2;
+    CcQueueDeferredWrite(DeferredWrite, Retrying);
+
+    /* Things may have changed since the caller was refused */
+    CcPostDeferredWrites();
 }
 
 /*
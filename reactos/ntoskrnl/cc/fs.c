@@ -186,7 +186,7 @@ CcPurgeCacheSection (
                       SharedCacheMap->SectionSize.QuadPart);
         if (ViewEnd >= EndOffset)
         {
-            break;
+            continue;
         }
 
         ASSERT((Vacb->ReferenceCount == 0) ||
@@ -198,7 +198,9 @@ CcPurgeCacheSection (
         {
             RemoveEntryList(&Vacb->DirtyVacbListEntry);
             DirtyPageCount -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+            SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
         }
+        CcRosUnindexVacb(SharedCacheMap, Vacb);
         RemoveEntryList(&Vacb->CacheMapVacbListEntry);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
@@ -44,6 +44,8 @@
 static LIST_ENTRY DirtyVacbListHead;
 static LIST_ENTRY VacbLruListHead;
 ULONG DirtyPageCount = 0;
+ULONG CcLazyWriteIos = 0;
+ULONG CcLazyWritePages = 0;
 
 KGUARDED_MUTEX ViewLock;
 
@@ -54,7 +56,7 @@ static NPAGED_LOOKASIDE_LIST VacbLookasideList;
 #if DBG
 static void CcRosVacbIncRefCount_(PROS_VACB vacb, const char* file, int line)
 {
-    ++vacb->ReferenceCount;
+    InterlockedIncrement((PLONG)&vacb->ReferenceCount);
     if (vacb->SharedCacheMap->Trace)
     {
         DbgPrint("(%s:%i) VACB %p ++RefCount=%lu, Dirty %u, PageOut %lu\n",
@@ -63,7 +65,7 @@ static void CcRosVacbIncRefCount_(PROS_VACB vacb, const char* file, int line)
 }
 static void CcRosVacbDecRefCount_(PROS_VACB vacb, const char* file, int line)
 {
-    --vacb->ReferenceCount;
+    InterlockedDecrement((PLONG)&vacb->ReferenceCount);
     if (vacb->SharedCacheMap->Trace)
     {
         DbgPrint("(%s:%i) VACB %p --RefCount=%lu, Dirty %u, PageOut %lu\n",
@@ -73,16 +75,132 @@ static void CcRosVacbDecRefCount_(PROS_VACB vacb, const char* file, int line)
 #define CcRosVacbIncRefCount(vacb) CcRosVacbIncRefCount_(vacb,__FILE__,__LINE__)
 #define CcRosVacbDecRefCount(vacb) CcRosVacbDecRefCount_(vacb,__FILE__,__LINE__)
 #else
-#define CcRosVacbIncRefCount(vacb) (++((vacb)->ReferenceCount))
-#define CcRosVacbDecRefCount(vacb) (--((vacb)->ReferenceCount))
+#define CcRosVacbIncRefCount(vacb) InterlockedIncrement((PLONG)&(vacb)->ReferenceCount)
+#define CcRosVacbDecRefCount(vacb) InterlockedDecrement((PLONG)&(vacb)->ReferenceCount)
 #endif
 
 NTSTATUS
 CcRosInternalFreeVacb(PROS_VACB Vacb);
 
+/* Number of VACB pointers in one block of a shared cache map index */
+#define VACB_INDEX_BLOCK_SIZE   (PAGE_SIZE / sizeof(PROS_VACB))
+
 
 /* FUNCTIONS *****************************************************************/
 
+/* Called with the CacheMapLock held */
+PROS_VACB
+CcRosGetIndexedVacb (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG Slot = (ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY;
+    ULONGLONG Block = Slot / VACB_INDEX_BLOCK_SIZE;
+
+    if (Block >= SharedCacheMap->VacbIndexSize ||
+        SharedCacheMap->VacbIndex[Block] == NULL)
+    {
+        return NULL;
+    }
+
+    return SharedCacheMap->VacbIndex[Block][Slot % VACB_INDEX_BLOCK_SIZE];
+}
+
+/* Called with the CacheMapLock held */
+static
+NTSTATUS
+CcRosIndexVacb (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONGLONG Slot = (ULONGLONG)Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+    ULONGLONG Block = Slot / VACB_INDEX_BLOCK_SIZE;
+    ULONG NewSize;
+    PROS_VACB **NewIndex;
+
+    if (Block >= MAXULONG / sizeof(PROS_VACB *))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Grow the block table so that it covers the whole section */
+    if (Block >= SharedCacheMap->VacbIndexSize)
+    {
+        NewSize = (ULONG)max(Block + 1,
+                             (ULONGLONG)SharedCacheMap->SectionSize.QuadPart /
+                             VACB_MAPPING_GRANULARITY / VACB_INDEX_BLOCK_SIZE + 1);
+        NewIndex = ExAllocatePoolWithTag(NonPagedPool,
+                                         NewSize * sizeof(PROS_VACB *),
+                                         TAG_VACB);
+        if (NewIndex == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(NewIndex, NewSize * sizeof(PROS_VACB *));
+        if (SharedCacheMap->VacbIndex != NULL)
+        {
+            RtlCopyMemory(NewIndex,
+                          SharedCacheMap->VacbIndex,
+                          SharedCacheMap->VacbIndexSize * sizeof(PROS_VACB *));
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB);
+        }
+        SharedCacheMap->VacbIndex = NewIndex;
+        SharedCacheMap->VacbIndexSize = NewSize;
+    }
+
+    if (SharedCacheMap->VacbIndex[Block] == NULL)
+    {
+        SharedCacheMap->VacbIndex[Block] = ExAllocatePoolWithTag(NonPagedPool,
+                                                                 VACB_INDEX_BLOCK_SIZE * sizeof(PROS_VACB),
+                                                                 TAG_VACB);
+        if (SharedCacheMap->VacbIndex[Block] == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        RtlZeroMemory(SharedCacheMap->VacbIndex[Block],
+                      VACB_INDEX_BLOCK_SIZE * sizeof(PROS_VACB));
+    }
+
+    ASSERT(SharedCacheMap->VacbIndex[Block][Slot % VACB_INDEX_BLOCK_SIZE] == NULL);
+    SharedCacheMap->VacbIndex[Block][Slot % VACB_INDEX_BLOCK_SIZE] = Vacb;
+    return STATUS_SUCCESS;
+}
+
+/* Called with the CacheMapLock held */
+VOID
+CcRosUnindexVacb (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+{
+    ULONGLONG Slot = (ULONGLONG)Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+    ULONGLONG Block = Slot / VACB_INDEX_BLOCK_SIZE;
+
+    ASSERT(Block < SharedCacheMap->VacbIndexSize);
+    ASSERT(SharedCacheMap->VacbIndex[Block][Slot % VACB_INDEX_BLOCK_SIZE] == Vacb);
+    SharedCacheMap->VacbIndex[Block][Slot % VACB_INDEX_BLOCK_SIZE] = NULL;
+}
+
+static
+VOID
+CcRosFreeVacbIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+{
+    ULONG i;
+
+    if (SharedCacheMap->VacbIndex == NULL)
+        return;
+
+    for (i = 0; i < SharedCacheMap->VacbIndexSize; i++)
+    {
+        if (SharedCacheMap->VacbIndex[i] != NULL)
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex[i], TAG_VACB);
+    }
+    ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB);
+    SharedCacheMap->VacbIndex = NULL;
+    SharedCacheMap->VacbIndexSize = 0;
+}
+
 VOID
 NTAPI
 CcRosTraceCacheMap (
@@ -146,6 +264,7 @@ CcRosFlushVacb (
         Vacb->Dirty = FALSE;
         RemoveEntryList(&Vacb->DirtyVacbListEntry);
         DirtyPageCount -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        Vacb->SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
         CcRosVacbDecRefCount(Vacb);
 
         KeReleaseSpinLock(&Vacb->SharedCacheMap->CacheMapLock, oldIrql);
@@ -241,6 +360,8 @@ CcRosFlushDirtyPages (
         {
             (*Count) += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
             Target -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+            CcLazyWriteIos++;
+            CcLazyWritePages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
         }
 
         current_entry = DirtyVacbListHead.Flink;
@@ -249,6 +370,12 @@ CcRosFlushDirtyPages (
     KeReleaseGuardedMutex(&ViewLock);
     KeLeaveCriticalRegion();
 
+    /* Writers throttled on the dirty page limits may go now */
+    if (*Count != 0)
+    {
+        CcPostDeferredWrites();
+    }
+
     DPRINT("CcRosFlushDirtyPages() finished\n");
     return STATUS_SUCCESS;
 }
@@ -295,6 +422,14 @@ retry:
 
         KeAcquireSpinLock(&current->SharedCacheMap->CacheMapLock, &oldIrql);
 
+        /* Give recently used VACBs a second chance */
+        if (current->Accessed)
+        {
+            current->Accessed = FALSE;
+            KeReleaseSpinLock(&current->SharedCacheMap->CacheMapLock, oldIrql);
+            continue;
+        }
+
         /* Reference the VACB */
         CcRosVacbIncRefCount(current);
 
@@ -327,6 +462,7 @@ retry:
             ASSERT(!current->Dirty);
             ASSERT(!current->MappedCount);
 
+            CcRosUnindexVacb(current->SharedCacheMap, current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -392,18 +528,23 @@ CcRosReleaseVacb (
     DPRINT("CcRosReleaseVacb(SharedCacheMap 0x%p, Vacb 0x%p, Valid %u)\n",
            SharedCacheMap, Vacb, Valid);
 
-    KeAcquireGuardedMutex(&ViewLock);
+    /* The caller holds the VACB lock, so the dirty state can't change under
+       us. The global lock is only needed to put it on the dirty list. */
+    WasDirty = Vacb->Dirty;
+    if (!WasDirty && Dirty)
+    {
+        KeAcquireGuardedMutex(&ViewLock);
+    }
     KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
     Vacb->Valid = Valid;
-
-    WasDirty = Vacb->Dirty;
     Vacb->Dirty = Vacb->Dirty || Dirty;
 
     if (!WasDirty && Vacb->Dirty)
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
 
     if (Mapped)
@@ -421,7 +562,10 @@ CcRosReleaseVacb (
     }
 
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-    KeReleaseGuardedMutex(&ViewLock);
+    if (!WasDirty && Dirty)
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+    }
     CcRosReleaseVacbLock(Vacb);
 
     return STATUS_SUCCESS;
@@ -434,7 +578,6 @@ CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -443,34 +586,25 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    KeAcquireGuardedMutex(&ViewLock);
     KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosGetIndexedVacb(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-            KeReleaseGuardedMutex(&ViewLock);
-            CcRosAcquireVacbLock(current, NULL);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-    KeReleaseGuardedMutex(&ViewLock);
 
-    return NULL;
+    if (current != NULL)
+    {
+        CcRosAcquireVacbLock(current, NULL);
+    }
+
+    return current;
 }
 
 NTSTATUS
@@ -500,6 +634,7 @@ CcRosMarkDirtyVacb (
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
     else
     {
@@ -541,10 +676,13 @@ CcRosUnmapVacb (
         return STATUS_UNSUCCESSFUL;
     }
 
-    KeAcquireGuardedMutex(&ViewLock);
+    WasDirty = Vacb->Dirty;
+    if (!WasDirty && NowDirty)
+    {
+        KeAcquireGuardedMutex(&ViewLock);
+    }
     KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    WasDirty = Vacb->Dirty;
     Vacb->Dirty = Vacb->Dirty || NowDirty;
 
     Vacb->MappedCount--;
@@ -553,6 +691,7 @@ CcRosUnmapVacb (
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
 
     CcRosVacbDecRefCount(Vacb);
@@ -566,7 +705,10 @@ CcRosUnmapVacb (
     }
 
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-    KeReleaseGuardedMutex(&ViewLock);
+    if (!WasDirty && NowDirty)
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+    }
     CcRosReleaseVacbLock(Vacb);
 
     return STATUS_SUCCESS;
@@ -638,8 +780,6 @@ CcRosCreateVacb (
     PROS_VACB *Vacb)
 {
     PROS_VACB current;
-    PROS_VACB previous;
-    PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL oldIrql;
 
@@ -658,6 +798,7 @@ CcRosCreateVacb (
     current->Valid = FALSE;
     current->Dirty = FALSE;
     current->PageOut = FALSE;
+    current->Accessed = FALSE;
     current->FileOffset.QuadPart = ROUND_DOWN(FileOffset, VACB_MAPPING_GRANULARITY);
     current->SharedCacheMap = SharedCacheMap;
 #if DBG
@@ -682,55 +823,40 @@ CcRosCreateVacb (
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosGetIndexedVacb(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
-#endif
-            CcRosReleaseVacbLock(*Vacb);
-            KeReleaseGuardedMutex(&ViewLock);
-            ExFreeToNPagedLookasideList(&VacbLookasideList, *Vacb);
-            *Vacb = current;
-            CcRosAcquireVacbLock(current, NULL);
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
+        if (SharedCacheMap->Trace)
         {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
         }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+#endif
+        CcRosReleaseVacbLock(*Vacb);
+        KeReleaseGuardedMutex(&ViewLock);
+        ExFreeToNPagedLookasideList(&VacbLookasideList, *Vacb);
+        *Vacb = current;
+        CcRosAcquireVacbLock(current, NULL);
+        return STATUS_SUCCESS;
     }
     /* There was no existing VACB. */
     current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
+    Status = CcRosIndexVacb(SharedCacheMap, current);
+    if (!NT_SUCCESS(Status))
     {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
+        CcRosReleaseVacbLock(current);
+        KeReleaseGuardedMutex(&ViewLock);
+        ExFreeToNPagedLookasideList(&VacbLookasideList, current);
+        *Vacb = NULL;
+        return Status;
     }
+    InsertTailList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseGuardedMutex(&ViewLock);
@@ -757,8 +883,13 @@ CcRosCreateVacb (
     Status = CcRosMapVacb(current);
     if (!NT_SUCCESS(Status))
     {
+        KeAcquireGuardedMutex(&ViewLock);
+        KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
+        CcRosUnindexVacb(SharedCacheMap, current);
         RemoveEntryList(&current->CacheMapVacbListEntry);
         RemoveEntryList(&current->VacbLruListEntry);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
+        KeReleaseGuardedMutex(&ViewLock);
         CcRosReleaseVacbLock(current);
         ExFreeToNPagedLookasideList(&VacbLookasideList, current);
     }
@@ -799,13 +930,9 @@ CcRosGetVacb (
         }
     }
 
-    KeAcquireGuardedMutex(&ViewLock);
-
-    /* Move to the tail of the LRU list */
-    RemoveEntryList(&current->VacbLruListEntry);
-    InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
-
-    KeReleaseGuardedMutex(&ViewLock);
+    /* Let the trimmer know it was used recently, this saves taking the
+       global lock to reorder the LRU list on every access */
+    current->Accessed = TRUE;
 
     /*
      * Return information about the VACB to the caller.
@@ -954,11 +1081,9 @@ CcFlushCache (
 
                 CcRosReleaseVacbLock(current);
 
-                KeAcquireGuardedMutex(&ViewLock);
                 KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
                 CcRosVacbDecRefCount(current);
                 KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-                KeReleaseGuardedMutex(&ViewLock);
             }
 
             Offset.QuadPart += VACB_MAPPING_GRANULARITY;
@@ -1015,10 +1140,12 @@ CcRosDeleteFileCache (
             {
                 RemoveEntryList(&current->DirtyVacbListEntry);
                 DirtyPageCount -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+                SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
                 DPRINT1("Freeing dirty VACB\n");
             }
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
         }
+        CcRosFreeVacbIndex(SharedCacheMap);
 #if DBG
         SharedCacheMap->Trace = FALSE;
 #endif
@@ -1109,6 +1236,7 @@ CcRosReleaseFileCache (
         SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
         if (FileObject->PrivateCacheMap != NULL)
         {
+            ExFreePoolWithTag(FileObject->PrivateCacheMap, TAG_PRIVATE_CACHE_MAP);
             FileObject->PrivateCacheMap = NULL;
             if (SharedCacheMap->OpenCount > 0)
             {
@@ -1125,6 +1253,37 @@ CcRosReleaseFileCache (
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+CcRosCreatePrivateCacheMap (
+    PFILE_OBJECT FileObject,
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+/*
+ * FUNCTION: Attaches a private cache map to a file object, ViewLock must be held
+ */
+{
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+
+    PrivateCacheMap = ExAllocatePoolWithTag(NonPagedPool,
+                                            sizeof(*PrivateCacheMap),
+                                            TAG_PRIVATE_CACHE_MAP);
+    if (PrivateCacheMap == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(PrivateCacheMap, sizeof(*PrivateCacheMap));
+    PrivateCacheMap->FileObject = FileObject;
+    PrivateCacheMap->SharedCacheMap = SharedCacheMap;
+    PrivateCacheMap->ReadAheadMask = PAGE_SIZE - 1;
+    KeInitializeSpinLock(&PrivateCacheMap->ReadAheadSpinLock);
+
+    FileObject->PrivateCacheMap = PrivateCacheMap;
+    SharedCacheMap->OpenCount++;
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 NTAPI
 CcTryToInitializeFileCache (
@@ -1143,12 +1302,11 @@ CcTryToInitializeFileCache (
     }
     else
     {
+        Status = STATUS_SUCCESS;
         if (FileObject->PrivateCacheMap == NULL)
         {
-            FileObject->PrivateCacheMap = SharedCacheMap;
-            SharedCacheMap->OpenCount++;
+            Status = CcRosCreatePrivateCacheMap(FileObject, SharedCacheMap);
         }
-        Status = STATUS_SUCCESS;
     }
     KeReleaseGuardedMutex(&ViewLock);
 
@@ -1169,6 +1327,7 @@ CcRosInitializeFileCache (
  */
 {
     PROS_SHARED_CACHE_MAP SharedCacheMap;
+    NTSTATUS Status = STATUS_SUCCESS;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     DPRINT("CcRosInitializeFileCache(FileObject 0x%p, SharedCacheMap 0x%p)\n",
@@ -1200,12 +1359,11 @@ CcRosInitializeFileCache (
     }
     if (FileObject->PrivateCacheMap == NULL)
     {
-        FileObject->PrivateCacheMap = SharedCacheMap;
-        SharedCacheMap->OpenCount++;
+        Status = CcRosCreatePrivateCacheMap(FileObject, SharedCacheMap);
     }
     KeReleaseGuardedMutex(&ViewLock);
 
-    return STATUS_SUCCESS;
+    return Status;
 }
 
 /*
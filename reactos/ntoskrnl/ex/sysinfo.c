@@ -697,18 +697,34 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CcPinReadWait = 0; /* FIXME */
     Spi->CcPinReadNoWaitMiss = 0; /* FIXME */
     Spi->CcPinReadWaitMiss = 0; /* FIXME */
+#ifndef NEWCC
+    Spi->CcCopyReadNoWait = CcCopyReadNoWait;
+    Spi->CcCopyReadWait = CcCopyReadWait;
+    Spi->CcCopyReadNoWaitMiss = CcCopyReadNoWaitMiss;
+    Spi->CcCopyReadWaitMiss = CcCopyReadWaitMiss;
+#else
     Spi->CcCopyReadNoWait = 0; /* FIXME */
     Spi->CcCopyReadWait = 0; /* FIXME */
     Spi->CcCopyReadNoWaitMiss = 0; /* FIXME */
     Spi->CcCopyReadWaitMiss = 0; /* FIXME */
+#endif
 
     Spi->CcMdlReadNoWait = 0; /* FIXME */
     Spi->CcMdlReadWait = 0; /* FIXME */
     Spi->CcMdlReadNoWaitMiss = 0; /* FIXME */
     Spi->CcMdlReadWaitMiss = 0; /* FIXME */
+#ifndef NEWCC
+    Spi->CcReadAheadIos = CcReadAheadIos;
+#else
     Spi->CcReadAheadIos = 0; /* FIXME */
+#endif
+#ifndef NEWCC
+    Spi->CcLazyWriteIos = CcLazyWriteIos;
+    Spi->CcLazyWritePages = CcLazyWritePages;
+#else
     Spi->CcLazyWriteIos = 0; /* FIXME */
     Spi->CcLazyWritePages = 0; /* FIXME */
+#endif
     Spi->CcDataFlushes = 0; /* FIXME */
     Spi->CcDataPages = 0; /* FIXME */
     Spi->ContextSwitches = 0; /* FIXME */
@@ -716,6 +732,20 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->SecondLevelTbFills = 0; /* FIXME */
     Spi->SystemCalls = 0; /* FIXME */
 
+    /* Our own counters, for callers that know about them */
+    if (Size >= sizeof(SYSTEM_PERFORMANCE_INFORMATION_REACTOS))
+    {
+        PSYSTEM_PERFORMANCE_INFORMATION_REACTOS Spir
+            = (PSYSTEM_PERFORMANCE_INFORMATION_REACTOS) Buffer;
+
+#ifndef NEWCC
+        Spir->CcThrottledWrites = CcThrottledWrites;
+#else
+        Spir->CcThrottledWrites = 0; /* FIXME */
+#endif
+        *ReqSize = sizeof(SYSTEM_PERFORMANCE_INFORMATION_REACTOS);
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -40,6 +40,15 @@
 // Global Cc Data
 //
 extern ULONG CcRosTraceLevel;
+extern ULONG CcCopyReadWait;
+extern ULONG CcCopyReadNoWait;
+extern ULONG CcCopyReadWaitMiss;
+extern ULONG CcCopyReadNoWaitMiss;
+extern ULONG CcReadAheadIos;
+extern ULONG CcDirtyPageThreshold;
+extern ULONG CcThrottledWrites;
+extern ULONG CcLazyWriteIos;
+extern ULONG CcLazyWritePages;
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -150,15 +159,40 @@ typedef struct _ROS_SHARED_CACHE_MAP
     LARGE_INTEGER SectionSize;
     LARGE_INTEGER FileSize;
     BOOLEAN PinAccess;
+    BOOLEAN DisableReadAhead;
     PCACHE_MANAGER_CALLBACKS Callbacks;
     PVOID LazyWriteContext;
     KSPIN_LOCK CacheMapLock;
+    /* Dirty pages of this file, and the limit set by the file system (0 if none). */
+    ULONG DirtyPages;
+    ULONG DirtyPageThreshold;
+    /* VACBs indexed by file offset, in blocks of a page, protected by CacheMapLock. */
+    struct _ROS_VACB ***VacbIndex;
+    ULONG VacbIndexSize;
     ULONG OpenCount;
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
 } ROS_SHARED_CACHE_MAP, *PROS_SHARED_CACHE_MAP;
 
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    PFILE_OBJECT FileObject;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    /* Read ahead granularity minus one, as set by the file system. */
+    ULONG ReadAheadMask;
+    /* Is a read ahead queued or running for this file object? */
+    BOOLEAN ReadAheadActive;
+    /* The last two reads, used to detect sequential access. */
+    LARGE_INTEGER FileOffset1;
+    LARGE_INTEGER BeyondLastByte1;
+    LARGE_INTEGER FileOffset2;
+    LARGE_INTEGER BeyondLastByte2;
+    /* Offset up to which read ahead has already been scheduled. */
+    LARGE_INTEGER ReadAheadOffset;
+    KSPIN_LOCK ReadAheadSpinLock;
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
 typedef struct _ROS_VACB
 {
     /* Base address of the region where the view's data is mapped. */
@@ -171,6 +205,8 @@ typedef struct _ROS_VACB
     BOOLEAN Dirty;
     /* Page out in progress */
     BOOLEAN PageOut;
+    /* Was the view used since the last trim pass? */
+    BOOLEAN Accessed;
     ULONG MappedCount;
     /* Entry in the list of VACBs for this shared cache map. */
     LIST_ENTRY CacheMapVacbListEntry;
@@ -192,6 +228,18 @@ typedef struct _ROS_VACB
     /* Pointer to the next VACB in a chain. */
 } ROS_VACB, *PROS_VACB;
 
+typedef struct _DEFERRED_WRITE
+{
+    LIST_ENTRY DeferredWriteLinks;
+    PFILE_OBJECT FileObject;
+    ULONG BytesToWrite;
+    /* Either an event to signal (CcCanIWrite) or a routine to call (CcDeferWrite). */
+    PKEVENT Event;
+    PCC_POST_DEFERRED_WRITE PostRoutine;
+    PVOID Context1;
+    PVOID Context2;
+} DEFERRED_WRITE, *PDEFERRED_WRITE;
+
 typedef struct _INTERNAL_BCB
 {
     /* Lock */
@@ -270,10 +318,30 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+PROS_VACB
+CcRosGetIndexedVacb(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset
+);
+
+VOID
+CcRosUnindexVacb(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
 
+VOID
+NTAPI
+CcInitDeferredWrites(VOID);
+
+VOID
+NTAPI
+CcPostDeferredWrites(VOID);
+
 NTSTATUS
 NTAPI
 CcRosMarkDirtyVacb(
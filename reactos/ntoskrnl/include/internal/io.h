@@ -92,6 +92,18 @@
 #define IOP_USE_TOP_LEVEL_DEVICE_HINT       0x01
 #define IOP_CREATE_FILE_OBJECT_EXTENSION    0x02
 
+//
+// Vista information class for the completion notification modes, which the
+// I/O manager handles itself. Our headers only expose it to Vista targets.
+//
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation ((FILE_INFORMATION_CLASS)41)
+#endif
+#define IOP_VALID_COMPLETION_NOTIFICATION_MODES         \
+    (FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |             \
+     FILE_SKIP_SET_EVENT_ON_HANDLE |                    \
+     FILE_SKIP_SET_USER_EVENT_ON_FAST_IO)
+
 
 typedef struct _FILE_OBJECT_EXTENSION
 {
@@ -118,6 +130,14 @@ typedef struct _FILE_OBJECT_EXTENSION
         FALSE :                                         \
         FileObject->Flags & FO_SYNCHRONOUS_IO))         \
 
+//
+// Determines if a request that completed inline can skip the completion port
+//
+#define IopSkipCompletionPort(FileObject, Status, Pending)  \
+    (((FileObject)->Flags & FO_SKIP_COMPLETION_PORT) &&     \
+     !(Pending) &&                                          \
+     NT_SUCCESS(Status))
+
 //
 // Returns the internal Device Object Extension
 //
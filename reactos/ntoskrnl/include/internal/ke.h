@@ -638,6 +638,17 @@ KiInsertQueue(
     BOOLEAN Head
 );
 
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
 VOID
 NTAPI
 KiTimerExpiration(
@@ -13,6 +13,12 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Entries NtRemoveIoCompletionEx can take without allocating an array */
+#define IOP_REMOVE_COMPLETION_BATCH 16
+
+/* Most entries NtRemoveIoCompletionEx removes in one call */
+#define IOP_REMOVE_COMPLETION_MAX 1024
+
 POBJECT_TYPE IoCompletionType;
 
 GENERAL_LOOKASIDE IoCompletionPacketLookaside;
@@ -95,6 +101,51 @@ IopFreeMiniPacket(PIOP_MINI_COMPLETION_PACKET Packet)
     InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Packet);
 }
 
+/*
+ * Extracts the completion data of a dequeued IRP or mini packet and frees it
+ */
+static
+VOID
+IopRemoveCompletionEntry(IN PLIST_ENTRY ListEntry,
+                         OUT PFILE_IO_COMPLETION_INFORMATION Information)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        Information->KeyContext = Irp->Tail.CompletionKey;
+        Information->ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        Information->IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        Information->KeyContext = Packet->KeyContext;
+        Information->ApcContext = Packet->ApcContext;
+        Information->IoStatusBlock.Status = Packet->IoStatus;
+        Information->IoStatusBlock.Information = Packet->IoStatusInformation;
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 VOID
 NTAPI
 IopDeleteIoCompletion(PVOID ObjectBody)
@@ -449,13 +500,10 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
-    PVOID Apc, Key;
-    IO_STATUS_BLOCK IoStatus;
+    FILE_IO_COMPLETION_INFORMATION Information;
     PAGED_CODE();
 
     /* Check if the call was from user mode */
@@ -506,46 +554,16 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
-
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
-            {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
-            }
-            else
-            {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
-
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
-            }
+            /* Get the completion data and free the packet */
+            IopRemoveCompletionEntry(ListEntry, &Information);
 
             /* Enter SEH to write back the values */
             _SEH2_TRY
             {
                 /* Write the values to caller */
-                *ApcContext = Apc;
-                *KeyContext = Key;
-                *IoStatusBlock = IoStatus;
+                *ApcContext = Information.ApcContext;
+                *KeyContext = Information.KeyContext;
+                *IoStatusBlock = Information.IoStatusBlock;
             }
             _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
@@ -563,6 +581,138 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
     return Status;
 }
 
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY LocalEntries[IOP_REMOVE_COMPLETION_BATCH];
+    PLIST_ENTRY *EntryArray = LocalEntries;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    FILE_IO_COMPLETION_INFORMATION Information;
+    ULONG Removed, i;
+    PAGED_CODE();
+
+    /* We need room for at least one entry */
+    if (!Count) return STATUS_INVALID_PARAMETER;
+
+    /* Bound the probe and the entry array; larger batches just return less */
+    if (Count > IOP_REMOVE_COMPLETION_MAX) Count = IOP_REMOVE_COMPLETION_MAX;
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the output array and the count */
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(ULONG_PTR));
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
+            }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Large batches need an entry array the dispatcher can write to */
+    if (Count > IOP_REMOVE_COMPLETION_BATCH)
+    {
+        EntryArray = ExAllocatePoolWithTag(NonPagedPool,
+                                           Count * sizeof(PLIST_ENTRY),
+                                           TAG_IO);
+        if (!EntryArray)
+        {
+            /* Settle for a smaller batch rather than failing */
+            EntryArray = LocalEntries;
+            Count = IOP_REMOVE_COMPLETION_BATCH;
+        }
+    }
+
+    /* Remove as many entries as we can in one go */
+    Removed = KeRemoveQueueEx(Queue,
+                              PreviousMode,
+                              Alertable,
+                              Timeout,
+                              EntryArray,
+                              Count);
+
+    /* If we got a timeout, an alert or a user APC back, return the status */
+    if ((Removed == 1) &&
+        (((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_TIMEOUT) ||
+         ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_USER_APC) ||
+         ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_ALERTED)))
+    {
+        Status = (NTSTATUS)(ULONG_PTR)EntryArray[0];
+        Removed = 0;
+    }
+
+    /* Every packet must be freed, even if the caller's buffer went bad */
+    for (i = 0; i < Removed; i++)
+    {
+        /* Get the completion data and free the packet */
+        IopRemoveCompletionEntry(EntryArray[i], &Information);
+        if (!NT_SUCCESS(Status)) continue;
+
+        /* Enter SEH to write back the values */
+        _SEH2_TRY
+        {
+            IoCompletionInformation[i] = Information;
+        }
+        _SEH2_EXCEPT(ExSystemExceptionFilter())
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+    }
+
+    /* Tell the caller how many entries were returned */
+    _SEH2_TRY
+    {
+        *NumEntriesRemoved = Removed;
+    }
+    _SEH2_EXCEPT(ExSystemExceptionFilter())
+    {
+        /* Get the exception code */
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    /* Free the entry array if we allocated one */
+    if (EntryArray != LocalEntries) ExFreePoolWithTag(EntryArray, TAG_IO);
+
+    /* Dereference the Object and return status */
+    ObDereferenceObject(Queue);
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 NtSetIoCompletion(IN HANDLE IoCompletionPortHandle,
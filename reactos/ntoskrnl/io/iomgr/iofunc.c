@@ -421,10 +421,13 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it unless told not to for fast I/O */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    {
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    }
                     ObDereferenceObject(EventObject);
                 }
 
@@ -435,7 +438,8 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                 }
 
                 /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status, FALSE))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1017,6 +1021,89 @@ IopGetFileMode(IN PFILE_OBJECT FileObject)
     return Mode;
 }
 
+/*
+ * Stores the completion notification modes on the file object. Nothing
+ * needs the driver for this, so it never becomes an IRP.
+ */
+static
+NTSTATUS
+IopSetIoCompletionNotificationModes(IN HANDLE FileHandle,
+                                    OUT PIO_STATUS_BLOCK IoStatusBlock,
+                                    IN PVOID FileInformation,
+                                    IN ULONG Length,
+                                    IN KPROCESSOR_MODE PreviousMode)
+{
+    PFILE_OBJECT FileObject;
+    ULONG Modes, Flags = 0;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Validate the length */
+    if (Length < sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION))
+    {
+        /* Invalid length */
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Enter SEH for probing and capturing */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            /* Probe the I/O Status block and the information */
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+            ProbeForRead(FileInformation, Length, sizeof(ULONG));
+        }
+
+        /* Capture the requested modes */
+        Modes = ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Return the exception code */
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Reject modes we don't know about */
+    if (Modes & ~IOP_VALID_COMPLETION_NOTIFICATION_MODES)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Reference the Handle */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       0,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID *)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Convert the modes to file object flags */
+    if (Modes & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) Flags |= FO_SKIP_COMPLETION_PORT;
+    if (Modes & FILE_SKIP_SET_EVENT_ON_HANDLE) Flags |= FO_SKIP_SET_EVENT;
+    if (Modes & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO) Flags |= FO_SKIP_SET_FAST_IO;
+
+    /* Modes can only be turned on, and requests in flight may read the flags */
+    InterlockedOr((PLONG)&FileObject->Flags, Flags);
+    ObDereferenceObject(FileObject);
+
+    /* Fill out the I/O Status Block */
+    _SEH2_TRY
+    {
+        IoStatusBlock->Status = STATUS_SUCCESS;
+        IoStatusBlock->Information = 0;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore any error */
+    }
+    _SEH2_END;
+
+    return STATUS_SUCCESS;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -1709,15 +1796,19 @@ NtLockFile(IN HANDLE FileHandle,
             }
             _SEH2_END;
 
-            /* If we had an event, signal it */
+            /* If we had an event, signal it unless told not to for fast I/O */
             if (EventHandle)
             {
-                KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                {
+                    KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                }
                 ObDereferenceObject(Event);
             }
 
             /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                !IopSkipCompletionPort(FileObject, KernelIosb.Status, FALSE))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -2840,6 +2931,16 @@ NtSetInformationFile(IN HANDLE FileHandle,
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
+    /* The completion notification modes never reach the driver */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        return IopSetIoCompletionNotificationModes(FileHandle,
+                                                   IoStatusBlock,
+                                                   FileInformation,
+                                                   Length,
+                                                   PreviousMode);
+    }
+
     /* Check if we're called from user mode */
     if (PreviousMode != KernelMode)
     {
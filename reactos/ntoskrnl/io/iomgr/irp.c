@@ -330,8 +330,14 @@ IopCompleteRequest(IN PKAPC Apc,
         (Irp->PendingReturned &&
          !IsIrpSynchronous(Irp, FileObject)))
     {
-        /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        /*
+         * Get any information we need from the FO before we kill it, unless
+         * the caller asked not to be notified of inline successes.
+         */
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            !(IopSkipCompletionPort(FileObject,
+                                    Irp->IoStatus.Status,
+                                    Irp->PendingReturned)))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -397,8 +403,14 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /* Signal the file object, unless the handle isn't used for waits */
+            if (!(FileObject->Flags & FO_SKIP_SET_EVENT) ||
+                (FileObject->Flags & FO_SYNCHRONOUS_IO))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
+
+            /* Set the status */
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -138,6 +138,49 @@ KiInsertQueue(IN PKQUEUE Queue,
     return InitialState;
 }
 
+/*
+ * Removes up to Count entries from a non-empty queue.
+ * The dispatcher lock must be held.
+ */
+static
+ULONG
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     OUT PLIST_ENTRY *EntryArray,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG Removed = 0;
+
+    QueueEntry = Queue->EntryListHead.Flink;
+    do
+    {
+        /* Decrease the number of entries */
+        Queue->Header.SignalState--;
+
+        /* Check if the entry is valid. If not, bugcheck */
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove the Entry */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+        EntryArray[Removed++] = QueueEntry;
+
+        /* Move on to the next one */
+        QueueEntry = Queue->EntryListHead.Flink;
+    } while ((Removed < Count) && (QueueEntry != &Queue->EntryListHead));
+
+    return Removed;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -240,6 +283,25 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* A single non-alertable removal */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * @implemented
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
@@ -250,8 +312,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
     PLARGE_INTEGER OriginalDueTime = Timeout;
     LARGE_INTEGER DueTime = {{0}}, NewDueTime, InterruptTime;
     ULONG Hand = 0;
+    ULONG Removed = 0;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -306,27 +370,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
         if ((Queue->CurrentCount < Queue->MaximumCount) &&
             (QueueEntry != &Queue->EntryListHead))
         {
-            /* Decrease the number of entries */
-            Queue->Header.SignalState--;
-
             /* Increase numbef of running threads */
             Queue->CurrentCount++;
 
-            /* Check if the entry is valid. If not, bugcheck */
-            if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
-            {
-                /* Invalid item */
-                KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
-                             (ULONG_PTR)QueueEntry,
-                             (ULONG_PTR)Queue,
-                             (ULONG_PTR)NULL,
-                             (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
-                                         WorkerRoutine);
-            }
-
-            /* Remove the Entry */
-            RemoveEntryList(QueueEntry);
-            QueueEntry->Flink = NULL;
+            /* Take as many entries as the caller asked for */
+            Removed = KiRemoveQueueEntries(Queue, EntryArray, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +392,13 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if there's a User APC Pending or we were alerted */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    Removed = 1;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +411,8 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[0] = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        Removed = 1;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +454,33 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* Return the status or the entry we were handed */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    if ((Count == 1) ||
+                        (Status == STATUS_TIMEOUT) ||
+                        (Status == STATUS_USER_APC) ||
+                        (Status == STATUS_ALERTED))
+                    {
+                        return 1;
+                    }
+
+                    /*
+                     * We were woken up with an entry and were already counted
+                     * as running, so grab whatever else got queued meanwhile.
+                     */
+                    Thread->WaitIrql = KeRaiseIrqlToSynchLevel();
+                    KiAcquireDispatcherLockAtDpcLevel();
+                    Removed = 1;
+                    if (Queue->EntryListHead.Flink != &Queue->EntryListHead)
+                    {
+                        Removed += KiRemoveQueueEntries(Queue,
+                                                        &EntryArray[1],
+                                                        Count - 1);
+                    }
+                    break;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,7 +503,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromDpcLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return Removed;
 }
 
 /*
@@ -15,6 +15,12 @@
 #define MODULE_INVOLVED_IN_ARM3
 #include <mm/ARM3/miarm.h>
 
+/* Number of pages zeroed per PFN lock hold and zero-space mapping */
+#define MI_ZERO_PAGE_BATCH      (MI_ZERO_PTES - 1)
+
+/* Period of the idle timer that picks up pages below the event threshold */
+#define MI_ZERO_IDLE_PERIOD     1000
+
 /* GLOBALS ********************************************************************/
 
 BOOLEAN MmZeroingPageThreadActive;
@@ -32,6 +38,51 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
+VOID
+MiZeroPagesNonTemporal(IN PVOID Address,
+                       IN SIZE_T Size)
+{
+#if defined(_M_IX86) || defined(_M_AMD64)
+    PLONG Current, End;
+
+    /* MOVNTI is an SSE2 instruction */
+    if (!(KeFeatureBits & KF_XMMI64))
+    {
+        RtlZeroMemory(Address, Size);
+        return;
+    }
+
+    /*
+     * Nobody is going to touch these pages until they are handed out again,
+     * so write around the caches instead of evicting the working set of
+     * whatever is actually running.
+     */
+    Current = Address;
+    End = (PLONG)((ULONG_PTR)Address + Size);
+    while (Current < End)
+    {
+#ifdef _MSC_VER
+        _mm_stream_si32((int*)&Current[0], 0);
+        _mm_stream_si32((int*)&Current[1], 0);
+        _mm_stream_si32((int*)&Current[2], 0);
+        _mm_stream_si32((int*)&Current[3], 0);
+#else
+        __asm__ __volatile__("movnti %1, %0" : "=m"(Current[0]) : "r"(0));
+        __asm__ __volatile__("movnti %1, %0" : "=m"(Current[1]) : "r"(0));
+        __asm__ __volatile__("movnti %1, %0" : "=m"(Current[2]) : "r"(0));
+        __asm__ __volatile__("movnti %1, %0" : "=m"(Current[3]) : "r"(0));
+#endif
+        Current += 4;
+    }
+
+    /* Make the streaming stores globally visible before the pages are */
+    _mm_sfence();
+#else
+    RtlZeroMemory(Address, Size);
+#endif
+}
+
 VOID
 NTAPI
 MmZeroPageThread(VOID)
@@ -39,10 +90,12 @@ MmZeroPageThread(VOID)
     PKTHREAD Thread = KeGetCurrentThread();
     PVOID StartAddress, EndAddress;
     PVOID WaitObjects[2];
+    KTIMER IdleTimer;
+    LARGE_INTEGER DueTime;
     KIRQL OldIrql;
     PVOID ZeroAddress;
-    PFN_NUMBER PageIndex, FreePage;
-    PMMPFN Pfn1;
+    PFN_NUMBER PageIndex, FreePage, PageCount;
+    PMMPFN Pfn1, FirstPfn;
 
     /* Get the discardable sections to free them */
     MiFindInitializationCode(&StartAddress, &EndAddress);
@@ -53,13 +106,22 @@ MmZeroPageThread(VOID)
     Thread->BasePriority = 0;
     KeSetPriorityThread(Thread, 0);
 
+    /*
+     * The free list only signals us once enough pages have piled up, so use
+     * a periodic timer to pick up the rest. Since we run at priority 0, the
+     * timer only gets us scheduled when the system is otherwise idle.
+     */
+    KeInitializeTimerEx(&IdleTimer, SynchronizationTimer);
+    DueTime.QuadPart = Int32x32To64(MI_ZERO_IDLE_PERIOD, -10000);
+    KeSetTimerEx(&IdleTimer, DueTime, MI_ZERO_IDLE_PERIOD, NULL);
+
     /* Setup the wait objects */
     WaitObjects[0] = &MmZeroingPageEvent;
-//    WaitObjects[1] = &PoSystemIdleTimer; FIXME: Implement idle timer
+    WaitObjects[1] = &IdleTimer;
 
     while (TRUE)
     {
-        KeWaitForMultipleObjects(1, // 2
+        KeWaitForMultipleObjects(2,
                                  WaitObjects,
                                  WaitAny,
                                  WrFreePage,
@@ -79,34 +141,50 @@ MmZeroPageThread(VOID)
                 break;
             }
 
-            PageIndex = MmFreePageListHead.Flink;
-            ASSERT(PageIndex != LIST_HEAD);
-            Pfn1 = MiGetPfnEntry(PageIndex);
-            MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-            MI_SET_PROCESS2("Kernel 0 Loop");
-            FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
-
-            /* The first global free page should also be the first on its own list */
-            if (FreePage != PageIndex)
+            /* Pull a batch of free pages, chaining them for the zero-space mapping */
+            FirstPfn = (PMMPFN)LIST_HEAD;
+            PageCount = 0;
+            do
             {
-                KeBugCheckEx(PFN_LIST_CORRUPT,
-                             0x8F,
-                             FreePage,
-                             PageIndex,
-                             0);
-            }
+                PageIndex = MmFreePageListHead.Flink;
+                ASSERT(PageIndex != LIST_HEAD);
+                Pfn1 = MiGetPfnEntry(PageIndex);
+                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+                MI_SET_PROCESS2("Kernel 0 Loop");
+                FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+
+                /* The first global free page should also be the first on its own list */
+                if (FreePage != PageIndex)
+                {
+                    KeBugCheckEx(PFN_LIST_CORRUPT,
+                                 0x8F,
+                                 FreePage,
+                                 PageIndex,
+                                 0);
+                }
+
+                Pfn1->u1.Flink = (ULONG_PTR)FirstPfn;
+                FirstPfn = Pfn1;
+                PageCount++;
+            } while ((PageCount < MI_ZERO_PAGE_BATCH) && (MmFreePageListHead.Total));
 
-            Pfn1->u1.Flink = LIST_HEAD;
             KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, 1);
+            /* Zero the whole batch through a single mapping */
+            ZeroAddress = MiMapPagesInZeroSpace(FirstPfn, PageCount);
             ASSERT(ZeroAddress);
-            RtlZeroMemory(ZeroAddress, PAGE_SIZE);
-            MiUnmapPagesInZeroSpace(ZeroAddress, 1);
+            MiZeroPagesNonTemporal(ZeroAddress, PageCount << PAGE_SHIFT);
+            MiUnmapPagesInZeroSpace(ZeroAddress, PageCount);
 
             OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
 
-            MiInsertPageInList(&MmZeroedPageListHead, PageIndex);
+            /* And hand all of it over to the zeroed list */
+            while (FirstPfn != (PMMPFN)LIST_HEAD)
+            {
+                Pfn1 = FirstPfn;
+                FirstPfn = (PMMPFN)Pfn1->u1.Flink;
+                MiInsertPageInList(&MmZeroedPageListHead, MiGetPfnEntryIndex(Pfn1));
+            }
         }
     }
 }
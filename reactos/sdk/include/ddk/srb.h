@@ -246,6 +246,9 @@ typedef struct _PORT_CONFIGURATION_INFORMATION {
   BOOLEAN ResetTargetSupported;
   UCHAR MaximumNumberOfLogicalUnits;
   BOOLEAN WmiDataProvider;
+#ifdef __STORPORT_H
+  UCHAR SynchronizationModel;
+#endif
 } PORT_CONFIGURATION_INFORMATION, *PPORT_CONFIGURATION_INFORMATION;
 
 #define CONFIG_INFO_VERSION_2 sizeof(PORT_CONFIGURATION_INFORMATION)
@@ -485,6 +488,15 @@ SCSI_ADAPTER_CONTROL_STATUS
   _In_ SCSI_ADAPTER_CONTROL_TYPE ControlType,
   _In_ PVOID Parameters);
 
+#ifdef __STORPORT_H
+typedef
+_Must_inspect_result_
+BOOLEAN
+(NTAPI *PHW_BUILDIO)(
+  _In_ PVOID DeviceExtension,
+  _In_ PSCSI_REQUEST_BLOCK Srb);
+#endif
+
 typedef enum _SCSI_NOTIFICATION_TYPE {
   RequestComplete,
   NextRequest,
@@ -533,6 +545,9 @@ typedef struct _HW_INITIALIZATION_DATA {
   USHORT DeviceIdLength;
   PVOID DeviceId;
   PHW_ADAPTER_CONTROL HwAdapterControl;
+#ifdef __STORPORT_H
+  PHW_BUILDIO HwBuildIo;
+#endif
 } HW_INITIALIZATION_DATA, *PHW_INITIALIZATION_DATA;
 
 #if defined(_NTDDK_)
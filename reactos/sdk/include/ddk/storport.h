@@ -49,28 +49,55 @@ typedef struct _STOR_SCATTER_GATHER_LIST {
   STOR_SCATTER_GATHER_ELEMENT List[0];
 } STOR_SCATTER_GATHER_LIST, *PSTOR_SCATTER_GATHER_LIST;
 
-typedef struct _SCSI_WMI_REQUEST_BLOCK {
-  USHORT Length;
-  UCHAR Function;
-  UCHAR SrbStatus;
-  UCHAR WMISubFunction;
-  UCHAR PathId;
-  UCHAR TargetId;
-  UCHAR Lun;
-  UCHAR Reserved1;
-  UCHAR WMIFlags;
-  UCHAR Reserved2[2];
-  ULONG SrbFlags;
-  ULONG DataTransferLength;
-  ULONG TimeOutValue;
-  PVOID DataBuffer;
-  PVOID DataPath;
-  PVOID Reserved3;
-  PVOID OriginalRequest;
-  PVOID SrbExtension;
-  ULONG Reserved4;
-  UCHAR Reserved5[16];
-} SCSI_WMI_REQUEST_BLOCK, *PSCSI_WMI_REQUEST_BLOCK;
+#define STOR_MAP_NO_BUFFERS             0
+#define STOR_MAP_ALL_BUFFERS            1
+#define STOR_MAP_NON_READ_WRITE_BUFFERS 2
+
+typedef enum _STOR_SYNCHRONIZATION_MODEL {
+  StorSynchronizeHalfDuplex,
+  StorSynchronizeFullDuplex
+} STOR_SYNCHRONIZATION_MODEL;
+
+/* Storport-specific notifications, see the inline helpers below */
+typedef enum _STORPORT_NOTIFICATION_TYPE {
+  EnablePassiveInitialization = 0x1000,
+  InitializeDpc,
+  IssueDpc,
+  AcquireSpinLock,
+  ReleaseSpinLock
+} STORPORT_NOTIFICATION_TYPE;
+
+typedef enum _STOR_SPINLOCK {
+  DpcLock = 1,
+  StartIoLock,
+  InterruptLock
+} STOR_SPINLOCK;
+
+typedef struct _STOR_LOCK_HANDLE {
+  STOR_SPINLOCK Lock;
+  struct {
+    KLOCK_QUEUE_HANDLE LockHandle;
+    KIRQL OldIrql;
+  } Context;
+} STOR_LOCK_HANDLE, *PSTOR_LOCK_HANDLE;
+
+typedef struct _STOR_DPC {
+  KDPC Dpc;
+  KSPIN_LOCK Lock;
+} STOR_DPC, *PSTOR_DPC;
+
+typedef VOID
+(NTAPI *PHW_DPC_ROUTINE)(
+  _In_ PSTOR_DPC Dpc,
+  _In_ PVOID HwDeviceExtension,
+  _In_ PVOID SystemArgument1,
+  _In_ PVOID SystemArgument2);
+
+typedef
+_Must_inspect_result_
+BOOLEAN
+(NTAPI *PHW_PASSIVE_INITIALIZE_ROUTINE)(
+  _In_ PVOID DeviceExtension);
 
 STORPORTAPI
 ULONG
@@ -209,6 +236,14 @@ NTAPI
 StorPortStallExecution(
   _In_ ULONG Delay);
 
+STORPORTAPI
+VOID
+NTAPI
+StorPortCopyMemory(
+  _Out_writes_bytes_(Length) PVOID Destination,
+  _In_reads_bytes_(Length) PVOID Source,
+  _In_ ULONG Length);
+
 STORPORTAPI
 STOR_PHYSICAL_ADDRESS
 NTAPI
@@ -401,6 +436,16 @@ StorPortGetScatterGatherList(
   _In_ PVOID DeviceExtension,
   _In_ PSCSI_REQUEST_BLOCK Srb);
 
+STORPORTAPI
+BOOLEAN
+NTAPI
+StorPortSetDeviceQueueDepth(
+  _In_ PVOID HwDeviceExtension,
+  _In_ UCHAR PathId,
+  _In_ UCHAR TargetId,
+  _In_ UCHAR Lun,
+  _In_ ULONG Depth);
+
 typedef BOOLEAN
 (NTAPI STOR_SYNCHRONIZED_ACCESS)(
   _In_ PVOID HwDeviceExtension,
@@ -415,6 +460,77 @@ StorPortSynchronizeAccess(
   _In_ PSTOR_SYNCHRONIZED_ACCESS SynchronizedAccessRoutine,
   _In_opt_ PVOID Context);
 
+FORCEINLINE
+BOOLEAN
+StorPortEnablePassiveInitialization(
+  _In_ PVOID HwDeviceExtension,
+  _In_ PHW_PASSIVE_INITIALIZE_ROUTINE HwPassiveInitializeRoutine)
+{
+  LONG Succ = FALSE;
+  StorPortNotification((SCSI_NOTIFICATION_TYPE)EnablePassiveInitialization,
+                       HwDeviceExtension,
+                       HwPassiveInitializeRoutine,
+                       &Succ);
+  return (BOOLEAN)Succ;
+}
+
+FORCEINLINE
+VOID
+StorPortInitializeDpc(
+  _In_ PVOID HwDeviceExtension,
+  _Out_ PSTOR_DPC Dpc,
+  _In_ PHW_DPC_ROUTINE HwDpcRoutine)
+{
+  StorPortNotification((SCSI_NOTIFICATION_TYPE)InitializeDpc,
+                       HwDeviceExtension,
+                       Dpc,
+                       HwDpcRoutine);
+}
+
+FORCEINLINE
+BOOLEAN
+StorPortIssueDpc(
+  _In_ PVOID HwDeviceExtension,
+  _In_ PSTOR_DPC Dpc,
+  _In_ PVOID SystemArgument1,
+  _In_ PVOID SystemArgument2)
+{
+  LONG Succ = FALSE;
+  StorPortNotification((SCSI_NOTIFICATION_TYPE)IssueDpc,
+                       HwDeviceExtension,
+                       Dpc,
+                       SystemArgument1,
+                       SystemArgument2,
+                       &Succ);
+  return (BOOLEAN)Succ;
+}
+
+FORCEINLINE
+VOID
+StorPortAcquireSpinLock(
+  _In_ PVOID HwDeviceExtension,
+  _In_ STOR_SPINLOCK SpinLock,
+  _In_opt_ PVOID LockContext,
+  _Out_ PSTOR_LOCK_HANDLE LockHandle)
+{
+  StorPortNotification((SCSI_NOTIFICATION_TYPE)AcquireSpinLock,
+                       HwDeviceExtension,
+                       SpinLock,
+                       LockContext,
+                       LockHandle);
+}
+
+FORCEINLINE
+VOID
+StorPortReleaseSpinLock(
+  _In_ PVOID HwDeviceExtension,
+  _Inout_ PSTOR_LOCK_HANDLE LockHandle)
+{
+  StorPortNotification((SCSI_NOTIFICATION_TYPE)ReleaseSpinLock,
+                       HwDeviceExtension,
+                       LockHandle);
+}
+
 #if DBG
 #define DebugPrint(x) StorPortDebugPrint x
 #else
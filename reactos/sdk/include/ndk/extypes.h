@@ -839,6 +839,18 @@ typedef struct _SYSTEM_PERFORMANCE_INFORMATION
     ULONG SystemCalls;
 } SYSTEM_PERFORMANCE_INFORMATION, *PSYSTEM_PERFORMANCE_INFORMATION;
 
+#ifdef __REACTOS__
+//
+// ReactOS-specific counters, returned after the standard ones
+// when the buffer has room for them
+//
+typedef struct _SYSTEM_PERFORMANCE_INFORMATION_REACTOS
+{
+    SYSTEM_PERFORMANCE_INFORMATION Standard;
+    ULONG CcThrottledWrites;
+} SYSTEM_PERFORMANCE_INFORMATION_REACTOS, *PSYSTEM_PERFORMANCE_INFORMATION_REACTOS;
+#endif
+
 // Class 3
 typedef struct _SYSTEM_TIMEOFDAY_INFORMATION
 {
@@ -203,6 +203,10 @@ extern "C" {
 #define COPY_FILE_FAIL_IF_EXISTS 0x00000001
 #define COPY_FILE_RESTARTABLE 0x00000002
 #define COPY_FILE_OPEN_SOURCE_FOR_WRITE 0x00000004
+#if (_WIN32_WINNT >= 0x0600)
+#define COPY_FILE_COPY_SYMLINK 0x00000800
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
 #define FILE_FLAG_WRITE_THROUGH	0x80000000
 #define FILE_FLAG_OVERLAPPED	1073741824
 #define FILE_FLAG_NO_BUFFERING	536870912
@@ -778,6 +782,15 @@ typedef struct _OVERLAPPED {
 	HANDLE hEvent;
 } OVERLAPPED, *POVERLAPPED, *LPOVERLAPPED;
 
+#if (_WIN32_WINNT >= 0x0600)
+typedef struct _OVERLAPPED_ENTRY {
+	ULONG_PTR lpCompletionKey;
+	LPOVERLAPPED lpOverlapped;
+	ULONG_PTR Internal;
+	DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+#endif
+
 typedef struct _STARTUPINFOA {
 	DWORD	cb;
 	LPSTR	lpReserved;
@@ -2284,6 +2297,9 @@ GetProfileStringW(
   _In_ DWORD nSize);
 
 BOOL WINAPI GetQueuedCompletionStatus(HANDLE,PDWORD,PULONG_PTR,LPOVERLAPPED*,DWORD);
+#if (_WIN32_WINNT >= 0x0600)
+BOOL WINAPI GetQueuedCompletionStatusEx(HANDLE,LPOVERLAPPED_ENTRY,ULONG,PULONG,DWORD,BOOL);
+#endif
 BOOL WINAPI GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR,PSECURITY_DESCRIPTOR_CONTROL,PDWORD);
 BOOL WINAPI GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR,LPBOOL,PACL*,LPBOOL);
 BOOL WINAPI GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR,PSID*,LPBOOL);
@@ -3822,6 +3838,145 @@ CopyFile2(
 
 #endif /* _WIN32_WINNT >= 0x0601 */
 
+#if (_WIN32_WINNT >= 0x0600)
+
+WINBASEAPI PTP_POOL WINAPI CreateThreadpool(_Reserved_ PVOID reserved);
+WINBASEAPI VOID WINAPI CloseThreadpool(_Inout_ PTP_POOL ptpp);
+WINBASEAPI VOID WINAPI SetThreadpoolThreadMaximum(_Inout_ PTP_POOL ptpp, _In_ DWORD cthrdMost);
+WINBASEAPI BOOL WINAPI SetThreadpoolThreadMinimum(_Inout_ PTP_POOL ptpp, _In_ DWORD cthrdMic);
+
+WINBASEAPI PTP_CLEANUP_GROUP WINAPI CreateThreadpoolCleanupGroup(VOID);
+WINBASEAPI VOID WINAPI CloseThreadpoolCleanupGroup(_Inout_ PTP_CLEANUP_GROUP ptpcg);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(
+  _Inout_ PTP_CLEANUP_GROUP ptpcg,
+  _In_ BOOL fCancelPendingCallbacks,
+  _Inout_opt_ PVOID pvCleanupContext);
+
+WINBASEAPI
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(
+  _In_ PTP_WORK_CALLBACK pfnwk,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI VOID WINAPI SubmitThreadpoolWork(_Inout_ PTP_WORK pwk);
+WINBASEAPI VOID WINAPI CloseThreadpoolWork(_Inout_ PTP_WORK pwk);
+WINBASEAPI VOID WINAPI WaitForThreadpoolWorkCallbacks(_Inout_ PTP_WORK pwk, _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(
+  _In_ PTP_SIMPLE_CALLBACK pfns,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(
+  _In_ PTP_TIMER_CALLBACK pfnti,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolTimer(
+  _Inout_ PTP_TIMER pti,
+  _In_opt_ PFILETIME pftDueTime,
+  _In_ DWORD msPeriod,
+  _In_opt_ DWORD msWindowLength);
+
+WINBASEAPI BOOL WINAPI IsThreadpoolTimerSet(_Inout_ PTP_TIMER pti);
+WINBASEAPI VOID WINAPI CloseThreadpoolTimer(_Inout_ PTP_TIMER pti);
+WINBASEAPI VOID WINAPI WaitForThreadpoolTimerCallbacks(_Inout_ PTP_TIMER pti, _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(
+  _In_ PTP_WAIT_CALLBACK pfnwa,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolWait(
+  _Inout_ PTP_WAIT pwa,
+  _In_opt_ HANDLE h,
+  _In_opt_ PFILETIME pftTimeout);
+
+WINBASEAPI VOID WINAPI CloseThreadpoolWait(_Inout_ PTP_WAIT pwa);
+WINBASEAPI VOID WINAPI WaitForThreadpoolWaitCallbacks(_Inout_ PTP_WAIT pwa, _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI BOOL WINAPI CallbackMayRunLong(_Inout_ PTP_CALLBACK_INSTANCE pci);
+WINBASEAPI VOID WINAPI DisassociateCurrentThreadFromCallback(_Inout_ PTP_CALLBACK_INSTANCE pci);
+WINBASEAPI VOID WINAPI SetEventWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE pci, _In_ HANDLE evt);
+WINBASEAPI VOID WINAPI ReleaseSemaphoreWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE pci, _In_ HANDLE sem, _In_ DWORD crel);
+WINBASEAPI VOID WINAPI ReleaseMutexWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE pci, _In_ HANDLE mut);
+WINBASEAPI VOID WINAPI LeaveCriticalSectionWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE pci, _Inout_ PCRITICAL_SECTION pcs);
+
+FORCEINLINE
+VOID
+InitializeThreadpoolEnvironment(
+  _Out_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpInitializeCallbackEnviron(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPool(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_POOL ptpp)
+{
+  TpSetCallbackThreadpool(pcbe, ptpp);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_CLEANUP_GROUP ptpcg,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK pfng)
+{
+  TpSetCallbackCleanupGroup(pcbe, ptpcg, pfng);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackRunsLong(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackLongFunction(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackLibrary(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PVOID mod)
+{
+  TpSetCallbackRaceWithDll(pcbe, mod);
+}
+
+FORCEINLINE
+VOID
+DestroyThreadpoolEnvironment(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpDestroyCallbackEnviron(pcbe);
+}
+
+#endif /* _WIN32_WINNT >= 0x0600 */
+
 WINBASEAPI
 BOOL
 WINAPI
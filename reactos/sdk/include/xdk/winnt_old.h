@@ -4215,6 +4215,93 @@ typedef struct _TP_CALLBACK_ENVIRON_V1 {
 } TP_CALLBACK_ENVIRON_V1, TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
 #endif /* (_WIN32_WINNT >= _WIN32_WINNT_WIN7) */
 
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+
+typedef VOID
+(NTAPI *PTP_TIMER_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_TIMER Timer);
+
+typedef DWORD TP_WAIT_RESULT;
+
+typedef struct _TP_WAIT TP_WAIT, *PTP_WAIT;
+
+typedef VOID
+(NTAPI *PTP_WAIT_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_WAIT Wait,
+  _In_ TP_WAIT_RESULT WaitResult);
+
+FORCEINLINE
+VOID
+TpInitializeCallbackEnviron(
+  _Out_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
+  CallbackEnviron->Version = 3;
+#else
+  CallbackEnviron->Version = 1;
+#endif
+  CallbackEnviron->Pool = NULL;
+  CallbackEnviron->CleanupGroup = NULL;
+  CallbackEnviron->CleanupGroupCancelCallback = NULL;
+  CallbackEnviron->RaceDll = NULL;
+  CallbackEnviron->ActivationContext = NULL;
+  CallbackEnviron->FinalizationCallback = NULL;
+  CallbackEnviron->u.Flags = 0;
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
+  CallbackEnviron->CallbackPriority = TP_CALLBACK_PRIORITY_NORMAL;
+  CallbackEnviron->Size = sizeof(TP_CALLBACK_ENVIRON);
+#endif
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackThreadpool(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PTP_POOL Pool)
+{
+  CallbackEnviron->Pool = Pool;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PTP_CLEANUP_GROUP CleanupGroup,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback)
+{
+  CallbackEnviron->CleanupGroup = CleanupGroup;
+  CallbackEnviron->CleanupGroupCancelCallback = CleanupGroupCancelCallback;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackLongFunction(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  CallbackEnviron->u.s.LongFunction = 1;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackRaceWithDll(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PVOID DllHandle)
+{
+  CallbackEnviron->RaceDll = DllHandle;
+}
+
+FORCEINLINE
+VOID
+TpDestroyCallbackEnviron(
+  _In_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  UNREFERENCED_PARAMETER(CallbackEnviron);
+}
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -320,6 +320,11 @@ typedef struct _HHIVE
     ULONG StorageTypeCount;
     ULONG Version;
     DUAL Storage[HTYPE_COUNT];
+
+    /* ReactOS-specific: blocks flushed to the hive and log files, and the
+     * number of FileWrite calls it took, since the hive was initialized */
+    ULONG FlushBlocks;
+    ULONG FlushWrites;
 } HHIVE, *PHHIVE;
 
 #define IsFreeCell(Cell)    ((Cell)->Size >= 0)
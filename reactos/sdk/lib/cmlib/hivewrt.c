@@ -9,6 +9,137 @@
 #define NDEBUG
 #include <debug.h>
 
+/*
+ * Largest write built in the staging buffer. Blocks of the same bin are
+ * contiguous in memory and are written straight from the hive whatever
+ * their number, the buffer is only used to join blocks of different bins.
+ */
+#define HV_WRITE_BUFFER_BLOCKS  64
+
+typedef struct _HV_WRITE_CONTEXT
+{
+    PHHIVE RegistryHive;
+    ULONG FileType;
+    PUCHAR Buffer;          /* Staging buffer, NULL if it could not be allocated */
+    ULONG FileOffset;       /* Where the pending blocks go */
+    PUCHAR Data;            /* The pending blocks, in the hive or in the buffer */
+    ULONG Count;
+    ULONG Blocks;           /* Statistics */
+    ULONG Writes;
+} HV_WRITE_CONTEXT, *PHV_WRITE_CONTEXT;
+
+static VOID CMAPI
+HvpInitWriteContext(
+    PHV_WRITE_CONTEXT Context,
+    PHHIVE RegistryHive,
+    ULONG FileType)
+{
+    Context->RegistryHive = RegistryHive;
+    Context->FileType = FileType;
+    Context->Buffer = RegistryHive->Allocate(HV_WRITE_BUFFER_BLOCKS * HBLOCK_SIZE, TRUE, TAG_CM);
+    Context->FileOffset = 0;
+    Context->Data = NULL;
+    Context->Count = 0;
+    Context->Blocks = 0;
+    Context->Writes = 0;
+}
+
+static BOOLEAN CMAPI
+HvpFlushBlocks(
+    PHV_WRITE_CONTEXT Context)
+{
+    ULONG FileOffset;
+
+    if (Context->Count == 0)
+    {
+        return TRUE;
+    }
+
+    FileOffset = Context->FileOffset;
+    if (!Context->RegistryHive->FileWrite(Context->RegistryHive, Context->FileType,
+                                          &FileOffset, Context->Data,
+                                          Context->Count * HBLOCK_SIZE))
+    {
+        return FALSE;
+    }
+
+    Context->Blocks += Context->Count;
+    Context->Writes++;
+    Context->Count = 0;
+
+    return TRUE;
+}
+
+/* Queues a block for writing, adjacent blocks go out in a single write */
+static BOOLEAN CMAPI
+HvpWriteBlock(
+    PHV_WRITE_CONTEXT Context,
+    ULONG FileOffset,
+    PVOID BlockPtr)
+{
+    if (Context->Count != 0 &&
+        FileOffset == Context->FileOffset + Context->Count * HBLOCK_SIZE)
+    {
+        /* Still in the same bin */
+        if (Context->Data != Context->Buffer &&
+            (PUCHAR)BlockPtr == Context->Data + Context->Count * HBLOCK_SIZE)
+        {
+            Context->Count++;
+            return TRUE;
+        }
+
+        /* Join it with the previous blocks in the staging buffer */
+        if (Context->Buffer != NULL && Context->Count < HV_WRITE_BUFFER_BLOCKS)
+        {
+            if (Context->Data != Context->Buffer)
+            {
+                RtlCopyMemory(Context->Buffer, Context->Data, Context->Count * HBLOCK_SIZE);
+                Context->Data = Context->Buffer;
+            }
+
+            RtlCopyMemory(Context->Buffer + Context->Count * HBLOCK_SIZE, BlockPtr, HBLOCK_SIZE);
+            Context->Count++;
+            return TRUE;
+        }
+    }
+
+    if (!HvpFlushBlocks(Context))
+    {
+        return FALSE;
+    }
+
+    Context->FileOffset = FileOffset;
+    Context->Data = BlockPtr;
+    Context->Count = 1;
+
+    return TRUE;
+}
+
+static BOOLEAN CMAPI
+HvpEndWrite(
+    PHV_WRITE_CONTEXT Context)
+{
+    BOOLEAN Success;
+
+    Success = HvpFlushBlocks(Context);
+
+    /* Keep the statistics where the hive owner can read them */
+    Context->RegistryHive->FlushBlocks += Context->Blocks;
+    Context->RegistryHive->FlushWrites += Context->Writes;
+
+    DPRINT("%lu blocks in %lu writes, %lu bytes per write\n",
+           Context->Blocks, Context->Writes,
+           Context->Writes ? Context->Blocks * HBLOCK_SIZE / Context->Writes : 0);
+
+    if (Context->Buffer != NULL)
+    {
+        Context->RegistryHive->Free(Context->Buffer, 0);
+        Context->Buffer = NULL;
+    }
+
+    return Success;
+}
+
 static BOOLEAN CMAPI
 HvpWriteLog(
     PHHIVE RegistryHive)
@@ -22,6 +153,7 @@ HvpWriteLog(
     ULONG LastIndex;
     PVOID BlockPtr;
     BOOLEAN Success;
+    HV_WRITE_CONTEXT Context;
     static ULONG PrintCount = 0;
 
     if (PrintCount++ == 0)
@@ -78,7 +210,8 @@ HvpWriteLog(
         return FALSE;
     }
 
-    /* Write dirty blocks */
+    /* Write dirty blocks, they follow each other in the log */
+    HvpInitWriteContext(&Context, RegistryHive, HFILE_TYPE_LOG);
     FileOffset = BufferSize;
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
@@ -93,10 +226,9 @@ HvpWriteLog(
         BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
 
         /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                         &FileOffset, BlockPtr, HBLOCK_SIZE);
-        if (!Success)
+        if (!HvpWriteBlock(&Context, FileOffset, BlockPtr))
         {
+            HvpEndWrite(&Context);
             return FALSE;
         }
 
@@ -104,6 +236,11 @@ HvpWriteLog(
         FileOffset += HBLOCK_SIZE;
     }
 
+    if (!HvpEndWrite(&Context))
+    {
+        return FALSE;
+    }
+
     Success = RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_LOG, FileOffset, FileOffset);
     if (!Success)
     {
@@ -153,6 +290,7 @@ HvpWriteHive(
     ULONG LastIndex;
     PVOID BlockPtr;
     BOOLEAN Success;
+    HV_WRITE_CONTEXT Context;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
     ASSERT(RegistryHive->BaseBlock->Length ==
@@ -182,6 +320,8 @@ HvpWriteHive(
         return FALSE;
     }
 
+    /* Runs of dirty blocks are written together */
+    HvpInitWriteContext(&Context, RegistryHive, HFILE_TYPE_PRIMARY);
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
     {
@@ -199,16 +339,20 @@ HvpWriteHive(
         FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
 
         /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
-                                          &FileOffset, BlockPtr, HBLOCK_SIZE);
-        if (!Success)
+        if (!HvpWriteBlock(&Context, FileOffset, BlockPtr))
         {
+            HvpEndWrite(&Context);
             return FALSE;
         }
 
         BlockIndex++;
     }
 
+    if (!HvpEndWrite(&Context))
+    {
+        return FALSE;
+    }
+
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_PRIMARY, NULL, 0);
     if (!Success)
     {
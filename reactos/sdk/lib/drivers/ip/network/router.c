@@ -17,6 +17,119 @@
 LIST_ENTRY FIBListHead;
 KSPIN_LOCK FIBLock;
 
+/*
+ * IPv4 routes are also hashed by prefix length and masked network address,
+ * so a lookup probes at most one bucket per prefix length in use instead of
+ * walking every route.
+ *
+ * Lookups don't take FIBLock. Writers update the bucket chains under FIBLock
+ * such that a concurrent reader always sees a consistent chain, and before
+ * freeing an unlinked entry they wait for the readers that might still see
+ * it: readers register in one of two counters selected by the read epoch,
+ * and a writer flips the epoch and waits for the old counter to drain.
+ * Readers run at DISPATCH_LEVEL for the few probes this takes, so the wait
+ * is short.
+ */
+#define FIB_HASH_BITS       6
+#define FIB_HASH_SIZE       (1 << FIB_HASH_BITS)
+#define FIB_PREFIX_LENGTHS  33
+
+static PFIB_ENTRY FIBHashTable[FIB_PREFIX_LENGTHS][FIB_HASH_SIZE];
+static UINT FIBPrefixCount[FIB_PREFIX_LENGTHS];
+static volatile LONG FIBReadEpoch;
+static volatile LONG FIBReaders[2];
+
+static ULONG FIBPrefixMask(UINT PrefixLength)
+/*
+ * FUNCTION: Returns the host order netmask for a prefix length
+ */
+{
+    return PrefixLength ? 0xFFFFFFFF << (32 - PrefixLength) : 0;
+}
+
+static UINT FIBHash(ULONG Network)
+/*
+ * FUNCTION: Hashes a masked host order IPv4 network address
+ */
+{
+    return (UINT)((Network * 2654435761U) >> (32 - FIB_HASH_BITS));
+}
+
+static VOID FIBIndexEntry(
+    PFIB_ENTRY FIBE)
+/*
+ * FUNCTION: Adds a FIB entry to the prefix hash tables
+ * NOTES:
+ *     The forward information base lock must be held when called
+ */
+{
+    PFIB_ENTRY *Bucket;
+    ULONG Network;
+
+    if (FIBE->NetworkAddress.Type != IP_ADDRESS_V4 ||
+        FIBE->Netmask.Type != IP_ADDRESS_V4) {
+        FIBE->PrefixLength = FIB_NOT_INDEXED;
+        FIBE->HashNext = NULL;
+        return;
+    }
+
+    FIBE->PrefixLength = AddrCountPrefixBits(&FIBE->Netmask);
+    Network = IPv4NToHl(FIBE->NetworkAddress.Address.IPv4Address) &
+              FIBPrefixMask(FIBE->PrefixLength);
+    Bucket = &FIBHashTable[FIBE->PrefixLength][FIBHash(Network)];
+
+    /* The entry must be complete before readers can reach it */
+    FIBE->HashNext = *Bucket;
+    InterlockedExchangePointer((PVOID*)Bucket, FIBE);
+    FIBPrefixCount[FIBE->PrefixLength]++;
+}
+
+static VOID FIBUnindexEntry(
+    PFIB_ENTRY FIBE)
+/*
+ * FUNCTION: Removes a FIB entry from the prefix hash tables
+ * NOTES:
+ *     The forward information base lock must be held when called.
+ *     Readers may still hold the entry until FIBSynchronize returns
+ */
+{
+    PFIB_ENTRY *Link;
+    ULONG Network;
+
+    if (FIBE->PrefixLength == FIB_NOT_INDEXED)
+        return;
+
+    Network = IPv4NToHl(FIBE->NetworkAddress.Address.IPv4Address) &
+              FIBPrefixMask(FIBE->PrefixLength);
+    Link = &FIBHashTable[FIBE->PrefixLength][FIBHash(Network)];
+
+    while (*Link && *Link != FIBE)
+        Link = &(*Link)->HashNext;
+
+    ASSERT(*Link == FIBE);
+    if (*Link) {
+        /* Leave HashNext intact, readers standing on FIBE still need it */
+        InterlockedExchangePointer((PVOID*)Link, FIBE->HashNext);
+        FIBPrefixCount[FIBE->PrefixLength]--;
+    }
+
+    FIBE->PrefixLength = FIB_NOT_INDEXED;
+}
+
+static VOID FIBSynchronize(
+    VOID)
+/*
+ * FUNCTION: Waits until lookups that may have seen unlinked entries are done
+ */
+{
+    LONG OldEpoch;
+
+    OldEpoch = (InterlockedIncrement(&FIBReadEpoch) - 1) & 1;
+
+    while (FIBReaders[OldEpoch] != 0)
+        YieldProcessor();
+}
+
 void RouterDumpRoutes() {
     PLIST_ENTRY CurrentEntry;
     PLIST_ENTRY NextEntry;
@@ -68,6 +181,10 @@ VOID DestroyFIBE(
 
     /* Unlink the FIB entry from the list */
     RemoveEntryList(&FIBE->ListEntry);
+    FIBUnindexEntry(FIBE);
+
+    /* Wait for lookups that might still be looking at it */
+    FIBSynchronize();
 
     /* And free the FIB entry */
     FreeFIB(FIBE);
@@ -206,6 +323,7 @@ PFIB_ENTRY RouterAddRoute(
  *     these references
  */
 {
+    KIRQL OldIrql;
     PFIB_ENTRY FIBE;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. NetworkAddress (0x%X)  Netmask (0x%X) "
@@ -230,12 +348,82 @@ PFIB_ENTRY RouterAddRoute(
     FIBE->Metric         = Metric;
 
     /* Add FIB to the forward information base */
-    TcpipInterlockedInsertTailList(&FIBListHead, &FIBE->ListEntry, &FIBLock);
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    InsertTailList(&FIBListHead, &FIBE->ListEntry);
+    FIBIndexEntry(FIBE);
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
     return FIBE;
 }
 
 
+static PNEIGHBOR_CACHE_ENTRY RouterLookupIPv4Route(PIP_ADDRESS Destination)
+/*
+ * FUNCTION: Finds the longest prefix IPv4 route to Destination
+ * ARGUMENTS:
+ *     Destination = Pointer to IPv4 destination address
+ * RETURNS:
+ *     Pointer to NCE for router, NULL if none was found
+ * NOTES:
+ *     Among routes of the same length the lowest metric route with a usable
+ *     neighbor wins. If no matching route has a usable neighbor the longest
+ *     match is returned anyway
+ */
+{
+    KIRQL OldIrql;
+    LONG Epoch;
+    INT Length;
+    ULONG Dest, Mask, Network;
+    UINT BestMetric = 0;
+    UCHAR State;
+    PFIB_ENTRY Current;
+    PNEIGHBOR_CACHE_ENTRY NCE, BestNCE = NULL, FallbackNCE = NULL;
+
+    Dest = IPv4NToHl(Destination->Address.IPv4Address);
+
+    /* Register as a reader of the current epoch, see FIBSynchronize */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    for (;;) {
+        Epoch = FIBReadEpoch & 1;
+        InterlockedIncrement(&FIBReaders[Epoch]);
+        if ((FIBReadEpoch & 1) == Epoch)
+            break;
+        InterlockedDecrement(&FIBReaders[Epoch]);
+    }
+
+    for (Length = FIB_PREFIX_LENGTHS - 1; Length >= 0 && !BestNCE; Length--) {
+        if (!FIBPrefixCount[Length])
+            continue;
+
+        Mask = FIBPrefixMask(Length);
+        Network = Dest & Mask;
+
+        for (Current = *(PFIB_ENTRY volatile *)&FIBHashTable[Length][FIBHash(Network)];
+             Current;
+             Current = *(PFIB_ENTRY volatile *)&Current->HashNext) {
+            if ((IPv4NToHl(Current->NetworkAddress.Address.IPv4Address) & Mask) != Network)
+                continue;
+
+            NCE   = Current->Router;
+            State = NCE->State;
+
+            if (!FallbackNCE)
+                FallbackNCE = NCE;
+
+            if (!(State & NUD_STALE) && !(State & NUD_INCOMPLETE) &&
+                (!BestNCE || Current->Metric < BestMetric)) {
+                BestNCE    = NCE;
+                BestMetric = Current->Metric;
+            }
+        }
+    }
+
+    InterlockedDecrement(&FIBReaders[Epoch]);
+    KeLowerIrql(OldIrql);
+
+    return BestNCE ? BestNCE : FallbackNCE;
+}
+
 PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 /*
  * FUNCTION: Finds a router to use to get to Destination
@@ -259,6 +447,11 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 
     TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
 
+    if (Destination->Type == IP_ADDRESS_V4) {
+        BestNCE = RouterLookupIPv4Route(Destination);
+        goto Done;
+    }
+
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
 
     CurrentEntry = FIBListHead.Flink;
@@ -266,6 +459,12 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
         NextEntry = CurrentEntry->Flink;
 	    Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
 
+        /* IPv4 routes are only reachable through the hash tables */
+        if (Current->PrefixLength != FIB_NOT_INDEXED) {
+            CurrentEntry = NextEntry;
+            continue;
+        }
+
         NCE   = Current->Router;
         State = NCE->State;
 
@@ -288,6 +487,7 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
+Done:
     if( BestNCE ) {
 	TI_DbgPrint(DEBUG_ROUTER,("Routing to %s\n", A2S(&BestNCE->Address)));
     } else {
@@ -492,6 +692,8 @@ NTSTATUS RouterStartup(
     /* Initialize the Forward Information Base */
     InitializeListHead(&FIBListHead);
     TcpipInitializeSpinLock(&FIBLock);
+    RtlZeroMemory(FIBHashTable, sizeof(FIBHashTable));
+    RtlZeroMemory(FIBPrefixCount, sizeof(FIBPrefixCount));
 
     return STATUS_SUCCESS;
 }
@@ -20,7 +20,28 @@
 #define COMPRESSION_FORMAT_MASK  0x00FF
 #define COMPRESSION_ENGINE_MASK  0xFF00
 
+/* LZNT1 works on 4 KB chunks, hash chains index 3-byte prefixes within one */
+#define LZNT1_CHUNK_SIZE         0x1000
+#define LZNT1_HASH_BITS          12
+#define LZNT1_HASH_SIZE          (1 << LZNT1_HASH_BITS)
+#define LZNT1_MIN_MATCH          3
 
+/* How many chain links each engine is willing to follow per position */
+#define LZNT1_STANDARD_CHAIN     16
+#define LZNT1_MAXIMUM_CHAIN      LZNT1_CHUNK_SIZE
+
+/* Stop searching once a match is at least this long (standard engine only) */
+#define LZNT1_STANDARD_NICE      32
+
+typedef struct _LZNT1_WORKSPACE
+{
+    /* Most recent position (+1) per hash bucket, 0 means empty */
+    USHORT HashHead[LZNT1_HASH_SIZE];
+    /* Previous position (+1) with the same hash, indexed by position */
+    USHORT HashChain[LZNT1_CHUNK_SIZE];
+} LZNT1_WORKSPACE, *PLZNT1_WORKSPACE;
+
+C_ASSERT(sizeof(LZNT1_WORKSPACE) <= 0x8010);
 
 
 /* FUNCTIONS ****************************************************************/
@@ -216,18 +237,189 @@ out:
 }
 
 
+/* number of displacement bits used for a back reference at chunk position pos,
+ * this must match the computation done in lznt1_decompress_chunk */
+static ULONG lznt1_displacement_bits(ULONG pos)
+{
+    ULONG displacement_bits;
+
+    for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
+        if ((1 << (displacement_bits - 1)) < pos) break;
+
+    return displacement_bits;
+}
+
+FORCEINLINE ULONG lznt1_hash(const UCHAR *src)
+{
+    ULONG value = (src[0] << 16) | (src[1] << 8) | src[2];
+    return (value * 2654435761U) >> (32 - LZNT1_HASH_BITS);
+}
+
+FORCEINLINE VOID lznt1_insert(PLZNT1_WORKSPACE ws, const UCHAR *chunk, ULONG pos)
+{
+    ULONG hash = lznt1_hash(chunk + pos);
+
+    ws->HashChain[pos] = ws->HashHead[hash];
+    ws->HashHead[hash] = (USHORT)(pos + 1);
+}
+
+/* find the longest earlier occurrence of the data at pos, returns its length */
+static ULONG lznt1_find_match(PLZNT1_WORKSPACE ws, const UCHAR *chunk, ULONG chunk_size,
+                              ULONG pos, ULONG max_chain, ULONG nice_length,
+                              ULONG *match_displacement)
+{
+    ULONG max_length, best_length = 0, length, candidate;
+    const UCHAR *cur = chunk + pos, *ref;
+
+    if (pos + LZNT1_MIN_MATCH > chunk_size)
+        return 0;
+
+    max_length = (1 << (16 - lznt1_displacement_bits(pos))) - 1 + LZNT1_MIN_MATCH;
+    max_length = min(max_length, chunk_size - pos);
+    nice_length = min(nice_length, max_length);
+
+    candidate = ws->HashHead[lznt1_hash(cur)];
+    while (candidate && max_chain--)
+    {
+        ref = chunk + candidate - 1;
+        candidate = ws->HashChain[candidate - 1];
+
+        /* quick reject: the byte just past the current best must match too */
+        if (ref[best_length] != cur[best_length] ||
+            ref[0] != cur[0] || ref[1] != cur[1] || ref[2] != cur[2])
+            continue;
+
+        /* overlapping references are fine, the decoder copies byte by byte */
+        for (length = LZNT1_MIN_MATCH; length < max_length; length++)
+            if (ref[length] != cur[length]) break;
+
+        if (length > best_length)
+        {
+            best_length = length;
+            *match_displacement = cur - ref;
+            if (best_length >= nice_length) break;
+        }
+    }
+
+    return best_length >= LZNT1_MIN_MATCH ? best_length : 0;
+}
+
+/* compress a single LZNT1 chunk, returns 0 if the result does not fit into dst */
+static ULONG lznt1_compress_chunk(const UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                                  USHORT engine, PLZNT1_WORKSPACE ws)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *flags = NULL;
+    ULONG pos = 0, flag_bit = 8, length, next_length;
+    ULONG displacement = 0, next_displacement, length_bits;
+    ULONG max_chain, nice_length;
+    BOOLEAN lazy;
+
+    if (engine == COMPRESSION_ENGINE_MAXIMUM)
+    {
+        max_chain   = LZNT1_MAXIMUM_CHAIN;
+        nice_length = MAXULONG;
+        lazy        = TRUE;
+    }
+    else
+    {
+        max_chain   = LZNT1_STANDARD_CHAIN;
+        nice_length = LZNT1_STANDARD_NICE;
+        lazy        = FALSE;
+    }
+
+    RtlZeroMemory(ws->HashHead, sizeof(ws->HashHead));
+
+    while (pos < src_size)
+    {
+        /* start a new group of 8 entities */
+        if (flag_bit == 8)
+        {
+            if (dst_cur >= dst_end) return 0;
+            flags = dst_cur++;
+            *flags = 0;
+            flag_bit = 0;
+        }
+
+        length = lznt1_find_match(ws, src, src_size, pos, max_chain, nice_length, &displacement);
+        if (pos + LZNT1_MIN_MATCH <= src_size)
+            lznt1_insert(ws, src, pos);
+
+        /* lazy evaluation: prefer a literal if the next position gives a longer match */
+        if (lazy && length)
+        {
+            next_length = lznt1_find_match(ws, src, src_size, pos + 1, max_chain,
+                                           nice_length, &next_displacement);
+            if (next_length > length + 1)
+                length = 0;
+        }
+
+        if (length)
+        {
+            /* backwards reference */
+            if (dst_cur + sizeof(WORD) > dst_end) return 0;
+            length_bits = 16 - lznt1_displacement_bits(pos);
+            *(WORD *)dst_cur = (WORD)(((displacement - 1) << length_bits) | (length - LZNT1_MIN_MATCH));
+            dst_cur += sizeof(WORD);
+            *flags |= 1 << flag_bit;
+
+            while (--length)
+            {
+                pos++;
+                if (pos + LZNT1_MIN_MATCH <= src_size)
+                    lznt1_insert(ws, src, pos);
+            }
+            pos++;
+        }
+        else
+        {
+            /* uncompressed data */
+            if (dst_cur >= dst_end) return 0;
+            *dst_cur++ = src[pos++];
+        }
+
+        flag_bit++;
+    }
+
+    return dst_cur - dst;
+}
+
 static NTSTATUS
 RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace,
+                        USHORT engine)
 {
         UCHAR *src_cur = src, *src_end = src + src_size;
         UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+        ULONG block_size, compressed_size;
+
+        if (engine != COMPRESSION_ENGINE_STANDARD &&
+            engine != COMPRESSION_ENGINE_MAXIMUM)
+            return STATUS_NOT_SUPPORTED;
+
+        if (!workspace)
+            return STATUS_ACCESS_VIOLATION;
 
         while (src_cur < src_end)
         {
             /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
+            block_size = min(LZNT1_CHUNK_SIZE, src_end - src_cur);
+            if (dst_cur + sizeof(WORD) > dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            /* a compressed chunk is only worth it if it is smaller than the raw data */
+            compressed_size = lznt1_compress_chunk(src_cur, block_size,
+                                                   dst_cur + sizeof(WORD),
+                                                   min(dst_end - dst_cur - sizeof(WORD), block_size - 1),
+                                                   engine, (PLZNT1_WORKSPACE)workspace);
+            if (compressed_size)
+            {
+                /* write compressed chunk header */
+                *(WORD *)dst_cur = 0xB000 | (compressed_size - 1);
+                dst_cur += sizeof(WORD) + compressed_size;
+                src_cur += block_size;
+                continue;
+            }
+
             if (dst_cur + sizeof(WORD) + block_size > dst_end)
                 return STATUS_BUFFER_TOO_SMALL;
 
@@ -261,7 +453,8 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
    }
    else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
    {
-      *BufferAndWorkSpaceSize = 0x10;
+      /* Same hash tables as the standard engine, only searched deeper */
+      *BufferAndWorkSpaceSize = 0x8010;
       *FragmentWorkSpaceSize = 0x1000;
       return(STATUS_SUCCESS);
    }
@@ -284,7 +477,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -297,7 +490,8 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      CompressedBufferSize,
                                      UncompressedChunkSize,
                                      FinalCompressedSize,
-                                     WorkSpace));
+                                     WorkSpace,
+                                     Engine));
 
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
@@ -1577,6 +1577,9 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
                             MEM_RELEASE);
     }
 
+    /* Tear down the front end heap */
+    RtlpDestroyLowFragmentationHeap(Heap);
+
     /* Delete tags and remove heap from the process heaps list in user mode */
     if (RtlpGetMode() == UserMode)
     {
@@ -1977,6 +1980,28 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small blocks without extra stuff are served by the front end, if there is one */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG &&
+        Index < HEAP_LFH_BUCKETS &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+    {
+        InUseEntry = RtlpLfhAllocate(Heap, Index);
+        if (InUseEntry)
+        {
+            InUseEntry->Flags = EntryFlags;
+            InUseEntry->UnusedBytes = (UCHAR)(AllocationSize - Size);
+            InUseEntry->SmallTagIndex = 0;
+
+            /* Zero memory if that was requested */
+            if (Flags & HEAP_ZERO_MEMORY)
+                RtlZeroMemory(InUseEntry + 1, Size);
+
+            return InUseEntry + 1;
+        }
+
+        /* Otherwise fall back to the backend */
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2180,6 +2205,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     if (RtlpHeapIsSpecial(Flags))
         return RtlDebugFreeHeap(Heap, Flags, Ptr);
 
+    /* Front end blocks go back to their subsegment, without the heap lock */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG &&
+        RtlpIsLfhEntry((PHEAP_ENTRY)Ptr - 1))
+    {
+        return RtlpLfhFree(Heap, (PHEAP_ENTRY)Ptr - 1);
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2590,6 +2622,26 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Front end blocks are resized by their own code */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG &&
+        RtlpIsLfhEntry((PHEAP_ENTRY)Ptr - 1))
+    {
+        Ptr = RtlpLfhReAllocate(Heap, Flags, Ptr, Size);
+
+        if (!Ptr && (Flags & HEAP_GENERATE_EXCEPTIONS))
+        {
+            ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+            ExceptionRecord.ExceptionRecord = NULL;
+            ExceptionRecord.NumberParameters = 1;
+            ExceptionRecord.ExceptionFlags = 0;
+            ExceptionRecord.ExceptionInformation[0] = Size;
+
+            RtlRaiseException(&ExceptionRecord);
+        }
+
+        return Ptr;
+    }
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3154,6 +3206,14 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks live inside a busy backend block */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG &&
+        RtlpIsLfhEntry(HeapEntry))
+    {
+        if (!RtlpLfhValidateEntry(Heap, HeapEntry)) goto invalid_entry;
+        return TRUE;
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -3918,13 +3978,15 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LOWFRAG)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        if (!HeapHandle)
+            return STATUS_INVALID_PARAMETER;
+
+        return RtlpActivateLowFragmentationHeap((PHEAP)HeapHandle);
     }
 
     return STATUS_SUCCESS;
@@ -3963,7 +4025,88 @@ RtlQueryHeapInformation(HANDLE HeapHandle,
     return STATUS_UNSUCCESSFUL;
 }
 
-NTSTATUS
+static
+ULONG
+RtlpCarveMultipleBlocks(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T AllocationSize,
+                        SIZE_T Index,
+                        ULONG Count,
+                        PVOID *Array)
+{
+    PHEAP_ENTRY BigEntry, InUseEntry, NextEntry;
+    SIZE_T BigSize, LastSize;
+    UCHAR BigFlags, EntryFlags;
+    ULONG i;
+
+    /* Get one block big enough for all of them, the backend splits a free block for us */
+    BigEntry = (PHEAP_ENTRY)RtlAllocateHeap(Heap,
+                                            (Flags | HEAP_NO_SERIALIZE) & ~HEAP_ZERO_MEMORY,
+                                            (Count * Index - 1) << HEAP_ENTRY_SHIFT);
+    if (!BigEntry) return 0;
+    BigEntry--;
+
+    /* It has to be a plain backend block, otherwise carving it is not possible */
+    if (BigEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC ||
+        RtlpIsLfhEntry(BigEntry) ||
+        BigEntry->Size < Count * Index)
+    {
+        RtlFreeHeap(Heap, Flags | HEAP_NO_SERIALIZE, BigEntry + 1);
+        return 0;
+    }
+
+    BigSize = BigEntry->Size;
+    BigFlags = BigEntry->Flags;
+    EntryFlags = BigFlags & ~HEAP_ENTRY_LAST_ENTRY;
+
+    /* Zero everything at once if requested */
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(BigEntry + 1, (BigSize << HEAP_ENTRY_SHIFT) - sizeof(HEAP_ENTRY));
+
+    /* Split it into Count blocks of Index units each, the last one takes the slack */
+    InUseEntry = BigEntry;
+    for (i = 0; i < Count; i++)
+    {
+        if (i == Count - 1)
+        {
+            LastSize = BigSize - (Count - 1) * Index;
+            InUseEntry->Size = (USHORT)LastSize;
+            InUseEntry->Flags = EntryFlags | (BigFlags & HEAP_ENTRY_LAST_ENTRY);
+            InUseEntry->UnusedBytes = (UCHAR)((LastSize << HEAP_ENTRY_SHIFT) - Size);
+        }
+        else
+        {
+            InUseEntry->Size = (USHORT)Index;
+            InUseEntry->Flags = EntryFlags;
+            InUseEntry->UnusedBytes = (UCHAR)(AllocationSize - Size);
+        }
+
+        if (i != 0)
+        {
+            InUseEntry->PreviousSize = (USHORT)Index;
+            InUseEntry->SegmentOffset = BigEntry->SegmentOffset;
+        }
+        InUseEntry->SmallTagIndex = 0;
+
+        Array[i] = InUseEntry + 1;
+        InUseEntry += InUseEntry->Size;
+    }
+
+    /* The block after the carved range now follows the last small block */
+    if (!(BigFlags & HEAP_ENTRY_LAST_ENTRY))
+    {
+        NextEntry = BigEntry + BigSize;
+        NextEntry->PreviousSize = (USHORT)(BigSize - (Count - 1) * Index);
+    }
+
+    return Count;
+}
+
+/*
+ * @implemented
+ */
+ULONG
 NTAPI
 RtlMultipleAllocateHeap(IN PVOID HeapHandle,
                         IN ULONG Flags,
@@ -3971,19 +4114,180 @@ RtlMultipleAllocateHeap(IN PVOID HeapHandle,
                         IN ULONG Count,
                         OUT PVOID *Array)
 {
-    UNIMPLEMENTED;
-    return 0;
+    PHEAP Heap = (PHEAP)HeapHandle;
+    SIZE_T AllocationSize, Index;
+    ULONG Allocated = 0, Batch, Carved, InnerFlags;
+    BOOLEAN HeapLocked = FALSE;
+    EXCEPTION_RECORD ExceptionRecord;
+
+    if (!Count) return 0;
+
+    /* Force flags */
+    Flags |= Heap->ForceFlags;
+
+    /* Special heaps do their own bookkeeping, keep it simple for them */
+    if (RtlpHeapIsSpecial(Flags))
+    {
+        while (Allocated < Count)
+        {
+            Array[Allocated] = RtlAllocateHeap(Heap, Flags, Size);
+            if (!Array[Allocated]) break;
+            Allocated++;
+        }
+        return Allocated;
+    }
+
+    /* Same size computation as RtlAllocateHeap */
+    AllocationSize = ((Size ? Size : 1) + Heap->AlignRound) & Heap->AlignMask;
+    Index = AllocationSize >> HEAP_ENTRY_SHIFT;
+
+    /* Nothing may raise while we hold the lock, the exception is generated once it is released */
+    InnerFlags = Flags & ~HEAP_GENERATE_EXCEPTIONS;
+
+    /* One lock acquisition for the whole batch */
+    if (!(Flags & HEAP_NO_SERIALIZE))
+    {
+        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        HeapLocked = TRUE;
+    }
+
+    /* Plain blocks which are not served by the front end are carved out of one big block */
+    if (Size < 0x80000000 &&
+        !(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        !Heap->PseudoTagEntries &&
+        !(Heap->Flags & (HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)) &&
+        !(Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG && Index < HEAP_LFH_BUCKETS))
+    {
+        while (Count - Allocated > 1)
+        {
+            /* Stay below the virtual memory threshold and the maximum block size */
+            Batch = (ULONG)min(Count - Allocated,
+                               min(Heap->VirtualMemoryThreshold, HEAP_MAX_BLOCK_SIZE) / Index);
+            if (Batch < 2) break;
+
+            Carved = RtlpCarveMultipleBlocks(Heap,
+                                             InnerFlags,
+                                             Size,
+                                             AllocationSize,
+                                             Index,
+                                             Batch,
+                                             &Array[Allocated]);
+            if (!Carved) break;
+            Allocated += Carved;
+        }
+    }
+
+    /* Whatever is left is allocated one by one, still under the same lock */
+    while (Allocated < Count)
+    {
+        Array[Allocated] = RtlAllocateHeap(Heap, InnerFlags | HEAP_NO_SERIALIZE, Size);
+        if (!Array[Allocated]) break;
+        Allocated++;
+    }
+
+    if (HeapLocked) RtlLeaveHeapLock(Heap->LockVariable);
+
+    /* Generate an exception */
+    if (Allocated < Count && (Flags & HEAP_GENERATE_EXCEPTIONS))
+    {
+        ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+        ExceptionRecord.ExceptionRecord = NULL;
+        ExceptionRecord.NumberParameters = 1;
+        ExceptionRecord.ExceptionFlags = 0;
+        ExceptionRecord.ExceptionInformation[0] = AllocationSize;
+
+        RtlRaiseException(&ExceptionRecord);
+    }
+
+    return Allocated;
 }
 
-NTSTATUS
+/*
+ * @implemented
+ */
+ULONG
 NTAPI
 RtlMultipleFreeHeap(IN PVOID HeapHandle,
                     IN ULONG Flags,
                     IN ULONG Count,
                     OUT PVOID *Array)
 {
-    UNIMPLEMENTED;
-    return 0;
+    PHEAP Heap = (PHEAP)HeapHandle;
+    PHEAP_ENTRY HeapEntry, NextEntry;
+    ULONG Freed = 0, i, j;
+    BOOLEAN HeapLocked = FALSE;
+
+    /* Force flags */
+    Flags |= Heap->ForceFlags;
+
+    /* Special heaps do their own bookkeeping, keep it simple for them */
+    if (RtlpHeapIsSpecial(Flags))
+    {
+        for (i = 0; i < Count; i++)
+        {
+            if (!RtlFreeHeap(Heap, Flags, Array[i])) break;
+            Freed++;
+        }
+        return Freed;
+    }
+
+    /* One lock acquisition for the whole batch */
+    if (!(Flags & HEAP_NO_SERIALIZE))
+    {
+        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        HeapLocked = TRUE;
+    }
+
+    for (i = 0; i < Count; i = j)
+    {
+        j = i + 1;
+
+        if (!Array[i])
+        {
+            Freed++;
+            continue;
+        }
+
+        HeapEntry = (PHEAP_ENTRY)Array[i] - 1;
+
+        /* Merge physically adjacent busy neighbours (typically a carved batch freed in order)
+           so that the free lists and coalescing are only touched once for the whole run */
+        if (!(HeapEntry->Flags & (HEAP_ENTRY_VIRTUAL_ALLOC | HEAP_ENTRY_EXTRA_PRESENT)) &&
+            (HeapEntry->Flags & HEAP_ENTRY_BUSY) &&
+            HeapEntry->SegmentOffset < HEAP_SEGMENTS)
+        {
+            while (j < Count && Array[j] &&
+                   !(HeapEntry->Flags & HEAP_ENTRY_LAST_ENTRY))
+            {
+                NextEntry = (PHEAP_ENTRY)Array[j] - 1;
+
+                if (NextEntry != HeapEntry + HeapEntry->Size ||
+                    (NextEntry->Flags & (HEAP_ENTRY_VIRTUAL_ALLOC | HEAP_ENTRY_EXTRA_PRESENT)) ||
+                    !(NextEntry->Flags & HEAP_ENTRY_BUSY) ||
+                    NextEntry->SegmentOffset != HeapEntry->SegmentOffset ||
+                    HeapEntry->Size + NextEntry->Size > HEAP_MAX_BLOCK_SIZE)
+                {
+                    break;
+                }
+
+                /* Absorb it */
+                HeapEntry->Size += NextEntry->Size;
+                HeapEntry->Flags |= NextEntry->Flags & HEAP_ENTRY_LAST_ENTRY;
+                if (!(HeapEntry->Flags & HEAP_ENTRY_LAST_ENTRY))
+                    (HeapEntry + HeapEntry->Size)->PreviousSize = HeapEntry->Size;
+
+                j++;
+            }
+        }
+
+        /* The absorbed blocks are only freed along with the run */
+        if (!RtlFreeHeap(Heap, Flags | HEAP_NO_SERIALIZE, Array[i])) break;
+        Freed += j - i;
+    }
+
+    if (HeapLocked) RtlLeaveHeapLock(Heap->LockVariable);
+
+    return Freed;
 }
 
 /* EOF */
@@ -55,6 +55,23 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types */
+#define HEAP_FRONT_END_NONE        0
+#define HEAP_FRONT_END_LOWFRAG     2
+
+/* Low fragmentation heap parameters */
+#define HEAP_LFH_BUCKETS           HEAP_FREELISTS
+#define HEAP_LFH_AFFINITY_SLOTS    4
+#define HEAP_LFH_SUBSEGMENT_SIZE   0x4000
+
+/* Low fragmentation heap blocks carry this value instead of a segment index */
+#define HEAP_LFH_SEGMENT_OFFSET    0xFF
+
+/* Bucket activation states */
+#define HEAP_LFH_BUCKET_INACTIVE   0
+#define HEAP_LFH_BUCKET_ACTIVATING 1
+#define HEAP_LFH_BUCKET_ACTIVE     2
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -327,6 +344,44 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+/* Low fragmentation heap structures */
+struct _HEAP_LFH_AFFINITY_SLOT;
+
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    LIST_ENTRY ListEntry;
+    struct _HEAP *Heap;
+    struct _HEAP_LFH_AFFINITY_SLOT *Slot;
+    SINGLE_LIST_ENTRY FreeList;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    USHORT FreeCount;
+    BOOLEAN InPartialList;
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+typedef struct _HEAP_LFH_AFFINITY_SLOT
+{
+    HEAP_LOCK LockStorage;
+    PHEAP_LOCK Lock;
+    PHEAP_LFH_SUBSEGMENT ActiveSubSegment;
+    LIST_ENTRY PartialList;
+    ULONG SubSegmentCount;
+    ULONG Allocations;
+    ULONG Frees;
+} HEAP_LFH_AFFINITY_SLOT, *PHEAP_LFH_AFFINITY_SLOT;
+
+typedef struct _HEAP_LFH_BUCKET
+{
+    LONG State;
+    PHEAP_LFH_AFFINITY_SLOT Slots;
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    ULONG SlotCount;
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -352,6 +407,38 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+FORCEINLINE BOOLEAN
+RtlpIsLfhEntry(PHEAP_ENTRY HeapEntry)
+{
+    return HeapEntry->LFHFlags == HEAP_LFH_SEGMENT_OFFSET &&
+           !(HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC);
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap);
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry);
+
 /* heapdbg.c */
 HANDLE NTAPI
 RtlDebugCreateHeap(ULONG Flags,
@@ -0,0 +1,421 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Heap low fragmentation front end
+ */
+
+/* Overview:
+   The low fragmentation heap (LFH) sits in front of the backend allocator
+   and serves small blocks from fixed size subsegments. There is one bucket
+   per block size (in heap entry units, i.e. per dedicated free list index).
+   Each bucket has a few affinity slots, each with its own lock, its active
+   subsegment and a list of partially used subsegments, so threads allocating
+   the same size do not all serialize on one lock, and none of them touch the
+   heap lock except when a subsegment is created or released.
+
+   Subsegments are ordinary busy blocks of the backend heap, so heap walking,
+   validation and destruction keep working unchanged. LFH blocks carry a
+   regular HEAP_ENTRY header (so RtlSizeHeap works as usual), with SegmentOffset
+   set to HEAP_LFH_SEGMENT_OFFSET and PreviousSize holding the distance to the
+   owning subsegment header in heap entry units.
+*/
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define HEAP_LFH_SUBSEGMENT_HEADER_SIZE ROUND_UP(sizeof(HEAP_LFH_SUBSEGMENT), HEAP_ENTRY_SIZE)
+
+C_ASSERT((HEAP_LFH_SUBSEGMENT_SIZE >> HEAP_ENTRY_SHIFT) <= MAXUSHORT);
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhGetSubSegment(PHEAP_ENTRY HeapEntry)
+{
+    return (PHEAP_LFH_SUBSEGMENT)(HeapEntry - HeapEntry->PreviousSize);
+}
+
+FORCEINLINE
+PHEAP_LFH_AFFINITY_SLOT
+RtlpLfhGetAffinitySlot(PHEAP_LFH Lfh,
+                       PHEAP_LFH_BUCKET Bucket)
+{
+    ULONG ThreadKey;
+
+    /* The LFH is user mode only, so spread threads by their ID */
+    ThreadKey = HandleToUlong(NtCurrentTeb()->ClientId.UniqueThread) >> 2;
+    return &Bucket->Slots[ThreadKey % Lfh->SlotCount];
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    ULONG ProcessorCount;
+
+    /* Already enabled? */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LOWFRAG)
+        return STATUS_SUCCESS;
+
+    /* The front end has no notion of tail/free checking, alignment or debug features,
+       and it only makes sense for serialized heaps */
+    if (RtlpGetMode() != UserMode ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_CREATE_ALIGN_16 |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED)) ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags))
+    {
+        DPRINT1("HEAP: Cannot enable LFH for heap %p with flags %x\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Lfh = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!Lfh) return STATUS_NO_MEMORY;
+
+    ProcessorCount = NtCurrentPeb()->NumberOfProcessors;
+    Lfh->SlotCount = max(1, min(ProcessorCount, HEAP_LFH_AFFINITY_SLOTS));
+
+    /* Publish it under the heap lock, somebody might have been faster */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_LOWFRAG)
+    {
+        Heap->FrontEndHeap = Lfh;
+        Heap->FrontEndHeapType = HEAP_FRONT_END_LOWFRAG;
+        Lfh = NULL;
+    }
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    if (Lfh) RtlFreeHeap(Heap, 0, Lfh);
+
+    DPRINT("HEAP: LFH enabled for heap %p\n", Heap);
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    ULONG Index, Slot;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_LOWFRAG || !Lfh)
+        return;
+
+    /* Memory goes away with the heap segments, only locks need cleanup */
+    for (Index = 0; Index < HEAP_LFH_BUCKETS; Index++)
+    {
+        Bucket = &Lfh->Buckets[Index];
+        if (Bucket->State != HEAP_LFH_BUCKET_ACTIVE) continue;
+
+        for (Slot = 0; Slot < Lfh->SlotCount; Slot++)
+            RtlDeleteHeapLock(Bucket->Slots[Slot].Lock);
+    }
+
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+    Heap->FrontEndHeap = NULL;
+}
+
+static
+BOOLEAN
+RtlpLfhActivateBucket(PHEAP Heap,
+                      PHEAP_LFH Lfh,
+                      PHEAP_LFH_BUCKET Bucket)
+{
+    PHEAP_LFH_AFFINITY_SLOT Slots;
+    PHEAP_LOCK Lock;
+    ULONG Slot;
+
+    /* Only one thread initializes a bucket, the others use the backend meanwhile */
+    if (InterlockedCompareExchange(&Bucket->State,
+                                   HEAP_LFH_BUCKET_ACTIVATING,
+                                   HEAP_LFH_BUCKET_INACTIVE) != HEAP_LFH_BUCKET_INACTIVE)
+    {
+        return FALSE;
+    }
+
+    Slots = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, Lfh->SlotCount * sizeof(HEAP_LFH_AFFINITY_SLOT));
+    if (!Slots)
+    {
+        InterlockedExchange(&Bucket->State, HEAP_LFH_BUCKET_INACTIVE);
+        return FALSE;
+    }
+
+    for (Slot = 0; Slot < Lfh->SlotCount; Slot++)
+    {
+        Lock = &Slots[Slot].LockStorage;
+        if (!NT_SUCCESS(RtlInitializeHeapLock(&Lock)))
+        {
+            while (Slot--) RtlDeleteHeapLock(Slots[Slot].Lock);
+            RtlFreeHeap(Heap, 0, Slots);
+            InterlockedExchange(&Bucket->State, HEAP_LFH_BUCKET_INACTIVE);
+            return FALSE;
+        }
+
+        Slots[Slot].Lock = Lock;
+        InitializeListHead(&Slots[Slot].PartialList);
+    }
+
+    Bucket->Slots = Slots;
+    InterlockedExchange(&Bucket->State, HEAP_LFH_BUCKET_ACTIVE);
+    return TRUE;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhCreateSubSegment(PHEAP Heap,
+                        PHEAP_LFH_AFFINITY_SLOT Slot,
+                        SIZE_T Index)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_ENTRY HeapEntry;
+    PSINGLE_LIST_ENTRY *Link;
+    USHORT Block, BlockCount;
+
+    /* Subsegments are plain backend blocks */
+    SubSegment = RtlAllocateHeap(Heap, 0, HEAP_LFH_SUBSEGMENT_SIZE);
+    if (!SubSegment) return NULL;
+
+    BlockCount = (USHORT)((HEAP_LFH_SUBSEGMENT_SIZE - HEAP_LFH_SUBSEGMENT_HEADER_SIZE) /
+                          (Index << HEAP_ENTRY_SHIFT));
+
+    SubSegment->Heap = Heap;
+    SubSegment->Slot = Slot;
+    SubSegment->BlockUnits = (USHORT)Index;
+    SubSegment->BlockCount = BlockCount;
+    SubSegment->FreeCount = BlockCount;
+    SubSegment->InPartialList = FALSE;
+
+    /* Carve all blocks and chain them in address order */
+    HeapEntry = (PHEAP_ENTRY)((ULONG_PTR)SubSegment + HEAP_LFH_SUBSEGMENT_HEADER_SIZE);
+    Link = &SubSegment->FreeList.Next;
+    for (Block = 0; Block < BlockCount; Block++)
+    {
+        HeapEntry->Size = (USHORT)Index;
+        HeapEntry->Flags = 0;
+        HeapEntry->SmallTagIndex = 0;
+        HeapEntry->PreviousSize = (USHORT)(HeapEntry - (PHEAP_ENTRY)SubSegment);
+        HeapEntry->LFHFlags = HEAP_LFH_SEGMENT_OFFSET;
+        HeapEntry->UnusedBytes = 0;
+
+        *Link = (PSINGLE_LIST_ENTRY)(HeapEntry + 1);
+        Link = &((PSINGLE_LIST_ENTRY)(HeapEntry + 1))->Next;
+        HeapEntry += Index;
+    }
+    *Link = NULL;
+
+    return SubSegment;
+}
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Index)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+    PHEAP_LFH_SUBSEGMENT SubSegment, NewSubSegment = NULL;
+    PSINGLE_LIST_ENTRY FreeBlock;
+    PHEAP_ENTRY HeapEntry;
+
+    ASSERT(Index < HEAP_LFH_BUCKETS);
+
+    /* A NULL return just means "use the backend" */
+    Bucket = &Lfh->Buckets[Index];
+    if (Bucket->State != HEAP_LFH_BUCKET_ACTIVE &&
+        !RtlpLfhActivateBucket(Heap, Lfh, Bucket))
+    {
+        return NULL;
+    }
+
+    Slot = RtlpLfhGetAffinitySlot(Lfh, Bucket);
+
+    for (;;)
+    {
+        RtlEnterHeapLock(Slot->Lock, TRUE);
+
+        SubSegment = Slot->ActiveSubSegment;
+        if (!SubSegment || !SubSegment->FreeCount)
+        {
+            if (!IsListEmpty(&Slot->PartialList))
+            {
+                /* Reuse a partially used subsegment, the full one is found again on free */
+                SubSegment = CONTAINING_RECORD(Slot->PartialList.Flink,
+                                               HEAP_LFH_SUBSEGMENT,
+                                               ListEntry);
+                RemoveEntryList(&SubSegment->ListEntry);
+                SubSegment->InPartialList = FALSE;
+                Slot->ActiveSubSegment = SubSegment;
+            }
+            else if (NewSubSegment)
+            {
+                Slot->ActiveSubSegment = SubSegment = NewSubSegment;
+                Slot->SubSegmentCount++;
+                NewSubSegment = NULL;
+            }
+            else
+            {
+                /* Allocate a fresh subsegment without holding the slot lock */
+                RtlLeaveHeapLock(Slot->Lock);
+
+                NewSubSegment = RtlpLfhCreateSubSegment(Heap, Slot, Index);
+                if (!NewSubSegment) return NULL;
+                continue;
+            }
+        }
+
+        FreeBlock = PopEntryList(&SubSegment->FreeList);
+        SubSegment->FreeCount--;
+        Slot->Allocations++;
+
+        /* Somebody else refilled the slot while we were allocating, park ours */
+        if (NewSubSegment)
+        {
+            InsertTailList(&Slot->PartialList, &NewSubSegment->ListEntry);
+            NewSubSegment->InPartialList = TRUE;
+            Slot->SubSegmentCount++;
+        }
+
+        RtlLeaveHeapLock(Slot->Lock);
+        break;
+    }
+
+    HeapEntry = (PHEAP_ENTRY)FreeBlock - 1;
+    ASSERT(RtlpIsLfhEntry(HeapEntry));
+    ASSERT(HeapEntry->Size == Index);
+
+    return HeapEntry;
+}
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment, ReleaseSubSegment = NULL;
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+
+    if (!RtlpLfhValidateEntry(Heap, HeapEntry))
+    {
+        DPRINT1("HEAP: Trying to free an invalid LFH address %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    SubSegment = RtlpLfhGetSubSegment(HeapEntry);
+    Slot = SubSegment->Slot;
+
+    RtlEnterHeapLock(Slot->Lock, TRUE);
+
+    HeapEntry->Flags = 0;
+    PushEntryList(&SubSegment->FreeList, (PSINGLE_LIST_ENTRY)(HeapEntry + 1));
+    SubSegment->FreeCount++;
+    Slot->Frees++;
+
+    /* The active subsegment is left alone, the others move between lists */
+    if (SubSegment != Slot->ActiveSubSegment)
+    {
+        if (SubSegment->FreeCount == SubSegment->BlockCount)
+        {
+            /* Completely free, give it back to the backend */
+            if (SubSegment->InPartialList)
+                RemoveEntryList(&SubSegment->ListEntry);
+            Slot->SubSegmentCount--;
+            ReleaseSubSegment = SubSegment;
+        }
+        else if (!SubSegment->InPartialList)
+        {
+            InsertTailList(&Slot->PartialList, &SubSegment->ListEntry);
+            SubSegment->InPartialList = TRUE;
+        }
+    }
+
+    RtlLeaveHeapLock(Slot->Lock);
+
+    if (ReleaseSubSegment)
+        RtlFreeHeap(Heap, 0, ReleaseSubSegment);
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size)
+{
+    PHEAP_ENTRY InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+    SIZE_T OldSize, AllocationSize;
+    PVOID NewBaseAddress;
+
+    if (!RtlpLfhValidateEntry(Heap, InUseEntry))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    OldSize = (InUseEntry->Size << HEAP_ENTRY_SHIFT) - InUseEntry->UnusedBytes;
+
+    AllocationSize = ((Size ? Size : 1) + Heap->AlignRound) & Heap->AlignMask;
+
+    /* Same size class and no extra stuff needed: just adjust the header */
+    if (!(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        (AllocationSize >> HEAP_ENTRY_SHIFT) == InUseEntry->Size)
+    {
+        if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+            RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+
+        InUseEntry->UnusedBytes = (UCHAR)(AllocationSize - Size);
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        return NULL;
+    }
+
+    /* Move it, preserving the settable user flags */
+    Flags &= ~HEAP_SETTABLE_USER_FLAGS;
+    Flags |= (InUseEntry->Flags & HEAP_ENTRY_SETTABLE_FLAGS) << 4;
+
+    NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewBaseAddress) return NULL;
+
+    RtlMoveMemory(NewBaseAddress, Ptr, min(Size, OldSize));
+
+    if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+        RtlZeroMemory((PCHAR)NewBaseAddress + OldSize, Size - OldSize);
+
+    RtlpLfhFree(Heap, InUseEntry);
+    return NewBaseAddress;
+}
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+
+    if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) return FALSE;
+    if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) return FALSE;
+    if (!RtlpIsLfhEntry(HeapEntry)) return FALSE;
+    if (HeapEntry->PreviousSize < (HEAP_LFH_SUBSEGMENT_HEADER_SIZE >> HEAP_ENTRY_SHIFT)) return FALSE;
+
+    SubSegment = RtlpLfhGetSubSegment(HeapEntry);
+    if (SubSegment->Heap != Heap) return FALSE;
+    if (SubSegment->BlockUnits != HeapEntry->Size) return FALSE;
+
+    /* The block must be one of the subsegment's slots */
+    return ((HeapEntry->PreviousSize - (HEAP_LFH_SUBSEGMENT_HEADER_SIZE >> HEAP_ENTRY_SHIFT)) %
+             SubSegment->BlockUnits) == 0;
+}
+
+/* EOF */
@@ -41,6 +41,7 @@ struct queue_timer
 {
     struct timer_queue *q;
     struct list entry;
+    ULONG heap_index;           /* position in the expiration heap, if armed */
     ULONG runcount;             /* number of callbacks pending execution */
     WAITORTIMERCALLBACKFUNC callback;
     PVOID param;
@@ -55,7 +56,10 @@ struct timer_queue
 {
     DWORD magic;
     RTL_CRITICAL_SECTION cs;
-    struct list timers;         /* sorted by expiration time */
+    struct list timers;         /* every timer of the queue, in no order */
+    struct queue_timer **heap;  /* armed timers, min-heap on expiration time */
+    ULONG heap_count;
+    ULONG heap_size;
     BOOL quit;                  /* queue should be deleted; once set, never unset */
     HANDLE event;
     HANDLE thread;
@@ -63,6 +67,92 @@ struct timer_queue
 
 #define EXPIRE_NEVER (~(ULONGLONG) 0)
 #define TIMER_QUEUE_MAGIC  0x516d6954   /* TimQ */
+#define HEAP_NOT_QUEUED    (~(ULONG) 0)
+#define HEAP_INITIAL_SIZE  16
+
+/* Upper bound of the callbacks dispatched for one wake of the timer thread */
+#define EXPIRE_BATCH       64
+
+static inline void heap_set(struct timer_queue *q, ULONG index, struct queue_timer *t)
+{
+    q->heap[index] = t;
+    t->heap_index = index;
+}
+
+static void heap_sift_up(struct timer_queue *q, ULONG index)
+{
+    struct queue_timer *t = q->heap[index];
+
+    while (index > 0)
+    {
+        ULONG parent = (index - 1) / 2;
+        if (q->heap[parent]->expire <= t->expire)
+            break;
+        heap_set(q, index, q->heap[parent]);
+        index = parent;
+    }
+    heap_set(q, index, t);
+}
+
+static void heap_sift_down(struct timer_queue *q, ULONG index)
+{
+    struct queue_timer *t = q->heap[index];
+
+    for (;;)
+    {
+        ULONG child = index * 2 + 1;
+        if (child >= q->heap_count)
+            break;
+        if (child + 1 < q->heap_count && q->heap[child + 1]->expire < q->heap[child]->expire)
+            child++;
+        if (t->expire <= q->heap[child]->expire)
+            break;
+        heap_set(q, index, q->heap[child]);
+        index = child;
+    }
+    heap_set(q, index, t);
+}
+
+static NTSTATUS heap_insert(struct timer_queue *q, struct queue_timer *t)
+{
+    if (q->heap_count == q->heap_size)
+    {
+        ULONG size = q->heap_size ? q->heap_size * 2 : HEAP_INITIAL_SIZE;
+        struct queue_timer **heap;
+
+        if (q->heap)
+            heap = RtlReAllocateHeap(RtlGetProcessHeap(), 0, q->heap, size * sizeof(*heap));
+        else
+            heap = RtlAllocateHeap(RtlGetProcessHeap(), 0, size * sizeof(*heap));
+        if (!heap)
+            return STATUS_NO_MEMORY;
+
+        q->heap = heap;
+        q->heap_size = size;
+    }
+
+    heap_set(q, q->heap_count++, t);
+    heap_sift_up(q, t->heap_index);
+    return STATUS_SUCCESS;
+}
+
+static void heap_remove(struct timer_queue *q, struct queue_timer *t)
+{
+    ULONG index = t->heap_index;
+    struct queue_timer *last;
+
+    t->heap_index = HEAP_NOT_QUEUED;
+    last = q->heap[--q->heap_count];
+    if (last == t)
+        return;
+
+    /* Fill the hole with the last timer and restore the order around it */
+    heap_set(q, index, last);
+    if (index > 0 && q->heap[(index - 1) / 2]->expire > last->expire)
+        heap_sift_up(q, index);
+    else
+        heap_sift_down(q, index);
+}
 
 static void queue_remove_timer(struct queue_timer *t)
 {
@@ -74,6 +164,8 @@ static void queue_remove_timer(struct queue_timer *t)
     assert(t->runcount == 0);
     assert(t->destroy);
 
+    if (t->heap_index != HEAP_NOT_QUEUED)
+        heap_remove(q, t);
     list_remove(&t->entry);
     if (t->event)
         NtSetEvent(t->event, NULL);
@@ -111,51 +203,91 @@ static inline ULONGLONG queue_current_time(void)
     return now.QuadPart * 1000 / freq.QuadPart;
 }
 
-static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
-                            BOOL set_event)
+static NTSTATUS queue_move_timer(struct queue_timer *t, ULONGLONG time,
+                                 BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
     struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
+    ULONGLONG old = t->expire;
+    NTSTATUS status = STATUS_SUCCESS;
 
     assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
 
-    if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
-        {
-            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
-            if (time < cur->expire)
-                break;
-        }
-    list_add_before(ptr, &t->entry);
-
     t->expire = time;
+    if (t->heap_index != HEAP_NOT_QUEUED)
+    {
+        /* Timers that will never expire don't need a place in the heap */
+        if (time == EXPIRE_NEVER)
+            heap_remove(q, t);
+        else if (time < old)
+            heap_sift_up(q, t->heap_index);
+        else
+            heap_sift_down(q, t->heap_index);
+    }
+    else if (time != EXPIRE_NEVER)
+    {
+        status = heap_insert(q, t);
+        if (status != STATUS_SUCCESS)
+            t->expire = EXPIRE_NEVER;
+    }
 
-    /* If we insert at the head of the list, we need to expire sooner
+    /* If we moved to the top of the heap, we need to expire sooner
        than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
+    if (set_event && t->heap_index == 0)
         NtSetEvent(q->event, NULL);
+
+    return status;
 }
 
-static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
-                                    BOOL set_event)
+static NTSTATUS queue_add_timer(struct queue_timer *t, ULONGLONG time,
+                                BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
-    list_remove(&t->entry);
-    queue_add_timer(t, time, set_event);
+    NTSTATUS status;
+
+    t->heap_index = HEAP_NOT_QUEUED;
+    t->expire = EXPIRE_NEVER;
+    status = queue_move_timer(t, time, set_event);
+    if (status == STATUS_SUCCESS)
+        list_add_tail(&t->q->timers, &t->entry);
+
+    return status;
+}
+
+static void queue_dispatch_timer(struct queue_timer *t)
+{
+    if (t->flags & WT_EXECUTEINTIMERTHREAD)
+        timer_callback_wrapper(t);
+    else
+    {
+        ULONG flags
+            = (t->flags
+               & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD
+                  | WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION));
+        NTSTATUS status = RtlQueueWorkItem(timer_callback_wrapper, t, flags);
+        if (status != STATUS_SUCCESS)
+            timer_cleanup_callback(t);
+    }
 }
 
 static void queue_timer_expire(struct timer_queue *q)
 {
-    struct queue_timer *t = NULL;
+    struct queue_timer *expired[EXPIRE_BATCH];
+    ULONG count = 0, i;
 
+    /* Collect everything that is due under one lock, dispatch outside of it */
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if (q->heap_count)
     {
-        ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        if (!t->destroy && t->expire <= ((now = queue_current_time())))
+        ULONGLONG now = queue_current_time(), next;
+
+        while (q->heap_count && count < EXPIRE_BATCH)
         {
+            struct queue_timer *t = q->heap[0];
+            assert(!t->destroy);
+            if (t->expire > now)
+                break;
+
             ++t->runcount;
             if (t->period)
             {
@@ -167,27 +299,13 @@ static void queue_timer_expire(struct timer_queue *q)
             else
                 next = EXPIRE_NEVER;
             queue_move_timer(t, next, FALSE);
+            expired[count++] = t;
         }
-        else
-            t = NULL;
     }
     RtlLeaveCriticalSection(&q->cs);
 
-    if (t)
-    {
-        if (t->flags & WT_EXECUTEINTIMERTHREAD)
-            timer_callback_wrapper(t);
-        else
-        {
-            ULONG flags
-                = (t->flags
-                   & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD
-                      | WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION));
-            NTSTATUS status = RtlQueueWorkItem(timer_callback_wrapper, t, flags);
-            if (status != STATUS_SUCCESS)
-                timer_cleanup_callback(t);
-        }
-    }
+    for (i = 0; i < count; i++)
+        queue_dispatch_timer(expired[i]);
 }
 
 static ULONG queue_get_timeout(struct timer_queue *q)
@@ -196,16 +314,12 @@ static ULONG queue_get_timeout(struct timer_queue *q)
     ULONG timeout = INFINITE;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if (q->heap_count)
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
-        assert(!t->destroy || t->expire == EXPIRE_NEVER);
-
-        if (t->expire != EXPIRE_NEVER)
-        {
-            ULONGLONG time = queue_current_time();
-            timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
-        }
+        ULONGLONG time = queue_current_time();
+        t = q->heap[0];
+        assert(!t->destroy && t->expire != EXPIRE_NEVER);
+        timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
     }
     RtlLeaveCriticalSection(&q->cs);
 
@@ -249,6 +363,8 @@ static DWORD WINAPI timer_queue_thread_proc(LPVOID p)
 
     NtClose(q->event);
     RtlDeleteCriticalSection(&q->cs);
+    if (q->heap)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, q->heap);
     q->magic = 0;
     RtlFreeHeap(RtlGetProcessHeap(), 0, q);
     RtlpExitThreadFunc(STATUS_SUCCESS);
@@ -265,8 +381,8 @@ static void queue_destroy_timer(struct queue_timer *t)
            cleanup wrapper.  */
         queue_remove_timer(t);
     else
-        /* Make sure no destroyed timer masks an active timer at the head
-           of the sorted list.  */
+        /* Make sure no destroyed timer masks an active timer at the top
+           of the heap.  */
         queue_move_timer(t, EXPIRE_NEVER, FALSE);
 }
 
@@ -291,6 +407,9 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
 
     RtlInitializeCriticalSection(&q->cs);
     list_init(&q->timers);
+    q->heap = NULL;
+    q->heap_count = 0;
+    q->heap_size = 0;
     q->quit = FALSE;
     q->magic = TIMER_QUEUE_MAGIC;
     status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
@@ -452,7 +571,7 @@ NTSTATUS WINAPI RtlCreateTimer(HANDLE TimerQueue, PHANDLE NewTimer,
     if (q->quit)
         status = STATUS_INVALID_HANDLE;
     else
-        queue_add_timer(t, queue_current_time() + DueTime, TRUE);
+        status = queue_add_timer(t, queue_current_time() + DueTime, TRUE);
     RtlLeaveCriticalSection(&q->cs);
 
     if (status == STATUS_SUCCESS)
@@ -26,6 +26,7 @@
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#include "pool.h"
 
 #if defined(_WIN32)
 #define GetSizeOfFile(handle) _GetSizeOfFile(handle)
@@ -337,6 +338,10 @@ CCabinet::CCabinet()
     BlockIsSplit = false;
     ScratchFile  = NULL;
 
+    CompressionPool  = NULL;
+    CompressionJobs  = 1;
+    CompressionLevel = Z_DEFAULT_COMPRESSION;
+
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
@@ -358,6 +363,11 @@ CCabinet::~CCabinet()
 
     if (CodecSelected)
         delete Codec;
+
+#ifndef CAB_READ_ONLY
+    if (CompressionPool)
+        delete CompressionPool;
+#endif
 }
 
 bool CCabinet::IsSeparator(char Char)
@@ -1484,6 +1494,9 @@ void CCabinet::SelectCodec(LONG Id)
 
         case CAB_CODEC_MSZIP:
             Codec = new CMSZipCodec();
+#ifndef CAB_READ_ONLY
+            ((CMSZipCodec*)Codec)->SetCompressionLevel(CompressionLevel);
+#endif
             break;
 
         default:
@@ -1601,8 +1614,15 @@ ULONG CCabinet::NewFolder()
  *     Status of operation
  */
 {
+    ULONG Status;
+
     DPRINT(MAX_TRACE, ("Creating new folder.\n"));
 
+    /* Blocks still being compressed belong to the previous folder */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     CurrentFolderNode = NewFolderNode();
     if (!CurrentFolderNode)
     {
@@ -1849,6 +1869,11 @@ ULONG CCabinet::WriteDisk(ULONG MoreDisks)
             }
         } while (CreateNewDisk);
     }
+
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     CommitDisk(MoreDisks);
 
     return CAB_STATUS_SUCCESS;
@@ -1988,6 +2013,12 @@ ULONG CCabinet::CloseCabinet()
 {
     ULONG Status;
 
+    if (CompressionPool)
+    {
+        delete CompressionPool;
+        CompressionPool = NULL;
+    }
+
     DestroyFileNodes();
 
     DestroyFolderNodes();
@@ -2262,6 +2293,49 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
     MaxDiskSize = Size;
 }
 
+
+void CCabinet::SetCompressionJobs(ULONG Jobs)
+/*
+ * FUNCTION: Sets the number of data blocks that are compressed in parallel
+ * ARGUMENTS:
+ *     Jobs = Number of worker threads (1 compresses on the calling thread)
+ * NOTES:
+ *     Blocks are only compressed in parallel if the disk size is unlimited
+ */
+{
+    if (Jobs < 1)
+        Jobs = 1;
+    else if (Jobs > CAB_MAX_JOBS)
+        Jobs = CAB_MAX_JOBS;
+
+    CompressionJobs = Jobs;
+}
+
+
+ULONG CCabinet::GetCompressionJobs()
+/*
+ * FUNCTION: Returns the number of data blocks that are compressed in parallel
+ * RETURNS:
+ *     Number of worker threads
+ */
+{
+    return CompressionJobs;
+}
+
+
+void CCabinet::SetCompressionLevel(LONG Level)
+/*
+ * FUNCTION: Sets the compression level for the MSZIP codec
+ * ARGUMENTS:
+ *     Level = Compression level (0-9), or Z_DEFAULT_COMPRESSION
+ */
+{
+    CompressionLevel = Level;
+
+    if (CodecSelected && CodecId == CAB_CODEC_MSZIP)
+        ((CMSZipCodec*)Codec)->SetCompressionLevel(Level);
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -3549,11 +3623,14 @@ ULONG CCabinet::WriteDataBlock()
  */
 {
     ULONG Status;
-    ULONG BytesWritten;
-    PCFDATA_NODE DataNode;
 
     if (!BlockIsSplit)
     {
+        /* Splitting disks needs the compressed size of each block right
+           away, so blocks are only compressed ahead without a size limit */
+        if (CompressionJobs > 1 && MaxDiskSize == 0)
+            return QueueDataBlock();
+
         Status = Codec->Compress(OutputBuffer,
             InputBuffer,
             CurrentIBufferSize,
@@ -3566,6 +3643,33 @@ ULONG CCabinet::WriteDataBlock()
         CurrentOBufferSize = TotalCompSize;
     }
 
+    Status = StoreDataBlock(CurrentIBufferSize);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    if (!BlockIsSplit)
+    {
+        CurrentIBufferSize = 0;
+        CurrentIBuffer     = InputBuffer;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::StoreDataBlock(ULONG UncompSize)
+/*
+ * FUNCTION: Writes the compressed data in the output buffer to the scratch file
+ * ARGUMENTS:
+ *     UncompSize = Number of uncompressed bytes in the data block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+    ULONG BytesWritten;
+    PCFDATA_NODE DataNode;
+
     DataNode = NewDataNode(CurrentFolderNode);
     if (!DataNode)
     {
@@ -3590,7 +3694,7 @@ ULONG CCabinet::WriteDataBlock()
     else
     {
         DataNode->Data.CompSize   = (USHORT)CurrentOBufferSize;
-        DataNode->Data.UncompSize = (USHORT)CurrentIBufferSize;
+        DataNode->Data.UncompSize = (USHORT)UncompSize;
     }
 
     DataNode->Data.Checksum = 0;
@@ -3619,10 +3723,115 @@ ULONG CCabinet::WriteDataBlock()
 
     LastBlockStart += DataNode->Data.UncompSize;
 
-    if (!BlockIsSplit)
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::QueueDataBlock()
+/*
+ * FUNCTION: Hands the current data block over to the compression workers
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCAB_COMPRESSION_JOB Job;
+    void* Buffer;
+    ULONG Status;
+
+    if (CompressionPool && CompressionPool->GetCodecId() != CodecId)
     {
-        CurrentIBufferSize = 0;
-        CurrentIBuffer     = InputBuffer;
+        Status = FlushDataBlocks();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+
+        delete CompressionPool;
+        CompressionPool = NULL;
+    }
+
+    if (!CompressionPool)
+    {
+        CompressionPool = new CCompressionPool;
+        if (!CompressionPool)
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        Status = CompressionPool->Create(CodecId, CompressionLevel, CompressionJobs);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            delete CompressionPool;
+            CompressionPool = NULL;
+            return Status;
+        }
+    }
+
+    /* Blocks are stored in the order they were queued */
+    if (CompressionPool->IsFull())
+    {
+        Status = StoreCompressedBlock(CompressionPool->GetCompletedJob());
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    /* Give the input buffer to the job and continue reading into its old one */
+    Job = CompressionPool->GetFreeJob();
+    Buffer = Job->InputBuffer;
+    Job->InputBuffer = InputBuffer;
+    Job->InputLength = CurrentIBufferSize;
+    CompressionPool->QueueJob(Job);
+
+    InputBuffer        = Buffer;
+    CurrentIBuffer     = InputBuffer;
+    CurrentIBufferSize = 0;
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::StoreCompressedBlock(PCAB_COMPRESSION_JOB Job)
+/*
+ * FUNCTION: Writes a block compressed by a worker to the scratch file
+ * ARGUMENTS:
+ *     Job = Pointer to the completed job
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    if (Job->Status != CS_SUCCESS)
+    {
+        DPRINT(MIN_TRACE, ("Cannot compress data block (%u).\n", (UINT)Job->Status));
+        return (Job->Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+    }
+
+    DPRINT(MAX_TRACE, ("Block compressed. InputLength (%u)  OutputLength(%u).\n",
+        (UINT)Job->InputLength, (UINT)Job->OutputLength));
+
+    CurrentOBuffer     = Job->OutputBuffer;
+    CurrentOBufferSize = Job->OutputLength;
+
+    return StoreDataBlock(Job->InputLength);
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Writes all blocks queued to the compression workers to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCAB_COMPRESSION_JOB Job;
+    ULONG Status;
+
+    if (!CompressionPool)
+        return CAB_STATUS_SUCCESS;
+
+    while ((Job = CompressionPool->GetCompletedJob()) != NULL)
+    {
+        Status = StoreCompressedBlock(Job);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
     }
 
     return CAB_STATUS_SUCCESS;
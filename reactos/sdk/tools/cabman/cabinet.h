@@ -293,6 +293,9 @@ public:
 
 #ifndef CAB_READ_ONLY
 
+class CCompressionPool;
+struct _CAB_COMPRESSION_JOB;
+
 class CCFDATAStorage
 {
 public:
@@ -392,6 +395,12 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of data blocks that are compressed in parallel */
+    void SetCompressionJobs(ULONG Jobs);
+    /* Returns the number of data blocks that are compressed in parallel */
+    ULONG GetCompressionJobs();
+    /* Sets the compression level for the MSZIP codec */
+    void SetCompressionLevel(LONG Level);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -435,6 +444,10 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG StoreDataBlock(ULONG UncompSize);
+    ULONG QueueDataBlock();
+    ULONG StoreCompressedBlock(struct _CAB_COMPRESSION_JOB* Job);
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILEHANDLE FileHandle, PCFFILE_NODE File);
@@ -500,6 +513,10 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+
+    CCompressionPool *CompressionPool;  // Workers compressing data blocks in parallel
+    ULONG CompressionJobs;      // Number of data blocks compressed in parallel
+    LONG CompressionLevel;      // Compression level for the MSZIP codec
 #endif /* CAB_READ_ONLY */
 };
 
@@ -14,6 +14,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#if !defined(_WIN32)
+#include <sys/time.h>
+#endif
 #include "cabman.h"
 
 
@@ -26,6 +29,22 @@ ULONG DebugTraceLevel = MIN_TRACE;
 #endif /* DBG */
 
 
+ULONG GetMilliseconds()
+/*
+ * FUNCTION: Returns a millisecond tick count for timing operations
+ */
+{
+#if defined(_WIN32)
+    return GetTickCount();
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (ULONG)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+
 char* Pad(char* Str, char PadChar, ULONG Length)
 /*
  * FUNCTION: Pads a string with a character to make a given length
@@ -192,8 +211,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [...]\n");
+    printf("CABMAN [-M mode] [-J jobs] [-Z level] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-J jobs] [-Z level] -S cabinet filename [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -207,6 +226,8 @@ void CCABManager::Usage()
     printf("  -D        Display cabinet directory.\n");
     printf("  -E        Extract files from cabinet.\n");
     printf("  -I        Don't create the cabinet, only the .inf file.\n");
+    printf("  -J jobs   Number of data blocks to compress in parallel\n");
+    printf("            (default is 1).\n");
     printf("  -L dir    Location to place extracted or generated files\n");
     printf("            (default is current directory).\n");
     printf("  -M mode   Specify the compression method to use:\n");
@@ -218,6 +239,8 @@ void CCABManager::Usage()
     printf("  -S        Create simple cabinet.\n");
     printf("  -P dir    Files in the .dff are relative to this directory.\n");
     printf("  -V        Verbose mode (prints more messages).\n");
+    printf("  -Z level  MsZip compression level, from 1 (fastest)\n");
+    printf("            to 9 (smallest).\n");
 }
 
 bool CCABManager::ParseCmdline(int argc, char* argv[])
@@ -231,6 +254,7 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
  */
 {
     int i;
+    int Value;
     bool ShowUsage;
     bool FoundCabinet = false;
 
@@ -267,6 +291,24 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     InfFileOnly = true;
                     break;
 
+                case 'j':
+                case 'J':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        Value = (i < argc) ? atoi(&argv[i][0]) : 0;
+                    }
+                    else
+                        Value = atoi(&argv[i][2]);
+
+                    if (Value < 1)
+                    {
+                        printf("ERROR: Invalid number of jobs specified!\n");
+                        return false;
+                    }
+                    SetCompressionJobs((ULONG)Value);
+                    break;
+
                 case 'l':
                 case 'L':
                     if (argv[i][2] == 0)
@@ -351,6 +393,23 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     Verbose = true;
                     break;
 
+                case 'Z':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        Value = (i < argc) ? atoi(&argv[i][0]) : 0;
+                    }
+                    else
+                        Value = atoi(&argv[i][2]);
+
+                    if (Value < 1 || Value > 9)
+                    {
+                        printf("ERROR: Invalid compression level specified!\n");
+                        return false;
+                    }
+                    SetCompressionLevel(Value);
+                    break;
+
                 default:
                     printf("ERROR: Bad parameter %s.\n", argv[i]);
                     return false;
@@ -560,6 +619,9 @@ bool CCABManager::Run()
  * FUNCTION: Process cabinet
  */
 {
+    bool Result;
+    ULONG StartTime;
+
     if (Verbose)
     {
         printf("ReactOS Cabinet Manager\n\n");
@@ -568,7 +630,23 @@ bool CCABManager::Run()
     switch (Mode)
     {
         case CM_MODE_CREATE:
-            return CreateCabinet();
+        case CM_MODE_CREATE_SIMPLE:
+            StartTime = GetMilliseconds();
+
+            if (Mode == CM_MODE_CREATE)
+                Result = CreateCabinet();
+            else
+                Result = CreateSimpleCabinet();
+
+            if (Result && Verbose)
+            {
+                ULONG Elapsed = GetMilliseconds() - StartTime;
+
+                printf("Cabinet created in %u.%03u seconds (%u job(s)).\n",
+                    (UINT)(Elapsed / 1000), (UINT)(Elapsed % 1000),
+                    (UINT)GetCompressionJobs());
+            }
+            return Result;
 
         case CM_MODE_DISPLAY:
             return DisplayCabinet();
@@ -576,9 +654,6 @@ bool CCABManager::Run()
         case CM_MODE_EXTRACT:
             return ExtractFromCabinet();
 
-        case CM_MODE_CREATE_SIMPLE:
-            return CreateSimpleCabinet();
-
         default:
             break;
     }
@@ -38,9 +38,19 @@ CMSZipCodec::CMSZipCodec()
  * FUNCTION: Default constructor
  */
 {
-    ZStream.zalloc = MSZipAlloc;
-    ZStream.zfree  = MSZipFree;
-    ZStream.opaque = (voidpf)0;
+    DeflateStream.zalloc = MSZipAlloc;
+    DeflateStream.zfree  = MSZipFree;
+    DeflateStream.opaque = (voidpf)0;
+
+    InflateStream.zalloc = MSZipAlloc;
+    InflateStream.zfree  = MSZipFree;
+    InflateStream.opaque = (voidpf)0;
+    InflateStream.next_in  = Z_NULL;
+    InflateStream.avail_in = 0;
+
+    CompressionLevel   = Z_DEFAULT_COMPRESSION;
+    DeflateInitialized = false;
+    InflateInitialized = false;
 }
 
 
@@ -49,6 +59,32 @@ CMSZipCodec::~CMSZipCodec()
  * FUNCTION: Default destructor
  */
 {
+    if (DeflateInitialized)
+        deflateEnd(&DeflateStream);
+
+    if (InflateInitialized)
+        inflateEnd(&InflateStream);
+}
+
+
+void CMSZipCodec::SetCompressionLevel(LONG Level)
+/*
+ * FUNCTION: Sets the zlib compression level
+ * ARGUMENTS:
+ *     Level = Compression level (0-9), or Z_DEFAULT_COMPRESSION
+ */
+{
+    if (Level == CompressionLevel)
+        return;
+
+    /* The stream is initialized again with the new level on next use */
+    if (DeflateInitialized)
+    {
+        deflateEnd(&DeflateStream);
+        DeflateInitialized = false;
+    }
+
+    CompressionLevel = Level;
 }
 
 
@@ -72,42 +108,50 @@ ULONG CMSZipCodec::Compress(void* OutputBuffer,
     Magic  = (PUSHORT)OutputBuffer;
     *Magic = MSZIP_MAGIC;
 
-    ZStream.next_in   = (unsigned char*)InputBuffer;
-    ZStream.avail_in  = InputLength;
-    ZStream.next_out  = (unsigned char*)((unsigned long)OutputBuffer + 2);
-    ZStream.avail_out = CAB_BLOCKSIZE + 12;
-
-    /* WindowBits is passed < 0 to tell that there is no zlib header */
-    Status = deflateInit2(&ZStream,
-                          Z_DEFAULT_COMPRESSION,
-                          Z_DEFLATED,
-                          -MAX_WBITS,
-                          8, /* memLevel */
-                          Z_DEFAULT_STRATEGY);
-    if (Status != Z_OK)
+    /* Every block is a separate deflate stream. Set up the compressor
+       state once and only reset it for the following blocks. */
+    if (DeflateInitialized)
     {
-        DPRINT(MIN_TRACE, ("deflateInit() returned (%d).\n", Status));
-        return CS_NOMEMORY;
+        Status = deflateReset(&DeflateStream);
+        if (Status != Z_OK)
+        {
+            DPRINT(MIN_TRACE, ("deflateReset() returned (%d).\n", Status));
+            return CS_BADSTREAM;
+        }
     }
-
-    Status = deflate(&ZStream, Z_FINISH);
-    if ((Status != Z_OK) && (Status != Z_STREAM_END))
+    else
     {
-        DPRINT(MIN_TRACE, ("deflate() returned (%d) (%s).\n", Status, ZStream.msg));
-        if (Status == Z_MEM_ERROR)
+        /* WindowBits is passed < 0 to tell that there is no zlib header */
+        Status = deflateInit2(&DeflateStream,
+                              CompressionLevel,
+                              Z_DEFLATED,
+                              -MAX_WBITS,
+                              8, /* memLevel */
+                              Z_DEFAULT_STRATEGY);
+        if (Status != Z_OK)
+        {
+            DPRINT(MIN_TRACE, ("deflateInit() returned (%d).\n", Status));
             return CS_NOMEMORY;
-        return CS_BADSTREAM;
+        }
+        DeflateInitialized = true;
     }
 
-    *OutputLength = ZStream.total_out + 2;
+    DeflateStream.next_in   = (unsigned char*)InputBuffer;
+    DeflateStream.avail_in  = InputLength;
+    DeflateStream.next_out  = (unsigned char*)((unsigned long)OutputBuffer + 2);
+    DeflateStream.avail_out = CAB_BLOCKSIZE + 12;
 
-    Status = deflateEnd(&ZStream);
-    if (Status != Z_OK)
+    Status = deflate(&DeflateStream, Z_FINISH);
+    if ((Status != Z_OK) && (Status != Z_STREAM_END))
     {
-        DPRINT(MIN_TRACE, ("deflateEnd() returned (%d).\n", Status));
+        DPRINT(MIN_TRACE, ("deflate() returned (%d) (%s).\n", Status, DeflateStream.msg));
+        if (Status == Z_MEM_ERROR)
+            return CS_NOMEMORY;
         return CS_BADSTREAM;
     }
 
+    *OutputLength = DeflateStream.total_out + 2;
+
     return CS_SUCCESS;
 }
 
@@ -137,45 +181,52 @@ ULONG CMSZipCodec::Uncompress(void* OutputBuffer,
         return CS_BADSTREAM;
     }
 
-    ZStream.next_in   = (unsigned char*)((unsigned long)InputBuffer + 2);
-    ZStream.avail_in  = InputLength - 2;
-    ZStream.next_out  = (unsigned char*)OutputBuffer;
-    ZStream.avail_out = CAB_BLOCKSIZE + 12;
-
-    /* WindowBits is passed < 0 to tell that there is no zlib header.
-     * Note that in this case inflate *requires* an extra "dummy" byte
-     * after the compressed stream in order to complete decompression and
-     * return Z_STREAM_END.
-     */
-    Status = inflateInit2(&ZStream, -MAX_WBITS);
-    if (Status != Z_OK)
+    if (InflateInitialized)
     {
-        DPRINT(MIN_TRACE, ("inflateInit2() returned (%d).\n", Status));
-        return CS_BADSTREAM;
+        Status = inflateReset(&InflateStream);
+        if (Status != Z_OK)
+        {
+            DPRINT(MIN_TRACE, ("inflateReset() returned (%d).\n", Status));
+            return CS_BADSTREAM;
+        }
     }
+    else
+    {
+        /* WindowBits is passed < 0 to tell that there is no zlib header.
+         * Note that in this case inflate *requires* an extra "dummy" byte
+         * after the compressed stream in order to complete decompression and
+         * return Z_STREAM_END.
+         */
+        Status = inflateInit2(&InflateStream, -MAX_WBITS);
+        if (Status != Z_OK)
+        {
+            DPRINT(MIN_TRACE, ("inflateInit2() returned (%d).\n", Status));
+            return CS_BADSTREAM;
+        }
+        InflateInitialized = true;
+    }
+
+    InflateStream.next_in   = (unsigned char*)((unsigned long)InputBuffer + 2);
+    InflateStream.avail_in  = InputLength - 2;
+    InflateStream.next_out  = (unsigned char*)OutputBuffer;
+    InflateStream.avail_out = CAB_BLOCKSIZE + 12;
 
-    while ((ZStream.total_out < CAB_BLOCKSIZE + 12) &&
-        (ZStream.total_in < InputLength - 2))
+    while ((InflateStream.total_out < CAB_BLOCKSIZE + 12) &&
+        (InflateStream.total_in < InputLength - 2))
     {
-        Status = inflate(&ZStream, Z_NO_FLUSH);
+        Status = inflate(&InflateStream, Z_NO_FLUSH);
         if (Status == Z_STREAM_END) break;
         if (Status != Z_OK)
         {
-            DPRINT(MIN_TRACE, ("inflate() returned (%d) (%s).\n", Status, ZStream.msg));
+            DPRINT(MIN_TRACE, ("inflate() returned (%d) (%s).\n", Status, InflateStream.msg));
             if (Status == Z_MEM_ERROR)
                 return CS_NOMEMORY;
             return CS_BADSTREAM;
         }
     }
 
-    *OutputLength = ZStream.total_out;
+    *OutputLength = InflateStream.total_out;
 
-    Status = inflateEnd(&ZStream);
-    if (Status != Z_OK)
-    {
-        DPRINT(MIN_TRACE, ("inflateEnd() returned (%d).\n", Status));
-        return CS_BADSTREAM;
-    }
     return CS_SUCCESS;
 }
 
@@ -32,9 +32,15 @@ public:
                              void* InputBuffer,
                              ULONG InputLength,
                              PULONG OutputLength);
+    /* Sets the zlib compression level */
+    void SetCompressionLevel(LONG Level);
 private:
     int Status;
-    z_stream ZStream; /* Zlib stream */
+    LONG CompressionLevel;
+    bool DeflateInitialized;
+    bool InflateInitialized;
+    z_stream DeflateStream; /* Zlib stream used for compression */
+    z_stream InflateStream; /* Zlib stream used for decompression */
 };
 
 /* EOF */
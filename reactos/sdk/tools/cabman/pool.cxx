@@ -0,0 +1,331 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/pool.cxx
+ * PURPOSE:     Worker threads for compressing data blocks
+ * NOTES:       Every worker thread owns one job and its own codec. Jobs
+ *              are queued and completed in round-robin order, so the
+ *              caller gets the compressed blocks back in the order they
+ *              were read.
+ */
+#include "pool.h"
+#include "raw.h"
+#include "mszip.h"
+
+
+/* Events */
+
+static bool InitializeCabEvent(PCAB_EVENT Event)
+{
+#if defined(_WIN32)
+    Event->Handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    return (Event->Handle != NULL);
+#else
+    Event->Signaled = false;
+    if (pthread_mutex_init(&Event->Mutex, NULL) != 0)
+        return false;
+    if (pthread_cond_init(&Event->Condition, NULL) != 0)
+    {
+        pthread_mutex_destroy(&Event->Mutex);
+        return false;
+    }
+    return true;
+#endif
+}
+
+static void DeleteCabEvent(PCAB_EVENT Event)
+{
+#if defined(_WIN32)
+    CloseHandle(Event->Handle);
+#else
+    pthread_cond_destroy(&Event->Condition);
+    pthread_mutex_destroy(&Event->Mutex);
+#endif
+}
+
+static void SignalCabEvent(PCAB_EVENT Event)
+{
+#if defined(_WIN32)
+    SetEvent(Event->Handle);
+#else
+    pthread_mutex_lock(&Event->Mutex);
+    Event->Signaled = true;
+    pthread_cond_signal(&Event->Condition);
+    pthread_mutex_unlock(&Event->Mutex);
+#endif
+}
+
+static void WaitForCabEvent(PCAB_EVENT Event)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(Event->Handle, INFINITE);
+#else
+    pthread_mutex_lock(&Event->Mutex);
+    while (!Event->Signaled)
+        pthread_cond_wait(&Event->Condition, &Event->Mutex);
+    Event->Signaled = false;
+    pthread_mutex_unlock(&Event->Mutex);
+#endif
+}
+
+
+/* Worker thread */
+
+#if defined(_WIN32)
+static DWORD WINAPI CompressionWorker(LPVOID Context)
+#else
+static void* CompressionWorker(void* Context)
+#endif
+/*
+ * FUNCTION: Compresses the blocks queued to a job until told to exit
+ * ARGUMENTS:
+ *     Context = Pointer to the job owned by this thread
+ */
+{
+    PCAB_COMPRESSION_JOB Job = (PCAB_COMPRESSION_JOB)Context;
+
+    for (;;)
+    {
+        WaitForCabEvent(&Job->StartEvent);
+        if (Job->Terminate)
+            break;
+
+        Job->Status = Job->Codec->Compress(Job->OutputBuffer,
+                                           Job->InputBuffer,
+                                           Job->InputLength,
+                                           &Job->OutputLength);
+
+        SignalCabEvent(&Job->DoneEvent);
+    }
+
+    return 0;
+}
+
+
+/* CCompressionPool */
+
+CCompressionPool::CCompressionPool()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    Jobs         = NULL;
+    JobCount     = 0;
+    StartedCount = 0;
+    OldestJob    = 0;
+    PendingCount = 0;
+    CodecId      = -1;
+}
+
+
+CCompressionPool::~CCompressionPool()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    Destroy();
+}
+
+
+ULONG CCompressionPool::Create(LONG CodecId, LONG CompressionLevel, ULONG JobCount)
+/*
+ * FUNCTION: Starts the worker threads
+ * ARGUMENTS:
+ *     CodecId          = Codec identifier of the codec the workers use
+ *     CompressionLevel = Compression level for the MSZIP codec
+ *     JobCount         = Number of worker threads
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCAB_COMPRESSION_JOB Job;
+    CMSZipCodec* MSZipCodec;
+    ULONG i;
+
+    ASSERT(Jobs == NULL);
+
+    if (JobCount == 0)
+        JobCount = 1;
+    else if (JobCount > CAB_MAX_JOBS)
+        JobCount = CAB_MAX_JOBS;
+
+    Jobs = (PCAB_COMPRESSION_JOB)AllocateMemory(JobCount * sizeof(CAB_COMPRESSION_JOB));
+    if (!Jobs)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+    memset(Jobs, 0, JobCount * sizeof(CAB_COMPRESSION_JOB));
+
+    this->CodecId = CodecId;
+    this->JobCount = JobCount;
+    StartedCount = 0;
+    OldestJob    = 0;
+    PendingCount = 0;
+
+    for (i = 0; i < JobCount; i++)
+    {
+        Job = &Jobs[i];
+
+        Job->InputBuffer  = AllocateMemory(CAB_BLOCKSIZE + 12);
+        Job->OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12);
+        if ((!Job->InputBuffer) || (!Job->OutputBuffer))
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            Destroy();
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        switch (CodecId)
+        {
+            case CAB_CODEC_RAW:
+                Job->Codec = new CRawCodec();
+                break;
+
+            case CAB_CODEC_MSZIP:
+                MSZipCodec = new CMSZipCodec();
+                MSZipCodec->SetCompressionLevel(CompressionLevel);
+                Job->Codec = MSZipCodec;
+                break;
+
+            default:
+                Destroy();
+                return CAB_STATUS_UNSUPPCOMP;
+        }
+
+        if (!InitializeCabEvent(&Job->StartEvent))
+        {
+            Destroy();
+            return CAB_STATUS_FAILURE;
+        }
+
+        if (!InitializeCabEvent(&Job->DoneEvent))
+        {
+            DeleteCabEvent(&Job->StartEvent);
+            Destroy();
+            return CAB_STATUS_FAILURE;
+        }
+
+#if defined(_WIN32)
+        Job->Thread = CreateThread(NULL, 0, CompressionWorker, Job, 0, NULL);
+        if (Job->Thread == NULL)
+#else
+        if (pthread_create(&Job->Thread, NULL, CompressionWorker, Job) != 0)
+#endif
+        {
+            DPRINT(MIN_TRACE, ("Cannot create worker thread.\n"));
+            DeleteCabEvent(&Job->DoneEvent);
+            DeleteCabEvent(&Job->StartEvent);
+            Destroy();
+            return CAB_STATUS_FAILURE;
+        }
+
+        StartedCount++;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCompressionPool::Destroy()
+/*
+ * FUNCTION: Stops the worker threads and frees the jobs
+ */
+{
+    PCAB_COMPRESSION_JOB Job;
+    ULONG i;
+
+    if (!Jobs)
+        return;
+
+    /* A worker that is still busy sees the request after finishing its block */
+    for (i = 0; i < StartedCount; i++)
+    {
+        Job = &Jobs[i];
+        Job->Terminate = true;
+        SignalCabEvent(&Job->StartEvent);
+    }
+
+    for (i = 0; i < StartedCount; i++)
+    {
+        Job = &Jobs[i];
+#if defined(_WIN32)
+        WaitForSingleObject(Job->Thread, INFINITE);
+        CloseHandle(Job->Thread);
+#else
+        pthread_join(Job->Thread, NULL);
+#endif
+        DeleteCabEvent(&Job->DoneEvent);
+        DeleteCabEvent(&Job->StartEvent);
+    }
+
+    for (i = 0; i < JobCount; i++)
+    {
+        Job = &Jobs[i];
+        if (Job->Codec)
+            delete Job->Codec;
+        if (Job->InputBuffer)
+            FreeMemory(Job->InputBuffer);
+        if (Job->OutputBuffer)
+            FreeMemory(Job->OutputBuffer);
+    }
+
+    FreeMemory(Jobs);
+    Jobs         = NULL;
+    JobCount     = 0;
+    StartedCount = 0;
+    OldestJob    = 0;
+    PendingCount = 0;
+}
+
+
+PCAB_COMPRESSION_JOB CCompressionPool::GetFreeJob()
+/*
+ * FUNCTION: Returns the job to fill and queue next
+ * RETURNS:
+ *     Pointer to job. The caller must complete a job first if the pool is full
+ */
+{
+    ASSERT(PendingCount < JobCount);
+
+    return &Jobs[(OldestJob + PendingCount) % JobCount];
+}
+
+
+void CCompressionPool::QueueJob(PCAB_COMPRESSION_JOB Job)
+/*
+ * FUNCTION: Hands a job over to its worker thread
+ * ARGUMENTS:
+ *     Job = Pointer to job returned by GetFreeJob
+ */
+{
+    ASSERT(Job == GetFreeJob());
+
+    PendingCount++;
+    SignalCabEvent(&Job->StartEvent);
+}
+
+
+PCAB_COMPRESSION_JOB CCompressionPool::GetCompletedJob()
+/*
+ * FUNCTION: Waits for the oldest queued job to complete
+ * RETURNS:
+ *     Pointer to job, or NULL if no job is queued. The compressed data
+ *     stays valid until the job is queued again
+ */
+{
+    PCAB_COMPRESSION_JOB Job;
+
+    if (PendingCount == 0)
+        return NULL;
+
+    Job = &Jobs[OldestJob];
+    WaitForCabEvent(&Job->DoneEvent);
+
+    OldestJob = (OldestJob + 1) % JobCount;
+    PendingCount--;
+
+    return Job;
+}
+
+/* EOF */
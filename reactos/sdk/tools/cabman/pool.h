@@ -0,0 +1,84 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/pool.h
+ * PURPOSE:     Worker threads for compressing data blocks
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#define CAB_MAX_JOBS 64
+
+
+/* Structures */
+
+typedef struct _CAB_EVENT
+{
+#if defined(_WIN32)
+    HANDLE Handle;
+#else
+    pthread_mutex_t Mutex;
+    pthread_cond_t Condition;
+    bool Signaled;
+#endif
+} CAB_EVENT, *PCAB_EVENT;
+
+typedef struct _CAB_COMPRESSION_JOB
+{
+    void* InputBuffer;          // Uncompressed data, owned by the job while queued
+    ULONG InputLength;          // Number of bytes in InputBuffer
+    void* OutputBuffer;         // Compressed data
+    ULONG OutputLength;         // Number of bytes in OutputBuffer
+    ULONG Status;               // Codec status code (CS_*)
+    /* Private to the pool */
+    CCABCodec* Codec;           // Codec used by the worker thread
+    CAB_EVENT StartEvent;       // Signaled when the job is queued
+    CAB_EVENT DoneEvent;        // Signaled when the job is completed
+    bool Terminate;             // true if the worker thread should exit
+#if defined(_WIN32)
+    HANDLE Thread;
+#else
+    pthread_t Thread;
+#endif
+} CAB_COMPRESSION_JOB, *PCAB_COMPRESSION_JOB;
+
+
+/* Classes */
+
+class CCompressionPool
+{
+public:
+    /* Default constructor */
+    CCompressionPool();
+    /* Default destructor */
+    virtual ~CCompressionPool();
+    /* Starts the worker threads */
+    ULONG Create(LONG CodecId, LONG CompressionLevel, ULONG JobCount);
+    /* Stops the worker threads */
+    void Destroy();
+    /* Returns the codec the workers use */
+    LONG GetCodecId() { return CodecId; }
+    /* Returns true if no job can be queued before one is completed */
+    bool IsFull() { return PendingCount == JobCount; }
+    /* Returns the job to fill and queue next */
+    PCAB_COMPRESSION_JOB GetFreeJob();
+    /* Hands a job returned by GetFreeJob over to its worker thread */
+    void QueueJob(PCAB_COMPRESSION_JOB Job);
+    /* Waits for the oldest queued job, returns NULL if there is none */
+    PCAB_COMPRESSION_JOB GetCompletedJob();
+private:
+    PCAB_COMPRESSION_JOB Jobs;
+    ULONG JobCount;
+    ULONG StartedCount;
+    ULONG OldestJob;            // Index of the oldest queued job
+    ULONG PendingCount;         // Number of queued jobs
+    LONG CodecId;
+};
+
+/* EOF */
@@ -53,6 +53,14 @@ ExportBinaryHive(
     CmHive->FileHandles[HFILE_TYPE_PRIMARY] = (HANDLE)File;
     ret = HvWriteHive(&CmHive->Hive);
     fclose(File);
+
+    if (ret)
+    {
+        printf("    %u blocks in %u writes\n",
+               (unsigned int)CmHive->Hive.FlushBlocks,
+               (unsigned int)CmHive->Hive.FlushWrites);
+    }
+
     return ret;
 }
 
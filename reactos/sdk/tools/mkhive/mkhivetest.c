@@ -0,0 +1,145 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS hive maker
+ * FILE:            tools/mkhive/mkhivetest.c
+ * PURPOSE:         Checks that saving a hive coalesces adjacent blocks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mkhive.h"
+
+/* Enough small keys for the hive to span a few hundred one-block bins */
+#define TEST_KEY_COUNT      4000
+#define TEST_VALUE_SIZE     200
+
+static PFILE_WRITE_ROUTINE BackendFileWrite;
+static ULONG BackendWrites;
+static int Failures;
+
+#define check(cond, msg) \
+    do { if (!(cond)) { printf("    FAILED: %s\n", msg); Failures++; } } while (0)
+
+/* Counts the calls that reach the CmpFileWrite backend of mkhive */
+static BOOLEAN
+NTAPI
+CountingFileWrite(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    IN PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    BackendWrites++;
+    return BackendFileWrite(RegistryHive, FileType, FileOffset, Buffer, BufferLength);
+}
+
+static BOOL
+FillHive(VOID)
+{
+    static const WCHAR Prefix[] = L"\\Registry\\Machine\\SYSTEM\\MkhiveTest\\Key";
+    WCHAR KeyName[sizeof(Prefix) / sizeof(WCHAR) + 8];
+    UCHAR Data[TEST_VALUE_SIZE];
+    HKEY Key;
+    ULONG i, Length;
+
+    Length = sizeof(Prefix) / sizeof(WCHAR) - 1;
+    memcpy(KeyName, Prefix, sizeof(Prefix));
+    memset(Data, 0x5A, sizeof(Data));
+
+    for (i = 0; i < TEST_KEY_COUNT; i++)
+    {
+        KeyName[Length + 0] = L'0' + (WCHAR)((i / 1000) % 10);
+        KeyName[Length + 1] = L'0' + (WCHAR)((i / 100) % 10);
+        KeyName[Length + 2] = L'0' + (WCHAR)((i / 10) % 10);
+        KeyName[Length + 3] = L'0' + (WCHAR)(i % 10);
+        KeyName[Length + 4] = UNICODE_NULL;
+
+        if (RegCreateKeyW(NULL, KeyName, &Key) != ERROR_SUCCESS)
+            return FALSE;
+
+        Data[0] = (UCHAR)i;
+        if (RegSetValueExW(Key, L"Data", 0, REG_BINARY, Data, sizeof(Data)) != ERROR_SUCCESS)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* The file must hold the base block followed by every block of the hive */
+static VOID
+CheckHiveFile(
+    IN PCSTR FileName,
+    IN PHHIVE Hive)
+{
+    UCHAR Block[HBLOCK_SIZE];
+    FILE *File;
+    ULONG i;
+    long Size;
+
+    File = fopen(FileName, "rb");
+    check(File != NULL, "cannot open the saved hive");
+    if (File == NULL)
+        return;
+
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    check(Size == (long)(Hive->Storage[Stable].Length + 1) * HBLOCK_SIZE,
+          "the saved hive has the wrong size");
+
+    fseek(File, HBLOCK_SIZE, SEEK_SET);
+    for (i = 0; i < Hive->Storage[Stable].Length; i++)
+    {
+        if (fread(Block, 1, HBLOCK_SIZE, File) != HBLOCK_SIZE ||
+            memcmp(Block, (PVOID)Hive->Storage[Stable].BlockList[i].BlockAddress, HBLOCK_SIZE) != 0)
+        {
+            printf("    FAILED: block %u differs from the hive in memory\n", (unsigned int)i);
+            Failures++;
+            break;
+        }
+    }
+
+    fclose(File);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *FileName = (argc > 1) ? argv[1] : "mkhivetest.hiv";
+    PHHIVE Hive = &SystemHive.Hive;
+    ULONG Blocks;
+
+    printf("Hive write test\n");
+
+    RegInitializeRegistry();
+    check(FillHive(), "cannot fill the hive");
+
+    BackendFileWrite = Hive->FileWrite;
+    Hive->FileWrite = CountingFileWrite;
+    Hive->FlushBlocks = 0;
+    Hive->FlushWrites = 0;
+
+    check(ExportBinaryHive(FileName, &SystemHive), "cannot save the hive");
+    Blocks = Hive->Storage[Stable].Length;
+
+    printf("  %u blocks, %u block writes, %u writes to the backend\n",
+           (unsigned int)Blocks, (unsigned int)Hive->FlushWrites, (unsigned int)BackendWrites);
+
+    /* Every block was written, plus the base block before and after */
+    check(Hive->FlushBlocks == Blocks, "not every block was written");
+    check(BackendWrites == Hive->FlushWrites + 2, "the statistics miss backend writes");
+
+    /* One write per block before the blocks were coalesced */
+    check(Blocks > 64, "the hive is too small for the test");
+    check(Hive->FlushWrites < Blocks / 8, "adjacent blocks were not coalesced");
+
+    CheckHiveFile(FileName, Hive);
+    remove(FileName);
+
+    RegShutdownRegistry();
+
+    printf(Failures ? "  %d failures\n" : "  Passed.\n", Failures);
+    return Failures ? 1 : 0;
+}
+
+/* EOF */
@@ -348,6 +348,139 @@ CreateInMemoryStructure(
 
 LIST_ENTRY CmiReparsePointsHead;
 
+/*
+ * Reparse points are looked up for every path component that gets opened,
+ * so besides the global list they are also hashed on their source key.
+ */
+#define REPARSE_POINT_HASH_SIZE 16
+#define REPARSE_POINT_HASH(Hive, Cell) \
+    ((((ULONG_PTR)(Hive) >> 4) ^ (ULONG_PTR)(Cell)) % REPARSE_POINT_HASH_SIZE)
+
+static LIST_ENTRY ReparsePointHashTable[REPARSE_POINT_HASH_SIZE];
+
+/*
+ * The INF files add values to keys in long runs sharing the same path, so
+ * remember the key cells opened for the components of the last path that
+ * was resolved from the root and restart the next lookup from the deepest
+ * common ancestor. Keys are never moved or deleted from the hives while
+ * mkhive runs, only new reparse points may change the resolved cells.
+ */
+#define KEY_PATH_CACHE_DEPTH 32
+
+typedef struct _KEY_PATH_CACHE_LEVEL
+{
+    ULONG Length;   /* Length in characters of the path up to this key */
+    PCMHIVE Hive;
+    HCELL_INDEX Cell;
+} KEY_PATH_CACHE_LEVEL, *PKEY_PATH_CACHE_LEVEL;
+
+typedef struct _KEY_PATH_CACHE
+{
+    PWSTR Path;
+    ULONG MaximumLength;
+    ULONG Depth;
+    KEY_PATH_CACHE_LEVEL Levels[KEY_PATH_CACHE_DEPTH];
+} KEY_PATH_CACHE, *PKEY_PATH_CACHE;
+
+static KEY_PATH_CACHE KeyPathCache;
+
+static VOID
+RegpAddReparsePoint(
+    IN PREPARSE_POINT ReparsePoint)
+{
+    ULONG Index = REPARSE_POINT_HASH(ReparsePoint->SourceHive,
+                                     ReparsePoint->SourceKeyCellOffset);
+
+    InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    InsertTailList(&ReparsePointHashTable[Index], &ReparsePoint->HashEntry);
+
+    /* The source key may already be cached without its redirection */
+    KeyPathCache.Depth = 0;
+}
+
+static PREPARSE_POINT
+RegpFindReparsePoint(
+    IN PCMHIVE SourceHive,
+    IN HCELL_INDEX SourceKeyCellOffset)
+{
+    PLIST_ENTRY Head, Ptr;
+    PREPARSE_POINT ReparsePoint;
+
+    Head = &ReparsePointHashTable[REPARSE_POINT_HASH(SourceHive, SourceKeyCellOffset)];
+    for (Ptr = Head->Flink; Ptr != Head; Ptr = Ptr->Flink)
+    {
+        ReparsePoint = CONTAINING_RECORD(Ptr, REPARSE_POINT, HashEntry);
+        if (ReparsePoint->SourceHive == SourceHive &&
+            ReparsePoint->SourceKeyCellOffset == SourceKeyCellOffset)
+        {
+            return ReparsePoint;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the deepest cached key that is an ancestor of (or is) KeyName,
+ * and make KeyName the cached path. Returns the number of valid levels.
+ */
+static ULONG
+RegpLookupKeyPathCache(
+    IN PCWSTR KeyName)
+{
+    ULONG Length, Common, Depth;
+    PWSTR NewPath;
+
+    Length = (ULONG)strlenW(KeyName);
+
+    /* Find how many characters the new path shares with the cached one */
+    Common = 0;
+    if (KeyPathCache.Depth > 0)
+    {
+        while (Common < Length &&
+               KeyPathCache.Path[Common] != UNICODE_NULL &&
+               RtlUpcaseUnicodeChar(KeyPathCache.Path[Common]) ==
+               RtlUpcaseUnicodeChar(KeyName[Common]))
+        {
+            Common++;
+        }
+    }
+
+    /* Keep the levels whose path ends on a component boundary of the new one */
+    for (Depth = 0; Depth < KeyPathCache.Depth; Depth++)
+    {
+        ULONG LevelLength = KeyPathCache.Levels[Depth].Length;
+
+        if (LevelLength > Common ||
+            (KeyName[LevelLength] != UNICODE_NULL &&
+             KeyName[LevelLength] != OBJ_NAME_PATH_SEPARATOR))
+        {
+            break;
+        }
+    }
+
+    if (Length + 1 > KeyPathCache.MaximumLength)
+    {
+        NewPath = (PWSTR)realloc(KeyPathCache.Path, (Length + 1) * sizeof(WCHAR));
+        if (!NewPath)
+        {
+            /* Disable caching for this lookup */
+            free(KeyPathCache.Path);
+            KeyPathCache.Path = NULL;
+            KeyPathCache.MaximumLength = 0;
+            KeyPathCache.Depth = 0;
+            return 0;
+        }
+
+        KeyPathCache.Path = NewPath;
+        KeyPathCache.MaximumLength = Length + 1;
+    }
+
+    RtlCopyMemory(KeyPathCache.Path, KeyName, (Length + 1) * sizeof(WCHAR));
+    KeyPathCache.Depth = Depth;
+    return Depth;
+}
+
 static LONG
 RegpOpenOrCreateKey(
     IN HKEY hParentKey,
@@ -365,9 +498,10 @@ RegpOpenOrCreateKey(
     PCMHIVE ParentRegistryHive;
     HCELL_INDEX ParentCellOffset;
     PCM_KEY_NODE ParentKeyCell;
-    PLIST_ENTRY Ptr;
-    PCM_KEY_NODE SubKeyCell;
     HCELL_INDEX BlockOffset;
+    PKEY_PATH_CACHE_LEVEL CacheLevel;
+    BOOL UseCache;
+    ULONG Depth;
 
     DPRINT("RegpCreateOpenKey('%S')\n", KeyName);
 
@@ -389,6 +523,27 @@ RegpOpenOrCreateKey(
     }
 
     LocalKeyName = (PWSTR)KeyName;
+
+    /* Only paths resolved from the root key are cached */
+    UseCache = (ParentRegistryHive == RootKey->RegistryHive &&
+                ParentCellOffset == RootKey->KeyCellOffset);
+    if (UseCache)
+    {
+        Depth = RegpLookupKeyPathCache(KeyName);
+        UseCache = (KeyPathCache.Path != NULL);
+        if (Depth > 0)
+        {
+            CacheLevel = &KeyPathCache.Levels[Depth - 1];
+            ParentRegistryHive = CacheLevel->Hive;
+            ParentCellOffset = CacheLevel->Cell;
+
+            LocalKeyName += CacheLevel->Length;
+            if (*LocalKeyName == UNICODE_NULL)
+                goto Done;
+            LocalKeyName++;
+        }
+    }
+
     for (;;)
     {
         End = (PWSTR)strchrW(LocalKeyName, OBJ_NAME_PATH_SEPARATOR);
@@ -420,18 +575,11 @@ RegpOpenOrCreateKey(
             Status = STATUS_SUCCESS;
 
             /* Search for a possible reparse point */
-            Ptr = CmiReparsePointsHead.Flink;
-            while (Ptr != &CmiReparsePointsHead)
+            CurrentReparsePoint = RegpFindReparsePoint(ParentRegistryHive, BlockOffset);
+            if (CurrentReparsePoint)
             {
-                CurrentReparsePoint = CONTAINING_RECORD(Ptr, REPARSE_POINT, ListEntry);
-                if (CurrentReparsePoint->SourceHive == ParentRegistryHive &&
-                    CurrentReparsePoint->SourceKeyCellOffset == BlockOffset)
-                {
-                    ParentRegistryHive = CurrentReparsePoint->DestinationHive;
-                    BlockOffset = CurrentReparsePoint->DestinationKeyCellOffset;
-                    break;
-                }
-                Ptr = Ptr->Flink;
+                ParentRegistryHive = CurrentReparsePoint->DestinationHive;
+                BlockOffset = CurrentReparsePoint->DestinationKeyCellOffset;
             }
         }
         else if (AllowCreation) // && (BlockOffset == HCELL_NIL)
@@ -449,12 +597,24 @@ RegpOpenOrCreateKey(
             return ERROR_UNSUCCESSFUL;
 
         ParentCellOffset = BlockOffset;
+
+        /* Remember the key for the next lookups sharing this path */
+        if (UseCache && KeyPathCache.Depth < KEY_PATH_CACHE_DEPTH)
+        {
+            CacheLevel = &KeyPathCache.Levels[KeyPathCache.Depth++];
+            CacheLevel->Length = (ULONG)((LocalKeyName - KeyName) +
+                                         KeyString.Length / sizeof(WCHAR));
+            CacheLevel->Hive = ParentRegistryHive;
+            CacheLevel->Cell = ParentCellOffset;
+        }
+
         if (End)
             LocalKeyName = End + 1;
         else
             break;
     }
 
+Done:
     CurrentKey = CreateInMemoryStructure(ParentRegistryHive, ParentCellOffset);
     if (!CurrentKey)
         return ERROR_OUTOFMEMORY;
@@ -480,6 +640,9 @@ RegDeleteKeyW(
 {
     DPRINT1("RegDeleteKeyW(0x%p, '%S') is UNIMPLEMENTED!\n",
             hKey, (lpSubKey ? lpSubKey : L""));
+
+    /* Deleted keys must not be found again through the path cache */
+    KeyPathCache.Depth = 0;
     return ERROR_SUCCESS;
 }
 
@@ -820,7 +983,7 @@ ConnectRegistry(
     NewKey->KeyCellOffset = HiveToConnect->Hive.BaseBlock->RootCell;
     ReparsePoint->DestinationHive = NewKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = NewKey->KeyCellOffset;
-    InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpAddReparsePoint(ReparsePoint);
     return TRUE;
 }
 
@@ -833,9 +996,12 @@ RegInitializeRegistry(VOID)
     NTSTATUS Status;
     PMEMKEY ControlSetKey, CurrentControlSetKey;
     PREPARSE_POINT ReparsePoint;
+    ULONG i;
 
     InitializeListHead(&CmiHiveListHead);
     InitializeListHead(&CmiReparsePointsHead);
+    for (i = 0; i < REPARSE_POINT_HASH_SIZE; i++)
+        InitializeListHead(&ReparsePointHashTable[i]);
 
     Status = CmiInitializeHive(&RootHive, L"");
     if (!NT_SUCCESS(Status))
@@ -905,7 +1071,7 @@ RegInitializeRegistry(VOID)
     ReparsePoint->SourceKeyCellOffset = CurrentControlSetKey->KeyCellOffset;
     ReparsePoint->DestinationHive = ControlSetKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = ControlSetKey->KeyCellOffset;
-    InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpAddReparsePoint(ReparsePoint);
 }
 
 VOID
@@ -913,6 +1079,11 @@ RegShutdownRegistry(VOID)
 {
     /* FIXME: clean up the complete hive */
 
+    free(KeyPathCache.Path);
+    KeyPathCache.Path = NULL;
+    KeyPathCache.MaximumLength = 0;
+    KeyPathCache.Depth = 0;
+
     free(RootKey);
 }
 
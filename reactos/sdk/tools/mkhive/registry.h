@@ -10,6 +10,7 @@
 typedef struct _REPARSE_POINT
 {
     LIST_ENTRY ListEntry;
+    LIST_ENTRY HashEntry;
     PCMHIVE SourceHive;
     HCELL_INDEX SourceKeyCellOffset;
     PCMHIVE DestinationHive;
@@ -222,7 +222,8 @@ BOOLEAN Dummy_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
                          POINTL* MaskOrigin, BRUSHOBJ* Brush,
                          POINTL* BrushOrign,
                          XLATEOBJ *ColorTranslation,
-                         ROP4 Rop)
+                         ROP4 Rop,
+                         ULONG Mode)
 {
   return FALSE;
 }
@@ -13,12 +13,378 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Number of destination pixels processed per row chunk */
+#define STRETCH_CHUNK 128
+
+/* Integer DDA, steps through Src source pixels over Dst destination pixels */
+typedef struct _STRETCH_DDA
+{
+  LONG Pos;
+  LONG Int;
+  LONG Frac;
+  LONG Err;
+  LONG Den;
+} STRETCH_DDA, *PSTRETCH_DDA;
+
+/* Source surface and its color translation, shared by the row kernels */
+typedef struct _STRETCH_SOURCE
+{
+  ULONG iFormat;
+  XLATEOBJ *pxlo;
+  PULONG pulXlate;
+  ULONG cEntries;
+  BOOLEAN Trivial;
+  BOOLEAN LastValid;
+  ULONG LastSource;
+  ULONG LastColor;
+} STRETCH_SOURCE, *PSTRETCH_SOURCE;
+
+static
+VOID
+DIB_StretchInitDda(PSTRETCH_DDA Dda, LONG Start, LONG Src, LONG Dst)
+{
+  /* Pos at destination pixel n is always Start + (n * Src) / Dst */
+  Dda->Pos = Start;
+  Dda->Int = Src / Dst;
+  Dda->Frac = Src % Dst;
+  Dda->Err = 0;
+  Dda->Den = Dst;
+}
+
+FORCEINLINE
+VOID
+DIB_StretchStepDda(PSTRETCH_DDA Dda)
+{
+  Dda->Pos += Dda->Int;
+  Dda->Err += Dda->Frac;
+  if (Dda->Err >= Dda->Den)
+  {
+    Dda->Err -= Dda->Den;
+    Dda->Pos++;
+  }
+}
+
+static
+VOID
+DIB_StretchInitSource(PSTRETCH_SOURCE Source, SURFOBJ *SourceSurf, XLATEOBJ *ColorTranslation)
+{
+  Source->iFormat = SourceSurf->iBitmapFormat;
+  Source->pxlo = ColorTranslation;
+  Source->Trivial = (!ColorTranslation || (ColorTranslation->flXlate & XO_TRIVIAL));
+  if (!Source->Trivial && (ColorTranslation->flXlate & XO_TABLE) && ColorTranslation->pulXlate)
+  {
+    Source->pulXlate = ColorTranslation->pulXlate;
+    Source->cEntries = ColorTranslation->cEntries;
+  }
+  else
+  {
+    Source->pulXlate = NULL;
+    Source->cEntries = 0;
+  }
+  Source->LastValid = FALSE;
+}
+
+FORCEINLINE
+ULONG
+DIB_StretchReadPixel(PBYTE Line, ULONG iFormat, LONG x)
+{
+  PBYTE addr;
+
+  switch (iFormat)
+  {
+    case BMF_1BPP:
+      return (Line[x >> 3] & MASK1BPP(x)) ? 1 : 0;
+    case BMF_4BPP:
+      return (Line[x >> 1] >> ((1 - (x & 1)) << 2)) & 0x0f;
+    case BMF_8BPP:
+      return Line[x];
+    case BMF_16BPP:
+      return ((PUSHORT)Line)[x];
+    case BMF_24BPP:
+      addr = Line + x * 3;
+      return addr[0] | (addr[1] << 8) | (addr[2] << 16);
+    default:
+      return ((PULONG)Line)[x];
+  }
+}
+
+FORCEINLINE
+VOID
+DIB_StretchWritePixel(PBYTE Line, ULONG iFormat, LONG x, ULONG Color)
+{
+  PBYTE addr;
+
+  switch (iFormat)
+  {
+    case BMF_8BPP:
+      Line[x] = (BYTE)Color;
+      break;
+    case BMF_16BPP:
+      ((PUSHORT)Line)[x] = (USHORT)Color;
+      break;
+    case BMF_24BPP:
+      addr = Line + x * 3;
+      addr[0] = (BYTE)Color;
+      addr[1] = (BYTE)(Color >> 8);
+      addr[2] = (BYTE)(Color >> 16);
+      break;
+    default:
+      ((PULONG)Line)[x] = Color;
+      break;
+  }
+}
+
+FORCEINLINE
+ULONG
+DIB_StretchXlate(PSTRETCH_SOURCE Source, ULONG Color)
+{
+  if (Source->Trivial)
+    return Color;
+
+  if (Source->pulXlate)
+    return (Color < Source->cEntries) ? Source->pulXlate[Color] : 0;
+
+  /* Stretching repeats or revisits pixels, remember the last translation */
+  if (!Source->LastValid || Source->LastSource != Color)
+  {
+    Source->LastSource = Color;
+    Source->LastColor = XLATEOBJ_iXlate(Source->pxlo, Color);
+    Source->LastValid = TRUE;
+  }
+  return Source->LastColor;
+}
+
+/* Reads Count translated source pixels along the DDA into Row */
+static
+VOID
+DIB_StretchFetchRow(PSTRETCH_SOURCE Source, PBYTE SourceLine, PSTRETCH_DDA Dda, PULONG Row, LONG Count)
+{
+  LONG i;
+
+  /* Keep the format switch out of the loop for the common formats */
+  switch (Source->iFormat)
+  {
+    case BMF_8BPP:
+      for (i = 0; i < Count; i++)
+      {
+        Row[i] = DIB_StretchXlate(Source, SourceLine[Dda->Pos]);
+        DIB_StretchStepDda(Dda);
+      }
+      break;
+    case BMF_16BPP:
+      for (i = 0; i < Count; i++)
+      {
+        Row[i] = DIB_StretchXlate(Source, ((PUSHORT)SourceLine)[Dda->Pos]);
+        DIB_StretchStepDda(Dda);
+      }
+      break;
+    case BMF_32BPP:
+      for (i = 0; i < Count; i++)
+      {
+        Row[i] = DIB_StretchXlate(Source, ((PULONG)SourceLine)[Dda->Pos]);
+        DIB_StretchStepDda(Dda);
+      }
+      break;
+    default:
+      for (i = 0; i < Count; i++)
+      {
+        Row[i] = DIB_StretchXlate(Source, DIB_StretchReadPixel(SourceLine, Source->iFormat, Dda->Pos));
+        DIB_StretchStepDda(Dda);
+      }
+      break;
+  }
+}
+
+/* Writes Count pixels from Row to the destination line, starting at x */
+static
+VOID
+DIB_StretchStoreRow(PBYTE DestLine, ULONG iFormat, LONG x, PULONG Row, LONG Count, ROP4 ROP, ULONG Mask)
+{
+  LONG i;
+
+  if (ROP == ROP4_SRCCOPY)
+  {
+    switch (iFormat)
+    {
+      case BMF_8BPP:
+        for (i = 0; i < Count; i++)
+          DestLine[x + i] = (BYTE)Row[i];
+        break;
+      case BMF_16BPP:
+        for (i = 0; i < Count; i++)
+          ((PUSHORT)DestLine)[x + i] = (USHORT)Row[i];
+        break;
+      case BMF_32BPP:
+        RtlCopyMemory((PULONG)DestLine + x, Row, Count * sizeof(ULONG));
+        break;
+      default:
+        for (i = 0; i < Count; i++)
+          DIB_StretchWritePixel(DestLine, iFormat, x + i, Row[i]);
+        break;
+    }
+  }
+  else
+  {
+    for (i = 0; i < Count; i++)
+    {
+      ULONG Dest = DIB_StretchReadPixel(DestLine, iFormat, x + i);
+      DIB_StretchWritePixel(DestLine, iFormat, x + i, DIB_DoRop(ROP, Dest, Row[i], 0) & Mask);
+    }
+  }
+}
+
+/* COLORONCOLOR: nearest neighbour, one row kernel per source and destination format */
+static
+VOID
+DIB_StretchBltNearest(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
+                      RECTL *DestRect, RECTL *SourceRect,
+                      XLATEOBJ *ColorTranslation, ROP4 ROP, ULONG Mask)
+{
+  ULONG Row[STRETCH_CHUNK];
+  STRETCH_SOURCE Source;
+  STRETCH_DDA Dda;
+  LONG DstWidth = DestRect->right - DestRect->left;
+  LONG DstHeight = DestRect->bottom - DestRect->top;
+  LONG SrcWidth = SourceRect->right - SourceRect->left;
+  LONG SrcHeight = SourceRect->bottom - SourceRect->top;
+  LONG DesY, DesX, Count, sy, LastSy = -1;
+  ULONG cjPixel = BitsPerFormat(DestSurf->iBitmapFormat) >> 3;
+  PBYTE SourceLine, DestLine, LastDestLine = NULL;
+
+  DIB_StretchInitSource(&Source, SourceSurf, ColorTranslation);
+
+  for (DesY = DestRect->top; DesY < DestRect->bottom; DesY++)
+  {
+    sy = SourceRect->top + (LONG)(((LONGLONG)(DesY - DestRect->top) * SrcHeight) / DstHeight);
+    DestLine = (PBYTE)DestSurf->pvScan0 + DesY * DestSurf->lDelta;
+
+    /* Enlarging vertically repeats source rows, just copy the previous result */
+    if (sy == LastSy && ROP == ROP4_SRCCOPY)
+    {
+      RtlCopyMemory(DestLine + DestRect->left * cjPixel,
+                    LastDestLine + DestRect->left * cjPixel,
+                    DstWidth * cjPixel);
+      continue;
+    }
+
+    SourceLine = (PBYTE)SourceSurf->pvScan0 + sy * SourceSurf->lDelta;
+    DIB_StretchInitDda(&Dda, SourceRect->left, SrcWidth, DstWidth);
+
+    for (DesX = DestRect->left; DesX < DestRect->right; DesX += Count)
+    {
+      Count = min(DestRect->right - DesX, STRETCH_CHUNK);
+      DIB_StretchFetchRow(&Source, SourceLine, &Dda, Row, Count);
+      DIB_StretchStoreRow(DestLine, DestSurf->iBitmapFormat, DesX, Row, Count, ROP, Mask);
+    }
+
+    LastSy = sy;
+    LastDestLine = DestLine;
+  }
+}
+
+FORCEINLINE
+ULONG
+DIB_StretchLerp(ULONG a, ULONG b, ULONG w)
+{
+  ULONG rb, ag;
+
+  /* Interpolate all four 8 bit channels, two at a time */
+  rb = (((a & 0x00FF00FF) * (256 - w) + (b & 0x00FF00FF) * w) >> 8) & 0x00FF00FF;
+  ag = ((((a >> 8) & 0x00FF00FF) * (256 - w) + ((b >> 8) & 0x00FF00FF) * w) >> 8) & 0x00FF00FF;
+  return rb | (ag << 8);
+}
+
+static
+BOOLEAN
+DIB_StretchCanInterpolate(SURFOBJ *DestSurf, SURFOBJ *SourceSurf)
+{
+  PPALETTE ppal = CONTAINING_RECORD(DestSurf, SURFACE, SurfObj)->ppal;
+
+  /* Translated colors must be made of 8 bit channels */
+  if (DestSurf->iBitmapFormat != BMF_24BPP && DestSurf->iBitmapFormat != BMF_32BPP)
+    return FALSE;
+  if (!ppal)
+    return FALSE;
+  if (ppal->flFlags & PAL_BITFIELDS)
+  {
+    if (!((ppal->RedMask == 0xFF0000 && ppal->GreenMask == 0xFF00 && ppal->BlueMask == 0xFF) ||
+          (ppal->RedMask == 0xFF && ppal->GreenMask == 0xFF00 && ppal->BlueMask == 0xFF0000)))
+      return FALSE;
+  }
+  else if (!(ppal->flFlags & (PAL_RGB | PAL_BGR)))
+  {
+    return FALSE;
+  }
+
+  /* Source positions are kept in 16.16 fixed point */
+  return (SourceSurf->sizlBitmap.cx < 0x8000 && abs(SourceSurf->sizlBitmap.cy) < 0x8000);
+}
+
+/* HALFTONE: bilinear filtering of the translated source colors */
+static
+VOID
+DIB_StretchBltBilinear(SURFOBJ *DestSurf, SURFOBJ *SourceSurf,
+                       RECTL *DestRect, RECTL *SourceRect,
+                       XLATEOBJ *ColorTranslation)
+{
+  STRETCH_SOURCE Source;
+  LONG DstWidth = DestRect->right - DestRect->left;
+  LONG DstHeight = DestRect->bottom - DestRect->top;
+  LONG StepX, StepY, StartX, MinX, MaxX, MinY, MaxY;
+  LONG DesX, DesY, fx, fy, sx0, sx1, sy0, sy1;
+  ULONG wx, wy, c00, c01, c10, c11;
+  PBYTE SourceLine0, SourceLine1, DestLine;
+
+  DIB_StretchInitSource(&Source, SourceSurf, ColorTranslation);
+
+  StepX = (LONG)(((LONGLONG)(SourceRect->right - SourceRect->left) << 16) / DstWidth);
+  StepY = (LONG)(((LONGLONG)(SourceRect->bottom - SourceRect->top) << 16) / DstHeight);
+  MinX = SourceRect->left << 16;
+  MaxX = (SourceRect->right - 1) << 16;
+  MinY = SourceRect->top << 16;
+  MaxY = (SourceRect->bottom - 1) << 16;
+
+  /* Sample at pixel centers */
+  StartX = MinX + StepX / 2 - 0x8000;
+  fy = MinY + StepY / 2 - 0x8000;
+
+  for (DesY = DestRect->top; DesY < DestRect->bottom; DesY++, fy += StepY)
+  {
+    LONG y = min(max(fy, MinY), MaxY);
+
+    sy0 = y >> 16;
+    sy1 = min(sy0 + 1, SourceRect->bottom - 1);
+    wy = (y >> 8) & 0xFF;
+    SourceLine0 = (PBYTE)SourceSurf->pvScan0 + sy0 * SourceSurf->lDelta;
+    SourceLine1 = (PBYTE)SourceSurf->pvScan0 + sy1 * SourceSurf->lDelta;
+    DestLine = (PBYTE)DestSurf->pvScan0 + DesY * DestSurf->lDelta;
+
+    for (DesX = DestRect->left, fx = StartX; DesX < DestRect->right; DesX++, fx += StepX)
+    {
+      LONG x = min(max(fx, MinX), MaxX);
+
+      sx0 = x >> 16;
+      sx1 = min(sx0 + 1, SourceRect->right - 1);
+      wx = (x >> 8) & 0xFF;
+
+      c00 = DIB_StretchXlate(&Source, DIB_StretchReadPixel(SourceLine0, Source.iFormat, sx0));
+      c01 = DIB_StretchXlate(&Source, DIB_StretchReadPixel(SourceLine0, Source.iFormat, sx1));
+      c10 = DIB_StretchXlate(&Source, DIB_StretchReadPixel(SourceLine1, Source.iFormat, sx0));
+      c11 = DIB_StretchXlate(&Source, DIB_StretchReadPixel(SourceLine1, Source.iFormat, sx1));
+
+      DIB_StretchWritePixel(DestLine, DestSurf->iBitmapFormat, DesX,
+                            DIB_StretchLerp(DIB_StretchLerp(c00, c01, wx),
+                                            DIB_StretchLerp(c10, c11, wx), wy));
+    }
+  }
+}
+
 BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *MaskSurf,
                             SURFOBJ *PatternSurface,
                             RECTL *DestRect, RECTL *SourceRect,
                             POINTL *MaskOrigin, BRUSHOBJ *Brush,
                             POINTL *BrushOrigin, XLATEOBJ *ColorTranslation,
-                            ROP4 ROP)
+                            ROP4 ROP, ULONG Mode)
 {
   LONG sx = 0;
   LONG sy = 0;
@@ -88,6 +454,27 @@ BOOLEAN DIB_XXBPP_StretchBlt(SURFOBJ *DestSurf, SURFOBJ *SourceSurf, SURFOBJ *Ma
     xxBPPMask = 0xFFFFFFFF;
   }
 
+  /* Use the row kernels for source-only ROPs when the whole source is addressable */
+  if (UsesSource && !UsesPattern && !MaskSurf &&
+      DestSurf->iBitmapFormat >= BMF_8BPP && DestSurf->iBitmapFormat <= BMF_32BPP &&
+      SourceSurf->iBitmapFormat >= BMF_1BPP && SourceSurf->iBitmapFormat <= BMF_32BPP &&
+      DstWidth > 0 && DstHeight > 0 && SrcWidth > 0 && SrcHeight > 0 &&
+      SourceRect->left >= 0 && SourceRect->top >= 0 &&
+      SourceRect->right <= SourceSurf->sizlBitmap.cx && SourceRect->bottom <= SourceCy)
+  {
+    if (Mode == HALFTONE && ROP == ROP4_SRCCOPY &&
+        DIB_StretchCanInterpolate(DestSurf, SourceSurf))
+    {
+      DIB_StretchBltBilinear(DestSurf, SourceSurf, DestRect, SourceRect, ColorTranslation);
+    }
+    else
+    {
+      DIB_StretchBltNearest(DestSurf, SourceSurf, DestRect, SourceRect,
+                            ColorTranslation, ROP, xxBPPMask);
+    }
+    return TRUE;
+  }
+
   if (UsesPattern)
   {
     if (PatternSurface)
@@ -131,6 +131,7 @@ typedef struct _SHARED_FACE {
   PSHARED_MEM   Memory;
   SHARED_FACE_CACHE EnglishUS;
   SHARED_FACE_CACHE UserLanguage;
+  LIST_ENTRY    GlyphCacheListHead;
 } SHARED_FACE, *PSHARED_FACE;
 
 typedef struct _FONTGDI {
@@ -93,6 +93,7 @@ IntEngStretchBlt(SURFOBJ *DestObj,
                  POINTL *pMaskOrigin,
                  BRUSHOBJ *Brush,
                  POINTL *BrushOrigin,
+                 DWORD Rop4,
                  ULONG Mode);
 
 BOOL APIENTRY
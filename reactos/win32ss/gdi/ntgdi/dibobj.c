@@ -1341,7 +1341,8 @@ NtGdiStretchDIBitsInternal(
                                NULL,
                                &pdc->eboFill.BrushObject,
                                NULL,
-                               WIN32_ROP3_TO_ENG_ROP4(dwRop));
+                               WIN32_ROP3_TO_ENG_ROP4(dwRop),
+                               pdc->pdcattr->jStretchBltMode);
 
     /* Cleanup */
     DC_vFinishBlit(pdc, NULL);
@@ -24,7 +24,10 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;   /* LRU list, most recently used first */
+    LIST_ENTRY HashEntry;   /* Hash bucket */
+    LIST_ENTRY FaceEntry;   /* Per-face list, see SHARED_FACE */
+    SIZE_T cbSize;          /* Bytes charged against the cache budget */
     int GlyphIndex;
     FT_Face Face;
     FT_BitmapGlyph BitmapGlyph;
@@ -87,10 +87,24 @@ static BOOL RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
   ASSERT(FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
+/* Glyph cache: hashed on (face, glyph, height), evicted LRU by size */
+#define FONT_CACHE_HASH_SIZE        256
+#define FONT_CACHE_DEFAULT_BUDGET   (512 * 1024)
+#define FONT_CACHE_MIN_BUDGET       (64 * 1024)
 
 static LIST_ENTRY FontCacheListHead;
-static UINT FontCacheNumEntries;
+static LIST_ENTRY FontCacheHashTable[FONT_CACHE_HASH_SIZE];
+
+/* Statistics, dumped by the GDI KDBG extension */
+UINT FontCacheNumEntries;
+SIZE_T FontCacheSize;
+SIZE_T FontCacheBudget = FONT_CACHE_DEFAULT_BUDGET;
+ULONG FontCacheHits;
+ULONG FontCacheMisses;
+ULONG FontCacheEvictions;
+
+static UNICODE_STRING GreInitializeRegPath =
+    RTL_CONSTANT_STRING(L"\\REGISTRY\\Machine\\Software\\Microsoft\\Windows NT\\CurrentVersion\\GRE_Initialize");
 
 static PWCHAR ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -192,6 +206,11 @@ SharedFace_Create(FT_Face Face, PSHARED_MEM Memory)
         Ptr->Memory = Memory;
         SharedFaceCache_Init(&Ptr->EnglishUS);
         SharedFaceCache_Init(&Ptr->UserLanguage);
+        InitializeListHead(&Ptr->GlyphCacheListHead);
+
+        /* Let the glyph cache find its per-face list from the FT_Face */
+        Face->generic.data = Ptr;
+        Face->generic.finalizer = NULL;
 
         SharedMem_AddRef(Memory);
         DPRINT("Creating SharedFace for %s\n", Face->family_name);
@@ -230,29 +249,32 @@ RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
 
     FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
+    RemoveEntryList(&Entry->HashEntry);
+    RemoveEntryList(&Entry->FaceEntry);
+    ASSERT(FontCacheSize >= Entry->cbSize);
+    FontCacheSize -= Entry->cbSize;
     ExFreePoolWithTag(Entry, TAG_FONT);
+    ASSERT(FontCacheNumEntries > 0);
     FontCacheNumEntries--;
-    ASSERT(FontCacheNumEntries <= MAX_FONT_CACHE);
 }
 
 static void
-RemoveCacheEntries(FT_Face Face)
+RemoveCacheEntries(PSHARED_FACE SharedFace)
 {
     PLIST_ENTRY CurrentEntry;
     PFONT_CACHE_ENTRY FontEntry;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    CurrentEntry = FontCacheListHead.Flink;
-    while (CurrentEntry != &FontCacheListHead)
+    /* Only walk the glyphs of this face, not the whole cache */
+    CurrentEntry = SharedFace->GlyphCacheListHead.Flink;
+    while (CurrentEntry != &SharedFace->GlyphCacheListHead)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, FaceEntry);
         CurrentEntry = CurrentEntry->Flink;
 
-        if (FontEntry->Face == Face)
-        {
-            RemoveCachedEntry(FontEntry);
-        }
+        ASSERT(FontEntry->Face == SharedFace->Face);
+        RemoveCachedEntry(FontEntry);
     }
 }
 
@@ -296,7 +318,7 @@ SharedFace_Release(PSHARED_FACE Ptr)
     if (Ptr->RefCount == 0)
     {
         DPRINT("Releasing SharedFace for %s\n", Ptr->Face->family_name);
-        RemoveCacheEntries(Ptr->Face);
+        RemoveCacheEntries(Ptr);
         FT_Done_Face(Ptr->Face);
         SharedMem_Release(Ptr->Memory);
         SharedFaceCache_Release(&Ptr->EnglishUS);
@@ -448,14 +470,39 @@ IntLoadFontSubstList(PLIST_ENTRY pHead)
     return NT_SUCCESS(Status);
 }
 
+static VOID
+InitFontCache(VOID)
+{
+    HKEY hKey;
+    DWORD dwBudget;
+    ULONG i;
+
+    InitializeListHead(&FontCacheListHead);
+    for (i = 0; i < FONT_CACHE_HASH_SIZE; i++)
+    {
+        InitializeListHead(&FontCacheHashTable[i]);
+    }
+    FontCacheNumEntries = 0;
+    FontCacheSize = 0;
+
+    /* The budget can be overridden through GRE_Initialize\GlyphCacheBudget */
+    if (NT_SUCCESS(RegOpenKey(GreInitializeRegPath.Buffer, &hKey)))
+    {
+        if (RegReadDWORD(hKey, L"GlyphCacheBudget", &dwBudget))
+        {
+            FontCacheBudget = max(dwBudget, FONT_CACHE_MIN_BUDGET);
+        }
+        ZwClose(hKey);
+    }
+}
+
 BOOL FASTCALL
 InitFontSupport(VOID)
 {
     ULONG ulError;
 
     InitializeListHead(&FontListHead);
-    InitializeListHead(&FontCacheListHead);
-    FontCacheNumEntries = 0;
+    InitFontCache();
     /* Fast Mutexes must be allocated from non paged pool */
     FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (FontListLock == NULL)
@@ -2572,6 +2619,25 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
+static
+ULONG
+FontCacheHash(
+    FT_Face Face,
+    INT GlyphIndex,
+    INT Height)
+{
+    ULONG_PTR Hash;
+
+    /* The transform is left out, glyphs rarely get cached at several of them */
+    Hash = (ULONG_PTR)Face >> 4;
+    Hash = Hash * 31 + (ULONG)GlyphIndex;
+    Hash = Hash * 31 + (ULONG)Height;
+    Hash ^= Hash >> 16;
+    Hash ^= Hash >> 8;
+
+    return (ULONG)Hash & (FONT_CACHE_HASH_SIZE - 1);
+}
+
 FT_BitmapGlyph APIENTRY
 ftGdiGlyphCacheGet(
     FT_Face Face,
@@ -2579,31 +2645,33 @@ ftGdiGlyphCacheGet(
     INT Height,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY CurrentEntry, BucketHead;
     PFONT_CACHE_ENTRY FontEntry;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    CurrentEntry = FontCacheListHead.Flink;
-    while (CurrentEntry != &FontCacheListHead)
+    BucketHead = &FontCacheHashTable[FontCacheHash(Face, GlyphIndex, Height)];
+    for (CurrentEntry = BucketHead->Flink;
+         CurrentEntry != BucketHead;
+         CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, HashEntry);
         if ((FontEntry->Face == Face) &&
             (FontEntry->GlyphIndex == GlyphIndex) &&
             (FontEntry->Height == Height) &&
             (SameScaleMatrix(&FontEntry->mxWorldToDevice, pmx)))
-            break;
-        CurrentEntry = CurrentEntry->Flink;
-    }
+        {
+            FontCacheHits++;
 
-    if (CurrentEntry == &FontCacheListHead)
-    {
-        return NULL;
+            /* Move it to the front of the LRU list */
+            RemoveEntryList(&FontEntry->ListEntry);
+            InsertHeadList(&FontCacheListHead, &FontEntry->ListEntry);
+            return FontEntry->BitmapGlyph;
+        }
     }
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&FontCacheListHead, CurrentEntry);
-    return FontEntry->BitmapGlyph;
+    FontCacheMisses++;
+    return NULL;
 }
 
 /* no cache */
@@ -2707,12 +2775,24 @@ ftGdiGlyphCacheSet(
     NewEntry->BitmapGlyph = BitmapGlyph;
     NewEntry->Height = Height;
     NewEntry->mxWorldToDevice = *pmx;
+    NewEntry->cbSize = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                       (SIZE_T)abs(BitmapGlyph->bitmap.pitch) * BitmapGlyph->bitmap.rows;
 
     InsertHeadList(&FontCacheListHead, &NewEntry->ListEntry);
-    if (++FontCacheNumEntries > MAX_FONT_CACHE)
+    InsertHeadList(&FontCacheHashTable[FontCacheHash(Face, GlyphIndex, Height)],
+                   &NewEntry->HashEntry);
+    ASSERT(Face->generic.data != NULL);
+    InsertTailList(&((PSHARED_FACE)Face->generic.data)->GlyphCacheListHead,
+                   &NewEntry->FaceEntry);
+    FontCacheNumEntries++;
+    FontCacheSize += NewEntry->cbSize;
+
+    /* Evict the least recently used glyphs, but never the one we return */
+    while ((FontCacheSize > FontCacheBudget) && (FontCacheNumEntries > 1))
     {
         NewEntry = CONTAINING_RECORD(FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
         RemoveCachedEntry(NewEntry);
+        FontCacheEvictions++;
     }
 
     return BitmapGlyph;
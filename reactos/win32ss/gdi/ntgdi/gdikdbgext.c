@@ -15,6 +15,12 @@
 extern PENTRY gpentHmgr;
 extern PULONG gpaulRefCount;
 extern ULONG gulFirstUnused;
+extern UINT FontCacheNumEntries;
+extern SIZE_T FontCacheSize;
+extern SIZE_T FontCacheBudget;
+extern ULONG FontCacheHits;
+extern ULONG FontCacheMisses;
+extern ULONG FontCacheEvictions;
 
 
 static const char * gpszObjectTypes[] =
@@ -69,6 +75,7 @@ KdbCommand_Gdi_help(VOID)
              "- handle <handle> - Displays information about a handle\n"
              "- entry <entry> - Displays an ENTRY, <entry> can be a pointer or index\n"
              "- baseobject <object> - Displays a BASEOBJECT\n"
+             "- glyphcache - Displays FreeType glyph cache statistics\n"
 #if DBG_ENABLE_EVENT_LOGGING
              "- eventlist <object> - Displays the eventlist for an object\n"
 #endif
@@ -278,6 +285,20 @@ KdbCommand_Gdi_baseobject(char *argv)
 {
 }
 
+static
+VOID
+KdbCommand_Gdi_glyphcache(VOID)
+{
+    ULONG ulLookups = FontCacheHits + FontCacheMisses;
+
+    DbgPrint("Glyph cache: %u entries, %Iu of %Iu bytes\n",
+             FontCacheNumEntries, FontCacheSize, FontCacheBudget);
+    DbgPrint(" Hits = %lu, Misses = %lu (%lu%% hit rate)\n",
+             FontCacheHits, FontCacheMisses,
+             ulLookups ? (ULONG)((ULONGLONG)FontCacheHits * 100 / ulLookups) : 0);
+    DbgPrint(" Evictions = %lu\n", FontCacheEvictions);
+}
+
 #if DBG_ENABLE_EVENT_LOGGING
 static
 VOID
@@ -347,6 +368,10 @@ DbgGdiKdbgCliCallback(
     {
         KdbCommand_Gdi_baseobject(argv[1]);
     }
+    else if (stricmp(argv[0], "!gdi.glyphcache") == 0)
+    {
+        KdbCommand_Gdi_glyphcache();
+    }
 #if DBG_ENABLE_EVENT_LOGGING
     else if (stricmp(argv[0], "!gdi.eventlist") == 0)
     {
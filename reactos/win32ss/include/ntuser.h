@@ -79,8 +79,23 @@ typedef enum _USERTHREADINFOCLASS
     UserThreadUseDesktop,
     UserThreadRestoreDesktop,
     UserThreadCsrApiPort,
+    UserThreadPostedMessageInformation, /* ReactOS-specific */
 } USERTHREADINFOCLASS;
 
+/* Posted-message queue counters of a thread, see UserThreadPostedMessageInformation */
+typedef struct _USERTHREAD_POSTEDMESSAGE_INFORMATION
+{
+    ULONG QueueDepth;           /* Posted messages not retrieved yet */
+    ULONG PeakQueueDepth;
+    ULONG PostedCount;
+    ULONG RetrievedCount;
+    ULONG WakeCount;            /* Times the thread queue event was signaled */
+    ULONG CachedCount;          /* Retrieved messages kept for the next posts */
+    ULONG CacheHitCount;        /* Posts that reused a kept message */
+    ULONGLONG TotalLatency;     /* Sum of the post to retrieval delays, in 100ns units */
+    ULONGLONG MaxLatency;
+} USERTHREAD_POSTEDMESSAGE_INFORMATION, *PUSERTHREAD_POSTEDMESSAGE_INFORMATION;
+
 typedef struct _LARGE_UNICODE_STRING
 {
     ULONG Length;
@@ -22,6 +22,9 @@ ULONG_PTR gdwMouseMoveExtraInfo = 0;
 DWORD gdwMouseMoveTimeStamp = 0;
 LIST_ENTRY usmList;
 
+/* Posted messages each thread keeps for reuse */
+#define POSTED_MESSAGE_CACHE_SIZE 64
+
 /* FUNCTIONS *****************************************************************/
 
 INIT_FUNCTION
@@ -438,7 +441,10 @@ MsqWakeQueue(PTHREADINFO pti, DWORD MessageBits, BOOL KeyEvent)
    if (MessageBits & QS_EVENT)       pti->nCntsQBits[QSRosEvent]++;
 
    if (KeyEvent)
+   {
+      pti->PostedMessageInfo.WakeCount++;
       KeSetEvent(pti->pEventQueueServer, IO_NO_INCREMENT, FALSE);
+   }
 }
 
 VOID FASTCALL
@@ -731,18 +737,38 @@ co_MsqInsertMouseMessage(MSG* Msg, DWORD flags, ULONG_PTR dwExtraInfo, BOOL Hook
    }
 }
 
+/*
+ * Allocates a message to be queued. Messages posted to a thread (pti not NULL)
+ * reuse the ones it already retrieved, without going to the global lookaside
+ * list. The caller must set up all the other fields.
+ */
 PUSER_MESSAGE FASTCALL
-MsqCreateMessage(LPMSG Msg)
+MsqCreateMessage(PTHREADINFO pti, LPMSG Msg)
 {
    PUSER_MESSAGE Message;
+   PSINGLE_LIST_ENTRY Entry = NULL;
 
-   Message = ExAllocateFromPagedLookasideList(pgMessageLookasideList);
-   if (!Message)
+   if (pti)
    {
-      return NULL;
+      Entry = PopEntryList(&pti->PostedMessageCache);
+   }
+
+   if (Entry)
+   {
+      pti->PostedMessageInfo.CachedCount--;
+      pti->PostedMessageInfo.CacheHitCount++;
+      /* The cache links the messages through their ListEntry, at offset 0 */
+      Message = (PUSER_MESSAGE)Entry;
+   }
+   else
+   {
+      Message = ExAllocateFromPagedLookasideList(pgMessageLookasideList);
+      if (!Message)
+      {
+         return NULL;
+      }
    }
 
-   RtlZeroMemory(Message, sizeof(*Message));
    RtlMoveMemory(&Message->Msg, Msg, sizeof(MSG));
    PostMsgCount++;
    return Message;
@@ -751,6 +777,8 @@ MsqCreateMessage(LPMSG Msg)
 VOID FASTCALL
 MsqDestroyMessage(PUSER_MESSAGE Message)
 {
+   PTHREADINFO pti;
+
    TRACE("Post Destroy %d\n",PostMsgCount)
    if (Message->pti == NULL)
    {
@@ -758,9 +786,25 @@ MsqDestroyMessage(PUSER_MESSAGE Message)
       return;
    }
    RemoveEntryList(&Message->ListEntry);
+   pti = Message->pti;
    Message->pti = NULL;
-   ExFreeToPagedLookasideList(pgMessageLookasideList, Message);
    PostMsgCount--;
+
+   /* Hardware messages may outlive their thread when queues are attached */
+   if (!Message->HardwareMessage)
+   {
+      pti->PostedMessageInfo.QueueDepth--;
+
+      if (!(pti->TIF_flags & TIF_INCLEANUP) &&
+          pti->PostedMessageInfo.CachedCount < POSTED_MESSAGE_CACHE_SIZE)
+      {
+         PushEntryList(&pti->PostedMessageCache, (PSINGLE_LIST_ENTRY)&Message->ListEntry);
+         pti->PostedMessageInfo.CachedCount++;
+         return;
+      }
+   }
+
+   ExFreeToPagedLookasideList(pgMessageLookasideList, Message);
 }
 
 PUSER_SENT_MESSAGE FASTCALL
@@ -1355,7 +1399,7 @@ MsqPostMessage(PTHREADINFO pti,
       return;
    }
 
-   if(!(Message = MsqCreateMessage(Msg)))
+   if(!(Message = MsqCreateMessage(HardwareMessage ? NULL : pti, Msg)))
    {
       return;
    }
@@ -1365,6 +1409,13 @@ MsqPostMessage(PTHREADINFO pti,
    if (!HardwareMessage)
    {
        InsertTailList(&pti->PostedMessagesListHead, &Message->ListEntry);
+
+       Message->PostTime = KeQueryInterruptTime();
+       pti->PostedMessageInfo.PostedCount++;
+       if (++pti->PostedMessageInfo.QueueDepth > pti->PostedMessageInfo.PeakQueueDepth)
+       {
+           pti->PostedMessageInfo.PeakQueueDepth = pti->PostedMessageInfo.QueueDepth;
+       }
    }
    else
    {
@@ -1376,6 +1427,7 @@ MsqPostMessage(PTHREADINFO pti,
    Message->ExtraInfo = ExtraInfo;
    Message->QS_Flags = MessageBits;
    Message->pti = pti;
+   Message->HardwareMessage = HardwareMessage;
    MsqWakeQueue(pti, MessageBits, TRUE);
    TRACE("Post Message %d\n",PostMsgCount);
 }
@@ -2152,6 +2204,15 @@ MsqPeekMessage(IN PTHREADINFO pti,
          {
              if (CurrentMessage->pti != NULL)
              {
+                ULONGLONG Latency = KeQueryInterruptTime() - CurrentMessage->PostTime;
+
+                pti->PostedMessageInfo.RetrievedCount++;
+                pti->PostedMessageInfo.TotalLatency += Latency;
+                if (Latency > pti->PostedMessageInfo.MaxLatency)
+                {
+                    pti->PostedMessageInfo.MaxLatency = Latency;
+                }
+
                 MsqDestroyMessage(CurrentMessage);
              }
              ClearMsgBitsMask(pti, QS_Flags);
@@ -2259,6 +2320,7 @@ MsqCleanupThreadMsgs(PTHREADINFO pti)
    PLIST_ENTRY CurrentEntry;
    PUSER_MESSAGE CurrentMessage;
    PUSER_SENT_MESSAGE CurrentSentMessage;
+   PSINGLE_LIST_ENTRY CurrentCacheEntry;
 
    TRACE("MsqCleanupThreadMsgs %p\n",pti);
 
@@ -2293,6 +2355,13 @@ MsqCleanupThreadMsgs(PTHREADINFO pti)
       MsqDestroyMessage(CurrentMessage);
    }
 
+   /* free the messages kept for reuse */
+   while ((CurrentCacheEntry = PopEntryList(&pti->PostedMessageCache)))
+   {
+      ExFreeToPagedLookasideList(pgMessageLookasideList, CurrentCacheEntry);
+   }
+   pti->PostedMessageInfo.CachedCount = 0;
+
    /* remove the messages that have not yet been dispatched */
    while (!IsListEmpty(&pti->SentMessagesListHead))
    {
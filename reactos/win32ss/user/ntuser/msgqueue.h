@@ -13,6 +13,8 @@ typedef struct _USER_MESSAGE
   LONG_PTR ExtraInfo;
   DWORD dwQEvent;
   PTHREADINFO pti;
+  BOOLEAN HardwareMessage;
+  ULONGLONG PostTime;
 } USER_MESSAGE, *PUSER_MESSAGE;
 
 struct _USER_MESSAGE_QUEUE;
@@ -132,7 +134,7 @@ VOID CALLBACK HungAppSysTimerProc(HWND,UINT,UINT_PTR,DWORD);
 NTSTATUS FASTCALL co_MsqSendMessage(PTHREADINFO ptirec,
            HWND Wnd, UINT Msg, WPARAM wParam, LPARAM lParam,
            UINT uTimeout, BOOL Block, INT HookMessage, ULONG_PTR *uResult);
-PUSER_MESSAGE FASTCALL MsqCreateMessage(LPMSG Msg);
+PUSER_MESSAGE FASTCALL MsqCreateMessage(PTHREADINFO pti, LPMSG Msg);
 VOID FASTCALL MsqDestroyMessage(PUSER_MESSAGE Message);
 VOID FASTCALL MsqPostMessage(PTHREADINFO, MSG*, BOOLEAN, DWORD, DWORD, LONG_PTR);
 VOID FASTCALL MsqPostQuitMessage(PTHREADINFO pti, ULONG ExitCode);
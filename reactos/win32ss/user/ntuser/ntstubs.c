@@ -595,9 +595,12 @@ NtUserQueryInformationThread(IN HANDLE ThreadHandle,
     NTSTATUS Status = STATUS_SUCCESS;
     PETHREAD Thread;
 
-    /* Allow only CSRSS to perform this operation */
-    if (PsGetCurrentProcess() != gpepCSRSS)
+    /* Allow only CSRSS to perform this operation, the queue counters are for everyone */
+    if (PsGetCurrentProcess() != gpepCSRSS &&
+        ThreadInformationClass != UserThreadPostedMessageInformation)
+    {
         return STATUS_ACCESS_DENIED;
+    }
 
     UserEnterExclusive();
 
@@ -612,6 +615,37 @@ NtUserQueryInformationThread(IN HANDLE ThreadHandle,
 
     switch (ThreadInformationClass)
     {
+        case UserThreadPostedMessageInformation:
+        {
+            PTHREADINFO pti;
+
+            if (ThreadInformationLength != sizeof(USERTHREAD_POSTEDMESSAGE_INFORMATION))
+            {
+                Status = STATUS_INFO_LENGTH_MISMATCH;
+                break;
+            }
+
+            pti = PsGetThreadWin32Thread(Thread);
+            if (pti == NULL)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            _SEH2_TRY
+            {
+                ProbeForWrite(ThreadInformation, sizeof(USERTHREAD_POSTEDMESSAGE_INFORMATION), sizeof(ULONG));
+                *(PUSERTHREAD_POSTEDMESSAGE_INFORMATION)ThreadInformation = pti->PostedMessageInfo;
+            }
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            {
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+
+            break;
+        }
+
         default:
         {
             STUB;
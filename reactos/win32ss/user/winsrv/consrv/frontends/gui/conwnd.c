@@ -608,6 +608,8 @@ OnNcCreate(HWND hWnd, LPCREATESTRUCTW Create)
 {
     PGUI_CONSOLE_DATA GuiData = (PGUI_CONSOLE_DATA)Create->lpCreateParams;
     PCONSRV_CONSOLE Console;
+    HDC hDC;
+    INT RefreshRate;
 
     if (NULL == GuiData)
     {
@@ -637,6 +639,13 @@ OnNcCreate(HWND hWnd, LPCREATESTRUCTW Create)
     GuiData->hBitmap = NULL;
     GuiData->hSysPalette = NULL; /* Original system palette */
 
+    /* Do not repaint the text faster than the display refreshes */
+    hDC = GetDC(NULL);
+    RefreshRate = GetDeviceCaps(hDC, VREFRESH);
+    ReleaseDC(NULL, hDC);
+    if (RefreshRate <= 1) RefreshRate = 60; /* 0 and 1 mean the hardware default */
+    GuiData->RefreshTime = 1000 / RefreshRate;
+
     /* Update the icons of the window */
     if (GuiData->hIcon != ghDefaultIcon)
     {
@@ -1287,6 +1296,10 @@ VOID
 InvalidateCell(PGUI_CONSOLE_DATA GuiData,
                SHORT x, SHORT y);
 
+VOID
+GuiRefreshTextModeView(PTEXTMODE_SCREEN_BUFFER Buffer,
+                       PGUI_CONSOLE_DATA GuiData);
+
 static VOID
 OnTimer(PGUI_CONSOLE_DATA GuiData)
 {
@@ -1304,8 +1317,16 @@ OnTimer(PGUI_CONSOLE_DATA GuiData)
 
     if (GetType(Buff) == TEXTMODE_BUFFER)
     {
-        InvalidateCell(GuiData, Buff->CursorPosition.X, Buff->CursorPosition.Y);
-        Buff->CursorBlinkOn = !Buff->CursorBlinkOn;
+        if (GuiData->RefreshPending)
+        {
+            /* Show the output written since the last refresh */
+            GuiRefreshTextModeView((PTEXTMODE_SCREEN_BUFFER)Buff, GuiData);
+        }
+        else
+        {
+            InvalidateCell(GuiData, Buff->CursorPosition.X, Buff->CursorPosition.Y);
+            Buff->CursorBlinkOn = !Buff->CursorBlinkOn;
+        }
 
         if ((GuiData->OldCursor.x != Buff->CursorPosition.X) ||
             (GuiData->OldCursor.y != Buff->CursorPosition.Y))
@@ -1390,6 +1411,8 @@ OnTimer(PGUI_CONSOLE_DATA GuiData)
     }
     else /* if (GetType(Buff) == GRAPHICS_BUFFER) */
     {
+        GuiData->RefreshPending = FALSE;
+        GuiData->PendingScroll  = 0;
     }
 
     LeaveCriticalSection(&Console->Lock);
@@ -1434,6 +1457,7 @@ OnNcDestroy(HWND hWnd)
         /* Free the terminal framebuffer */
         if (GuiData->hMemDC ) DeleteDC(GuiData->hMemDC);
         if (GuiData->hBitmap) DeleteObject(GuiData->hBitmap);
+        if (GuiData->DirtyLines.Buffer) ConsoleFreeHeap(GuiData->DirtyLines.Buffer);
         // if (GuiData->hSysPalette) DeleteObject(GuiData->hSysPalette);
         DeleteFonts(GuiData);
     }
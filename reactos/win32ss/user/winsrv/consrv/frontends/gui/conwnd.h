@@ -86,6 +86,22 @@ typedef struct _GUI_CONSOLE_DATA
     UINT CharHeight;    /* both normal and bold/underlined fonts...              */
 /*****************************************************/
 
+/*** Damage tracking of the text-mode framebuffer, see text.c ***/
+    RTL_BITMAP DirtyLines;              /* Rows of the screen-buffer memory whose framebuffer line is out of date */
+    PCONSOLE_SCREEN_BUFFER DrawnBuffer; /* What the framebuffer was drawn from and with... */
+    HBITMAP  DrawnBitmap;
+    HFONT    DrawnFont;
+    HPALETTE DrawnPalette;
+    COORD    DrawnSize;
+    COLORREF DrawnColors[16];
+    USHORT   DrawnVirtualY;             /* ... and the screen-buffer scrolling it reflects */
+    COORD    DrawnCursor;               /* Caret drawn in the framebuffer, by screen-buffer memory row; Y == -1 if none */
+
+    UINT RefreshTime;                   /* Minimum time between two repaints, in ms */
+    BOOLEAN RefreshPending;             /* A repaint is scheduled */
+    UINT PendingScroll;                 /* Lines scrolled since the last repaint */
+/*****************************************************/
+
     PCONSRV_CONSOLE Console;           /* Pointer to the owned console */
     PCONSOLE_SCREEN_BUFFER ActiveBuffer;    /* Pointer to the active screen buffer (then maybe the previous Console member is redundant?? Or not...) */
     CONSOLE_SELECTION_INFO Selection;       /* Contains information about the selection */
@@ -19,8 +19,6 @@
 #include "guiterm.h"
 #include "resource.h"
 
-// HACK!! Remove it when the hack in GuiWriteStream is fixed
-#define CONGUI_UPDATE_TIME    0
 #define CONGUI_UPDATE_TIMER   1
 
 #define PM_CREATE_CONSOLE     (WM_APP + 1)
@@ -92,12 +90,35 @@ SmallRectToRect(PGUI_CONSOLE_DATA GuiData, PRECT Rect, PSMALL_RECT SmallRect)
     Rect->bottom = (SmallRect->Bottom + 1 - Buffer->ViewOrigin.Y) * HeightUnit;
 }
 
+/* NOTE: Defined in text.c */
+VOID
+GuiMarkTextLinesDirty(PGUI_CONSOLE_DATA GuiData,
+                      SHORT Top,
+                      SHORT Bottom);
+
+static VOID
+ScheduleRefresh(PGUI_CONSOLE_DATA GuiData)
+{
+    /*
+     * Repaint at most once per refresh interval: output coming faster
+     * than that only accumulates dirty lines and scrolling until then.
+     */
+    if (!GuiData->RefreshPending)
+    {
+        GuiData->RefreshPending = TRUE;
+        SetTimer(GuiData->hWindow, CONGUI_UPDATE_TIMER, GuiData->RefreshTime, NULL);
+    }
+}
+
 static VOID
 DrawRegion(PGUI_CONSOLE_DATA GuiData,
            SMALL_RECT* Region)
 {
     RECT RegionRect;
 
+    if (GetType(GuiData->ActiveBuffer) == TEXTMODE_BUFFER)
+        GuiMarkTextLinesDirty(GuiData, Region->Top, Region->Bottom);
+
     SmallRectToRect(GuiData, &RegionRect, Region);
     /* Do not erase the background: it speeds up redrawing and reduce flickering */
     InvalidateRect(GuiData->hWindow, &RegionRect, FALSE);
@@ -657,7 +678,15 @@ GuiDrawRegion(IN OUT PFRONTEND This,
     /* Do nothing if the window is hidden */
     if (!GuiData->IsWindowVisible) return;
 
-    DrawRegion(GuiData, Region);
+    if (GetType(GuiData->ActiveBuffer) == TEXTMODE_BUFFER)
+    {
+        GuiMarkTextLinesDirty(GuiData, Region->Top, Region->Bottom);
+        ScheduleRefresh(GuiData);
+    }
+    else
+    {
+        DrawRegion(GuiData, Region);
+    }
 }
 
 static VOID NTAPI
@@ -671,8 +700,6 @@ GuiWriteStream(IN OUT PFRONTEND This,
 {
     PGUI_CONSOLE_DATA GuiData = This->Context;
     PCONSOLE_SCREEN_BUFFER Buff;
-    SHORT CursorEndX, CursorEndY;
-    RECT ScrollRect;
 
     if (NULL == GuiData || NULL == GuiData->hWindow) return;
 
@@ -682,45 +709,18 @@ GuiWriteStream(IN OUT PFRONTEND This,
     Buff = GuiData->ActiveBuffer;
     if (GetType(Buff) != TEXTMODE_BUFFER) return;
 
-    if (0 != ScrolledLines)
-    {
-        ScrollRect.left = 0;
-        ScrollRect.top = 0;
-        ScrollRect.right = Buff->ViewSize.X * GuiData->CharWidth;
-        ScrollRect.bottom = Region->Top * GuiData->CharHeight;
-
-        ScrollWindowEx(GuiData->hWindow,
-                       0,
-                       -(int)(ScrolledLines * GuiData->CharHeight),
-                       &ScrollRect,
-                       NULL,
-                       NULL,
-                       NULL,
-                       SW_INVALIDATE);
-    }
-
-    DrawRegion(GuiData, Region);
-
-    if (CursorStartX < Region->Left || Region->Right < CursorStartX
-            || CursorStartY < Region->Top || Region->Bottom < CursorStartY)
-    {
-        InvalidateCell(GuiData, CursorStartX, CursorStartY);
-    }
+    /*
+     * Only record what changed: the window is scrolled and repainted
+     * once per refresh interval by GuiRefreshTextModeView.
+     */
+    GuiData->PendingScroll += ScrolledLines;
 
-    CursorEndX = Buff->CursorPosition.X;
-    CursorEndY = Buff->CursorPosition.Y;
-    if ((CursorEndX < Region->Left || Region->Right < CursorEndX
-            || CursorEndY < Region->Top || Region->Bottom < CursorEndY)
-            && (CursorEndX != CursorStartX || CursorEndY != CursorStartY))
-    {
-        InvalidateCell(GuiData, CursorEndX, CursorEndY);
-    }
+    GuiMarkTextLinesDirty(GuiData, Region->Top, Region->Bottom);
+    GuiMarkTextLinesDirty(GuiData, CursorStartY, CursorStartY);
+    GuiMarkTextLinesDirty(GuiData, Buff->CursorPosition.Y, Buff->CursorPosition.Y);
 
-    // HACK!!
-    // Set up the update timer (very short interval) - this is a "hack" for getting the OS to
-    // repaint the window without having it just freeze up and stay on the screen permanently.
     Buff->CursorBlinkOn = TRUE;
-    SetTimer(GuiData->hWindow, CONGUI_UPDATE_TIMER, CONGUI_UPDATE_TIME, NULL);
+    ScheduleRefresh(GuiData);
 }
 
 /* static */ VOID NTAPI
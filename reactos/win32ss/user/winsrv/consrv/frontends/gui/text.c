@@ -339,6 +339,154 @@ GuiPasteToTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
     GlobalUnlock(hData);
 }
 
+/*
+ * The framebuffer keeps what was drawn, as long as it was drawn from the same
+ * screen-buffer with the same font and colors. Only the lines that changed
+ * since are drawn again: the DirtyLines bitmap is indexed by the rows of the
+ * screen-buffer memory, so that it stays valid when VirtualY scrolls the
+ * screen-buffer, while the framebuffer lines are scrolled along with it.
+ */
+
+static VOID
+MarkDirtyRows(PGUI_CONSOLE_DATA GuiData,
+              ULONG FirstRow,
+              ULONG Count)
+{
+    ULONG Rows = GuiData->DirtyLines.SizeOfBitMap;
+
+    if (FirstRow + Count <= Rows)
+    {
+        RtlSetBits(&GuiData->DirtyLines, FirstRow, Count);
+    }
+    else
+    {
+        /* The lines wrap around the end of the screen-buffer memory */
+        RtlSetBits(&GuiData->DirtyLines, FirstRow, Rows - FirstRow);
+        RtlSetBits(&GuiData->DirtyLines, 0, Count - (Rows - FirstRow));
+    }
+}
+
+VOID
+GuiMarkTextLinesDirty(PGUI_CONSOLE_DATA GuiData,
+                      SHORT Top,
+                      SHORT Bottom)
+{
+    PTEXTMODE_SCREEN_BUFFER Buffer = (PTEXTMODE_SCREEN_BUFFER)GuiData->ActiveBuffer;
+    ULONG Rows = GuiData->DirtyLines.SizeOfBitMap;
+
+    /* Everything gets drawn anyway if the framebuffer does not match the buffer */
+    if (GuiData->DrawnBuffer != GuiData->ActiveBuffer || GetType(Buffer) != TEXTMODE_BUFFER)
+        return;
+    if (GuiData->DirtyLines.Buffer == NULL || Rows != (ULONG)Buffer->ScreenBufferSize.Y)
+        return;
+
+    if (Top < 0) Top = 0;
+    if (Bottom >= (SHORT)Rows) Bottom = (SHORT)Rows - 1;
+    if (Top > Bottom) return;
+
+    MarkDirtyRows(GuiData, (Top + Buffer->VirtualY) % Rows, Bottom - Top + 1);
+}
+
+static VOID
+SyncFramebuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
+                PGUI_CONSOLE_DATA GuiData)
+{
+    PCONSRV_CONSOLE Console = Buffer->Header.Console;
+    ULONG Rows = Buffer->ScreenBufferSize.Y;
+    ULONG Shift, SizeInBytes;
+    RECT rcFramebuffer;
+
+    if (GuiData->DrawnBuffer  != (PCONSOLE_SCREEN_BUFFER)Buffer   ||
+        GuiData->DrawnBitmap  != GuiData->hBitmap                 ||
+        GuiData->DrawnFont    != GuiData->Font[FONT_NORMAL]       ||
+        GuiData->DrawnPalette != Buffer->PaletteHandle            ||
+        GuiData->DrawnSize.X  != Buffer->ScreenBufferSize.X       ||
+        GuiData->DrawnSize.Y  != Buffer->ScreenBufferSize.Y       ||
+        RtlCompareMemory(GuiData->DrawnColors, Console->Colors,
+                         sizeof(Console->Colors)) != sizeof(Console->Colors))
+    {
+        /* The whole framebuffer must be drawn again */
+        if (GuiData->DirtyLines.SizeOfBitMap != Rows)
+        {
+            if (GuiData->DirtyLines.Buffer)
+                ConsoleFreeHeap(GuiData->DirtyLines.Buffer);
+
+            SizeInBytes = ((Rows + 31) / 32) * sizeof(ULONG);
+            RtlInitializeBitMap(&GuiData->DirtyLines,
+                                ConsoleAllocHeap(0, SizeInBytes),
+                                Rows);
+            if (GuiData->DirtyLines.Buffer == NULL)
+            {
+                /* We will just draw everything we are asked for */
+                GuiData->DirtyLines.SizeOfBitMap = 0;
+            }
+        }
+        if (GuiData->DirtyLines.Buffer)
+            RtlSetAllBits(&GuiData->DirtyLines);
+
+        GuiData->DrawnBuffer   = (PCONSOLE_SCREEN_BUFFER)Buffer;
+        GuiData->DrawnBitmap   = GuiData->hBitmap;
+        GuiData->DrawnFont     = GuiData->Font[FONT_NORMAL];
+        GuiData->DrawnPalette  = Buffer->PaletteHandle;
+        GuiData->DrawnSize     = Buffer->ScreenBufferSize;
+        GuiData->DrawnVirtualY = Buffer->VirtualY;
+        GuiData->DrawnCursor.Y = -1;
+        RtlCopyMemory(GuiData->DrawnColors, Console->Colors, sizeof(Console->Colors));
+        return;
+    }
+
+    if (GuiData->DrawnVirtualY != Buffer->VirtualY)
+    {
+        /*
+         * The screen-buffer scrolled since the last paint: scroll the lines
+         * already drawn the same way instead of drawing them again.
+         */
+        Shift = (Buffer->VirtualY + Rows - GuiData->DrawnVirtualY) % Rows;
+
+        rcFramebuffer.left   = 0;
+        rcFramebuffer.top    = 0;
+        rcFramebuffer.right  = Buffer->ScreenBufferSize.X * GuiData->CharWidth;
+        rcFramebuffer.bottom = Rows * GuiData->CharHeight;
+        ScrollDC(GuiData->hMemDC, 0, -(INT)(Shift * GuiData->CharHeight),
+                 &rcFramebuffer, &rcFramebuffer, NULL, NULL);
+
+        /* The bottom lines were not drawn at their new place */
+        if (GuiData->DirtyLines.Buffer)
+            MarkDirtyRows(GuiData, (Rows - Shift + Buffer->VirtualY) % Rows, Shift);
+
+        GuiData->DrawnVirtualY = Buffer->VirtualY;
+    }
+}
+
+static VOID
+DrawTextRun(PGUI_CONSOLE_DATA GuiData,
+            ULONG Start,
+            ULONG Line,
+            PWCHAR Run,
+            ULONG Length,
+            BOOLEAN IsBlank)
+{
+    RECT rcRun;
+
+    if (IsBlank)
+    {
+        /* Only the background to fill, no glyph to render */
+        rcRun.left   = Start * GuiData->CharWidth;
+        rcRun.top    = Line  * GuiData->CharHeight;
+        rcRun.right  = (Start + Length) * GuiData->CharWidth;
+        rcRun.bottom = (Line + 1) * GuiData->CharHeight;
+        ExtTextOutW(GuiData->hMemDC, rcRun.left, rcRun.top, ETO_OPAQUE, &rcRun, NULL, 0, NULL);
+    }
+    else
+    {
+        TextOutW(GuiData->hMemDC,
+                 Start * GuiData->CharWidth,
+                 Line  * GuiData->CharHeight,
+                 Run,
+                 Length);
+    }
+}
+
 VOID
 GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
                        PGUI_CONSOLE_DATA GuiData,
@@ -349,14 +497,16 @@ GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
     // ASSERT(Console == GuiData->Console);
 
     ULONG TopLine, BottomLine, LeftChar, RightChar;
-    ULONG Line, Char, Start;
+    ULONG Line, Char, Start, Row, Rows;
     PCHAR_INFO From;
     PWCHAR To;
     WORD LastAttribute, Attribute;
     ULONG CursorX, CursorY, CursorHeight;
     HBRUSH CursorBrush, OldBrush;
     HFONT OldFont, NewFont;
-    BOOLEAN IsUnderline;
+    BOOLEAN IsUnderline, IsBlank, CursorLineDrawn = FALSE;
+    BOOLEAN Tracked;
+    WCHAR LineBuffer[256];  // Buffer containing a run of characters with the same attribute
 
     if (Buffer->Buffer == NULL) return;
 
@@ -367,14 +517,42 @@ GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
     rcFramebuffer->right  = Buffer->ViewOrigin.X * GuiData->CharWidth  + rcView->right;
     rcFramebuffer->bottom = Buffer->ViewOrigin.Y * GuiData->CharHeight + rcView->bottom;
 
-    LeftChar   = rcFramebuffer->left   / GuiData->CharWidth;
     TopLine    = rcFramebuffer->top    / GuiData->CharHeight;
-    RightChar  = rcFramebuffer->right  / GuiData->CharWidth;
     BottomLine = rcFramebuffer->bottom / GuiData->CharHeight;
 
-    if (RightChar  >= (ULONG)Buffer->ScreenBufferSize.X) RightChar  = Buffer->ScreenBufferSize.X - 1;
     if (BottomLine >= (ULONG)Buffer->ScreenBufferSize.Y) BottomLine = Buffer->ScreenBufferSize.Y - 1;
 
+    /* Dirty lines are always drawn in full, so that they are then up to date */
+    LeftChar  = 0;
+    RightChar = Buffer->ScreenBufferSize.X - 1;
+
+    SyncFramebuffer(Buffer, GuiData);
+    Rows    = Buffer->ScreenBufferSize.Y;
+    Tracked = (GuiData->DirtyLines.Buffer != NULL);
+
+    /* The caret drawn at the last paint must be erased if it moved or blinked off */
+    CursorY = (Buffer->CursorPosition.Y + Buffer->VirtualY) % Rows;
+    if (Tracked && GuiData->DrawnCursor.Y >= 0 &&
+        ((ULONG)GuiData->DrawnCursor.Y != CursorY || GuiData->DrawnCursor.X != Buffer->CursorPosition.X ||
+         !Buffer->CursorInfo.bVisible || !Buffer->CursorBlinkOn || Buffer->ForceCursorOff))
+    {
+        RtlSetBit(&GuiData->DirtyLines, GuiData->DrawnCursor.Y);
+
+        /* It may lie outside of the area being painted */
+        Line = (GuiData->DrawnCursor.Y + Rows - Buffer->VirtualY) % Rows;
+        if (Line < TopLine || Line > BottomLine)
+        {
+            RECT rcLine;
+
+            rcLine.left   = 0;
+            rcLine.right  = Buffer->ViewSize.X * GuiData->CharWidth;
+            rcLine.top    = ((LONG)Line - Buffer->ViewOrigin.Y) * GuiData->CharHeight;
+            rcLine.bottom = rcLine.top + GuiData->CharHeight;
+            InvalidateRect(GuiData->hWindow, &rcLine, FALSE);
+        }
+        GuiData->DrawnCursor.Y = -1;
+    }
+
     LastAttribute = ConioCoordToPointer(Buffer, LeftChar, TopLine)->Attributes;
 
     SetTextColor(GuiData->hMemDC, PaletteRGBFromAttrib(Console, TextAttribFromAttrib(LastAttribute)));
@@ -388,26 +566,32 @@ GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
 
     for (Line = TopLine; Line <= BottomLine; Line++)
     {
-        WCHAR LineBuffer[80];   // Buffer containing a part or all the line to be displayed
-        From  = ConioCoordToPointer(Buffer, LeftChar, Line);    // Get the first code of the line
-        Start = LeftChar;
-        To    = LineBuffer;
+        /* Skip the lines the framebuffer already holds */
+        Row = (Line + Buffer->VirtualY) % Rows;
+        if (Tracked)
+        {
+            if (!RtlTestBit(&GuiData->DirtyLines, Row)) continue;
+            RtlClearBit(&GuiData->DirtyLines, Row);
+        }
+        if (Line == (ULONG)Buffer->CursorPosition.Y) CursorLineDrawn = TRUE;
+
+        From    = ConioCoordToPointer(Buffer, LeftChar, Line);    // Get the first code of the line
+        Start   = LeftChar;
+        To      = LineBuffer;
+        IsBlank = TRUE;
 
         for (Char = LeftChar; Char <= RightChar; Char++)
         {
             /*
-             * We flush the buffer if the new attribute is different
+             * We flush the run if the new attribute is different
              * from the current one, or if the buffer is full.
              */
             if (From->Attributes != LastAttribute || (Char - Start == sizeof(LineBuffer) / sizeof(WCHAR)))
             {
-                TextOutW(GuiData->hMemDC,
-                         Start * GuiData->CharWidth,
-                         Line  * GuiData->CharHeight,
-                         LineBuffer,
-                         Char - Start);
-                Start = Char;
-                To    = LineBuffer;
+                DrawTextRun(GuiData, Start, Line, LineBuffer, Char - Start, IsBlank);
+                Start   = Char;
+                To      = LineBuffer;
+                IsBlank = TRUE;
                 Attribute = From->Attributes;
                 if (Attribute != LastAttribute)
                 {
@@ -426,23 +610,22 @@ GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
                 }
             }
 
+            /* Underlined blanks still need to be drawn */
+            if (From->Char.UnicodeChar != L' ' || IsUnderline) IsBlank = FALSE;
             *(To++) = (From++)->Char.UnicodeChar;
         }
 
-        TextOutW(GuiData->hMemDC,
-                 Start * GuiData->CharWidth,
-                 Line  * GuiData->CharHeight,
-                 LineBuffer,
-                 RightChar - Start + 1);
+        DrawTextRun(GuiData, Start, Line, LineBuffer, RightChar - Start + 1, IsBlank);
     }
 
     /* Restore the old font */
     SelectObject(GuiData->hMemDC, OldFont);
 
     /*
-     * Draw the caret
+     * Draw the caret, over the line that was just drawn
      */
-    if (Buffer->CursorInfo.bVisible &&
+    if (CursorLineDrawn &&
+        Buffer->CursorInfo.bVisible &&
         Buffer->CursorBlinkOn &&
         !Buffer->ForceCursorOff)
     {
@@ -468,10 +651,83 @@ GuiPaintTextModeBuffer(PTEXTMODE_SCREEN_BUFFER Buffer,
 
             SelectObject(GuiData->hMemDC, OldBrush);
             DeleteObject(CursorBrush);
+
+            GuiData->DrawnCursor.X = (SHORT)CursorX;
+            GuiData->DrawnCursor.Y = (SHORT)((CursorY + Buffer->VirtualY) % Rows);
         }
     }
 
     LeaveCriticalSection(&Console->Lock);
 }
 
+/*
+ * Called at most once per refresh interval, to bring the window up to date
+ * with all the output written since the last time.
+ */
+VOID
+GuiRefreshTextModeView(PTEXTMODE_SCREEN_BUFFER Buffer,
+                       PGUI_CONSOLE_DATA GuiData)
+{
+    RECT rcView, rcLines;
+    ULONG Line, FirstDirty, Rows;
+    BOOLEAN Dirty;
+
+    GuiData->RefreshPending = FALSE;
+
+    rcView.left   = 0;
+    rcView.top    = 0;
+    rcView.right  = Buffer->ViewSize.X * GuiData->CharWidth;
+    rcView.bottom = Buffer->ViewSize.Y * GuiData->CharHeight;
+
+    /* Reuse what is already on screen for the lines that just scrolled */
+    if (GuiData->PendingScroll >= (UINT)Buffer->ViewSize.Y)
+    {
+        InvalidateRect(GuiData->hWindow, &rcView, FALSE);
+    }
+    else if (GuiData->PendingScroll != 0)
+    {
+        ScrollWindowEx(GuiData->hWindow,
+                       0,
+                       -(int)(GuiData->PendingScroll * GuiData->CharHeight),
+                       &rcView,
+                       NULL,
+                       NULL,
+                       NULL,
+                       SW_INVALIDATE);
+    }
+    GuiData->PendingScroll = 0;
+
+    Rows = GuiData->DirtyLines.SizeOfBitMap;
+    if (GuiData->DirtyLines.Buffer == NULL ||
+        GuiData->DrawnBuffer != (PCONSOLE_SCREEN_BUFFER)Buffer ||
+        Rows != (ULONG)Buffer->ScreenBufferSize.Y)
+    {
+        /* Nothing drawn yet, or not tracked */
+        InvalidateRect(GuiData->hWindow, &rcView, FALSE);
+        return;
+    }
+
+    /* Invalidate the visible dirty lines, by runs of consecutive lines */
+    FirstDirty = 0;
+    Dirty = FALSE;
+    for (Line = Buffer->ViewOrigin.Y; Line <= (ULONG)(Buffer->ViewOrigin.Y + Buffer->ViewSize.Y); Line++)
+    {
+        if (Line < (ULONG)(Buffer->ViewOrigin.Y + Buffer->ViewSize.Y) && Line < Rows &&
+            RtlTestBit(&GuiData->DirtyLines, (Line + Buffer->VirtualY) % Rows))
+        {
+            if (!Dirty) FirstDirty = Line;
+            Dirty = TRUE;
+        }
+        else if (Dirty)
+        {
+            rcLines.left   = 0;
+            rcLines.right  = rcView.right;
+            rcLines.top    = (FirstDirty - Buffer->ViewOrigin.Y) * GuiData->CharHeight;
+            rcLines.bottom = (Line - Buffer->ViewOrigin.Y) * GuiData->CharHeight;
+            InvalidateRect(GuiData->hWindow, &rcLines, FALSE);
+            Dirty = FALSE;
+        }
+    }
+}
+
 /* EOF */
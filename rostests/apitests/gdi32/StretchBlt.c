@@ -0,0 +1,298 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for StretchBlt between DIB sections
+ */
+
+#include <apitest.h>
+
+#include <wingdi.h>
+
+#define SRC_WIDTH   20
+#define SRC_HEIGHT  16
+#define DST_WIDTH   40
+#define DST_HEIGHT  30
+
+typedef struct
+{
+    BITMAPINFOHEADER bmiHeader;
+    RGBQUAD bmiColors[256];
+} BITMAPINFO256;
+
+typedef struct
+{
+    HDC hdc;
+    HBITMAP hbmp;
+    HBITMAP hbmpOld;
+    PUCHAR pjBits;
+    ULONG cBitsPixel;
+    ULONG lDelta;
+} TEST_DIB, *PTEST_DIB;
+
+/* The source rectangle, and how many source pixels in a row are equal */
+typedef struct
+{
+    INT xSrc, ySrc, cxSrc, cySrc;
+    INT xDst, yDst, cxDst, cyDst;
+    INT cxBlock, cyBlock;
+} STRETCH_CASE;
+
+/*
+ * Only whole ratios are used: enlarging repeats every source pixel, and
+ * shrinking reads blocks of equal source pixels, so the expected result
+ * does not depend on which pixel of a block gets picked.
+ */
+static const STRETCH_CASE StretchCases[] =
+{
+    { 3, 2, 12, 9,   1, 1, 12,  9,  1, 1 },  /* Same size */
+    { 3, 2, 12, 9,   2, 1, 24, 18,  1, 1 },  /* Twice as large */
+    { 1, 3, 13, 9,   0, 0, 39,  9,  1, 1 },  /* Three times as wide */
+    { 5, 1,  7, 9,   3, 1,  7, 27,  1, 1 },  /* Three times as high */
+    { 3, 2, 12, 9,   1, 4,  6,  3,  2, 3 },  /* Half as wide, a third as high */
+    { 2, 4, 18, 8,   1, 1,  6, 16,  3, 1 },  /* A third as wide, twice as high */
+};
+
+static const ULONG SourceFormats[] = { 1, 4, 8, 16, 24, 32 };
+static const ULONG TargetFormats[] = { 8, 16, 24, 32 };
+static const DWORD Rops[] = { SRCCOPY, NOTSRCCOPY, SRCINVERT, SRCAND };
+
+static
+ULONG
+GetBits(
+    PTEST_DIB Dib,
+    INT x,
+    INT y)
+{
+    PUCHAR pj = Dib->pjBits + y * Dib->lDelta;
+
+    switch (Dib->cBitsPixel)
+    {
+        case 1: return (pj[x / 8] >> (7 - x % 8)) & 1;
+        case 4: return (pj[x / 2] >> ((x % 2) ? 0 : 4)) & 0xF;
+        case 8: return pj[x];
+        case 16: return ((PUSHORT)pj)[x];
+        case 24: return pj[x * 3] | (pj[x * 3 + 1] << 8) | (pj[x * 3 + 2] << 16);
+        default: return ((PULONG)pj)[x];
+    }
+}
+
+static
+VOID
+SetBits(
+    PTEST_DIB Dib,
+    INT x,
+    INT y,
+    ULONG Value)
+{
+    PUCHAR pj = Dib->pjBits + y * Dib->lDelta;
+
+    switch (Dib->cBitsPixel)
+    {
+        case 1:
+            pj[x / 8] = (UCHAR)((pj[x / 8] & ~(0x80 >> (x % 8))) | ((Value & 1) << (7 - x % 8)));
+            break;
+        case 4:
+            if (x % 2)
+                pj[x / 2] = (UCHAR)((pj[x / 2] & 0xF0) | (Value & 0xF));
+            else
+                pj[x / 2] = (UCHAR)((pj[x / 2] & 0x0F) | ((Value & 0xF) << 4));
+            break;
+        case 8: pj[x] = (UCHAR)Value; break;
+        case 16: ((PUSHORT)pj)[x] = (USHORT)(Value & 0x7FFF); break;
+        case 24:
+            pj[x * 3] = (UCHAR)Value;
+            pj[x * 3 + 1] = (UCHAR)(Value >> 8);
+            pj[x * 3 + 2] = (UCHAR)(Value >> 16);
+            break;
+        default: ((PULONG)pj)[x] = Value & 0xFFFFFF; break;
+    }
+}
+
+static
+BOOL
+CreateTestDib(
+    PTEST_DIB Dib,
+    ULONG cBitsPixel,
+    INT cx,
+    INT cy)
+{
+    BITMAPINFO256 bmi;
+    ULONG i;
+
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = cx;
+    bmi.bmiHeader.biHeight = -cy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = (WORD)cBitsPixel;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    if (cBitsPixel <= 8)
+    {
+        bmi.bmiHeader.biClrUsed = 1 << cBitsPixel;
+        for (i = 0; i < bmi.bmiHeader.biClrUsed; i++)
+        {
+            bmi.bmiColors[i].rgbRed = (BYTE)(i * 37 + 11);
+            bmi.bmiColors[i].rgbGreen = (BYTE)(i * 91 + 3);
+            bmi.bmiColors[i].rgbBlue = (BYTE)(i * 53 + 29);
+        }
+    }
+
+    Dib->cBitsPixel = cBitsPixel;
+    Dib->lDelta = ((cx * cBitsPixel + 31) / 32) * 4;
+    Dib->hdc = CreateCompatibleDC(NULL);
+    Dib->hbmp = CreateDIBSection(NULL, (BITMAPINFO *)&bmi, DIB_RGB_COLORS, (PVOID *)&Dib->pjBits, NULL, 0);
+    if (!Dib->hdc || !Dib->hbmp)
+    {
+        if (Dib->hdc) DeleteDC(Dib->hdc);
+        if (Dib->hbmp) DeleteObject(Dib->hbmp);
+        return FALSE;
+    }
+
+    Dib->hbmpOld = SelectObject(Dib->hdc, Dib->hbmp);
+    SetStretchBltMode(Dib->hdc, COLORONCOLOR);
+    return TRUE;
+}
+
+static
+VOID
+DeleteTestDib(
+    PTEST_DIB Dib)
+{
+    SelectObject(Dib->hdc, Dib->hbmpOld);
+    DeleteDC(Dib->hdc);
+    DeleteObject(Dib->hbmp);
+}
+
+static
+ULONG
+Hash(
+    INT x,
+    INT y)
+{
+    ULONG Value = (ULONG)(x * 7919 + y * 104729 + 12345);
+
+    Value ^= Value >> 7;
+    Value *= 2654435761U;
+    return Value ^ (Value >> 13);
+}
+
+/* Source pixels are equal within the blocks of the case, counted from the source rectangle */
+static
+VOID
+FillSource(
+    PTEST_DIB Src,
+    const STRETCH_CASE *Case)
+{
+    INT x, y;
+
+    for (y = 0; y < SRC_HEIGHT; y++)
+    {
+        for (x = 0; x < SRC_WIDTH; x++)
+        {
+            SetBits(Src, x, y, Hash((x - Case->xSrc + 64 * Case->cxBlock) / Case->cxBlock,
+                                    (y - Case->ySrc + 64 * Case->cyBlock) / Case->cyBlock));
+        }
+    }
+}
+
+static
+VOID
+FillTarget(
+    PTEST_DIB Dst)
+{
+    INT x, y;
+
+    for (y = 0; y < DST_HEIGHT; y++)
+    {
+        for (x = 0; x < DST_WIDTH; x++)
+            SetBits(Dst, x, y, Hash(x + 1000, y));
+    }
+}
+
+static
+VOID
+TestStretch(
+    PTEST_DIB Src,
+    PTEST_DIB Dst,
+    PTEST_DIB Ref,
+    const STRETCH_CASE *Case,
+    DWORD Rop)
+{
+    INT x, y, xSrc, ySrc, Errors = 0;
+    BOOL Ret;
+
+    FillSource(Src, Case);
+    FillTarget(Dst);
+    FillTarget(Ref);
+
+    Ret = StretchBlt(Dst->hdc, Case->xDst, Case->yDst, Case->cxDst, Case->cyDst,
+                     Src->hdc, Case->xSrc, Case->ySrc, Case->cxSrc, Case->cySrc, Rop);
+    ok(Ret, "StretchBlt failed\n");
+
+    /* The reference copies every pixel on its own, without stretching */
+    for (y = 0; y < Case->cyDst; y++)
+    {
+        ySrc = Case->ySrc + (y * Case->cySrc) / Case->cyDst;
+        for (x = 0; x < Case->cxDst; x++)
+        {
+            xSrc = Case->xSrc + (x * Case->cxSrc) / Case->cxDst;
+            BitBlt(Ref->hdc, Case->xDst + x, Case->yDst + y, 1, 1, Src->hdc, xSrc, ySrc, Rop);
+        }
+    }
+    GdiFlush();
+
+    /* Pixels outside the target rectangle must not change either */
+    for (y = 0; y < DST_HEIGHT; y++)
+    {
+        for (x = 0; x < DST_WIDTH; x++)
+        {
+            if (GetBits(Dst, x, y) != GetBits(Ref, x, y) && Errors++ == 0)
+            {
+                ok(0, "%lu bpp to %lu bpp, %d x %d to %d x %d, rop 0x%lx: pixel (%d, %d) is 0x%lx, expected 0x%lx\n",
+                   Src->cBitsPixel, Dst->cBitsPixel, Case->cxSrc, Case->cySrc, Case->cxDst, Case->cyDst, Rop,
+                   x, y, GetBits(Dst, x, y), GetBits(Ref, x, y));
+            }
+        }
+    }
+}
+
+START_TEST(StretchBlt)
+{
+    TEST_DIB Src, Dst, Ref;
+    ULONG i, j, k, l;
+
+    for (i = 0; i < sizeof(SourceFormats) / sizeof(SourceFormats[0]); i++)
+    {
+        if (!CreateTestDib(&Src, SourceFormats[i], SRC_WIDTH, SRC_HEIGHT))
+        {
+            skip("Cannot create a %lu bpp DIB section\n", SourceFormats[i]);
+            continue;
+        }
+
+        for (j = 0; j < sizeof(TargetFormats) / sizeof(TargetFormats[0]); j++)
+        {
+            if (!CreateTestDib(&Dst, TargetFormats[j], DST_WIDTH, DST_HEIGHT))
+            {
+                skip("Cannot create a %lu bpp DIB section\n", TargetFormats[j]);
+                continue;
+            }
+            if (!CreateTestDib(&Ref, TargetFormats[j], DST_WIDTH, DST_HEIGHT))
+            {
+                skip("Cannot create a %lu bpp DIB section\n", TargetFormats[j]);
+                DeleteTestDib(&Dst);
+                continue;
+            }
+
+            for (k = 0; k < sizeof(StretchCases) / sizeof(StretchCases[0]); k++)
+            {
+                for (l = 0; l < sizeof(Rops) / sizeof(Rops[0]); l++)
+                    TestStretch(&Src, &Dst, &Ref, &StretchCases[k], Rops[l]);
+            }
+
+            DeleteTestDib(&Ref);
+            DeleteTestDib(&Dst);
+        }
+
+        DeleteTestDib(&Src);
+    }
+}
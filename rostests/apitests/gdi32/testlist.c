@@ -73,6 +73,7 @@ extern void func_SetPixel(void);
 extern void func_SetSysColors(void);
 extern void func_SetWindowExtEx(void);
 extern void func_SetWorldTransform(void);
+extern void func_StretchBlt(void);
 
 const struct test winetest_testlist[] =
 {
@@ -146,6 +147,7 @@ const struct test winetest_testlist[] =
     { "SetSysColors", func_SetSysColors },
     { "SetWindowExtEx", func_SetWindowExtEx },
     { "SetWorldTransform", func_SetWorldTransform },
+    { "StretchBlt", func_StretchBlt },
 
     { 0, 0 }
 };
@@ -0,0 +1,316 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Route lookup scaling and route selection with large IPv4 routing tables
+ */
+
+#include <apitest.h>
+#include <winsock2.h>
+#include <iphlpapi.h>
+
+/* Routes are carved as /30 networks out of the 198.18.0.0/15 benchmark range */
+#define ROUTE_COUNT     2000
+#define ROUTE_BASE      0xC6120000
+#define ROUTE_MASK      0xFFFFFFFC
+#define SEND_COUNT      1000
+
+/* A /16 covering the /30 routes, and an address only it covers */
+#define COVER_BASE      0xC6120000
+#define COVER_MASK      0xFFFF0000
+#define COVER_ADDRESS   0xC612FF01
+
+static
+PMIB_IPFORWARDTABLE
+GetRouteTable(VOID)
+{
+    PMIB_IPFORWARDTABLE Table;
+    ULONG Size = 0;
+    DWORD Err;
+
+    Err = GetIpForwardTable(NULL, &Size, FALSE);
+    if (Err != ERROR_INSUFFICIENT_BUFFER)
+        return NULL;
+
+    Table = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!Table)
+        return NULL;
+
+    Err = GetIpForwardTable(Table, &Size, FALSE);
+    if (Err != NO_ERROR)
+    {
+        HeapFree(GetProcessHeap(), 0, Table);
+        return NULL;
+    }
+
+    return Table;
+}
+
+static
+BOOL
+GetDefaultRoute(
+    PMIB_IPFORWARDROW Row)
+{
+    PMIB_IPFORWARDTABLE Table;
+    DWORD i;
+    BOOL Found = FALSE;
+
+    Table = GetRouteTable();
+    if (!Table)
+        return FALSE;
+
+    for (i = 0; i < Table->dwNumEntries; i++)
+    {
+        if (Table->table[i].dwForwardDest == 0 && Table->table[i].dwForwardMask == 0)
+        {
+            *Row = Table->table[i];
+            Found = TRUE;
+            break;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Table);
+    return Found;
+}
+
+/* Number of /30 routes of the test range in the routing table */
+static
+ULONG
+CountTestRoutes(VOID)
+{
+    PMIB_IPFORWARDTABLE Table;
+    ULONG Count = 0;
+    DWORD i;
+
+    Table = GetRouteTable();
+    if (!Table)
+        return ~0UL;
+
+    for (i = 0; i < Table->dwNumEntries; i++)
+    {
+        if ((ntohl(Table->table[i].dwForwardDest) & COVER_MASK) == COVER_BASE &&
+            Table->table[i].dwForwardMask == htonl(ROUTE_MASK))
+        {
+            Count++;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Table);
+    return Count;
+}
+
+#define CheckBestRoute(Destination, Dest, Mask, NextHop) \
+    CheckBestRoute_(__LINE__, Destination, Dest, Mask, NextHop)
+
+static
+VOID
+CheckBestRoute_(
+    INT Line,
+    ULONG Destination,
+    ULONG ExpectedDest,
+    ULONG ExpectedMask,
+    ULONG ExpectedNextHop)
+{
+    MIB_IPFORWARDROW Row;
+    DWORD Err;
+
+    ZeroMemory(&Row, sizeof(Row));
+    Err = GetBestRoute(htonl(Destination), 0, &Row);
+    ok_(__FILE__, Line)(Err == NO_ERROR, "GetBestRoute failed: %lu\n", Err);
+    ok_(__FILE__, Line)(Row.dwForwardDest == htonl(ExpectedDest) && Row.dwForwardMask == htonl(ExpectedMask),
+                        "Route to 0x%08lx: got 0x%08lx/0x%08lx, expected 0x%08lx/0x%08lx\n",
+                        Destination, ntohl(Row.dwForwardDest), ntohl(Row.dwForwardMask),
+                        ExpectedDest, ExpectedMask);
+    ok_(__FILE__, Line)(Row.dwForwardNextHop == ExpectedNextHop,
+                        "Route to 0x%08lx: next hop 0x%08lx, expected 0x%08lx\n",
+                        Destination, ntohl(Row.dwForwardNextHop), ntohl(ExpectedNextHop));
+}
+
+static
+VOID
+FillRoute(
+    PMIB_IPFORWARDROW Row,
+    PMIB_IPFORWARDROW Default,
+    ULONG Index)
+{
+    ZeroMemory(Row, sizeof(*Row));
+    Row->dwForwardDest = htonl(ROUTE_BASE + Index * 4);
+    Row->dwForwardMask = htonl(ROUTE_MASK);
+    Row->dwForwardNextHop = Default->dwForwardNextHop;
+    Row->dwForwardIfIndex = Default->dwForwardIfIndex;
+    Row->dwForwardType = MIB_IPROUTE_TYPE_INDIRECT;
+    Row->dwForwardProto = MIB_IPPROTO_NETMGMT;
+    Row->dwForwardMetric1 = 1;
+}
+
+static
+VOID
+FillCoverRoute(
+    PMIB_IPFORWARDROW Row,
+    PMIB_IPFORWARDROW Default,
+    ULONG NextHop,
+    ULONG Metric)
+{
+    ZeroMemory(Row, sizeof(*Row));
+    Row->dwForwardDest = htonl(COVER_BASE);
+    Row->dwForwardMask = htonl(COVER_MASK);
+    Row->dwForwardNextHop = NextHop;
+    Row->dwForwardIfIndex = Default->dwForwardIfIndex;
+    Row->dwForwardType = MIB_IPROUTE_TYPE_INDIRECT;
+    Row->dwForwardProto = MIB_IPPROTO_NETMGMT;
+    Row->dwForwardMetric1 = Metric;
+}
+
+/* Longest prefix first, then the lowest metric among routes to the same prefix */
+static
+VOID
+TestRouteSelection(
+    PMIB_IPFORWARDROW Default)
+{
+    MIB_IPFORWARDROW Slow, Fast;
+    ULONG OtherHop = htonl(ntohl(Default->dwForwardNextHop) + 1);
+    DWORD Err;
+
+    CheckBestRoute(ROUTE_BASE + 1, ROUTE_BASE, ROUTE_MASK, Default->dwForwardNextHop);
+    CheckBestRoute(ROUTE_BASE + (ROUTE_COUNT / 2) * 4 + 2,
+                   ROUTE_BASE + (ROUTE_COUNT / 2) * 4, ROUTE_MASK, Default->dwForwardNextHop);
+    CheckBestRoute(ROUTE_BASE + (ROUTE_COUNT - 1) * 4 + 3,
+                   ROUTE_BASE + (ROUTE_COUNT - 1) * 4, ROUTE_MASK, Default->dwForwardNextHop);
+    CheckBestRoute(COVER_ADDRESS, 0, 0, Default->dwForwardNextHop);
+
+    /* Added first, so a lookup that ignores the metric would pick it */
+    FillCoverRoute(&Slow, Default, Default->dwForwardNextHop, 20);
+    Err = CreateIpForwardEntry(&Slow);
+    ok(Err == NO_ERROR, "CreateIpForwardEntry failed: %lu\n", Err);
+    if (Err != NO_ERROR)
+        return;
+
+    FillCoverRoute(&Fast, Default, OtherHop, 10);
+    Err = CreateIpForwardEntry(&Fast);
+    ok(Err == NO_ERROR, "CreateIpForwardEntry failed: %lu\n", Err);
+    if (Err == NO_ERROR)
+    {
+        /* The /30 routes still beat the /16, whatever its metric */
+        CheckBestRoute(ROUTE_BASE + 5, ROUTE_BASE + 4, ROUTE_MASK, Default->dwForwardNextHop);
+        CheckBestRoute(COVER_ADDRESS, COVER_BASE, COVER_MASK, OtherHop);
+
+        Err = DeleteIpForwardEntry(&Fast);
+        ok(Err == NO_ERROR, "DeleteIpForwardEntry failed: %lu\n", Err);
+    }
+
+    CheckBestRoute(COVER_ADDRESS, COVER_BASE, COVER_MASK, Default->dwForwardNextHop);
+
+    Err = DeleteIpForwardEntry(&Slow);
+    ok(Err == NO_ERROR, "DeleteIpForwardEntry failed: %lu\n", Err);
+    CheckBestRoute(COVER_ADDRESS, 0, 0, Default->dwForwardNextHop);
+}
+
+static
+ULONG
+TimeSends(
+    SOCKET Socket,
+    ULONG Destination,
+    PULONG Failures)
+{
+    struct sockaddr_in Addr;
+    LARGE_INTEGER Frequency, Start, End;
+    CHAR Payload[16] = { 0 };
+    ULONG i;
+
+    ZeroMemory(&Addr, sizeof(Addr));
+    Addr.sin_family = AF_INET;
+    Addr.sin_port = htons(9);
+    Addr.sin_addr.s_addr = htonl(Destination);
+
+    *Failures = 0;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < SEND_COUNT; i++)
+    {
+        if (sendto(Socket, Payload, sizeof(Payload), 0, (struct sockaddr *)&Addr, sizeof(Addr)) == SOCKET_ERROR)
+            (*Failures)++;
+    }
+    QueryPerformanceCounter(&End);
+
+    /* Microseconds per send */
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart / SEND_COUNT);
+}
+
+START_TEST(RouteTable)
+{
+    MIB_IPFORWARDROW Default, Row;
+    WSADATA WsaData;
+    SOCKET Socket;
+    ULONG Added = 0, Failures, Baseline, Matched, Unmatched, i;
+    DWORD Err;
+
+    if (!GetDefaultRoute(&Default))
+    {
+        skip("No default route\n");
+        return;
+    }
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Socket != INVALID_SOCKET, "socket failed: %d\n", WSAGetLastError());
+    if (Socket == INVALID_SOCKET)
+        goto Cleanup;
+
+    /* Baseline: only the default route matches */
+    Baseline = TimeSends(Socket, ROUTE_BASE + ROUTE_COUNT * 4 + 1, &Failures);
+    ok(Failures == 0, "%lu sends failed\n", Failures);
+
+    for (i = 0; i < ROUTE_COUNT; i++)
+    {
+        FillRoute(&Row, &Default, i);
+        Err = CreateIpForwardEntry(&Row);
+        if (Err == ERROR_ACCESS_DENIED)
+        {
+            skip("Adding routes requires administrator rights\n");
+            break;
+        }
+        ok(Err == NO_ERROR, "CreateIpForwardEntry(%lu) failed: %lu\n", i, Err);
+        if (Err != NO_ERROR)
+            break;
+        Added++;
+    }
+
+    if (Added == ROUTE_COUNT)
+    {
+        /* Destination covered by the last route added */
+        Matched = TimeSends(Socket, ROUTE_BASE + (ROUTE_COUNT - 1) * 4 + 1, &Failures);
+        ok(Failures == 0, "%lu sends failed\n", Failures);
+
+        /* Destination only covered by the default route */
+        Unmatched = TimeSends(Socket, ROUTE_BASE + ROUTE_COUNT * 4 + 1, &Failures);
+        ok(Failures == 0, "%lu sends failed\n", Failures);
+
+        trace("sendto: %lu us with no routes, %lu us matched and %lu us unmatched with %u routes\n",
+              Baseline, Matched, Unmatched, ROUTE_COUNT);
+
+        ok(CountTestRoutes() == ROUTE_COUNT, "Not all routes are in the routing table\n");
+        TestRouteSelection(&Default);
+    }
+
+    for (i = 0; i < Added; i++)
+    {
+        FillRoute(&Row, &Default, i);
+        Err = DeleteIpForwardEntry(&Row);
+        ok(Err == NO_ERROR, "DeleteIpForwardEntry(%lu) failed: %lu\n", i, Err);
+    }
+
+    if (Added)
+    {
+        ok(CountTestRoutes() == 0, "Deleted routes are still in the routing table\n");
+        CheckBestRoute(ROUTE_BASE + 1, 0, 0, Default.dwForwardNextHop);
+    }
+
+    closesocket(Socket);
+
+Cleanup:
+    WSACleanup();
+}
@@ -5,12 +5,14 @@
 
 extern void func_GetNetworkParams(void);
 extern void func_icmp(void);
+extern void func_RouteTable(void);
 extern void func_SendARP(void);
 
 const struct test winetest_testlist[] =
 {
     { "GetNetworkParams",     func_GetNetworkParams },
     { "icmp",                 func_icmp },
+    { "RouteTable",           func_RouteTable },
     { "SendARP",              func_SendARP },
 
     { 0, 0 }
@@ -0,0 +1,297 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for CopyFileEx (correctness, progress and throughput)
+ */
+
+#include <apitest.h>
+
+#ifndef COPY_FILE_NO_BUFFERING
+#define COPY_FILE_NO_BUFFERING 0x00001000
+#endif
+
+/* Odd size, so the last chunk is neither a sector nor a buffer multiple */
+#define SMALL_FILE_SIZE     (300 * 1024 + 17)
+
+/* Size of the benchmark file in MB, override with COPYFILE_BENCH_MB for multi-GB runs */
+#define BENCH_DEFAULT_MB    64
+
+#define REFERENCE_CHUNK     0x10000
+
+static WCHAR SourcePath[MAX_PATH];
+static WCHAR DestPath[MAX_PATH];
+static ULONG ProgressCalls;
+static DWORD ProgressResult;
+
+static
+BOOL
+CreateTestFile(
+    PCWSTR Path,
+    ULONGLONG Size)
+{
+    HANDLE File;
+    PUCHAR Buffer;
+    DWORD Written, Length, i;
+    ULONGLONG Offset;
+    BOOL Ret = TRUE;
+
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, REFERENCE_CHUNK);
+    if (!Buffer)
+    {
+        CloseHandle(File);
+        return FALSE;
+    }
+
+    for (Offset = 0; Offset < Size && Ret; Offset += Length)
+    {
+        Length = (DWORD)min(Size - Offset, REFERENCE_CHUNK);
+        for (i = 0; i < Length; i++)
+            Buffer[i] = (UCHAR)((Offset + i) * 7 + ((Offset + i) >> 12));
+        Ret = WriteFile(File, Buffer, Length, &Written, NULL) && Written == Length;
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+    return Ret;
+}
+
+static
+BOOL
+CompareFiles(
+    PCWSTR Path1,
+    PCWSTR Path2)
+{
+    HANDLE File1, File2;
+    PUCHAR Buffer1, Buffer2;
+    DWORD Read1, Read2;
+    BOOL Same = FALSE;
+
+    File1 = CreateFileW(Path1, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    File2 = CreateFileW(Path2, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    Buffer1 = HeapAlloc(GetProcessHeap(), 0, REFERENCE_CHUNK);
+    Buffer2 = HeapAlloc(GetProcessHeap(), 0, REFERENCE_CHUNK);
+
+    if (File1 != INVALID_HANDLE_VALUE && File2 != INVALID_HANDLE_VALUE && Buffer1 && Buffer2)
+    {
+        for (;;)
+        {
+            if (!ReadFile(File1, Buffer1, REFERENCE_CHUNK, &Read1, NULL) ||
+                !ReadFile(File2, Buffer2, REFERENCE_CHUNK, &Read2, NULL) ||
+                Read1 != Read2 ||
+                memcmp(Buffer1, Buffer2, Read1) != 0)
+            {
+                break;
+            }
+
+            if (Read1 == 0)
+            {
+                Same = TRUE;
+                break;
+            }
+        }
+    }
+
+    if (Buffer1) HeapFree(GetProcessHeap(), 0, Buffer1);
+    if (Buffer2) HeapFree(GetProcessHeap(), 0, Buffer2);
+    if (File1 != INVALID_HANDLE_VALUE) CloseHandle(File1);
+    if (File2 != INVALID_HANDLE_VALUE) CloseHandle(File2);
+    return Same;
+}
+
+static
+ULONGLONG
+GetSize(
+    PCWSTR Path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+
+    if (!GetFileAttributesExW(Path, GetFileExInfoStandard, &Data))
+        return (ULONGLONG)-1;
+    return ((ULONGLONG)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+}
+
+static
+DWORD
+CALLBACK
+ProgressRoutine(
+    LARGE_INTEGER TotalFileSize,
+    LARGE_INTEGER TotalBytesTransferred,
+    LARGE_INTEGER StreamSize,
+    LARGE_INTEGER StreamBytesTransferred,
+    DWORD dwStreamNumber,
+    DWORD dwCallbackReason,
+    HANDLE hSourceFile,
+    HANDLE hDestinationFile,
+    LPVOID lpData)
+{
+    ok(TotalBytesTransferred.QuadPart <= TotalFileSize.QuadPart,
+       "Transferred %I64u of %I64u\n", TotalBytesTransferred.QuadPart, TotalFileSize.QuadPart);
+    ProgressCalls++;
+    return ProgressResult;
+}
+
+/* What CopyFileEx used to do: one synchronous 64 KB read then write at a time */
+static
+BOOL
+ReferenceCopy(
+    PCWSTR Source,
+    PCWSTR Dest)
+{
+    HANDLE SourceFile, DestFile;
+    PUCHAR Buffer;
+    DWORD Read, Written;
+    BOOL Ret = FALSE;
+
+    SourceFile = CreateFileW(Source, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    if (SourceFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    DestFile = CreateFileW(Dest, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    Buffer = VirtualAlloc(NULL, REFERENCE_CHUNK, MEM_COMMIT, PAGE_READWRITE);
+    if (DestFile != INVALID_HANDLE_VALUE && Buffer)
+    {
+        for (;;)
+        {
+            if (!ReadFile(SourceFile, Buffer, REFERENCE_CHUNK, &Read, NULL))
+                break;
+
+            if (Read == 0)
+            {
+                Ret = TRUE;
+                break;
+            }
+
+            if (!WriteFile(DestFile, Buffer, Read, &Written, NULL) || Written != Read)
+                break;
+        }
+    }
+
+    if (Buffer) VirtualFree(Buffer, 0, MEM_RELEASE);
+    if (DestFile != INVALID_HANDLE_VALUE) CloseHandle(DestFile);
+    CloseHandle(SourceFile);
+    return Ret;
+}
+
+static
+ULONG
+TimeCopy(
+    DWORD Flags,
+    BOOL Reference)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    BOOL Ret;
+
+    DeleteFileW(DestPath);
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    if (Reference)
+        Ret = ReferenceCopy(SourcePath, DestPath);
+    else
+        Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, Flags);
+    QueryPerformanceCounter(&End);
+
+    ok(Ret, "Copy failed: %lu\n", GetLastError());
+    if (!Ret)
+        return 0;
+
+    /* Milliseconds */
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+}
+
+static
+VOID
+TestBenchmark(VOID)
+{
+    CHAR Value[16];
+    ULONGLONG Size;
+    ULONG SizeMB, ReferenceTime, PipelinedTime, NoBufferingTime;
+
+    SizeMB = BENCH_DEFAULT_MB;
+    if (GetEnvironmentVariableA("COPYFILE_BENCH_MB", Value, sizeof(Value)))
+        SizeMB = strtoul(Value, NULL, 10);
+    if (SizeMB == 0)
+    {
+        skip("Benchmark disabled\n");
+        return;
+    }
+
+    Size = (ULONGLONG)SizeMB * 1024 * 1024 + 4097;
+    if (!CreateTestFile(SourcePath, Size))
+    {
+        skip("Failed to create %lu MB source file: %lu\n", SizeMB, GetLastError());
+        DeleteFileW(SourcePath);
+        return;
+    }
+
+    ReferenceTime = TimeCopy(0, TRUE);
+    PipelinedTime = TimeCopy(0, FALSE);
+    ok(CompareFiles(SourcePath, DestPath), "Copy differs from source\n");
+    NoBufferingTime = TimeCopy(COPY_FILE_NO_BUFFERING, FALSE);
+    ok(CompareFiles(SourcePath, DestPath), "Non-cached copy differs from source\n");
+    ok(GetSize(DestPath) == Size, "Size = %I64u, expected %I64u\n", GetSize(DestPath), Size);
+
+    trace("Copied %lu MB: %lu ms with a 64 KB loop, %lu ms with CopyFileEx, %lu ms with COPY_FILE_NO_BUFFERING\n",
+          SizeMB, ReferenceTime, PipelinedTime, NoBufferingTime);
+
+    DeleteFileW(DestPath);
+    DeleteFileW(SourcePath);
+}
+
+START_TEST(CopyFile)
+{
+    WCHAR TempDir[MAX_PATH];
+    BOOL Ret;
+
+    GetTempPathW(_countof(TempDir), TempDir);
+    GetTempFileNameW(TempDir, L"cps", 0, SourcePath);
+    GetTempFileNameW(TempDir, L"cpd", 0, DestPath);
+
+    if (!CreateTestFile(SourcePath, SMALL_FILE_SIZE))
+    {
+        skip("Failed to create source file: %lu\n", GetLastError());
+        DeleteFileW(SourcePath);
+        DeleteFileW(DestPath);
+        return;
+    }
+
+    /* The destination exists already */
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, COPY_FILE_FAIL_IF_EXISTS);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok(GetLastError() == ERROR_FILE_EXISTS, "GetLastError() = %lu\n", GetLastError());
+
+    /* Plain copy, with a bounded number of progress callbacks */
+    ProgressCalls = 0;
+    ProgressResult = PROGRESS_CONTINUE;
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, NULL, NULL, 0);
+    ok(Ret, "CopyFileExW failed: %lu\n", GetLastError());
+    ok(CompareFiles(SourcePath, DestPath), "Copy differs from source\n");
+    ok(ProgressCalls >= 2, "ProgressCalls = %lu\n", ProgressCalls);
+    ok(ProgressCalls <= 8, "ProgressCalls = %lu\n", ProgressCalls);
+
+    /* Small files are copied correctly when asked not to use the cache */
+    Ret = CopyFileExW(SourcePath, DestPath, NULL, NULL, NULL, COPY_FILE_NO_BUFFERING);
+    ok(Ret, "CopyFileExW failed: %lu\n", GetLastError());
+    ok(CompareFiles(SourcePath, DestPath), "Copy differs from source\n");
+    ok(GetSize(DestPath) == SMALL_FILE_SIZE, "Size = %I64u\n", GetSize(DestPath));
+
+    /* Cancelling from the progress routine removes the destination */
+    DeleteFileW(DestPath);
+    ProgressCalls = 0;
+    ProgressResult = PROGRESS_CANCEL;
+    SetLastError(0xdeadbeef);
+    Ret = CopyFileExW(SourcePath, DestPath, ProgressRoutine, NULL, NULL, 0);
+    ok(!Ret, "CopyFileExW succeeded\n");
+    ok(GetLastError() == ERROR_REQUEST_ABORTED, "GetLastError() = %lu\n", GetLastError());
+    ok(ProgressCalls == 1, "ProgressCalls = %lu\n", ProgressCalls);
+    ok(GetFileAttributesW(DestPath) == INVALID_FILE_ATTRIBUTES, "Destination was kept\n");
+
+    TestBenchmark();
+
+    DeleteFileW(DestPath);
+    DeleteFileW(SourcePath);
+}
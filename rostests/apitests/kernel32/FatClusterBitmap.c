@@ -0,0 +1,274 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for FAT cluster allocation (free cluster bitmap)
+ */
+
+#include <apitest.h>
+#include <winioctl.h>
+
+#define FILE_COUNT      4
+#define ROUNDS          24
+#define MAX_CLUSTERS    (FILE_COUNT * ROUNDS * 2)
+
+static WCHAR FileNames[FILE_COUNT][MAX_PATH];
+static HANDLE Files[FILE_COUNT];
+static ULONG FileClusters[FILE_COUNT];
+static DWORD ClusterSize;
+static PUCHAR Buffer;
+
+static
+BOOL
+IsFatVolume(
+    PCWSTR Path)
+{
+    WCHAR Root[4], FileSystem[MAX_PATH];
+
+    Root[0] = Path[0];
+    Root[1] = L':';
+    Root[2] = L'\\';
+    Root[3] = UNICODE_NULL;
+    if (!GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, MAX_PATH))
+        return FALSE;
+
+    return (wcsncmp(FileSystem, L"FAT", 3) == 0);
+}
+
+static
+DWORD
+GetFreeClusters(
+    PCWSTR Path)
+{
+    WCHAR Root[4];
+    DWORD SectorsPerCluster, BytesPerSector, FreeClusters, TotalClusters;
+
+    Root[0] = Path[0];
+    Root[1] = L':';
+    Root[2] = L'\\';
+    Root[3] = UNICODE_NULL;
+    if (!GetDiskFreeSpaceW(Root, &SectorsPerCluster, &BytesPerSector, &FreeClusters, &TotalClusters))
+        return 0;
+
+    ClusterSize = SectorsPerCluster * BytesPerSector;
+    return FreeClusters;
+}
+
+static
+VOID
+FillCluster(
+    ULONG File,
+    ULONG Cluster)
+{
+    DWORD i;
+
+    for (i = 0; i < ClusterSize; i++)
+        Buffer[i] = (UCHAR)(File * 61 + Cluster * 7 + (i >> 5));
+}
+
+static
+BOOL
+ResizeFile(
+    ULONG File,
+    ULONG Clusters)
+{
+    DWORD Written;
+    LARGE_INTEGER Offset;
+
+    Offset.QuadPart = (LONGLONG)FileClusters[File] * ClusterSize;
+    if (!SetFilePointerEx(Files[File], Offset, NULL, FILE_BEGIN))
+        return FALSE;
+
+    /* Grow a cluster at a time, so the files interleave on the disk */
+    while (FileClusters[File] < Clusters)
+    {
+        FillCluster(File, FileClusters[File]);
+        if (!WriteFile(Files[File], Buffer, ClusterSize, &Written, NULL) || Written != ClusterSize)
+            return FALSE;
+        FileClusters[File]++;
+    }
+
+    if (FileClusters[File] > Clusters)
+    {
+        Offset.QuadPart = (LONGLONG)Clusters * ClusterSize;
+        if (!SetFilePointerEx(Files[File], Offset, NULL, FILE_BEGIN) ||
+            !SetEndOfFile(Files[File]))
+        {
+            return FALSE;
+        }
+        FileClusters[File] = Clusters;
+    }
+
+    return TRUE;
+}
+
+/* Reads the cluster chain of a file from the FAT, returns the number of clusters */
+static
+ULONG
+GetFileClusters(
+    ULONG File,
+    PLONGLONG Lcns,
+    ULONG MaxLcns)
+{
+    STARTING_VCN_INPUT_BUFFER Input;
+    struct
+    {
+        RETRIEVAL_POINTERS_BUFFER Header;
+        LARGE_INTEGER Extents[MAX_CLUSTERS * 2];
+    } Output;
+    DWORD Returned, i;
+    LONGLONG Vcn, Lcn;
+    ULONG Count = 0;
+
+    Input.StartingVcn.QuadPart = 0;
+    if (!DeviceIoControl(Files[File], FSCTL_GET_RETRIEVAL_POINTERS,
+                         &Input, sizeof(Input), &Output, sizeof(Output), &Returned, NULL))
+    {
+        return 0;
+    }
+
+    Vcn = Output.Header.StartingVcn.QuadPart;
+    for (i = 0; i < Output.Header.ExtentCount; i++)
+    {
+        for (Lcn = Output.Header.Extents[i].Lcn.QuadPart;
+             Vcn < Output.Header.Extents[i].NextVcn.QuadPart;
+             Vcn++, Lcn++)
+        {
+            if (Count < MaxLcns)
+                Lcns[Count] = Lcn;
+            Count++;
+        }
+    }
+
+    return Count;
+}
+
+static
+int
+__cdecl
+CompareLcn(
+    const void *A,
+    const void *B)
+{
+    LONGLONG Left = *(const LONGLONG *)A, Right = *(const LONGLONG *)B;
+
+    return (Left < Right) ? -1 : (Left > Right);
+}
+
+static
+VOID
+CheckFiles(VOID)
+{
+    LONGLONG Lcns[FILE_COUNT * MAX_CLUSTERS];
+    ULONG File, Count, Total = 0, Cluster, i;
+    DWORD Read;
+
+    for (File = 0; File < FILE_COUNT; File++)
+    {
+        FlushFileBuffers(Files[File]);
+        if (FileClusters[File] == 0)
+            continue;
+
+        /* The FAT chain has exactly the clusters the file needs */
+        Count = GetFileClusters(File, &Lcns[Total], MAX_CLUSTERS);
+        ok(Count == FileClusters[File], "File %lu: %lu clusters in the FAT, expected %lu\n",
+           File, Count, FileClusters[File]);
+        Total += min(Count, MAX_CLUSTERS);
+
+        /* And they hold the file's own data */
+        SetFilePointer(Files[File], 0, NULL, FILE_BEGIN);
+        for (Cluster = 0; Cluster < FileClusters[File]; Cluster++)
+        {
+            if (!ReadFile(Files[File], Buffer + ClusterSize, ClusterSize, &Read, NULL) || Read != ClusterSize)
+            {
+                ok(0, "File %lu: cannot read cluster %lu\n", File, Cluster);
+                break;
+            }
+            FillCluster(File, Cluster);
+            ok(!memcmp(Buffer, Buffer + ClusterSize, ClusterSize),
+               "File %lu: cluster %lu holds wrong data\n", File, Cluster);
+        }
+    }
+
+    /* No cluster belongs to two files, or twice to the same one */
+    qsort(Lcns, Total, sizeof(Lcns[0]), CompareLcn);
+    for (i = 1; i < Total; i++)
+    {
+        ok(Lcns[i] != Lcns[i - 1], "Cluster %I64d is allocated twice\n", Lcns[i]);
+    }
+}
+
+START_TEST(FatClusterBitmap)
+{
+    WCHAR TempPath[MAX_PATH];
+    DWORD FreeBefore, FreeAfter;
+    ULONG File, Round;
+    BOOL Ret;
+
+    if (!GetTempPathW(MAX_PATH, TempPath) || !IsFatVolume(TempPath))
+    {
+        skip("Temporary directory is not on a FAT volume\n");
+        return;
+    }
+
+    /* Create the files first, so their directory entries are not counted */
+    for (File = 0; File < FILE_COUNT; File++)
+    {
+        GetTempFileNameW(TempPath, L"fcb", 0, FileNames[File]);
+        Files[File] = CreateFileW(FileNames[File], GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        ok(Files[File] != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+        if (Files[File] == INVALID_HANDLE_VALUE)
+        {
+            while (File--)
+            {
+                CloseHandle(Files[File]);
+                DeleteFileW(FileNames[File]);
+            }
+            return;
+        }
+    }
+
+    FreeBefore = GetFreeClusters(TempPath);
+    Buffer = HeapAlloc(GetProcessHeap(), 0, ClusterSize * 2);
+    if (FreeBefore < MAX_CLUSTERS * FILE_COUNT || !Buffer)
+    {
+        skip("Not enough free space or memory\n");
+        goto Cleanup;
+    }
+
+    /* Interleave the extends of all files */
+    Ret = TRUE;
+    for (Round = 1; Round <= ROUNDS && Ret; Round++)
+    {
+        for (File = 0; File < FILE_COUNT && Ret; File++)
+            Ret = ResizeFile(File, Round);
+    }
+    ok(Ret, "Extending the files failed: %lu\n", GetLastError());
+    CheckFiles();
+
+    /* Free clusters in the middle of the used area and allocate them again */
+    Ret = ResizeFile(1, ROUNDS / 3) && ResizeFile(3, 1);
+    ok(Ret, "Truncating the files failed: %lu\n", GetLastError());
+    CheckFiles();
+    ok(GetFreeClusters(TempPath) == FreeBefore - (ROUNDS * 2 + ROUNDS / 3 + 1),
+       "Free cluster count out of sync after truncating\n");
+
+    Ret = ResizeFile(0, ROUNDS * 2) && ResizeFile(3, ROUNDS) && ResizeFile(2, ROUNDS * 2);
+    ok(Ret, "Extending the files again failed: %lu\n", GetLastError());
+    CheckFiles();
+
+    /* Freeing everything gives every cluster back */
+    for (File = 0; File < FILE_COUNT; File++)
+        ResizeFile(File, 0);
+    FreeAfter = GetFreeClusters(TempPath);
+    ok(FreeAfter == FreeBefore, "Free clusters: %lu, expected %lu\n", FreeAfter, FreeBefore);
+
+Cleanup:
+    if (Buffer)
+        HeapFree(GetProcessHeap(), 0, Buffer);
+    for (File = 0; File < FILE_COUNT; File++)
+    {
+        CloseHandle(Files[File]);
+        DeleteFileW(FileNames[File]);
+    }
+}
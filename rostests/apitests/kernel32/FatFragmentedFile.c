@@ -0,0 +1,292 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for seeking and reading in fragmented FAT files
+ */
+
+#include <apitest.h>
+#include <winioctl.h>
+
+#define ROUNDS          32
+#define MAX_EXTENTS     (ROUNDS * 2)
+
+static HANDLE Files[2];
+static WCHAR FileNames[2][MAX_PATH];
+static ULONG FileClusters[2];
+static DWORD ClusterSize, SectorSize;
+static PUCHAR Buffer, ReadBuffer;
+
+static
+BOOL
+GetFatGeometry(
+    PCWSTR Path)
+{
+    WCHAR Root[4], FileSystem[MAX_PATH];
+    DWORD SectorsPerCluster, FreeClusters, TotalClusters;
+
+    Root[0] = Path[0];
+    Root[1] = L':';
+    Root[2] = L'\\';
+    Root[3] = UNICODE_NULL;
+    if (!GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, MAX_PATH) ||
+        wcsncmp(FileSystem, L"FAT", 3) != 0)
+    {
+        return FALSE;
+    }
+
+    if (!GetDiskFreeSpaceW(Root, &SectorsPerCluster, &SectorSize, &FreeClusters, &TotalClusters) ||
+        FreeClusters < ROUNDS * 4)
+    {
+        return FALSE;
+    }
+
+    ClusterSize = SectorsPerCluster * SectorSize;
+    return TRUE;
+}
+
+/* Every sector of a cluster says which file, cluster and pass wrote it */
+static
+VOID
+FillCluster(
+    PUCHAR Data,
+    ULONG File,
+    ULONG Cluster,
+    ULONG Pass)
+{
+    DWORD i;
+
+    for (i = 0; i < ClusterSize; i += sizeof(ULONG))
+        *(PULONG)(Data + i) = (File << 28) ^ (Pass << 24) ^ (Cluster << 12) ^ i;
+}
+
+static
+BOOL
+AppendCluster(
+    ULONG File,
+    ULONG Pass)
+{
+    LARGE_INTEGER Offset;
+    DWORD Written;
+
+    Offset.QuadPart = (LONGLONG)FileClusters[File] * ClusterSize;
+    if (!SetFilePointerEx(Files[File], Offset, NULL, FILE_BEGIN))
+        return FALSE;
+
+    FillCluster(Buffer, File, FileClusters[File], Pass);
+    if (!WriteFile(Files[File], Buffer, ClusterSize, &Written, NULL) || Written != ClusterSize)
+        return FALSE;
+
+    FileClusters[File]++;
+    return TRUE;
+}
+
+/* Grows both files a cluster at a time, so they take turns on the disk */
+static
+BOOL
+GrowInterleaved(
+    ULONG Rounds,
+    ULONG Pass)
+{
+    ULONG Round;
+
+    for (Round = 0; Round < Rounds; Round++)
+    {
+        if (!AppendCluster(0, Pass) || !AppendCluster(1, Pass))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONG
+GetExtentCount(
+    ULONG File)
+{
+    STARTING_VCN_INPUT_BUFFER Input;
+    struct
+    {
+        RETRIEVAL_POINTERS_BUFFER Header;
+        LARGE_INTEGER Extents[MAX_EXTENTS * 2];
+    } Output;
+    DWORD Returned;
+
+    Input.StartingVcn.QuadPart = 0;
+    if (!DeviceIoControl(Files[File], FSCTL_GET_RETRIEVAL_POINTERS,
+                         &Input, sizeof(Input), &Output, sizeof(Output), &Returned, NULL))
+    {
+        return 0;
+    }
+
+    return Output.Header.ExtentCount;
+}
+
+/* Reads Length bytes at Offset straight from the disk, and checks them against what was written */
+static
+VOID
+CheckRead(
+    HANDLE Handle,
+    ULONG File,
+    ULONGLONG Offset,
+    DWORD Length,
+    const ULONG *Passes)
+{
+    LARGE_INTEGER Position;
+    DWORD Read, Done, Chunk;
+    ULONG Cluster;
+
+    Position.QuadPart = Offset;
+    ok(SetFilePointerEx(Handle, Position, NULL, FILE_BEGIN), "SetFilePointerEx failed: %lu\n", GetLastError());
+    if (!ReadFile(Handle, ReadBuffer, Length, &Read, NULL) || Read != Length)
+    {
+        ok(0, "File %lu: reading %lu bytes at 0x%I64x failed: %lu, %lu bytes read\n",
+           File, Length, Offset, GetLastError(), Read);
+        return;
+    }
+
+    for (Done = 0; Done < Length; Done += Chunk)
+    {
+        Cluster = (ULONG)((Offset + Done) / ClusterSize);
+        Chunk = min(Length - Done, ClusterSize - (DWORD)((Offset + Done) % ClusterSize));
+        FillCluster(Buffer, File, Cluster, Passes[Cluster]);
+        if (memcmp(ReadBuffer + Done, Buffer + (Offset + Done) % ClusterSize, Chunk))
+        {
+            ok(0, "File %lu: wrong data in cluster %lu read at 0x%I64x\n", File, Cluster, Offset);
+            return;
+        }
+    }
+}
+
+static
+VOID
+CheckFile(
+    ULONG File,
+    const ULONG *Passes)
+{
+    HANDLE Handle;
+    ULONG Cluster, i;
+    LARGE_INTEGER Size;
+
+    FlushFileBuffers(Files[File]);
+
+    /* Bypass the cache, so every read maps its clusters again */
+    Handle = CreateFileW(FileNames[File], GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    ok(Handle != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (Handle == INVALID_HANDLE_VALUE)
+        return;
+
+    ok(GetFileSizeEx(Handle, &Size) && Size.QuadPart == (LONGLONG)FileClusters[File] * ClusterSize,
+       "File %lu: size is 0x%I64x, expected %lu clusters\n", File, Size.QuadPart, FileClusters[File]);
+
+    /* Jump around: backwards, then with a stride that wraps over the whole file */
+    for (Cluster = FileClusters[File]; Cluster-- > 0; )
+        CheckRead(Handle, File, (ULONGLONG)Cluster * ClusterSize, ClusterSize, Passes);
+    for (i = 0, Cluster = 0; i < FileClusters[File]; i++, Cluster = (Cluster + 7) % FileClusters[File])
+        CheckRead(Handle, File, (ULONGLONG)Cluster * ClusterSize, ClusterSize, Passes);
+
+    /* Reads that cross from one run into the next */
+    for (Cluster = 1; Cluster < FileClusters[File]; Cluster += 3)
+        CheckRead(Handle, File, (ULONGLONG)Cluster * ClusterSize - SectorSize, SectorSize * 2, Passes);
+
+    /* And the whole file at once */
+    if ((ULONGLONG)FileClusters[File] * ClusterSize <= (ULONGLONG)ClusterSize * ROUNDS * 2)
+        CheckRead(Handle, File, 0, FileClusters[File] * ClusterSize, Passes);
+
+    CloseHandle(Handle);
+}
+
+START_TEST(FatFragmentedFile)
+{
+    WCHAR TempPath[MAX_PATH];
+    ULONG Passes[ROUNDS * 2];
+    LARGE_INTEGER Offset;
+    ULONG File, i, Extents;
+    BOOL Ret;
+
+    if (!GetTempPathW(MAX_PATH, TempPath) || !GetFatGeometry(TempPath))
+    {
+        skip("Temporary directory is not on a FAT volume with enough free space\n");
+        return;
+    }
+
+    /* Sector aligned, for the non-cached reads */
+    Buffer = VirtualAlloc(NULL, ClusterSize, MEM_COMMIT, PAGE_READWRITE);
+    ReadBuffer = VirtualAlloc(NULL, ClusterSize * ROUNDS * 2, MEM_COMMIT, PAGE_READWRITE);
+    if (!Buffer || !ReadBuffer)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    for (File = 0; File < 2; File++)
+    {
+        GetTempFileNameW(TempPath, L"ffr", 0, FileNames[File]);
+        Files[File] = CreateFileW(FileNames[File], GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        ok(Files[File] != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+        if (Files[File] == INVALID_HANDLE_VALUE)
+            goto Cleanup;
+    }
+
+    for (i = 0; i < ROUNDS * 2; i++)
+        Passes[i] = 0;
+
+    Ret = GrowInterleaved(ROUNDS, 0);
+    ok(Ret, "Growing the files failed: %lu\n", GetLastError());
+    if (!Ret)
+        goto Cleanup;
+
+    Extents = GetExtentCount(0);
+    if (Extents < 2)
+    {
+        skip("The files did not fragment\n");
+        goto Cleanup;
+    }
+    trace("%lu clusters of %lu bytes in %lu runs\n", FileClusters[0], ClusterSize, Extents);
+    CheckFile(0, Passes);
+
+    /* Truncate in the middle of a run, then read what is left */
+    Offset.QuadPart = (LONGLONG)(ROUNDS / 2 + 1) * ClusterSize;
+    Ret = SetFilePointerEx(Files[0], Offset, NULL, FILE_BEGIN) && SetEndOfFile(Files[0]);
+    ok(Ret, "Truncating the file failed: %lu\n", GetLastError());
+    FileClusters[0] = ROUNDS / 2 + 1;
+    CheckFile(0, Passes);
+
+    /* Extend again with new data, the freed clusters and new ones mix into the file */
+    for (i = FileClusters[0]; i < ROUNDS * 2; i++)
+        Passes[i] = 1;
+    Ret = GrowInterleaved(ROUNDS / 2, 1);
+    ok(Ret, "Growing the files again failed: %lu\n", GetLastError());
+    while (Ret && FileClusters[0] < ROUNDS * 2)
+        Ret = AppendCluster(0, 1);
+    ok(Ret, "Extending the file failed: %lu\n", GetLastError());
+    CheckFile(0, Passes);
+
+    /* Truncate to a single cluster and grow it back */
+    Offset.QuadPart = ClusterSize;
+    Ret = SetFilePointerEx(Files[0], Offset, NULL, FILE_BEGIN) && SetEndOfFile(Files[0]);
+    ok(Ret, "Truncating the file failed: %lu\n", GetLastError());
+    FileClusters[0] = 1;
+    CheckFile(0, Passes);
+
+    for (i = 1; i < ROUNDS * 2; i++)
+        Passes[i] = 2;
+    Ret = GrowInterleaved(ROUNDS - 1, 2);
+    ok(Ret, "Growing the files failed: %lu\n", GetLastError());
+    CheckFile(0, Passes);
+
+Cleanup:
+    for (File = 0; File < 2; File++)
+    {
+        if (Files[File] && Files[File] != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(Files[File]);
+            DeleteFileW(FileNames[File]);
+        }
+    }
+    if (ReadBuffer)
+        VirtualFree(ReadBuffer, 0, MEM_RELEASE);
+    if (Buffer)
+        VirtualFree(Buffer, 0, MEM_RELEASE);
+}
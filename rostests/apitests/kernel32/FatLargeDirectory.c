@@ -0,0 +1,242 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for name lookups in large FAT directories
+ */
+
+#include <apitest.h>
+#include <strsafe.h>
+
+/*
+ * A long name takes four 32-byte entries and a short one a single entry,
+ * so the directory grows to about 56KB, well beyond the 32KB where the
+ * driver starts indexing the names.
+ */
+#define LONG_COUNT      400
+#define SHORT_COUNT     200
+#define FILE_COUNT      (LONG_COUNT + SHORT_COUNT)
+
+static WCHAR Directory[MAX_PATH];
+static BOOLEAN Exists[FILE_COUNT];
+
+static
+BOOL
+IsFatVolume(
+    PCWSTR Path)
+{
+    WCHAR Root[4], FileSystem[MAX_PATH];
+
+    Root[0] = Path[0];
+    Root[1] = L':';
+    Root[2] = L'\\';
+    Root[3] = UNICODE_NULL;
+    if (!GetVolumeInformationW(Root, NULL, 0, NULL, NULL, NULL, FileSystem, MAX_PATH))
+        return FALSE;
+
+    return (wcsncmp(FileSystem, L"FAT", 3) == 0);
+}
+
+/* Files below LONG_COUNT have long names, the others 8.3 names. Renamed files swap the kind. */
+static
+VOID
+GetName(
+    PWSTR Path,
+    ULONG Index,
+    BOOLEAN Renamed)
+{
+    BOOLEAN Long = (Index < LONG_COUNT) != Renamed;
+
+    if (Long)
+        StringCchPrintfW(Path, MAX_PATH, L"%s\\Long file name number %04lu%s.data",
+                         Directory, Index, Renamed ? L" renamed" : L"");
+    else
+        StringCchPrintfW(Path, MAX_PATH, L"%s\\%c%05lu.TXT",
+                         Directory, Renamed ? L'R' : L'S', Index);
+}
+
+static
+BOOL
+CreateTestFile(
+    PCWSTR Path,
+    ULONG Index)
+{
+    HANDLE File;
+    DWORD Written;
+    BOOL Ret;
+
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    Ret = WriteFile(File, &Index, sizeof(Index), &Written, NULL);
+    CloseHandle(File);
+    return Ret && Written == sizeof(Index);
+}
+
+#define CheckFile(Path, Index) CheckFile_(__LINE__, Path, Index)
+
+/* Opens the file by name, and makes sure it's the expected one. Index ~0 means it must not exist. */
+static
+VOID
+CheckFile_(
+    INT Line,
+    PCWSTR Path,
+    ULONG Index)
+{
+    HANDLE File;
+    ULONG Content = ~0UL;
+    DWORD Read;
+
+    File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (Index == ~0UL)
+    {
+        ok_(__FILE__, Line)(File == INVALID_HANDLE_VALUE && GetLastError() == ERROR_FILE_NOT_FOUND,
+                            "%ls: found, error %lu\n", Path, GetLastError());
+        if (File != INVALID_HANDLE_VALUE)
+            CloseHandle(File);
+        return;
+    }
+
+    ok_(__FILE__, Line)(File != INVALID_HANDLE_VALUE, "%ls: not found, error %lu\n", Path, GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    ok_(__FILE__, Line)(ReadFile(File, &Content, sizeof(Content), &Read, NULL) && Read == sizeof(Content),
+                        "%ls: cannot read, error %lu\n", Path, GetLastError());
+    ok_(__FILE__, Line)(Content == Index, "%ls: opened file %lu, expected %lu\n", Path, Content, Index);
+    CloseHandle(File);
+}
+
+static
+VOID
+CheckAllFiles(VOID)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        GetName(Path, i, FALSE);
+        CheckFile(Path, Exists[i] ? i : ~0UL);
+    }
+}
+
+START_TEST(FatLargeDirectory)
+{
+    WCHAR TempPath[MAX_PATH], Path[MAX_PATH], NewPath[MAX_PATH], ShortPath[MAX_PATH];
+    ULONG i, Created = 0;
+    BOOL Ret;
+
+    if (!GetTempPathW(MAX_PATH, TempPath) || !IsFatVolume(TempPath))
+    {
+        skip("Temporary directory is not on a FAT volume\n");
+        return;
+    }
+
+    StringCchPrintfW(Directory, MAX_PATH, L"%sFatLargeDirectory%lu", TempPath, GetCurrentProcessId());
+    if (!CreateDirectoryW(Directory, NULL))
+    {
+        skip("Cannot create %ls: %lu\n", Directory, GetLastError());
+        return;
+    }
+
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        GetName(Path, i, FALSE);
+        Exists[i] = (BOOLEAN)CreateTestFile(Path, i);
+        ok(Exists[i], "Cannot create %ls: %lu\n", Path, GetLastError());
+        if (!Exists[i])
+            goto Cleanup;
+        Created++;
+    }
+
+    /* Every name finds its own file, and only that one */
+    CheckAllFiles();
+
+    /* Names are case-insensitive */
+    GetName(Path, 7, FALSE);
+    _wcsupr(Path + wcslen(Directory));
+    CheckFile(Path, 7);
+    GetName(Path, LONG_COUNT + 7, FALSE);
+    _wcslwr(Path + wcslen(Directory));
+    CheckFile(Path, LONG_COUNT + 7);
+
+    /* The generated short name of a long name leads to the same file */
+    GetName(Path, LONG_COUNT / 2, FALSE);
+    if (GetShortPathNameW(Path, ShortPath, MAX_PATH))
+    {
+        ok(wcscmp(Path, ShortPath) != 0, "%ls has no short name\n", Path);
+        CheckFile(ShortPath, LONG_COUNT / 2);
+    }
+    else
+    {
+        ok(0, "GetShortPathNameW failed: %lu\n", GetLastError());
+    }
+
+    /* Names that don't exist, some of them close to existing ones */
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\Long file name number %04lu.data", Directory, (ULONG)FILE_COUNT);
+    CheckFile(Path, ~0UL);
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\Long file name number 0001.dat", Directory);
+    CheckFile(Path, ~0UL);
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\S%05lu.TXT", Directory, 0UL);
+    CheckFile(Path, ~0UL);
+
+    /* Rename every fifth file, long names to short ones and the other way round */
+    for (i = 0; i < FILE_COUNT; i += 5)
+    {
+        GetName(Path, i, FALSE);
+        GetName(NewPath, i, TRUE);
+        Ret = MoveFileW(Path, NewPath);
+        ok(Ret, "MoveFileW(%ls, %ls) failed: %lu\n", Path, NewPath, GetLastError());
+        if (Ret)
+        {
+            Exists[i] = FALSE;
+            CheckFile(Path, ~0UL);
+            CheckFile(NewPath, i);
+        }
+    }
+    CheckAllFiles();
+
+    /* Delete every third file */
+    for (i = 1; i < FILE_COUNT; i += 3)
+    {
+        if (!Exists[i])
+            continue;
+
+        GetName(Path, i, FALSE);
+        Ret = DeleteFileW(Path);
+        ok(Ret, "DeleteFileW(%ls) failed: %lu\n", Path, GetLastError());
+        if (Ret)
+            Exists[i] = FALSE;
+    }
+    CheckAllFiles();
+
+    /* Renamed files can still be found under their new name */
+    for (i = 0; i < FILE_COUNT; i += 5)
+    {
+        GetName(NewPath, i, TRUE);
+        CheckFile(NewPath, i);
+    }
+
+    /* Bring some deleted names back, they may take the freed entries */
+    for (i = 1; i < FILE_COUNT; i += 9)
+    {
+        if (Exists[i])
+            continue;
+
+        GetName(Path, i, FALSE);
+        Exists[i] = (BOOLEAN)CreateTestFile(Path, i);
+        ok(Exists[i], "Cannot create %ls again: %lu\n", Path, GetLastError());
+    }
+    CheckAllFiles();
+
+Cleanup:
+    for (i = 0; i < Created; i++)
+    {
+        GetName(Path, i, FALSE);
+        DeleteFileW(Path);
+        GetName(Path, i, TRUE);
+        DeleteFileW(Path);
+    }
+    ok(RemoveDirectoryW(Directory), "RemoveDirectoryW failed: %lu\n", GetLastError());
+}
@@ -0,0 +1,146 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for SetFileCompletionNotificationModes
+ */
+
+#include <apitest.h>
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#define FILE_SKIP_SET_EVENT_ON_HANDLE        0x2
+#endif
+
+#define PIPE_NAME L"\\\\.\\pipe\\SetFileCompletionNotificationModes"
+
+typedef BOOL (WINAPI *PSET_FILE_COMPLETION_NOTIFICATION_MODES)(HANDLE, UCHAR);
+
+static PSET_FILE_COMPLETION_NOTIFICATION_MODES pSetFileCompletionNotificationModes;
+
+static
+BOOL
+CreatePipePair(
+    PHANDLE Server,
+    PHANDLE Client)
+{
+    *Server = CreateNamedPipeW(PIPE_NAME,
+                               PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                               PIPE_TYPE_BYTE | PIPE_WAIT,
+                               1, 4096, 4096, 0, NULL);
+    if (*Server == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    *Client = CreateFileW(PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (*Client == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(*Server);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Reads data that is already buffered in the pipe, so the read completes
+ * inline, and reports whether a completion packet was queued for it.
+ */
+static
+BOOL
+InlineReadQueuesPacket(
+    UCHAR Modes,
+    PBOOL HandleSignaled)
+{
+    HANDLE Server, Client, Port;
+    OVERLAPPED Overlapped, *Completed;
+    CHAR Buffer[4];
+    DWORD Bytes;
+    ULONG_PTR Key;
+    BOOL Ret, Queued = FALSE;
+
+    if (!CreatePipePair(&Server, &Client))
+    {
+        skip("Failed to create pipe pair: %lu\n", GetLastError());
+        return FALSE;
+    }
+
+    Port = CreateIoCompletionPort(Server, NULL, 42, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+
+    if (Modes)
+    {
+        Ret = pSetFileCompletionNotificationModes(Server, Modes);
+        ok(Ret, "SetFileCompletionNotificationModes failed: %lu\n", GetLastError());
+    }
+
+    Ret = WriteFile(Client, "ping", 4, &Bytes, NULL);
+    ok(Ret && Bytes == 4, "WriteFile failed: %lu\n", GetLastError());
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = ReadFile(Server, Buffer, sizeof(Buffer), &Bytes, &Overlapped);
+    ok(Ret, "ReadFile did not complete inline: %lu\n", GetLastError());
+    ok(Bytes == 4, "Bytes = %lu\n", Bytes);
+    *HandleSignaled = (WaitForSingleObject(Server, 0) == WAIT_OBJECT_0);
+
+    if (Port)
+    {
+        Queued = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Completed, 0);
+        if (Queued)
+        {
+            ok(Key == 42, "Key = %lu\n", (ULONG)Key);
+            ok(Completed == &Overlapped, "Completed = %p\n", Completed);
+        }
+        else
+        {
+            ok(GetLastError() == WAIT_TIMEOUT, "GetLastError() = %lu\n", GetLastError());
+        }
+        CloseHandle(Port);
+    }
+
+    CloseHandle(Client);
+    CloseHandle(Server);
+    return Queued;
+}
+
+START_TEST(SetFileCompletionNotificationModes)
+{
+    HANDLE Server, Client;
+    BOOL Ret, Signaled;
+
+    pSetFileCompletionNotificationModes = (PSET_FILE_COMPLETION_NOTIFICATION_MODES)
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetFileCompletionNotificationModes");
+    if (!pSetFileCompletionNotificationModes)
+    {
+        skip("SetFileCompletionNotificationModes not available\n");
+        return;
+    }
+
+    if (CreatePipePair(&Server, &Client))
+    {
+        /* Unknown modes are rejected */
+        SetLastError(0xdeadbeef);
+        Ret = pSetFileCompletionNotificationModes(Server, 0x80);
+        ok(!Ret, "SetFileCompletionNotificationModes succeeded\n");
+        ok(GetLastError() == ERROR_INVALID_PARAMETER, "GetLastError() = %lu\n", GetLastError());
+
+        Ret = pSetFileCompletionNotificationModes(Server, 0);
+        ok(Ret, "SetFileCompletionNotificationModes failed: %lu\n", GetLastError());
+
+        CloseHandle(Client);
+        CloseHandle(Server);
+    }
+    else
+    {
+        skip("Failed to create pipe pair: %lu\n", GetLastError());
+    }
+
+    /* By default, inline completions still queue a packet and signal the handle */
+    ok(InlineReadQueuesPacket(0, &Signaled), "No packet queued\n");
+    ok(Signaled, "Handle not signaled\n");
+
+    /* Skipping the port on success leaves the port empty */
+    ok(!InlineReadQueuesPacket(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS, &Signaled), "Packet queued\n");
+
+    /* Skipping the event leaves the handle unsignaled */
+    InlineReadQueuesPacket(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE, &Signaled);
+    ok(!Signaled, "Handle signaled\n");
+}
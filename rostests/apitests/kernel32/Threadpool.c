@@ -0,0 +1,385 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for the Vista thread pool (work, timers, waits, cleanup groups)
+ */
+
+#include <apitest.h>
+
+#define WORK_COUNT      20000
+#define FANOUT_COUNT    64
+
+typedef PTP_WORK (WINAPI *PCREATE_THREADPOOL_WORK)(PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *PTP_WORK_FUNCTION)(PTP_WORK);
+typedef VOID (WINAPI *PWAIT_FOR_THREADPOOL_WORK_CALLBACKS)(PTP_WORK, BOOL);
+typedef PTP_TIMER (WINAPI *PCREATE_THREADPOOL_TIMER)(PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *PSET_THREADPOOL_TIMER)(PTP_TIMER, PFILETIME, DWORD, DWORD);
+typedef VOID (WINAPI *PTP_TIMER_FUNCTION)(PTP_TIMER);
+typedef PTP_WAIT (WINAPI *PCREATE_THREADPOOL_WAIT)(PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *PSET_THREADPOOL_WAIT)(PTP_WAIT, HANDLE, PFILETIME);
+typedef VOID (WINAPI *PTP_WAIT_FUNCTION)(PTP_WAIT);
+typedef PTP_CLEANUP_GROUP (WINAPI *PCREATE_THREADPOOL_CLEANUP_GROUP)(VOID);
+typedef VOID (WINAPI *PCLOSE_THREADPOOL_CLEANUP_GROUP_MEMBERS)(PTP_CLEANUP_GROUP, BOOL, PVOID);
+typedef VOID (WINAPI *PCLOSE_THREADPOOL_CLEANUP_GROUP)(PTP_CLEANUP_GROUP);
+typedef BOOL (WINAPI *PTRY_SUBMIT_THREADPOOL_CALLBACK)(PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+typedef VOID (WINAPI *PSET_EVENT_WHEN_CALLBACK_RETURNS)(PTP_CALLBACK_INSTANCE, HANDLE);
+
+static PCREATE_THREADPOOL_WORK pCreateThreadpoolWork;
+static PTP_WORK_FUNCTION pSubmitThreadpoolWork;
+static PTP_WORK_FUNCTION pCloseThreadpoolWork;
+static PWAIT_FOR_THREADPOOL_WORK_CALLBACKS pWaitForThreadpoolWorkCallbacks;
+static PCREATE_THREADPOOL_TIMER pCreateThreadpoolTimer;
+static PSET_THREADPOOL_TIMER pSetThreadpoolTimer;
+static PTP_TIMER_FUNCTION pCloseThreadpoolTimer;
+static PCREATE_THREADPOOL_WAIT pCreateThreadpoolWait;
+static PSET_THREADPOOL_WAIT pSetThreadpoolWait;
+static PTP_WAIT_FUNCTION pCloseThreadpoolWait;
+static PCREATE_THREADPOOL_CLEANUP_GROUP pCreateThreadpoolCleanupGroup;
+static PCLOSE_THREADPOOL_CLEANUP_GROUP_MEMBERS pCloseThreadpoolCleanupGroupMembers;
+static PCLOSE_THREADPOOL_CLEANUP_GROUP pCloseThreadpoolCleanupGroup;
+static PTRY_SUBMIT_THREADPOOL_CALLBACK pTrySubmitThreadpoolCallback;
+static PSET_EVENT_WHEN_CALLBACK_RETURNS pSetEventWhenCallbackReturns;
+
+static LONG WorkCount;
+static LONG FanoutCount;
+static HANDLE BlockEvent;
+static LONG TimerCount;
+static LONG WaitCount;
+static TP_WAIT_RESULT LastWaitResult;
+static LONG CancelCount;
+
+static
+BOOL
+LoadThreadpool(VOID)
+{
+    HMODULE hKernel32;
+
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(hKernel32, "CreateThreadpoolWork"))
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+    if (!hKernel32)
+        return FALSE;
+
+#define LOAD(Name) \
+    p##Name = (PVOID)GetProcAddress(hKernel32, #Name); \
+    if (!p##Name) return FALSE;
+
+    LOAD(CreateThreadpoolWork);
+    LOAD(SubmitThreadpoolWork);
+    LOAD(CloseThreadpoolWork);
+    LOAD(WaitForThreadpoolWorkCallbacks);
+    LOAD(CreateThreadpoolTimer);
+    LOAD(SetThreadpoolTimer);
+    LOAD(CloseThreadpoolTimer);
+    LOAD(CreateThreadpoolWait);
+    LOAD(SetThreadpoolWait);
+    LOAD(CloseThreadpoolWait);
+    LOAD(CreateThreadpoolCleanupGroup);
+    LOAD(CloseThreadpoolCleanupGroupMembers);
+    LOAD(CloseThreadpoolCleanupGroup);
+    LOAD(TrySubmitThreadpoolCallback);
+    LOAD(SetEventWhenCallbackReturns);
+#undef LOAD
+
+    return TRUE;
+}
+
+static
+VOID
+NTAPI
+CountingWork(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work)
+{
+    InterlockedIncrement(&WorkCount);
+}
+
+static
+VOID
+NTAPI
+FanoutWork(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work)
+{
+    /* Posting from a worker lands in its own deque, the others have to steal it */
+    if (InterlockedIncrement(&FanoutCount) == 1)
+    {
+        ULONG i;
+        for (i = 1; i < FANOUT_COUNT; i++)
+            pSubmitThreadpoolWork(Work);
+    }
+}
+
+static
+VOID
+NTAPI
+BlockingWork(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WORK Work)
+{
+    WaitForSingleObject(BlockEvent, 10000);
+}
+
+static
+VOID
+NTAPI
+UnblockingCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context)
+{
+    pSetEventWhenCallbackReturns(Instance, BlockEvent);
+}
+
+static
+VOID
+NTAPI
+TimerCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_TIMER Timer)
+{
+    InterlockedIncrement(&TimerCount);
+    SetEvent((HANDLE)Context);
+}
+
+static
+VOID
+NTAPI
+WaitCallback(
+    PTP_CALLBACK_INSTANCE Instance,
+    PVOID Context,
+    PTP_WAIT Wait,
+    TP_WAIT_RESULT WaitResult)
+{
+    LastWaitResult = WaitResult;
+    InterlockedIncrement(&WaitCount);
+    SetEvent((HANDLE)Context);
+}
+
+static
+VOID
+NTAPI
+CancelCallback(
+    PVOID ObjectContext,
+    PVOID CleanupContext)
+{
+    ok(CleanupContext == (PVOID)0x1234, "CleanupContext = %p\n", CleanupContext);
+    InterlockedIncrement(&CancelCount);
+}
+
+static
+DWORD
+WINAPI
+LegacyWork(
+    PVOID Context)
+{
+    if (InterlockedIncrement(&WorkCount) == WORK_COUNT)
+        SetEvent((HANDLE)Context);
+    return 0;
+}
+
+static
+VOID
+TestWork(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    HANDLE Done;
+    PTP_WORK Work;
+    ULONG i, PoolTime, LegacyTime;
+
+    Work = pCreateThreadpoolWork(CountingWork, NULL, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    WorkCount = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < WORK_COUNT; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    QueryPerformanceCounter(&End);
+    ok(WorkCount == WORK_COUNT, "WorkCount = %ld\n", WorkCount);
+    PoolTime = (ULONG)((End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+    pCloseThreadpoolWork(Work);
+
+    /* Same amount of work through the legacy pool */
+    Done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    WorkCount = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < WORK_COUNT; i++)
+        QueueUserWorkItem(LegacyWork, Done, WT_EXECUTEDEFAULT);
+    ok(WaitForSingleObject(Done, 30000) == WAIT_OBJECT_0, "Legacy work did not finish\n");
+    QueryPerformanceCounter(&End);
+    LegacyTime = (ULONG)((End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+    CloseHandle(Done);
+
+    trace("%u work items: %lu ms with the thread pool, %lu ms with QueueUserWorkItem\n",
+          WORK_COUNT, PoolTime, LegacyTime);
+
+    /* Work submitted from a callback */
+    Work = pCreateThreadpoolWork(FanoutWork, NULL, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (Work)
+    {
+        FanoutCount = 0;
+        pSubmitThreadpoolWork(Work);
+        pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+        ok(FanoutCount == FANOUT_COUNT, "FanoutCount = %ld\n", FanoutCount);
+        pCloseThreadpoolWork(Work);
+    }
+
+    /* A blocked worker must not keep queued work from running */
+    BlockEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Work = pCreateThreadpoolWork(BlockingWork, NULL, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (Work)
+    {
+        for (i = 0; i < 2; i++)
+            pSubmitThreadpoolWork(Work);
+        ok(pTrySubmitThreadpoolCallback(UnblockingCallback, NULL, NULL),
+           "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+        ok(WaitForSingleObject(BlockEvent, 10000) == WAIT_OBJECT_0, "Pool starved\n");
+        pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+        pCloseThreadpoolWork(Work);
+    }
+    CloseHandle(BlockEvent);
+}
+
+static
+VOID
+TestTimer(VOID)
+{
+    LARGE_INTEGER DueTime;
+    FILETIME FileTime;
+    HANDLE Event;
+    PTP_TIMER Timer;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Timer = pCreateThreadpoolTimer(TimerCallback, Event, NULL);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed: %lu\n", GetLastError());
+    if (!Timer)
+    {
+        CloseHandle(Event);
+        return;
+    }
+
+    /* One shot, 50 ms from now */
+    TimerCount = 0;
+    DueTime.QuadPart = -50 * 10000;
+    FileTime.dwLowDateTime = DueTime.u.LowPart;
+    FileTime.dwHighDateTime = DueTime.u.HighPart;
+    pSetThreadpoolTimer(Timer, &FileTime, 0, 0);
+    ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "Timer did not fire\n");
+    Sleep(200);
+    ok(TimerCount == 1, "TimerCount = %ld\n", TimerCount);
+
+    /* Periodic, then stopped */
+    TimerCount = 0;
+    pSetThreadpoolTimer(Timer, &FileTime, 20, 0);
+    Sleep(300);
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    ok(TimerCount >= 3, "TimerCount = %ld\n", TimerCount);
+
+    pCloseThreadpoolTimer(Timer);
+    CloseHandle(Event);
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    LARGE_INTEGER Timeout;
+    FILETIME FileTime;
+    HANDLE Event, Signal;
+    PTP_WAIT Wait;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Signal = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Wait = pCreateThreadpoolWait(WaitCallback, Event, NULL);
+    ok(Wait != NULL, "CreateThreadpoolWait failed: %lu\n", GetLastError());
+    if (!Wait)
+    {
+        CloseHandle(Signal);
+        CloseHandle(Event);
+        return;
+    }
+
+    WaitCount = 0;
+    pSetThreadpoolWait(Wait, Signal, NULL);
+    SetEvent(Signal);
+    ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "Wait did not fire\n");
+    ok(LastWaitResult == WAIT_OBJECT_0, "LastWaitResult = %lu\n", LastWaitResult);
+
+    /* A wait fires once per SetThreadpoolWait */
+    SetEvent(Signal);
+    Sleep(200);
+    ok(WaitCount == 1, "WaitCount = %ld\n", WaitCount);
+
+    Timeout.QuadPart = -50 * 10000;
+    FileTime.dwLowDateTime = Timeout.u.LowPart;
+    FileTime.dwHighDateTime = Timeout.u.HighPart;
+    WaitForSingleObject(Signal, 0);
+    pSetThreadpoolWait(Wait, Signal, &FileTime);
+    ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "Wait did not time out\n");
+    ok(LastWaitResult == WAIT_TIMEOUT, "LastWaitResult = %lu\n", LastWaitResult);
+
+    pCloseThreadpoolWait(Wait);
+    CloseHandle(Signal);
+    CloseHandle(Event);
+}
+
+static
+VOID
+TestCleanupGroup(VOID)
+{
+    TP_CALLBACK_ENVIRON Environment;
+    PTP_CLEANUP_GROUP Group;
+    PTP_WORK Work;
+    ULONG i;
+
+    Group = pCreateThreadpoolCleanupGroup();
+    ok(Group != NULL, "CreateThreadpoolCleanupGroup failed: %lu\n", GetLastError());
+    if (!Group)
+        return;
+
+    TpInitializeCallbackEnviron(&Environment);
+    TpSetCallbackCleanupGroup(&Environment, Group, CancelCallback);
+
+    /* Members are released with the group, pending callbacks never run */
+    BlockEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Work = pCreateThreadpoolWork(BlockingWork, NULL, &Environment);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    CancelCount = 0;
+    if (Work)
+    {
+        for (i = 0; i < 4; i++)
+            pSubmitThreadpoolWork(Work);
+        SetEvent(BlockEvent);
+    }
+
+    pCloseThreadpoolCleanupGroupMembers(Group, TRUE, (PVOID)0x1234);
+    ok(CancelCount == (Work ? 1 : 0), "CancelCount = %ld\n", CancelCount);
+
+    pCloseThreadpoolCleanupGroup(Group);
+    TpDestroyCallbackEnviron(&Environment);
+    CloseHandle(BlockEvent);
+}
+
+START_TEST(Threadpool)
+{
+    if (!LoadThreadpool())
+    {
+        skip("Thread pool API not available\n");
+        return;
+    }
+
+    TestWork();
+    TestTimer();
+    TestWait();
+    TestCleanupGroup();
+}
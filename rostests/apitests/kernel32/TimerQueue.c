@@ -0,0 +1,194 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for timer queue ordering and scalability
+ */
+
+#include <apitest.h>
+
+#define ORDER_TIMERS        64
+#define STRESS_TIMERS       100000
+#define STRESS_SPREAD_MS    2000
+#define PERIODIC_TIMERS     10000
+#define PERIODIC_PERIOD_MS  50
+#define PERIODIC_RUN_MS     1000
+
+static LONG FiredCount;
+static LONG OrderViolations;
+static LONG LastDue;
+static HANDLE DoneEvent;
+static LONG DoneTarget;
+
+static
+VOID
+CALLBACK
+OrderCallback(
+    PVOID Parameter,
+    BOOLEAN TimerOrWaitFired)
+{
+    LONG Due = (LONG)(ULONG_PTR)Parameter;
+
+    /* Runs in the timer thread, so callbacks are serialized */
+    if (Due < LastDue)
+        OrderViolations++;
+    LastDue = Due;
+
+    if (InterlockedIncrement(&FiredCount) == DoneTarget)
+        SetEvent(DoneEvent);
+}
+
+static
+VOID
+CALLBACK
+CountCallback(
+    PVOID Parameter,
+    BOOLEAN TimerOrWaitFired)
+{
+    if (InterlockedIncrement(&FiredCount) == DoneTarget)
+        SetEvent(DoneEvent);
+}
+
+static
+ULONG
+ElapsedMs(
+    PLARGE_INTEGER Start)
+{
+    LARGE_INTEGER Frequency, End;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start->QuadPart) * 1000 / Frequency.QuadPart);
+}
+
+static
+VOID
+TestOrder(VOID)
+{
+    HANDLE Queue, Timer;
+    ULONG i, Due;
+    BOOL Ret;
+
+    Queue = CreateTimerQueue();
+    ok(Queue != NULL, "CreateTimerQueue failed: %lu\n", GetLastError());
+    if (!Queue)
+        return;
+
+    FiredCount = 0;
+    OrderViolations = 0;
+    LastDue = 0;
+    DoneTarget = ORDER_TIMERS;
+    ResetEvent(DoneEvent);
+
+    /* Insert in a scrambled order, 20 ms apart so the clock cannot reorder them */
+    for (i = 0; i < ORDER_TIMERS; i++)
+    {
+        Due = 100 + ((i * 37) % ORDER_TIMERS) * 20;
+        Ret = CreateTimerQueueTimer(&Timer, Queue, OrderCallback, (PVOID)(ULONG_PTR)Due,
+                                    Due, 0, WT_EXECUTEINTIMERTHREAD);
+        ok(Ret, "CreateTimerQueueTimer failed: %lu\n", GetLastError());
+    }
+
+    ok(WaitForSingleObject(DoneEvent, 10000) == WAIT_OBJECT_0, "Timers did not fire\n");
+    ok(FiredCount == ORDER_TIMERS, "FiredCount = %ld\n", FiredCount);
+    ok(OrderViolations == 0, "OrderViolations = %ld\n", OrderViolations);
+
+    Ret = DeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE);
+    ok(Ret, "DeleteTimerQueueEx failed: %lu\n", GetLastError());
+}
+
+static
+VOID
+TestStress(VOID)
+{
+    LARGE_INTEGER Start;
+    HANDLE Queue, Timer;
+    ULONG i, CreateTime, FireTime, DeleteTime;
+    BOOL Ret;
+
+    Queue = CreateTimerQueue();
+    ok(Queue != NULL, "CreateTimerQueue failed: %lu\n", GetLastError());
+    if (!Queue)
+        return;
+
+    FiredCount = 0;
+    DoneTarget = STRESS_TIMERS;
+    ResetEvent(DoneEvent);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < STRESS_TIMERS; i++)
+    {
+        Ret = CreateTimerQueueTimer(&Timer, Queue, CountCallback, NULL,
+                                    500 + (i * 7919) % STRESS_SPREAD_MS, 0,
+                                    WT_EXECUTEINTIMERTHREAD);
+        if (!Ret)
+        {
+            ok(0, "CreateTimerQueueTimer %lu failed: %lu\n", i, GetLastError());
+            DoneTarget = i;
+            break;
+        }
+    }
+    CreateTime = ElapsedMs(&Start);
+
+    ok(WaitForSingleObject(DoneEvent, 60000) == WAIT_OBJECT_0, "Timers did not fire\n");
+    FireTime = ElapsedMs(&Start);
+    ok(FiredCount == DoneTarget, "FiredCount = %ld, expected %ld\n", FiredCount, DoneTarget);
+
+    QueryPerformanceCounter(&Start);
+    Ret = DeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE);
+    ok(Ret, "DeleteTimerQueueEx failed: %lu\n", GetLastError());
+    DeleteTime = ElapsedMs(&Start);
+
+    trace("%lu one-shot timers: created in %lu ms, all fired after %lu ms (spread %u ms), deleted in %lu ms\n",
+          (ULONG)DoneTarget, CreateTime, FireTime, 500 + STRESS_SPREAD_MS, DeleteTime);
+}
+
+static
+VOID
+TestPeriodic(VOID)
+{
+    LARGE_INTEGER Start;
+    HANDLE Queue, Timer;
+    ULONG i, Expected;
+    BOOL Ret;
+
+    Queue = CreateTimerQueue();
+    ok(Queue != NULL, "CreateTimerQueue failed: %lu\n", GetLastError());
+    if (!Queue)
+        return;
+
+    FiredCount = 0;
+    DoneTarget = -1;
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < PERIODIC_TIMERS; i++)
+    {
+        Ret = CreateTimerQueueTimer(&Timer, Queue, CountCallback, NULL,
+                                    i % PERIODIC_PERIOD_MS, PERIODIC_PERIOD_MS,
+                                    WT_EXECUTEINTIMERTHREAD);
+        ok(Ret, "CreateTimerQueueTimer failed: %lu\n", GetLastError());
+    }
+
+    Sleep(PERIODIC_RUN_MS);
+    Ret = DeleteTimerQueueEx(Queue, INVALID_HANDLE_VALUE);
+    ok(Ret, "DeleteTimerQueueEx failed: %lu\n", GetLastError());
+
+    /* Every re-arm goes back through the queue, so it must keep up */
+    Expected = PERIODIC_TIMERS * (PERIODIC_RUN_MS / PERIODIC_PERIOD_MS);
+    ok(FiredCount >= (LONG)(Expected / 2), "FiredCount = %ld, expected about %lu\n", FiredCount, Expected);
+    trace("%u periodic timers: %ld callbacks in %lu ms, expected about %lu\n",
+          PERIODIC_TIMERS, FiredCount, ElapsedMs(&Start), Expected);
+}
+
+START_TEST(TimerQueue)
+{
+    DoneEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(DoneEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!DoneEvent)
+        return;
+
+    TestOrder();
+    TestStress();
+    TestPeriodic();
+
+    CloseHandle(DoneEvent);
+}
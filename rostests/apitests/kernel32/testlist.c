@@ -4,10 +4,14 @@
 #include <apitest.h>
 
 extern void func_Console(void);
+extern void func_CopyFile(void);
 extern void func_CreateProcess(void);
 extern void func_DefaultActCtx(void);
 extern void func_DeviceIoControl(void);
 extern void func_dosdev(void);
+extern void func_FatClusterBitmap(void);
+extern void func_FatFragmentedFile(void);
+extern void func_FatLargeDirectory(void);
 extern void func_FindActCtxSectionStringW(void);
 extern void func_FindFiles(void);
 extern void func_GetComputerNameEx(void);
@@ -24,18 +28,25 @@ extern void func_MultiByteToWideChar(void);
 extern void func_PrivMoveFileIdentityW(void);
 extern void func_SetConsoleWindowInfo(void);
 extern void func_SetCurrentDirectory(void);
+extern void func_SetFileCompletionNotificationModes(void);
 extern void func_SetUnhandledExceptionFilter(void);
 extern void func_TerminateProcess(void);
+extern void func_Threadpool(void);
+extern void func_TimerQueue(void);
 extern void func_TunnelCache(void);
 extern void func_WideCharToMultiByte(void);
 
 const struct test winetest_testlist[] =
 {
     { "ConsoleCP",                   func_Console },
+    { "CopyFile",                    func_CopyFile },
     { "CreateProcess",               func_CreateProcess },
     { "DefaultActCtx",               func_DefaultActCtx },
     { "DeviceIoControl",             func_DeviceIoControl },
     { "dosdev",                      func_dosdev },
+    { "FatClusterBitmap",            func_FatClusterBitmap },
+    { "FatFragmentedFile",           func_FatFragmentedFile },
+    { "FatLargeDirectory",           func_FatLargeDirectory },
     { "FindActCtxSectionStringW",    func_FindActCtxSectionStringW },
     { "FindFiles",                   func_FindFiles },
     { "GetComputerNameEx",           func_GetComputerNameEx },
@@ -52,8 +63,11 @@ const struct test winetest_testlist[] =
     { "PrivMoveFileIdentityW",       func_PrivMoveFileIdentityW },
     { "SetConsoleWindowInfo",        func_SetConsoleWindowInfo },
     { "SetCurrentDirectory",         func_SetCurrentDirectory },
+    { "SetFileCompletionNotificationModes", func_SetFileCompletionNotificationModes },
     { "SetUnhandledExceptionFilter", func_SetUnhandledExceptionFilter },
     { "TerminateProcess",            func_TerminateProcess },
+    { "Threadpool",                  func_Threadpool },
+    { "TimerQueue",                  func_TimerQueue },
     { "TunnelCache",                 func_TunnelCache },
     { "WideCharToMultiByte",         func_WideCharToMultiByte },
     { 0, 0 }
@@ -0,0 +1,185 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for NtRemoveIoCompletionEx (batched dequeue and throughput)
+ */
+
+#include <apitest.h>
+#include <ndk/iofuncs.h>
+
+#define PACKET_COUNT    20000
+#define BATCH_SIZE      64
+
+typedef NTSTATUS (NTAPI *PNT_REMOVE_IO_COMPLETION_EX)(HANDLE, PFILE_IO_COMPLETION_INFORMATION, ULONG, PULONG, PLARGE_INTEGER, BOOLEAN);
+
+static PNT_REMOVE_IO_COMPLETION_EX pNtRemoveIoCompletionEx;
+static ULONG ApcCount;
+
+static
+VOID
+NTAPI
+ApcRoutine(
+    ULONG_PTR Parameter)
+{
+    ApcCount++;
+}
+
+static
+BOOLEAN
+PostPackets(
+    HANDLE Port,
+    ULONG Count)
+{
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Status = NtSetIoCompletion(Port, (PVOID)(ULONG_PTR)i, (PVOID)(ULONG_PTR)~i, STATUS_SUCCESS, i);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+ULONG
+DrainSingle(
+    HANDLE Port)
+{
+    LARGE_INTEGER Zero = { { 0 } };
+    IO_STATUS_BLOCK IoStatus;
+    PVOID Key, Apc;
+    ULONG Removed = 0;
+
+    while (NtRemoveIoCompletion(Port, &Key, &Apc, &IoStatus, &Zero) == STATUS_SUCCESS)
+        Removed++;
+    return Removed;
+}
+
+static
+ULONG
+DrainBatched(
+    HANDLE Port,
+    PULONG Mismatches)
+{
+    FILE_IO_COMPLETION_INFORMATION Entries[BATCH_SIZE];
+    LARGE_INTEGER Zero = { { 0 } };
+    ULONG Removed = 0, Count, i;
+
+    *Mismatches = 0;
+    while (pNtRemoveIoCompletionEx(Port, Entries, BATCH_SIZE, &Count, &Zero, FALSE) == STATUS_SUCCESS)
+    {
+        /* Packets come back in the order they were posted */
+        for (i = 0; i < Count; i++)
+        {
+            if ((Entries[i].KeyContext != (PVOID)(ULONG_PTR)(Removed + i)) ||
+                (Entries[i].ApcContext != (PVOID)(ULONG_PTR)~(Removed + i)) ||
+                (Entries[i].IoStatusBlock.Status != STATUS_SUCCESS) ||
+                (Entries[i].IoStatusBlock.Information != Removed + i))
+            {
+                (*Mismatches)++;
+            }
+        }
+        Removed += Count;
+    }
+    return Removed;
+}
+
+static
+ULONG
+MeasureRate(
+    HANDLE Port,
+    BOOLEAN Batched)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Removed, Mismatches = 0;
+    double Seconds;
+
+    if (!PostPackets(Port, PACKET_COUNT))
+        return 0;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Removed = Batched ? DrainBatched(Port, &Mismatches) : DrainSingle(Port);
+    QueryPerformanceCounter(&End);
+
+    ok(Removed == PACKET_COUNT, "Removed %lu packets, expected %u\n", Removed, PACKET_COUNT);
+    ok(Mismatches == 0, "%lu packets had unexpected contents\n", Mismatches);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    return Seconds > 0 ? (ULONG)(Removed / Seconds) : 0;
+}
+
+START_TEST(NtRemoveIoCompletionEx)
+{
+    FILE_IO_COMPLETION_INFORMATION Entries[4];
+    LARGE_INTEGER Timeout;
+    HANDLE Port;
+    NTSTATUS Status;
+    ULONG Count, Single, Batched;
+
+    pNtRemoveIoCompletionEx = (PNT_REMOVE_IO_COMPLETION_EX)GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+                                                                          "NtRemoveIoCompletionEx");
+    if (!pNtRemoveIoCompletionEx)
+    {
+        skip("NtRemoveIoCompletionEx not available\n");
+        return;
+    }
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* At least one entry must be requested */
+    Count = 0xdeadbeef;
+    Timeout.QuadPart = 0;
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 0, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* An empty port times out */
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Count == 0, "Count = %lu\n", Count);
+
+    /* Fewer packets than requested come back in one call */
+    PostPackets(Port, 3);
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Count == 3, "Count = %lu\n", Count);
+
+    /* More packets than requested are left for the next call */
+    PostPackets(Port, 6);
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Count == 4, "Count = %lu\n", Count);
+    ok(Entries[3].KeyContext == (PVOID)3, "KeyContext = %p\n", Entries[3].KeyContext);
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Count == 2, "Count = %lu\n", Count);
+    ok(Entries[0].KeyContext == (PVOID)4, "KeyContext = %p\n", Entries[0].KeyContext);
+
+    /* Alertable waits deliver user APCs, non-alertable ones don't */
+    ApcCount = 0;
+    QueueUserAPC(ApcRoutine, GetCurrentThread(), 0);
+    Timeout.QuadPart = -100 * 10000;
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(ApcCount == 0, "ApcCount = %lu\n", ApcCount);
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 4, &Count, NULL, TRUE);
+    ok_ntstatus(Status, STATUS_USER_APC);
+    ok(ApcCount == 1, "ApcCount = %lu\n", ApcCount);
+    ok(Count == 0, "Count = %lu\n", Count);
+
+    /* Compare the dequeue rate of single and batched removal */
+    Single = MeasureRate(Port, FALSE);
+    Batched = MeasureRate(Port, TRUE);
+    trace("Dequeued %lu packets/s one at a time, %lu packets/s in batches of %u\n",
+          Single, Batched, BATCH_SIZE);
+
+    NtClose(Port);
+}
@@ -12,6 +12,116 @@
 
 PVOID Buffers[0x100];
 
+static
+VOID
+TestLowFragmentationHeap(VOID)
+{
+    RTL_HEAP_PARAMETERS Parameters = {0};
+    ULONG HeapType, i;
+    SIZE_T Size;
+    NTSTATUS Status;
+    HANDLE hHeap;
+    PUCHAR Ptr;
+
+    /* Heaps without serialization can't have a front end */
+    Parameters.Length = sizeof(Parameters);
+    hHeap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, &Parameters);
+    ok(hHeap != NULL, "RtlCreateHeap failed\n");
+    if (hHeap)
+    {
+        HeapType = 2;
+        Status = RtlSetHeapInformation(hHeap, HeapCompatibilityInformation, &HeapType, sizeof(HeapType));
+        ok_ntstatus(Status, STATUS_UNSUCCESSFUL);
+        RtlDestroyHeap(hHeap);
+    }
+
+    hHeap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, &Parameters);
+    ok(hHeap != NULL, "RtlCreateHeap failed\n");
+    if (!hHeap)
+        return;
+
+    HeapType = 2;
+    Status = RtlSetHeapInformation(hHeap, HeapCompatibilityInformation, &HeapType, sizeof(HeapType));
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    HeapType = 0xdeadbeef;
+    Status = RtlQueryHeapInformation(hHeap, HeapCompatibilityInformation, &HeapType, sizeof(HeapType), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(HeapType == 2, "HeapType = %lu\n", HeapType);
+
+    /* Small blocks of all sizes, with distinct contents */
+    for (i = 0; i < 0x100; ++i)
+    {
+        Buffers[i] = RtlAllocateHeap(hHeap, 0, i + 1);
+        ok(Buffers[i] != NULL, "Allocation %lu failed\n", i);
+        if (!Buffers[i]) break;
+        ok(RtlSizeHeap(hHeap, 0, Buffers[i]) == i + 1, "Size %lu\n", (ULONG)RtlSizeHeap(hHeap, 0, Buffers[i]));
+        RtlFillMemory(Buffers[i], i + 1, (UCHAR)i);
+    }
+    ok(RtlValidateHeap(hHeap, 0, NULL), "Heap corrupted\n");
+
+    for (i = 0; i < 0x100 && Buffers[i]; ++i)
+    {
+        ok(RtlValidateHeap(hHeap, 0, Buffers[i]), "Block %lu invalid\n", i);
+        Size = RtlCompareMemoryUlong(Buffers[i], (i + 1) & ~3, (UCHAR)i * 0x01010101);
+        ok(Size == ((i + 1) & ~3), "Block %lu overwritten\n", i);
+    }
+
+    /* Growing keeps the contents and zeroes the tail */
+    Ptr = RtlReAllocateHeap(hHeap, HEAP_ZERO_MEMORY, Buffers[0x10], 0x200);
+    ok(Ptr != NULL, "RtlReAllocateHeap failed\n");
+    if (Ptr)
+    {
+        Buffers[0x10] = Ptr;
+        ok(Ptr[0] == 0x10 && Ptr[0x10] == 0x10 && Ptr[0x11] == 0 && Ptr[0x1FF] == 0, "Wrong contents\n");
+        ok(RtlSizeHeap(hHeap, 0, Ptr) == 0x200, "Size %lu\n", (ULONG)RtlSizeHeap(hHeap, 0, Ptr));
+    }
+
+    for (i = 0; i < 0x100 && Buffers[i]; ++i)
+        ok(RtlFreeHeap(hHeap, 0, Buffers[i]), "Free %lu failed\n", i);
+
+    ok(RtlValidateHeap(hHeap, 0, NULL), "Heap corrupted\n");
+    RtlDestroyHeap(hHeap);
+}
+
+static
+VOID
+TestMultipleHeap(VOID)
+{
+    ULONG Count, i;
+    HANDLE hHeap;
+
+    hHeap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(hHeap != NULL, "RtlCreateHeap failed\n");
+    if (!hHeap)
+        return;
+
+    RtlZeroMemory(Buffers, sizeof(Buffers));
+    Count = RtlMultipleAllocateHeap(hHeap, HEAP_ZERO_MEMORY, 0x30, 0x100, Buffers);
+    ok(Count == 0x100, "Count = %lu\n", Count);
+    ok(RtlValidateHeap(hHeap, 0, NULL), "Heap corrupted\n");
+
+    for (i = 0; i < Count; ++i)
+    {
+        ok(RtlSizeHeap(hHeap, 0, Buffers[i]) == 0x30, "Size %lu\n", (ULONG)RtlSizeHeap(hHeap, 0, Buffers[i]));
+        ok(RtlCompareMemoryUlong(Buffers[i], 0x30, 0) == 0x30, "Block %lu not zeroed\n", i);
+        RtlFillMemory(Buffers[i], 0x30, (UCHAR)i);
+    }
+
+    /* Blocks must not overlap */
+    for (i = 0; i < Count; ++i)
+        ok(RtlCompareMemoryUlong(Buffers[i], 0x30, (UCHAR)i * 0x01010101) == 0x30, "Block %lu overwritten\n", i);
+
+    /* Free single blocks in between, then the rest in one go */
+    ok(RtlFreeHeap(hHeap, 0, Buffers[0x10]), "Free failed\n");
+    Buffers[0x10] = NULL;
+    Count = RtlMultipleFreeHeap(hHeap, 0, 0x100, Buffers);
+    ok(Count == 0x100, "Count = %lu\n", Count);
+    ok(RtlValidateHeap(hHeap, 0, NULL), "Heap corrupted\n");
+
+    RtlDestroyHeap(hHeap);
+}
+
 START_TEST(RtlAllocateHeap)
 {
     USHORT i;
@@ -74,4 +184,7 @@ START_TEST(RtlAllocateHeap)
     _SEH2_END;
 
     ok(hHeap == NULL, "Unexpected heap value: %p\n", hHeap);
+
+    TestLowFragmentationHeap();
+    TestMultipleHeap();
 }
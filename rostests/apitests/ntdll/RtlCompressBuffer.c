@@ -0,0 +1,189 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for RtlCompressBuffer LZNT1 engines (round trip, ratio, throughput)
+ */
+
+#include <apitest.h>
+#include <ndk/rtlfuncs.h>
+
+#define CORPUS_TEXT_SIZE    (256 * 1024)
+
+static
+PUCHAR
+LoadCorpusFile(
+    PCWSTR FileName,
+    PULONG Size)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+    PUCHAR Buffer;
+    DWORD Read;
+
+    GetSystemDirectoryW(Path, MAX_PATH);
+    lstrcatW(Path, L"\\");
+    lstrcatW(Path, FileName);
+
+    File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    *Size = GetFileSize(File, NULL);
+    Buffer = HeapAlloc(GetProcessHeap(), 0, *Size);
+    if (Buffer && (!ReadFile(File, Buffer, *Size, &Read, NULL) || Read != *Size))
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        Buffer = NULL;
+    }
+    CloseHandle(File);
+    return Buffer;
+}
+
+static
+PUCHAR
+MakeTextCorpus(
+    PULONG Size)
+{
+    static const PCSTR Words[] = { "the ", "cache ", "manager ", "maps ", "views ", "of ",
+                                   "files ", "into ", "system ", "space ", "and ", "flushes ",
+                                   "dirty ", "pages ", "lazily.\r\n", "ReactOS " };
+    PUCHAR Buffer;
+    ULONG Offset = 0, Seed = 0x1234, Length;
+    PCSTR Word;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CORPUS_TEXT_SIZE);
+    if (!Buffer)
+        return NULL;
+
+    while (Offset < CORPUS_TEXT_SIZE)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Word = Words[(Seed >> 16) % (sizeof(Words) / sizeof(Words[0]))];
+        Length = min(lstrlenA(Word), CORPUS_TEXT_SIZE - Offset);
+        RtlCopyMemory(Buffer + Offset, Word, Length);
+        Offset += Length;
+    }
+
+    *Size = CORPUS_TEXT_SIZE;
+    return Buffer;
+}
+
+static
+VOID
+TestRoundTrip(
+    PCSTR Name,
+    PUCHAR Data,
+    ULONG Size,
+    USHORT Engine)
+{
+    ULONG WorkSpaceSize, FragmentSize, CompressedSize, FinalSize;
+    LARGE_INTEGER Frequency, Start, End;
+    PUCHAR WorkSpace, Compressed, Decompressed;
+    NTSTATUS Status;
+    double Seconds;
+
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1 | Engine,
+                                            &WorkSpaceSize, &FragmentSize);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Worst case: every 4 KB chunk is stored raw behind a 2 byte header */
+    CompressedSize = Size + (Size / 0x1000 + 1) * sizeof(USHORT);
+    WorkSpace = HeapAlloc(GetProcessHeap(), 0, WorkSpaceSize);
+    Compressed = HeapAlloc(GetProcessHeap(), 0, CompressedSize);
+    Decompressed = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!WorkSpace || !Compressed || !Decompressed)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1 | Engine,
+                               Data,
+                               Size,
+                               Compressed,
+                               CompressedSize,
+                               0x1000,
+                               &FinalSize,
+                               WorkSpace);
+    QueryPerformanceCounter(&End);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    ok(FinalSize < Size, "%s: no compression achieved (%lu -> %lu)\n", Name, Size, FinalSize);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    trace("%s (%s): %lu -> %lu bytes (%lu%%), %lu KB/s\n",
+          Name,
+          Engine == COMPRESSION_ENGINE_MAXIMUM ? "maximum" : "standard",
+          Size, FinalSize, (ULONG)((ULONGLONG)FinalSize * 100 / Size),
+          Seconds > 0 ? (ULONG)(Size / 1024 / Seconds) : 0);
+
+    CompressedSize = FinalSize;
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1,
+                                 Decompressed,
+                                 Size,
+                                 Compressed,
+                                 CompressedSize,
+                                 &FinalSize);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(FinalSize == Size, "%s: decompressed %lu bytes, expected %lu\n", Name, FinalSize, Size);
+    ok(RtlCompareMemory(Data, Decompressed, Size) == Size, "%s: round trip mismatch\n", Name);
+
+Cleanup:
+    if (Decompressed) HeapFree(GetProcessHeap(), 0, Decompressed);
+    if (Compressed) HeapFree(GetProcessHeap(), 0, Compressed);
+    if (WorkSpace) HeapFree(GetProcessHeap(), 0, WorkSpace);
+}
+
+static
+VOID
+TestCorpus(
+    PCSTR Name,
+    PUCHAR Data,
+    ULONG Size)
+{
+    if (!Data)
+    {
+        skip("%s not available\n", Name);
+        return;
+    }
+
+    TestRoundTrip(Name, Data, Size, COMPRESSION_ENGINE_STANDARD);
+    TestRoundTrip(Name, Data, Size, COMPRESSION_ENGINE_MAXIMUM);
+    HeapFree(GetProcessHeap(), 0, Data);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    UCHAR Small[] = "WineWineWine";
+    UCHAR Output[64];
+    UCHAR WorkSpace[0x8010];
+    ULONG FinalSize;
+    NTSTATUS Status;
+    PUCHAR Data;
+    ULONG Size;
+
+    /* Repeated input must actually shrink now */
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1, Small, sizeof(Small),
+                               Output, sizeof(Output), 0x1000, &FinalSize, WorkSpace);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok((*(PUSHORT)Output & 0xF000) == 0xB000, "Expected compressed chunk, got %04x\n", *(PUSHORT)Output);
+    ok(FinalSize < sizeof(Small), "FinalSize = %lu\n", FinalSize);
+
+    /* Unknown engines are rejected */
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1 | 0x0200, Small, sizeof(Small),
+                               Output, sizeof(Output), 0x1000, &FinalSize, WorkSpace);
+    ok_ntstatus(Status, STATUS_NOT_SUPPORTED);
+
+    Data = MakeTextCorpus(&Size);
+    TestCorpus("text", Data, Size);
+    Data = LoadCorpusFile(L"ntdll.dll", &Size);
+    TestCorpus("ntdll.dll", Data, Size);
+    Data = LoadCorpusFile(L"kernel32.dll", &Size);
+    TestCorpus("kernel32.dll", Data, Size);
+    Data = LoadCorpusFile(L"shell32.dll", &Size);
+    TestCorpus("shell32.dll", Data, Size);
+}
@@ -0,0 +1,107 @@
+/*
+ * PROJECT:         ReactOS API tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for the throttling of cached writes
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <ndk/exfuncs.h>
+#include <ndk/rtlfuncs.h>
+
+#define CHUNK_SIZE      (1024 * 1024)
+
+/* Don't fill machines with a lot of memory, they take too long to reach the limit */
+#define MAX_WRITE_SIZE  (768ULL * 1024 * 1024)
+
+static
+BOOLEAN
+GetThrottledWrites(
+    PULONG ThrottledWrites)
+{
+    SYSTEM_PERFORMANCE_INFORMATION_REACTOS Info;
+    ULONG ReturnLength;
+    NTSTATUS Status;
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation, &Info, sizeof(Info), &ReturnLength);
+    ok(Status == STATUS_SUCCESS, "NtQuerySystemInformation returned %lx\n", Status);
+    if (!NT_SUCCESS(Status) || ReturnLength != sizeof(Info))
+        return FALSE;
+
+    *ThrottledWrites = Info.CcThrottledWrites;
+    return TRUE;
+}
+
+START_TEST(WriteThrottle)
+{
+    SYSTEM_BASIC_INFORMATION BasicInfo;
+    ULARGE_INTEGER FreeBytes;
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    ULONG Before, After;
+    ULONGLONG Memory, ToWrite, Written = 0;
+    DWORD Chunk;
+    HANDLE File;
+    PUCHAR Buffer;
+    NTSTATUS Status;
+
+    if (!GetThrottledWrites(&Before))
+    {
+        skip("The throttled write counter is not available\n");
+        return;
+    }
+
+    Status = NtQuerySystemInformation(SystemBasicInformation, &BasicInfo, sizeof(BasicInfo), NULL);
+    ok(Status == STATUS_SUCCESS, "NtQuerySystemInformation returned %lx\n", Status);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* The cache lets an eighth of the physical memory get dirty, go well beyond */
+    Memory = (ULONGLONG)BasicInfo.NumberOfPhysicalPages * BasicInfo.PageSize;
+    ToWrite = Memory / 4;
+    GetTempPathW(MAX_PATH, TempPath);
+    if (ToWrite > MAX_WRITE_SIZE ||
+        !GetDiskFreeSpaceExW(TempPath, &FreeBytes, NULL, NULL) ||
+        FreeBytes.QuadPart < ToWrite * 2)
+    {
+        skip("Too much memory or too little disk space to reach the dirty page limit\n");
+        return;
+    }
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+    FillMemory(Buffer, CHUNK_SIZE, 0x5A);
+
+    GetTempFileNameW(TempPath, L"cct", 0, FileName);
+    File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    /* Dirty the cache much faster than the lazy writer can clean it */
+    while (Written < ToWrite)
+    {
+        if (!WriteFile(File, Buffer, CHUNK_SIZE, &Chunk, NULL) || Chunk != CHUNK_SIZE)
+        {
+            ok(0, "WriteFile failed after %I64u bytes: %lu\n", Written, GetLastError());
+            break;
+        }
+        Written += Chunk;
+    }
+
+    ok(GetThrottledWrites(&After), "Cannot query the throttled write counter\n");
+    ok(After > Before, "No write was throttled after writing %I64u MB with %I64u MB of memory\n",
+       Written / CHUNK_SIZE, Memory / CHUNK_SIZE);
+    trace("%lu writes throttled\n", After - Before);
+
+    CloseHandle(File);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
@@ -0,0 +1,115 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for NtUserQueryInformationThread
+ * PROGRAMMERS:
+ */
+
+#include <win32nt.h>
+
+/* More than the messages a thread keeps for reuse */
+#define BURST_COUNT 100
+
+static
+NTSTATUS
+QueryPostedMessageInfo(PUSERTHREAD_POSTEDMESSAGE_INFORMATION Info)
+{
+    return NtUserQueryInformationThread(GetCurrentThread(),
+                                        UserThreadPostedMessageInformation,
+                                        Info,
+                                        sizeof(*Info));
+}
+
+static
+VOID
+PostBurst(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < BURST_COUNT; i++)
+    {
+        if (!PostThreadMessageW(GetCurrentThreadId(), WM_APP, i, 0))
+        {
+            ok(0, "PostThreadMessageW(%lu) failed: %lu\n", i, GetLastError());
+            break;
+        }
+    }
+}
+
+static
+ULONG
+RetrieveBurst(VOID)
+{
+    MSG msg;
+    ULONG Count = 0;
+
+    while (PeekMessageW(&msg, NULL, WM_APP, WM_APP, PM_REMOVE))
+    {
+        ok(msg.wParam == Count, "Got message %lu, expected %lu\n", (ULONG)msg.wParam, Count);
+        Count++;
+    }
+
+    return Count;
+}
+
+START_TEST(NtUserQueryInformationThread)
+{
+    USERTHREAD_POSTEDMESSAGE_INFORMATION Before, Posted, Retrieved, Reposted;
+    MSG msg;
+    NTSTATUS Status;
+
+    /* Make this a GUI thread with a message queue */
+    PeekMessageW(&msg, NULL, 0, 0, PM_NOREMOVE);
+
+    Status = NtUserQueryInformationThread(GetCurrentThread(),
+                                          UserThreadPostedMessageInformation,
+                                          &Before,
+                                          sizeof(Before) - 1);
+    if (Status == STATUS_NOT_IMPLEMENTED || Status == STATUS_ACCESS_DENIED)
+    {
+        skip("UserThreadPostedMessageInformation is not supported\n");
+        return;
+    }
+    ok(Status == STATUS_INFO_LENGTH_MISMATCH, "Status = 0x%lx\n", Status);
+
+    Status = QueryPostedMessageInfo(&Before);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* A burst of posts queues them all and signals the thread for each */
+    PostBurst();
+    Status = QueryPostedMessageInfo(&Posted);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(Posted.PostedCount - Before.PostedCount == BURST_COUNT,
+       "PostedCount grew by %lu\n", Posted.PostedCount - Before.PostedCount);
+    ok(Posted.QueueDepth - Before.QueueDepth == BURST_COUNT,
+       "QueueDepth grew by %lu\n", Posted.QueueDepth - Before.QueueDepth);
+    ok(Posted.PeakQueueDepth >= Posted.QueueDepth,
+       "PeakQueueDepth = %lu, QueueDepth = %lu\n", Posted.PeakQueueDepth, Posted.QueueDepth);
+    ok(Posted.WakeCount - Before.WakeCount >= BURST_COUNT,
+       "WakeCount grew by %lu\n", Posted.WakeCount - Before.WakeCount);
+
+    /* Retrieving them fills the cache */
+    ok(RetrieveBurst() == BURST_COUNT, "Not all messages were retrieved\n");
+    Status = QueryPostedMessageInfo(&Retrieved);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(Retrieved.RetrievedCount - Posted.RetrievedCount == BURST_COUNT,
+       "RetrievedCount grew by %lu\n", Retrieved.RetrievedCount - Posted.RetrievedCount);
+    ok(Retrieved.QueueDepth == Before.QueueDepth,
+       "QueueDepth = %lu, expected %lu\n", Retrieved.QueueDepth, Before.QueueDepth);
+    ok(Retrieved.CachedCount > 0 && Retrieved.CachedCount < BURST_COUNT,
+       "CachedCount = %lu\n", Retrieved.CachedCount);
+    ok(Retrieved.TotalLatency >= Posted.TotalLatency, "TotalLatency went back\n");
+
+    /* The next burst takes its messages from the cache first */
+    PostBurst();
+    Status = QueryPostedMessageInfo(&Reposted);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(Reposted.CacheHitCount - Retrieved.CacheHitCount == Retrieved.CachedCount,
+       "CacheHitCount grew by %lu, expected %lu\n",
+       Reposted.CacheHitCount - Retrieved.CacheHitCount, Retrieved.CachedCount);
+    ok(Reposted.CachedCount == 0, "CachedCount = %lu\n", Reposted.CachedCount);
+
+    ok(RetrieveBurst() == BURST_COUNT, "Not all messages were retrieved\n");
+}
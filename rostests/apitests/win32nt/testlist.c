@@ -52,6 +52,7 @@ extern void func_NtUserGetClassInfo(void);
 //extern void func_NtUserGetIconInfo(void);
 extern void func_NtUserGetTitleBarInfo(void);
 extern void func_NtUserProcessConnect(void);
+extern void func_NtUserQueryInformationThread(void);
 extern void func_NtUserRedrawWindow(void);
 extern void func_NtUserScrollDC(void);
 extern void func_NtUserSelectPalette(void);
@@ -114,6 +115,7 @@ const struct test winetest_testlist[] =
     //{ "NtUserGetIconInfo", func_NtUserGetIconInfo },
     { "NtUserGetTitleBarInfo", func_NtUserGetTitleBarInfo },
     { "NtUserProcessConnect", func_NtUserProcessConnect },
+    { "NtUserQueryInformationThread", func_NtUserQueryInformationThread },
     { "NtUserRedrawWindow", func_NtUserRedrawWindow },
     { "NtUserScrollDC", func_NtUserScrollDC },
     { "NtUserSelectPalette", func_NtUserSelectPalette },
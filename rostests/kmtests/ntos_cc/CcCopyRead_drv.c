@@ -195,6 +195,13 @@ TestIrpHandler(
             Fcb->Header.FileSize.QuadPart = 1004;
             Fcb->Header.ValidDataLength.QuadPart = 1004;
         }
+        else if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR) &&
+                 IoStack->FileObject->FileName.Buffer[1] == 'H')
+        {
+            Fcb->Header.AllocationSize.QuadPart = 0x100000000LL;
+            Fcb->Header.FileSize.QuadPart = 0x100000000LL;
+            Fcb->Header.ValidDataLength.QuadPart = 0x100000000LL;
+        }
         else if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR) &&
                  IoStack->FileObject->FileName.Buffer[1] == 'R')
         {
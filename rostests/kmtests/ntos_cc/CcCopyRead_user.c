@@ -7,6 +7,45 @@
 
 #include <kmt_test.h>
 
+#define RANDOM_READS 256
+
+static
+VOID
+RandomReadBenchmark(
+    _In_ HANDLE Handle,
+    _In_ PVOID Buffer)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER ByteOffset;
+    LARGE_INTEGER Start, End, Frequency;
+    IO_STATUS_BLOCK IoStatusBlock;
+    ULONG Seed, Pass, i;
+    ULONG Errors = 0;
+
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        /* Same offsets on both passes: the first one creates the views, the second one only looks them up */
+        Seed = 0x5eed;
+        NtQueryPerformanceCounter(&Start, &Frequency);
+        for (i = 0; i < RANDOM_READS; i++)
+        {
+            ByteOffset.QuadPart = ((ULONGLONG)RtlRandom(&Seed) * 2) % (0x100000000LL - 0x200000) + 0x100000;
+            ByteOffset.QuadPart |= 1;
+            Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, 1022, &ByteOffset, NULL);
+            if (Status != STATUS_SUCCESS || ((USHORT *)Buffer)[0] != 0xBABA)
+                Errors++;
+        }
+        NtQueryPerformanceCounter(&End, NULL);
+
+        trace("%s pass: %lu random reads in %I64u us\n",
+              Pass == 0 ? "Cold" : "Warm",
+              RANDOM_READS,
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+    }
+
+    ok_eq_ulong(Errors, 0UL);
+}
+
 START_TEST(CcCopyRead)
 {
     HANDLE Handle;
@@ -18,6 +57,7 @@ START_TEST(CcCopyRead)
     UNICODE_STRING BigAlignmentTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\BigAlignmentTest");
     UNICODE_STRING SmallAlignmentTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\SmallAlignmentTest");
     UNICODE_STRING ReallySmallAlignmentTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\ReallySmallAlignmentTest");
+    UNICODE_STRING HugeFileTest = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcCopyRead\\HugeFileTest");
     
     KmtLoadDriver(L"CcCopyRead", FALSE);
     KmtOpenDriver();
@@ -89,6 +129,16 @@ START_TEST(CcCopyRead)
 
     NtClose(Handle);
 
+    InitializeObjectAttributes(&ObjectAttributes, &HugeFileTest, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    if (NT_SUCCESS(Status))
+    {
+        RandomReadBenchmark(Handle, Buffer);
+        NtClose(Handle);
+    }
+
     RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
     KmtCloseDriver();
     KmtUnloadDriver();